@@ -10,7 +10,8 @@ enum class BuildErrorKind {
     ImmediateOutOfRange,
     MissingArgument,
     DuplicateLabel,
-    UnresolvedSymbol
+    UnresolvedSymbol,
+    SyntaxError
 };
 
 struct BuildError {
@@ -0,0 +1,181 @@
+#include "ElfFile.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <iterator>
+
+#include "endianness.hpp"
+
+namespace {
+    constexpr uint8_t ELFCLASS64 = 2;
+    constexpr uint8_t ELFDATA2LSB = 1;
+    constexpr uint8_t ELFDATA2MSB = 2;
+    constexpr uint16_t ET_EXEC = 2;
+    constexpr uint16_t EM_RISCV = 243;
+
+    constexpr uint32_t PT_LOAD = 1;
+    constexpr uint32_t PT_INTERP = 3;
+    constexpr uint32_t PF_X = 1;
+
+    constexpr uint32_t SHT_PROGBITS = 1;
+    constexpr uint32_t SHT_SYMTAB = 2;
+    constexpr uint64_t SHF_ALLOC = 0x2;
+    constexpr uint64_t SHF_EXECINSTR = 0x4;
+
+    constexpr uint8_t STT_OBJECT = 1;
+    constexpr uint8_t STT_FUNC = 2;
+    constexpr uint16_t SHN_UNDEF = 0;
+
+    constexpr size_t EHDR_SIZE = 64;
+    constexpr size_t SHDR_SIZE = 64;
+    constexpr size_t SYM_SIZE = 24;
+
+    /// Bounds-checked field reader in the file's byte order
+    class Reader {
+    public:
+        Reader(std::span<const uint8_t> image, std::endian endianness) : m_image(image), m_endianness(endianness) {}
+
+        [[nodiscard]] bool contains(uint64_t offset, uint64_t size) const noexcept {
+            return offset <= m_image.size() && size <= m_image.size() - offset;
+        }
+
+        template<std::unsigned_integral T>
+        [[nodiscard]] T get(uint64_t offset) const noexcept {
+            T value{};
+            std::memcpy(&value, m_image.data() + offset, sizeof(T));
+            return m_endianness == std::endian::native ? value : endianness::swap_endian(value);
+        }
+
+    private:
+        std::span<const uint8_t> m_image;
+        std::endian m_endianness;
+    };
+}
+
+std::variant<ElfFile, std::string> ElfFile::read(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return std::format("Cannot open '{}'", path.string());
+
+    std::vector<uint8_t> image{std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+    if (file.bad())
+        return std::format("Cannot read '{}'", path.string());
+    return parse(std::move(image));
+}
+
+std::variant<ElfFile, std::string> ElfFile::parse(std::vector<uint8_t> image) {
+    if (image.size() < EHDR_SIZE || !std::equal(image.begin(), image.begin() + 4, "\x7F" "ELF"))
+        return "Not an ELF file";
+    if (image[4] != ELFCLASS64)
+        return "Only 64-bit ELF files are supported";
+    if (image[5] != ELFDATA2LSB && image[5] != ELFDATA2MSB)
+        return "Invalid ELF data encoding";
+
+    ElfFile elf;
+    elf.m_endianness = image[5] == ELFDATA2LSB ? std::endian::little : std::endian::big;
+    elf.m_image = std::move(image);
+    std::span<const uint8_t> bytes = elf.m_image;
+    Reader r(bytes, elf.m_endianness);
+
+    if (r.get<uint16_t>(16) != ET_EXEC)
+        return "Only statically linked executables (ET_EXEC) are supported";
+    if (r.get<uint16_t>(18) != EM_RISCV)
+        return "Not a RISC-V executable";
+
+    elf.m_entry = r.get<uint64_t>(24);
+    uint64_t phoff = r.get<uint64_t>(32);
+    uint64_t shoff = r.get<uint64_t>(40);
+    uint16_t phentsize = r.get<uint16_t>(54);
+    uint16_t phnum = r.get<uint16_t>(56);
+    uint16_t shentsize = r.get<uint16_t>(58);
+    uint16_t shnum = r.get<uint16_t>(60);
+
+    if (phnum == 0 || phentsize < PROGRAM_HEADER_SIZE || !r.contains(phoff, uint64_t(phnum) * phentsize))
+        return "Invalid program header table";
+    elf.m_phdr_count = phnum;
+
+    for (uint16_t i = 0; i < phnum; ++i) {
+        uint64_t ph = phoff + uint64_t(i) * phentsize;
+        uint32_t type = r.get<uint32_t>(ph);
+        if (type == PT_INTERP)
+            return "Dynamically linked executables are not supported";
+        if (type != PT_LOAD)
+            continue;
+
+        uint32_t flags = r.get<uint32_t>(ph + 4);
+        uint64_t offset = r.get<uint64_t>(ph + 8);
+        uint64_t vaddr = r.get<uint64_t>(ph + 16);
+        uint64_t filesz = r.get<uint64_t>(ph + 32);
+        uint64_t memsz = r.get<uint64_t>(ph + 40);
+        if (filesz > memsz || !r.contains(offset, filesz))
+            return std::format("Invalid PT_LOAD segment at 0x{:x}", vaddr);
+
+        elf.m_segments.push_back(Segment{
+            .address = vaddr,
+            .mem_size = memsz,
+            .data = bytes.subspan(offset, filesz),
+            .executable = (flags & PF_X) != 0
+        });
+        if (phoff >= offset && phoff + uint64_t(phnum) * PROGRAM_HEADER_SIZE <= offset + filesz)
+            elf.m_phdr_address = vaddr + (phoff - offset);
+    }
+    if (elf.m_segments.empty())
+        return "ELF file has no loadable segments";
+    std::ranges::sort(elf.m_segments, {}, &Segment::address);
+
+    // sections are optional for execution: they only narrow down the code ranges and carry symbols
+    bool has_sections = shnum != 0 && shentsize >= SHDR_SIZE && r.contains(shoff, uint64_t(shnum) * shentsize);
+    for (uint16_t i = 0; has_sections && i < shnum; ++i) {
+        uint64_t sh = shoff + uint64_t(i) * shentsize;
+        uint32_t type = r.get<uint32_t>(sh + 4);
+        uint64_t flags = r.get<uint64_t>(sh + 8);
+        uint64_t addr = r.get<uint64_t>(sh + 16);
+        uint64_t offset = r.get<uint64_t>(sh + 24);
+        uint64_t size = r.get<uint64_t>(sh + 32);
+        uint32_t link = r.get<uint32_t>(sh + 40);
+
+        if (type == SHT_PROGBITS && (flags & SHF_ALLOC) && (flags & SHF_EXECINSTR) && size > 0)
+            elf.m_code_ranges.push_back(CodeRange{addr, size});
+
+        if (type != SHT_SYMTAB || link >= shnum || !r.contains(offset, size))
+            continue;
+        uint64_t strtab = shoff + uint64_t(link) * shentsize;
+        uint64_t str_offset = r.get<uint64_t>(strtab + 24);
+        uint64_t str_size = r.get<uint64_t>(strtab + 32);
+        if (!r.contains(str_offset, str_size))
+            continue;
+        auto names = bytes.subspan(str_offset, str_size);
+
+        for (uint64_t sym = offset; sym + SYM_SIZE <= offset + size; sym += SYM_SIZE) {
+            uint32_t name = r.get<uint32_t>(sym);
+            uint8_t kind = r.get<uint8_t>(sym + 4) & 0xF;
+            uint16_t shndx = r.get<uint16_t>(sym + 6);
+            if ((kind != STT_FUNC && kind != STT_OBJECT) || shndx == SHN_UNDEF || name >= names.size())
+                continue;
+
+            auto name_bytes = names.subspan(name);
+            auto name_end = std::ranges::find(name_bytes, uint8_t{0});
+            elf.m_symbols.push_back(Symbol{
+                .name = std::string(name_bytes.begin(), name_end),
+                .address = r.get<uint64_t>(sym + 8),
+                .size = r.get<uint64_t>(sym + 16),
+                .is_function = kind == STT_FUNC
+            });
+        }
+    }
+    std::ranges::sort(elf.m_symbols, {}, &Symbol::address);
+
+    if (elf.m_code_ranges.empty()) {
+        for (const auto &seg: elf.m_segments) {
+            if (seg.executable)
+                elf.m_code_ranges.push_back(CodeRange{seg.address, seg.data.size()});
+        }
+    }
+    std::ranges::sort(elf.m_code_ranges, {}, &CodeRange::address);
+    if (elf.m_code_ranges.empty())
+        return "ELF file has no executable code";
+
+    return elf;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <variant>
+#include <vector>
+
+/// @brief Static ELF64 RISC-V executable, read into memory and validated.
+/// Segment data views point into the file image and stay valid for the lifetime of this object.
+class ElfFile {
+public:
+    struct Segment { ///< PT_LOAD program header
+        uint64_t address;
+        uint64_t mem_size;
+        std::span<const uint8_t> data; ///< file-backed part, the rest (bss) is zero
+        bool executable;
+    };
+
+    struct CodeRange { ///< executable section (or segment, if the file has no section headers)
+        uint64_t address;
+        uint64_t size;
+    };
+
+    struct Symbol {
+        std::string name;
+        uint64_t address;
+        uint64_t size;
+        bool is_function;
+    };
+
+    ElfFile(ElfFile &&) noexcept = default;
+    ElfFile &operator=(ElfFile &&) noexcept = default;
+
+    /// @return parsed executable or error message
+    [[nodiscard]] static std::variant<ElfFile, std::string> read(const std::filesystem::path &path);
+
+    /// @return parsed executable or error message
+    [[nodiscard]] static std::variant<ElfFile, std::string> parse(std::vector<uint8_t> image);
+
+    [[nodiscard]] uint64_t entry() const noexcept { return m_entry; }
+    [[nodiscard]] std::endian endianness() const noexcept { return m_endianness; }
+    [[nodiscard]] const std::vector<Segment> &segments() const noexcept { return m_segments; }
+    [[nodiscard]] const std::vector<CodeRange> &code_ranges() const noexcept { return m_code_ranges; }
+
+    /// @return defined object and function symbols, sorted by address
+    [[nodiscard]] const std::vector<Symbol> &symbols() const noexcept { return m_symbols; }
+
+    /// @return guest address of the program headers if a segment maps them (for AT_PHDR), 0 otherwise
+    [[nodiscard]] uint64_t program_headers_address() const noexcept { return m_phdr_address; }
+    [[nodiscard]] uint16_t program_header_count() const noexcept { return m_phdr_count; }
+
+    /// Size of one program header entry (AT_PHENT)
+    static constexpr uint16_t PROGRAM_HEADER_SIZE = 56;
+
+private:
+    ElfFile() = default;
+
+    std::vector<uint8_t> m_image;
+    std::endian m_endianness = std::endian::little;
+    uint64_t m_entry = 0;
+    uint64_t m_phdr_address = 0;
+    uint16_t m_phdr_count = 0;
+    std::vector<Segment> m_segments;
+    std::vector<CodeRange> m_code_ranges;
+    std::vector<Symbol> m_symbols;
+};
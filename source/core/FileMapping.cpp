@@ -0,0 +1,69 @@
+#include "FileMapping.hpp"
+
+#include <format>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+FileMapping::~FileMapping() {
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+#else
+    munmap(m_data, m_size);
+#endif
+}
+
+std::variant<std::unique_ptr<FileMapping>, std::string>
+FileMapping::open(const std::filesystem::path &path, Mode mode) {
+    bool cow = mode == Mode::CopyOnWrite;
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return std::format("Cannot open '{}'", path.string());
+
+    LARGE_INTEGER size{};
+    bool has_size = GetFileSizeEx(file, &size) && size.QuadPart > 0;
+    HANDLE map = nullptr;
+    if (has_size)
+        map = CreateFileMappingW(file, nullptr, cow ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!has_size)
+        return std::format("Cannot map empty file '{}'", path.string());
+    if (!map)
+        return std::format("Cannot map '{}'", path.string());
+
+    void *view = MapViewOfFile(map, cow ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(map); // the view keeps the mapping alive
+    if (!view)
+        return std::format("Cannot map '{}'", path.string());
+    return std::unique_ptr<FileMapping>(
+        new FileMapping(static_cast<uint8_t *>(view), static_cast<size_t>(size.QuadPart), mode));
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::format("Cannot open '{}'", path.string());
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return std::format("Cannot map empty file '{}'", path.string());
+    }
+    // MAP_PRIVATE pages are only copied once written, so a read-only file can be mapped writable
+    int prot = cow ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *addr = mmap(nullptr, static_cast<size_t>(st.st_size), prot, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid after close
+    if (addr == MAP_FAILED)
+        return std::format("Cannot map '{}'", path.string());
+    return std::unique_ptr<FileMapping>(
+        new FileMapping(static_cast<uint8_t *>(addr), static_cast<size_t>(st.st_size), mode));
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string>
+#include <variant>
+
+/// @brief Memory mapping of a whole host file.
+/// The bytes are served from the host page cache; with Mode::CopyOnWrite writes go to
+/// private copies of the touched pages and never reach the file.
+class FileMapping {
+public:
+    enum class Mode {
+        ReadOnly,
+        CopyOnWrite
+    };
+
+    FileMapping(const FileMapping &) = delete;
+    FileMapping &operator=(const FileMapping &) = delete;
+    ~FileMapping();
+
+    /// @return mapping or error message
+    [[nodiscard]] static std::variant<std::unique_ptr<FileMapping>, std::string>
+    open(const std::filesystem::path &path, Mode mode);
+
+    [[nodiscard]] std::span<uint8_t> bytes() const noexcept { return {m_data, m_size}; }
+    [[nodiscard]] size_t size() const noexcept { return m_size; }
+    [[nodiscard]] bool writable() const noexcept { return m_mode == Mode::CopyOnWrite; }
+
+private:
+    FileMapping(uint8_t *data, size_t size, Mode mode) : m_data(data), m_size(size), m_mode(mode) {}
+
+    uint8_t *m_data;
+    size_t m_size;
+    Mode m_mode;
+};
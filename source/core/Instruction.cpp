@@ -1,4 +1,5 @@
 #include "Instruction.hpp"
+#include <format>
 #include <rv64/instruction_sets/Rv64IMC.hpp>
 
 #include "rv64/Cpu.hpp"
@@ -29,7 +30,11 @@ size_t InstProto::byte_size() const noexcept {
 }
 
 Instruction Instruction::create(std::string_view mnemonic, const std::array<InstArg, 3> &args) {
-    return {rv64::is::Rv64IMC::get_inst_proto(std::string(mnemonic)).id, args};
+    return {rv64::is::Rv64IMC::get_inst_proto(mnemonic).id, args};
+}
+
+Instruction Instruction::create(int proto_id, const std::array<InstArg, 3> &args) {
+    return {proto_id, args};
 }
 
 // Instruction methods
@@ -58,6 +63,27 @@ size_t Instruction::byte_size() const noexcept {
     return get_prototype().byte_size();
 }
 
+std::string Instruction::to_string() const {
+    if (!is_valid())
+        return "<invalid>";
+
+    std::string text(get_prototype().mnemonic);
+    const char *separator = " ";
+    for (const auto &arg: m_args) {
+        if (std::holds_alternative<std::monostate>(arg))
+            break;
+        text += separator;
+        separator = ", ";
+        std::visit([&]<typename T>(const T &value) {
+            if constexpr (std::is_same_v<T, rv64::Reg>)
+                text += std::format("x{}", value.idx());
+            else if constexpr (!std::is_same_v<T, std::monostate>)
+                text += std::to_string(static_cast<int64_t>(value));
+        }, arg);
+    }
+    return text;
+}
+
 const Instruction &Instruction::invalid_cref() noexcept {
     static Instruction invalid_inst{};
     return invalid_inst;
@@ -5,6 +5,7 @@
 #include "common.hpp"
 #include "rv64/GPIntReg.hpp"
 #include "rv64/Reg.hpp"
+#include "parser/Symbol.hpp"
 
 namespace rv64 {
     class Cpu;
@@ -29,7 +30,7 @@ enum class InstArgType {
 };
 
 struct UnresolvedSymbol {
-    std::string name;
+    asm_parsing::SymbolId id;
     int64_t offset = 0;
 };
 
@@ -38,12 +39,18 @@ struct UnsignedLiteral {
     int64_t value;
 };
 
+/// Operand kept as text because it could not be classified (e.g. invalid register name)
+struct OperandText {
+    SmallString<31> text;
+};
+
 using RawInstArg = std::variant<
     std::monostate,
-    std::string,
+    rv64::Reg,
     int64_t,
     UnsignedLiteral,
-    UnresolvedSymbol
+    UnresolvedSymbol,
+    OperandText
 >;
 
 using InstArg = std::variant<
@@ -86,7 +93,11 @@ public:
 
     [[nodiscard]] bool is_padding() const noexcept { return !is_valid(); }
 
+    /// @return assembly text, e.g. "addi x5, x5, -1" (registers by number, immediates in decimal)
+    [[nodiscard]] std::string to_string() const;
+
     [[nodiscard]] static Instruction create(std::string_view mnemonic, const std::array<InstArg, 3> &args);
+    [[nodiscard]] static Instruction create(int proto_id, const std::array<InstArg, 3> &args);
 
 private:
     friend class InstructionBuilder;
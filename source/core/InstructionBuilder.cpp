@@ -1,6 +1,8 @@
 #include "InstructionBuilder.hpp"
 
+#include <charconv>
 #include <format>
+#include <limits>
 
 #include "rv64/instruction_sets/Rv64IMC.hpp"
 
@@ -40,70 +42,130 @@ static std::optional<BuildError> try_parse_intN(int64_t value, InstArg &out, std
     };
 }
 
-enum class ImmFormat { Decimal, Unsigned };
+std::optional<InstructionBuilder::Immediate> InstructionBuilder::parse_immediate(std::string_view str) noexcept {
+    bool negative = false;
+    bool signed_literal = !str.empty() && (str[0] == '+' || str[0] == '-');
+    if (signed_literal) {
+        negative = str[0] == '-';
+        str.remove_prefix(1);
+    }
 
-static bool try_parse_immediate(std::string_view str, int64_t &out, ImmFormat &format) {
-    try {
-        if (str.starts_with("0b") || str.starts_with("0B")) {
-            out = std::stoll(std::string(str.substr(2)), nullptr, 2);
-            format = ImmFormat::Unsigned;
-        } else if (str.starts_with("0x") || str.starts_with("0X")) {
-            out = std::stoll(std::string(str), nullptr, 0);
-            format = ImmFormat::Unsigned;
-        } else {
-            out = std::stoll(std::string(str), nullptr, 0);
-            format = ImmFormat::Decimal;
-        }
-        return true;
-    } catch (...) {
-        return false;
+    int base = 10;
+    bool is_unsigned_literal = false;
+    if (str.starts_with("0x") || str.starts_with("0X")) {
+        base = 16;
+        is_unsigned_literal = !signed_literal;
+        str.remove_prefix(2);
+    } else if (str.starts_with("0b") || str.starts_with("0B")) {
+        base = 2;
+        is_unsigned_literal = !signed_literal;
+        str.remove_prefix(2);
+    } else if (str.size() > 1 && str[0] == '0') {
+        base = 8;
+        str.remove_prefix(1);
     }
+
+    if (str.empty() || str[0] == '+' || str[0] == '-')
+        return std::nullopt;
+
+    uint64_t magnitude = 0;
+    auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), magnitude, base);
+    if (ec != std::errc{} || end != str.data() + str.size())
+        return std::nullopt;
+
+    // same accepted range as std::stoll: [INT64_MIN, INT64_MAX]
+    constexpr auto max_positive = static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+    if (magnitude > max_positive + (negative ? 1 : 0))
+        return std::nullopt;
+
+    auto value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+    return Immediate{value, is_unsigned_literal};
 }
 
 
-InstructionBuilder::InstructionBuilder(std::string_view mnemonic)
-    : m_mnemonic(to_lowercase(std::string(mnemonic))) {
+InstructionBuilder::InstructionBuilder(std::string_view mnemonic) {
+    set_mnemonic(mnemonic);
 }
 
 InstructionBuilder &InstructionBuilder::set_mnemonic(std::string_view mnemonic) {
-    m_mnemonic = to_lowercase(std::string(mnemonic));
+    if (!m_mnemonic.assign(mnemonic, true)) {
+        // longer than any mnemonic, don't look up its truncated prefix
+        m_proto_id = -1;
+        m_error = BuildError{
+            .kind = BuildErrorKind::UnknownMnemonic,
+            .message = std::format("Unknown instruction '{}'", to_lowercase(mnemonic)),
+            .line = std::nullopt
+        };
+        return *this;
+    }
+    m_proto_id = rv64::is::Rv64IMC::get_inst_proto(m_mnemonic.view()).id;
     return *this;
 }
 
-InstructionBuilder &InstructionBuilder::add_arg(std::string_view arg) {
+OperandText InstructionBuilder::operand_text(std::string_view arg, bool is_register) {
+    OperandText text;
+    if (!text.text.assign(arg) && is_register && !m_error) {
+        m_error = BuildError{
+            .kind = BuildErrorKind::InvalidRegister,
+            .message = std::format("Invalid register '{}'", arg),
+            .line = std::nullopt
+        };
+    }
+    return text;
+}
+
+InstArgType InstructionBuilder::expected_arg(size_t idx) const noexcept {
+    if (m_proto_id < 0 || idx >= 3) return InstArgType::None;
+    return rv64::is::Rv64IMC::get_inst_proto(m_proto_id).args[idx];
+}
+
+InstructionBuilder &InstructionBuilder::add_arg(std::string_view arg, asm_parsing::SymbolTable &symbols) {
     if (m_arg_count >= 3) return *this;
 
-    std::string arg_str(arg);
+    using Id = rv64::is::IExtensionC::InstId;
 
     // Handle c.*sp instructions: accept both "imm" and "imm(x2)" / "imm(sp)" formats
     // Also ignore "sp" or "x2" passed as separate token (parser splits 0(sp) into sp, 0)
-    if (m_mnemonic == "c.lwsp" || m_mnemonic == "c.ldsp" ||
-        m_mnemonic == "c.swsp" || m_mnemonic == "c.sdsp") {
-
-        // Normalize to lowercase for comparison
-        std::string lowered = arg_str;
-        for (char &c : lowered) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    if (m_proto_id == (int) Id::c_lwsp || m_proto_id == (int) Id::c_ldsp ||
+        m_proto_id == (int) Id::c_swsp || m_proto_id == (int) Id::c_sdsp) {
 
         // If the token is exactly x2/sp, it's the implicit base - skip it
+        SmallString<3> lowered(arg, true);
         if (lowered == "x2" || lowered == "sp") {
             return *this;
         }
     }
 
     // Try to parse as immediate first
-    int64_t imm_value;
-    ImmFormat format;
-    if (try_parse_immediate(arg_str, imm_value, format)) {
-        if (format == ImmFormat::Unsigned) {
-            m_raw_args[m_arg_count++] = UnsignedLiteral{imm_value};
+    if (auto imm = parse_immediate(arg)) {
+        if (imm->is_unsigned_literal) {
+            m_raw_args[m_arg_count++] = UnsignedLiteral{imm->value};
         } else {
-            m_raw_args[m_arg_count++] = imm_value;
+            m_raw_args[m_arg_count++] = imm->value;
         }
         return *this;
     }
 
-    // Otherwise store as string (register name or symbol)
-    m_raw_args[m_arg_count++] = arg_str;
+    auto expected = expected_arg(m_arg_count);
+
+    // Unknown instruction or surplus argument: keep the text, build() reports the error
+    if (expected == InstArgType::None) {
+        m_raw_args[m_arg_count++] = operand_text(arg, false);
+        return *this;
+    }
+
+    // Register position: keep invalid names as text so build() can report them
+    if (expected == InstArgType::IntReg || expected == InstArgType::IntRegP) {
+        rv64::Reg reg(arg);
+        if (reg.is_valid())
+            m_raw_args[m_arg_count++] = reg;
+        else
+            m_raw_args[m_arg_count++] = operand_text(arg, true);
+        return *this;
+    }
+
+    // Immediate position: it's a symbol reference
+    m_raw_args[m_arg_count++] = UnresolvedSymbol{symbols.intern(arg), 0};
     return *this;
 }
 
@@ -113,96 +175,57 @@ InstructionBuilder &InstructionBuilder::add_imm(int64_t value) {
     return *this;
 }
 
-InstructionBuilder &InstructionBuilder::add_symbol(std::string_view symbol, int64_t offset) {
+InstructionBuilder &InstructionBuilder::add_symbol(asm_parsing::SymbolId symbol, int64_t offset) {
     if (m_arg_count >= 3) return *this;
-    m_raw_args[m_arg_count++] = UnresolvedSymbol{std::string(symbol), offset};
+    m_raw_args[m_arg_count++] = UnresolvedSymbol{symbol, offset};
     return *this;
 }
 
-std::optional<BuildError> InstructionBuilder::resolve_symbols(const std::unordered_map<std::string, uint64_t> &symbol_table, uint64_t current_pc) {
-    // PC-relative instruction metadata (jalr, c.jr, c.jalr are NOT here - they use absolute addressing)
-    struct InstrMeta {
-        int arg_index;      // which argument is the PC-relative offset
-        int offset_divisor; // divide byte offset by this (2 for half-word encoding)
-    };
-
-    static const std::unordered_map<std::string_view, InstrMeta> pc_relative_instrs{
-        {"beq",      {2, 2}},
-        {"bne",      {2, 2}},
-        {"blt",      {2, 2}},
-        {"bltu",     {2, 2}},
-        {"bge",      {2, 2}},
-        {"bgeu",     {2, 2}},
-        {"jal",      {1, 2}},
-        {"c.j",      {0, 2}},
-        {"c.beqz",   {1, 2}},
-        {"c.bnez",   {1, 2}},
-    };
-
-    auto meta_it = pc_relative_instrs.find(m_mnemonic);
+std::optional<InstructionBuilder::PcRelativeArg> InstructionBuilder::pc_relative_arg() const noexcept {
+    // jalr, c.jr, c.jalr are NOT here - they use absolute addressing
+    switch (m_proto_id) {
+        case (int) rv64::is::IBaseI::InstId::beq:
+        case (int) rv64::is::IBaseI::InstId::bne:
+        case (int) rv64::is::IBaseI::InstId::blt:
+        case (int) rv64::is::IBaseI::InstId::bltu:
+        case (int) rv64::is::IBaseI::InstId::bge:
+        case (int) rv64::is::IBaseI::InstId::bgeu:
+            return PcRelativeArg{2, 2};
+        case (int) rv64::is::IBaseI::InstId::jal:
+        case (int) rv64::is::IExtensionC::InstId::c_beqz:
+        case (int) rv64::is::IExtensionC::InstId::c_bnez:
+            return PcRelativeArg{1, 2};
+        case (int) rv64::is::IExtensionC::InstId::c_j:
+            return PcRelativeArg{0, 2};
+        default:
+            return std::nullopt;
+    }
+}
 
-    // Get the instruction prototype to check argument types
-    auto proto = rv64::is::Rv64IMC::get_inst_proto(m_mnemonic);
+std::optional<BuildError> InstructionBuilder::resolve_symbols(const asm_parsing::SymbolTable &symbol_table, uint64_t current_pc) {
+    auto meta = pc_relative_arg();
 
     for (size_t i = 0; i < m_arg_count; ++i) {
-        std::string symbol_name;
-        int64_t symbol_offset = 0;
-
-        // Check for UnresolvedSymbol variant
-        if (auto *sym = std::get_if<UnresolvedSymbol>(&m_raw_args[i])) {
-            symbol_name = sym->name;
-            symbol_offset = sym->offset;
-        }
-        // Check for string that might be a symbol (not a number, not a register)
-        else if (auto *str = std::get_if<std::string>(&m_raw_args[i])) {
-            // If proto is invalid (unknown instruction), skip symbol resolution
-            // Let build() report the "Unknown instruction" error
-            if (!proto) {
-                continue;
-            }
-
-            // Only try symbol resolution if this argument position expects an immediate
-            // This prevents treating invalid register names like 'x32' as symbols
-            auto arg_type = proto.args[i];
-            bool is_immediate_arg = (arg_type != InstArgType::IntReg &&
-                                     arg_type != InstArgType::IntRegP &&
-                                     arg_type != InstArgType::None);
-            if (!is_immediate_arg) {
-                continue; // Let build() handle invalid register errors
-            }
-
-            // Skip if it parses as an immediate
-            int64_t dummy;
-            ImmFormat fmt;
-            if (try_parse_immediate(*str, dummy, fmt)) {
-                continue;
-            }
-            // It's likely a symbol
-            symbol_name = *str;
-        }
-        else {
+        auto *sym = std::get_if<UnresolvedSymbol>(&m_raw_args[i]);
+        if (!sym) {
             continue;
         }
 
-        if (symbol_name.empty()) {
-            continue;
-        }
-
-        auto it = symbol_table.find(symbol_name);
-        if (it == symbol_table.end()) {
+        auto address = symbol_table.address_of(sym->id);
+        if (!address) {
             return BuildError{
                 .kind = BuildErrorKind::UnresolvedSymbol,
-                .message = std::format("Unresolved symbol '{}'", symbol_name)
+                .message = std::format("Unresolved symbol '{}'", symbol_table.name_of(sym->id))
             };
         }
 
-        uint64_t target_address = it->second + symbol_offset;
+        uint64_t target_address = *address + sym->offset;
 
-        // If this instruction is in the PC-relative table, and we're at the offset argument
-        if (meta_it != pc_relative_instrs.end() && static_cast<int>(i) == meta_it->second.arg_index) {
+        // If this instruction is PC-relative, and we're at the offset argument
+        if (meta && static_cast<int>(i) == meta->arg_index) {
             // PC-relative offset: RISC-V spec defines offsets relative to current PC
             int64_t byte_offset = static_cast<int64_t>(target_address) - static_cast<int64_t>(current_pc);
-            m_raw_args[i] = byte_offset / meta_it->second.offset_divisor;
+            m_raw_args[i] = byte_offset / meta->offset_divisor;
         } else {
             // Absolute address (for non-PC-relative instructions like jalr, or data labels)
             m_raw_args[i] = static_cast<int64_t>(target_address);
@@ -212,13 +235,16 @@ std::optional<BuildError> InstructionBuilder::resolve_symbols(const std::unorder
 }
 
 std::variant<Instruction, BuildError> InstructionBuilder::build() const {
-    auto proto = rv64::is::Rv64IMC::get_inst_proto(m_mnemonic);
+    if (m_error)
+        return *m_error;
+    auto proto = rv64::is::Rv64IMC::get_inst_proto(m_proto_id);
     if (!proto) {
         return BuildError{
             .kind = BuildErrorKind::UnknownMnemonic,
-            .message = std::format("Unknown instruction '{}'", m_mnemonic)
+            .message = std::format("Unknown instruction '{}'", m_mnemonic.view())
         };
     }
+    auto mnemonic = proto.mnemonic;
 
     std::array<InstArg, 3> validated_args;
 
@@ -231,32 +257,29 @@ std::variant<Instruction, BuildError> InstructionBuilder::build() const {
         if (i >= m_arg_count) {
             return BuildError{
                 .kind = BuildErrorKind::MissingArgument,
-                .message = std::format("Missing argument {} for '{}'", i + 1, m_mnemonic)
+                .message = std::format("Missing argument {} for '{}'", i + 1, mnemonic)
             };
         }
 
         if (arg == InstArgType::IntReg || arg == InstArgType::IntRegP) {
-            if (auto *str = std::get_if<std::string>(&m_raw_args[i])) {
-                rv64::Reg reg(*str);
-                if (!reg.is_valid()) {
-                    return BuildError{
-                        .kind = BuildErrorKind::InvalidRegister,
-                        .message = std::format("Invalid register '{}'", *str)
-                    };
-                }
-
-                if (arg == InstArgType::IntRegP && !reg.in_compressed_range()) {
+            if (auto *reg = std::get_if<rv64::Reg>(&m_raw_args[i])) {
+                if (arg == InstArgType::IntRegP && !reg->in_compressed_range()) {
                     return BuildError{
                         .kind = BuildErrorKind::RegisterNotInCompressedRange,
                         .message = std::format("Register '{}' not in compressed range (x8-x15) for '{}'",
-                                               *str, m_mnemonic)
+                                               reg->get_name(), mnemonic)
                     };
                 }
-                validated_args[i] = reg;
+                validated_args[i] = *reg;
+            } else if (auto *text = std::get_if<OperandText>(&m_raw_args[i])) {
+                return BuildError{
+                    .kind = BuildErrorKind::InvalidRegister,
+                    .message = std::format("Invalid register '{}'", text->text.view())
+                };
             } else {
                 return BuildError{
                     .kind = BuildErrorKind::InvalidRegister,
-                    .message = std::format("Expected register for argument {} of '{}'", i + 1, m_mnemonic)
+                    .message = std::format("Expected register for argument {} of '{}'", i + 1, mnemonic)
                 };
             }
             continue;
@@ -271,19 +294,15 @@ std::variant<Instruction, BuildError> InstructionBuilder::build() const {
         } else if (auto *ulit = std::get_if<UnsignedLiteral>(&m_raw_args[i])) {
             imm_value = ulit->value;
             is_unsigned_literal = true;
-        } else if (auto *str = std::get_if<std::string>(&m_raw_args[i])) {
-            ImmFormat fmt;
-            if (!try_parse_immediate(*str, imm_value, fmt)) {
-                return BuildError{
-                    .kind = BuildErrorKind::ImmediateOutOfRange,
-                    .message = std::format("Cannot parse '{}' as immediate", *str)
-                };
-            }
-            is_unsigned_literal = (fmt == ImmFormat::Unsigned);
         } else if (std::get_if<UnresolvedSymbol>(&m_raw_args[i])) {
             return BuildError{
                 .kind = BuildErrorKind::UnresolvedSymbol,
-                .message = std::format("Unresolved symbol in argument {} of '{}'", i + 1, m_mnemonic)
+                .message = std::format("Unresolved symbol in argument {} of '{}'", i + 1, mnemonic)
+            };
+        } else {
+            return BuildError{
+                .kind = BuildErrorKind::ImmediateOutOfRange,
+                .message = std::format("Expected immediate for argument {} of '{}'", i + 1, mnemonic)
             };
         }
 
@@ -291,37 +310,37 @@ std::variant<Instruction, BuildError> InstructionBuilder::build() const {
         std::optional<BuildError> range_err;
         switch (arg) {
             case InstArgType::Imm12:
-                range_err = try_parse_intN<int12>(imm_value, validated_args[i], m_mnemonic, is_unsigned_literal);
+                range_err = try_parse_intN<int12>(imm_value, validated_args[i], mnemonic, is_unsigned_literal);
                 break;
             case InstArgType::Imm20:
-                range_err = try_parse_intN<int20>(imm_value, validated_args[i], m_mnemonic, is_unsigned_literal);
+                range_err = try_parse_intN<int20>(imm_value, validated_args[i], mnemonic, is_unsigned_literal);
                 break;
             case InstArgType::UImm5:
-                range_err = try_parse_intN<uint5>(imm_value, validated_args[i], m_mnemonic);
+                range_err = try_parse_intN<uint5>(imm_value, validated_args[i], mnemonic);
                 break;
             case InstArgType::UImm6:
-                range_err = try_parse_intN<uint6>(imm_value, validated_args[i], m_mnemonic);
+                range_err = try_parse_intN<uint6>(imm_value, validated_args[i], mnemonic);
                 break;
             case InstArgType::UImm12:
-                range_err = try_parse_intN<uint12>(imm_value, validated_args[i], m_mnemonic);
+                range_err = try_parse_intN<uint12>(imm_value, validated_args[i], mnemonic);
                 break;
             case InstArgType::UImm20:
-                range_err = try_parse_intN<uint20>(imm_value, validated_args[i], m_mnemonic);
+                range_err = try_parse_intN<uint20>(imm_value, validated_args[i], mnemonic);
                 break;
             case InstArgType::Imm5:
-                range_err = try_parse_intN<int5>(imm_value, validated_args[i], m_mnemonic, is_unsigned_literal);
+                range_err = try_parse_intN<int5>(imm_value, validated_args[i], mnemonic, is_unsigned_literal);
                 break;
             case InstArgType::Imm6:
-                range_err = try_parse_intN<int6>(imm_value, validated_args[i], m_mnemonic, is_unsigned_literal);
+                range_err = try_parse_intN<int6>(imm_value, validated_args[i], mnemonic, is_unsigned_literal);
                 break;
             case InstArgType::Imm8:
-                range_err = try_parse_intN<int8>(imm_value, validated_args[i], m_mnemonic, is_unsigned_literal);
+                range_err = try_parse_intN<int8>(imm_value, validated_args[i], mnemonic, is_unsigned_literal);
                 break;
             case InstArgType::Imm11:
-                range_err = try_parse_intN<int11>(imm_value, validated_args[i], m_mnemonic, is_unsigned_literal);
+                range_err = try_parse_intN<int11>(imm_value, validated_args[i], mnemonic, is_unsigned_literal);
                 break;
             case InstArgType::UImm8:
-                range_err = try_parse_intN<uint8>(imm_value, validated_args[i], m_mnemonic);
+                range_err = try_parse_intN<uint8>(imm_value, validated_args[i], mnemonic);
                 break;
             default:
                 assert(false && "Unhandled InstArgType in InstructionBuilder::build()");
@@ -333,7 +352,9 @@ std::variant<Instruction, BuildError> InstructionBuilder::build() const {
 }
 
 void InstructionBuilder::reset() {
+    m_proto_id = -1;
     m_mnemonic.clear();
     m_raw_args = {};
     m_arg_count = 0;
+    m_error.reset();
 }
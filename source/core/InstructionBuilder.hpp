@@ -1,32 +1,42 @@
 #pragma once
 #include <Instruction.hpp>
 #include <BuildError.hpp>
-#include <unordered_map>
+#include <parser/SymbolTable.hpp>
 #include <variant>
 #include <optional>
+#include <concepts>
 
 /// @brief Builder for constructing instructions in stages
+/// Operands are classified when added (immediate, register or interned symbol),
+/// so the builder holds no heap-allocated strings and is cheap to copy.
 class InstructionBuilder {
 public:
+    /// @brief Parsed integer literal
+    struct Immediate {
+        int64_t value;
+        bool is_unsigned_literal; ///< hex/binary literal that may wrap for signed immediates
+    };
+
     InstructionBuilder() = default;
     explicit InstructionBuilder(std::string_view mnemonic);
 
     InstructionBuilder& set_mnemonic(std::string_view mnemonic);
 
     /// @brief adds a raw argument (register name, immediate string, or symbol)
-    InstructionBuilder& add_arg(std::string_view arg);
+    /// @param symbols table used to intern symbol references
+    InstructionBuilder& add_arg(std::string_view arg, asm_parsing::SymbolTable &symbols);
 
     /// @brief adds a parsed immediate argument
     InstructionBuilder& add_imm(int64_t value);
 
     /// @brief adds a symbol reference
-    InstructionBuilder& add_symbol(std::string_view symbol, int64_t offset = 0);
+    InstructionBuilder& add_symbol(asm_parsing::SymbolId symbol, int64_t offset = 0);
 
     /// @brief resolves symbols using the provided symbol table
-    /// @param symbol_table Map of symbol names to absolute addresses
+    /// @param symbol_table Symbol table holding absolute addresses of the referenced symbols
     /// @param current_pc Current instruction's PC (for branch offset calculation)
     /// @return nullopt on success, BuildError on failure
-    std::optional<BuildError> resolve_symbols(const std::unordered_map<std::string, uint64_t> &symbol_table, uint64_t current_pc = 0);
+    std::optional<BuildError> resolve_symbols(const asm_parsing::SymbolTable &symbol_table, uint64_t current_pc = 0);
 
     /// @brief validates and builds the final instruction
     /// @return Instruction on success, BuildError on failure
@@ -34,8 +44,44 @@ public:
 
     void reset();
 
+    /// @brief rewrites the ids of unresolved symbol operands, e.g. when moving the builder to another SymbolTable
+    /// @param map callable SymbolId -> SymbolId
+    template<std::invocable<asm_parsing::SymbolId> F>
+    void remap_symbols(F &&map) {
+        for (size_t i = 0; i < m_arg_count; ++i) {
+            if (auto *sym = std::get_if<UnresolvedSymbol>(&m_raw_args[i]))
+                sym->id = map(sym->id);
+        }
+    }
+
+    /// @brief PC-relative operand of branches and jumps
+    struct PcRelativeArg {
+        int arg_index;      ///< which argument is the PC-relative offset
+        int offset_divisor; ///< divide byte offset by this (2 for half-word encoding)
+    };
+
+    /// @return the PC-relative operand, nullopt if symbols resolve to absolute addresses
+    [[nodiscard]] std::optional<PcRelativeArg> pc_relative_arg() const noexcept;
+
+    /// @return prototype id of the mnemonic, -1 if unknown
+    [[nodiscard]] int get_proto_id() const noexcept { return m_proto_id; }
+
+    /// @brief parses an integer literal (decimal, octal, 0x hex or 0b binary, optionally signed)
+    /// without allocating or throwing.
+    /// A sign makes a hex or binary literal signed (-0x10 is -16, not an unsigned literal).
+    /// Unlike std::stoll the whole string must be consumed, so "08" (invalid octal) and "12abc"
+    /// are not literals and are taken as symbol names.
+    /// @return nullopt if the whole string is not a valid 64-bit literal
+    [[nodiscard]] static std::optional<Immediate> parse_immediate(std::string_view str) noexcept;
+
 private:
-    std::string m_mnemonic;
+    [[nodiscard]] InstArgType expected_arg(size_t idx) const noexcept;
+    /// @brief keeps the operand as text; a token too long to keep is rejected with its full text
+    [[nodiscard]] OperandText operand_text(std::string_view arg, bool is_register);
+
+    int m_proto_id = -1;
+    SmallString<16> m_mnemonic; // lowercase, kept for error messages
     std::array<RawInstArg, 3> m_raw_args;
     size_t m_arg_count = 0;
-};
\ No newline at end of file
+    std::optional<BuildError> m_error; // first error found before build(), e.g. an oversize token
+};
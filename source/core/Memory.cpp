@@ -4,13 +4,23 @@
 #include <cassert>
 #include <cstring>
 #include <format>
+#include <ranges>
 #include <span>
 
+#include "endianness.hpp"
 #include "rv64/AssemblerUnit.hpp"
+#include "rv64/CacheModel.hpp"
+#include "rv64/Decoder.hpp"
+#include "rv64/Trace.hpp"
 
 namespace {
     constexpr size_t MIN_INSTR_SIZE = 2; // Compressed instructions are 2 bytes
     constexpr size_t MAX_STRING_LEN = 4096; // Max string length to prevent infinite loops
+
+    template<std::integral T>
+    T to_guest_order(T value, std::endian guest) noexcept {
+        return guest == std::endian::native ? value : endianness::swap_endian(value);
+    }
 }
 
 Memory::Memory(const Layout &layout, std::span<const uint8_t> program_data)
@@ -48,6 +58,8 @@ std::string Memory::load_string(uint64_t address, MemErr &err) const {
                 err = MemErr::SegFault;
                 return "";
             }
+        } else if (auto *file = find_mapped(byte_addr, 1)) {
+            ch = file->mapping->bytes()[byte_addr - file->address];
         } else {
             err = MemErr::SegFault;
             return "";
@@ -64,52 +76,206 @@ std::string Memory::load_string(uint64_t address, MemErr &err) const {
     return result;
 }
 
-void Memory::load_program(const asm_parsing::ParsedInstVec &instructions) {
-    m_instructions = instructions;
-    auto bytecode = rv64::AssemblerUnit::assemble(instructions, m_layout.endianness);
-    m_data_size += bytecode.size();
-    if (m_data_size > PROGRAM_MEM_LIMIT) {
-        throw std::runtime_error("Program exceeds memory limit after loading");
+MemErr Memory::host_spans(uint64_t address, size_t size, std::vector<std::span<uint8_t>> &out, bool write) {
+    if (size == 0)
+        return MemErr::None;
+
+    PagedMemory *region = nullptr;
+    uint64_t offset = 0;
+    if (in_data(address, size)) {
+        region = &m_data;
+        offset = to_data_offset(address);
+    } else if (in_stack(address, size)) {
+        region = &m_stack;
+        offset = to_stack_offset(address);
+    } else if (auto *file = find_mapped(address, size); file && (!write || file->mapping->writable())) {
+        if (write && m_store_journal)
+            journal_range(address, size);
+        out.push_back(file->mapping->bytes().subspan(address - file->address, size)); // contiguous on the host
+        return MemErr::None;
+    } else {
+        return MemErr::SegFault;
+    }
+
+    if (write && m_store_journal)
+        journal_range(address, size);
+    for (uint64_t end = offset + size; offset < end;) {
+        auto span = region->page_span(offset, end - offset);
+        out.push_back(span);
+        offset += span.size();
     }
+    return MemErr::None;
+}
+
+void Memory::load_program(asm_parsing::ParsedInstVec instructions) {
+    size_t code_size = rv64::AssemblerUnit::code_size(instructions);
+    reserve_program(code_size);
+
+    // Encode directly into the data segment pages
+    rv64::AssemblerUnit::assemble_into(instructions, m_layout.endianness, m_data.begin());
+    index_program(std::move(instructions), m_layout.data_base, code_size);
+}
+
+void Memory::load_program(asm_parsing::ParsedInstVec instructions, std::span<const uint8_t> bytecode) {
+    reserve_program(bytecode.size());
+
     // Load bytecode into data segment
     std::ranges::copy(bytecode, m_data.begin());
+    index_program(std::move(instructions), m_layout.data_base, bytecode.size());
+}
+
+std::optional<std::string> Memory::load_image(std::span<const ImageSegment> segments,
+                                              std::span<const AddressRange> code) {
+    uint64_t image_end = m_layout.data_base;
+    for (const auto &seg: segments) {
+        if (seg.address < m_layout.data_base || seg.mem_size > PROGRAM_MEM_LIMIT
+            || seg.address - m_layout.data_base > PROGRAM_MEM_LIMIT - seg.mem_size)
+            return std::format("Segment at 0x{:x} does not fit in the data segment", seg.address);
+        image_end = std::max(image_end, seg.address + seg.mem_size);
+    }
+    if (image_end - m_layout.data_base + m_layout.initial_heap_size > PROGRAM_MEM_LIMIT)
+        return "Program exceeds memory limit";
+
+    if (code.empty() || code.front().begin & 1 || code.front().begin < m_layout.data_base
+        || code.back().end > image_end)
+        return "Code is outside of the loaded segments";
+
+    m_heap_start = image_end;
+    m_data_size = image_end - m_layout.data_base + m_layout.initial_heap_size;
+    for (const auto &seg: segments)
+        std::ranges::copy(seg.bytes, m_data.begin() + ptrdiff_t(to_data_offset(seg.address)));
+
+    // linear sweep; anything that does not decode (gaps, data in code) becomes an invalid
+    // 2-byte entry that stops the CPU if executed
+    asm_parsing::ParsedInstVec instructions;
+    uint64_t code_begin = code.front().begin;
+    uint64_t code_end = code.back().end;
+    auto range = code.begin();
+    for (uint64_t pc = code_begin; pc < code_end;) {
+        while (range->end <= pc)
+            ++range;
+
+        Instruction inst = Instruction::invalid();
+        uint16_t low = 0;
+        if (pc >= range->begin && m_data.load(to_data_offset(pc), low)) {
+            if (rv64::Decoder::instruction_length(low) == 2) {
+                inst = rv64::Decoder::decode(low);
+            } else if (uint32_t raw = 0; pc + 4 <= range->end && m_data.load(to_data_offset(pc), raw)) {
+                inst = rv64::Decoder::decode(raw);
+            }
+        }
+
+        pc += std::max(inst.byte_size(), MIN_INSTR_SIZE);
+        instructions.push_back(asm_parsing::ParsedInst{SIZE_MAX, std::move(inst)});
+    }
+
+    index_program(std::move(instructions), code_begin, code_end - code_begin);
+    return std::nullopt;
+}
+
+void Memory::reserve_program(size_t code_size) {
+    m_data_size += code_size;
+    if (m_data_size > PROGRAM_MEM_LIMIT) {
+        throw std::runtime_error("Program exceeds memory limit after loading");
+    }
 
     // Update heap start
-    m_heap_start = m_layout.data_base + bytecode.size();
+    m_heap_start = m_layout.data_base + code_size;
+}
+
+void Memory::index_program(asm_parsing::ParsedInstVec &&instructions, uint64_t code_base, size_t code_size) {
+    m_code_base = code_base;
+    m_program.clear();
+    m_program_lines.clear();
+    m_pc_index.clear();
+    m_program.reserve(instructions.size());
+    m_program_lines.reserve(instructions.size());
+    m_pc_index.reserve(code_size / MIN_INSTR_SIZE);
+
+    for (auto &parsed: instructions) {
+        auto index = static_cast<uint32_t>(m_program.size());
+        m_pc_index.push_back(index);
+        for (size_t half = MIN_INSTR_SIZE; half < parsed.inst.byte_size(); half += MIN_INSTR_SIZE)
+            m_pc_index.push_back(NOT_AN_INSTRUCTION);
+
+        m_program.push_back(std::move(parsed.inst));
+        m_program_lines.push_back(parsed.lineno == SIZE_MAX ? NO_LINE : static_cast<uint32_t>(parsed.lineno));
+    }
+    m_fused = {};
+}
+
+void Memory::set_fusion(bool enabled) {
+    static_assert(NO_LINE == rv64::FusedOp::NO_LINE);
+    m_fused = enabled ? rv64::fuse_program(m_program, m_program_lines) : rv64::FusedProgram{};
 }
 
 Memory::InstructionFetch Memory::get_instruction_at(uint64_t address, MemErr &err) const {
-    assert(!m_instructions.empty());
+    assert(!m_program.empty());
 
-    size_t relative_addr = address - m_layout.data_base;
+    size_t relative_addr = address - m_code_base;
     size_t offset = relative_addr / MIN_INSTR_SIZE;
 
     // check if end of program has been reached
-    if (offset == m_instructions.size()) {
+    if (offset == m_pc_index.size()) {
         err = MemErr::ProgramExit;
         return {Instruction::invalid(), std::nullopt};
     }
 
     // check if address is in instruction memory range
-    if (address < m_layout.data_base || offset > m_instructions.size()) {
+    if (address < m_code_base || offset > m_pc_index.size()) {
         err = MemErr::SegFault;
         return {Instruction::invalid(), std::nullopt};
     }
 
-    const auto &parsed_inst = m_instructions.at(offset);
+    auto index = m_pc_index[offset];
 
-    // check for padding (invalid instruction fetch)
-    if (parsed_inst.is_padding()) {
+    // check for a fetch from the middle of an instruction
+    if (index == NOT_AN_INSTRUCTION) {
         err = MemErr::InvalidInstructionAddress;
         return {Instruction::invalid(), std::nullopt};
     }
 
     err = MemErr::None;
-    return {parsed_inst.inst, parsed_inst.lineno};
+    auto line = m_program_lines[index];
+    return {m_program[index], line == NO_LINE ? std::nullopt : std::optional<size_t>(line)};
+}
+
+const rv64::FusedOp *Memory::get_fused_at(uint64_t address) const noexcept {
+    size_t offset = (address - m_code_base) / MIN_INSTR_SIZE;
+    if (m_fused.index.empty() || address < m_code_base || offset >= m_pc_index.size())
+        return nullptr;
+
+    auto index = m_pc_index[offset];
+    if (index == NOT_AN_INSTRUCTION || m_fused.index[index] == rv64::FusedProgram::NO_OP)
+        return nullptr;
+    return &m_fused.ops[m_fused.index[index]];
+}
+
+uint64_t Memory::get_instruction_begin_addr() const noexcept {
+    return m_code_base;
+}
+
+size_t Memory::get_instruction_size(uint64_t address) const noexcept {
+    auto index = get_program_index(address);
+    if (index == NOT_AN_INSTRUCTION)
+        return 0;
+    size_t next = (address - m_code_base) / MIN_INSTR_SIZE + 1;
+    return next < m_pc_index.size() && m_pc_index[next] == NOT_AN_INSTRUCTION ? 2 * MIN_INSTR_SIZE : MIN_INSTR_SIZE;
+}
+
+uint32_t Memory::get_program_index(uint64_t address) const noexcept {
+    size_t offset = (address - m_code_base) / MIN_INSTR_SIZE;
+    if (address < m_code_base || offset >= m_pc_index.size() || address % MIN_INSTR_SIZE != 0)
+        return NOT_AN_INSTRUCTION;
+    return m_pc_index[offset];
+}
+
+size_t Memory::get_program_size() const noexcept {
+    return m_program.size();
 }
 
 uint64_t Memory::get_instruction_end_addr() const {
-    return m_layout.data_base + m_instructions.size() * MIN_INSTR_SIZE;
+    return m_code_base + m_pc_index.size() * MIN_INSTR_SIZE;
 }
 
 std::string Memory::err_to_string(MemErr err) {
@@ -185,6 +351,53 @@ std::optional<std::string> Memory::validate_layout(const Layout &layout) {
     return std::nullopt;
 }
 
+size_t Memory::mapped_size(uint64_t address) const noexcept {
+    if (in_data(address, 1))
+        return m_layout.data_base + m_data_size - address;
+    if (in_stack(address, 1))
+        return stack_end_addr() - address;
+    if (auto *file = find_mapped(address, 1))
+        return file->address + file->mapping->size() - address;
+    return 0;
+}
+
+std::optional<std::string> Memory::map_file(uint64_t address, const std::filesystem::path &path,
+                                            FileMapping::Mode mode) {
+    auto opened = FileMapping::open(path, mode);
+    if (auto *err = std::get_if<std::string>(&opened))
+        return *err;
+    auto mapping = std::move(std::get<std::unique_ptr<FileMapping>>(opened));
+
+    uint64_t end = address + mapping->size();
+    auto overlaps = [&](uint64_t begin, uint64_t region_end) { return address < region_end && begin < end; };
+    if (end < address)
+        return "File mapping wraps around the address space";
+    if (overlaps(m_layout.data_base, m_layout.data_base + PROGRAM_MEM_LIMIT))
+        return std::format("File mapping at 0x{:x} overlaps the data segment", address);
+    if (overlaps(m_stack_bottom, stack_end_addr()))
+        return std::format("File mapping at 0x{:x} overlaps the stack", address);
+    for (const auto &file: m_mapped_files) {
+        if (overlaps(file.address, file.address + file.mapping->size()))
+            return std::format("File mapping at 0x{:x} overlaps another mapping", address);
+    }
+
+    m_mapped_files.push_back(MappedFile{address, std::move(mapping)});
+    return std::nullopt;
+}
+
+void Memory::unmap_files() {
+    m_mapped_files.clear();
+}
+
+const Memory::MappedFile *Memory::find_mapped(uint64_t address, size_t size) const noexcept {
+    for (const auto &file: m_mapped_files) {
+        if (address >= file.address && address - file.address <= file.mapping->size()
+            && size <= file.mapping->size() - (address - file.address))
+            return &file;
+    }
+    return nullptr;
+}
+
 bool Memory::in_stack(uint64_t address, size_t obj_size) const noexcept {
     return address >= m_stack_bottom && address + obj_size <= stack_end_addr();
 }
@@ -207,6 +420,15 @@ uint64_t Memory::stack_end_addr() const noexcept {
 
 template<std::integral T>
 T Memory::load(uint64_t address, MemErr &err) const {
+    if (m_cache) [[unlikely]]
+        m_cache->load(address, sizeof(T));
+    if (m_trace) [[unlikely]]
+        m_trace->load(address, sizeof(T));
+    return load_unobserved<T>(address, err);
+}
+
+template<std::integral T>
+T Memory::load_unobserved(uint64_t address, MemErr &err) const {
     err = MemErr::None;
     T value = 0;
 
@@ -228,12 +450,35 @@ T Memory::load(uint64_t address, MemErr &err) const {
         return value;
     }
 
+    // File mappings are read straight from the host page cache
+    if (auto *file = find_mapped(address, sizeof(T))) {
+        std::memcpy(&value, file->mapping->bytes().data() + (address - file->address), sizeof(T));
+        return to_guest_order(value, m_layout.endianness);
+    }
+
     err = MemErr::SegFault;
     return 0;
 }
 
 template<std::integral T>
 MemErr Memory::store(uint64_t address, T value) {
+    if (m_cache) [[unlikely]]
+        m_cache->store(address, sizeof(T));
+    if (m_trace) [[unlikely]]
+        m_trace->store(address, sizeof(T), static_cast<std::make_unsigned_t<T>>(value));
+    if (!m_store_journal) [[likely]]
+        return store_unjournaled(address, value);
+
+    MemErr err;
+    auto old = load_unobserved<std::make_unsigned_t<T>>(address, err);
+    err = store_unjournaled(address, value);
+    if (err == MemErr::None)
+        m_store_journal->push_back({address, old, sizeof(T)});
+    return err;
+}
+
+template<std::integral T>
+MemErr Memory::store_unjournaled(uint64_t address, T value) {
     // Check stack first (more commonly accessed for writes)
     if (in_stack(address, sizeof(T))) {
         return m_stack.store(to_stack_offset(address), value)
@@ -248,9 +493,59 @@ MemErr Memory::store(uint64_t address, T value) {
                    : MemErr::SegFault;
     }
 
+    if (auto *file = find_mapped(address, sizeof(T)); file && file->mapping->writable()) {
+        value = to_guest_order(value, m_layout.endianness);
+        std::memcpy(file->mapping->bytes().data() + (address - file->address), &value, sizeof(T));
+        return MemErr::None;
+    }
+
     return MemErr::SegFault;
 }
 
+void Memory::undo_stores(std::span<const StoreRecord> journal) {
+    for (const auto &rec: journal | std::views::reverse) {
+        switch (rec.size) {
+            case 1: (void) store_unjournaled(rec.address, static_cast<uint8_t>(rec.old_value)); break;
+            case 2: (void) store_unjournaled(rec.address, static_cast<uint16_t>(rec.old_value)); break;
+            case 4: (void) store_unjournaled(rec.address, static_cast<uint32_t>(rec.old_value)); break;
+            default: (void) store_unjournaled(rec.address, rec.old_value); break;
+        }
+    }
+}
+
+void Memory::journal_range(uint64_t address, size_t size) {
+    MemErr err;
+    uint64_t end = address + size;
+    for (; end - address >= sizeof(uint64_t); address += sizeof(uint64_t))
+        m_store_journal->push_back({address, load_unobserved<uint64_t>(address, err), sizeof(uint64_t)});
+    for (; address < end; ++address)
+        m_store_journal->push_back({address, load_unobserved<uint8_t>(address, err), 1});
+}
+
+std::vector<uint64_t> Memory::journaled_values(std::span<const StoreRecord> journal) const {
+    std::vector<uint64_t> values;
+    values.reserve(journal.size());
+    for (const auto &rec: journal) {
+        MemErr err;
+        switch (rec.size) {
+            case 1: values.push_back(load_unobserved<uint8_t>(rec.address, err)); break;
+            case 2: values.push_back(load_unobserved<uint16_t>(rec.address, err)); break;
+            case 4: values.push_back(load_unobserved<uint32_t>(rec.address, err)); break;
+            default: values.push_back(load_unobserved<uint64_t>(rec.address, err)); break;
+        }
+    }
+    return values;
+}
+
+bool Memory::same_stores(const Memory &a, std::span<const StoreRecord> a_journal,
+                         const Memory &b, std::span<const StoreRecord> b_journal) {
+    auto same_location = [](const StoreRecord &x, const StoreRecord &y) {
+        return x.address == y.address && x.size == y.size;
+    };
+    return std::ranges::equal(a_journal, b_journal, same_location)
+           && a.journaled_values(a_journal) == b.journaled_values(b_journal);
+}
+
 // Explicit template instantiations
 #define INSTANTIATE_LOAD(TYPE) \
     template TYPE Memory::load(uint64_t address, MemErr &err) const;
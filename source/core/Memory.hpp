@@ -4,9 +4,13 @@
 #include <bit>
 #include <memory>
 #include <optional>
+#include <filesystem>
+#include <vector>
 
+#include "FileMapping.hpp"
 #include "PagedMemory.hpp"
 #include "parser/asm_parsing.hpp"
+#include "rv64/Fusion.hpp"
 
 enum class MemErr {
     None = 0,
@@ -14,10 +18,15 @@ enum class MemErr {
     NotTermStr = 2,
     OutOfMemory = 3,
     NegativeSizeOfHeap = 4,
-    InvalidInstructionAddress = 5, ///< i.e. padding fetch
+    InvalidInstructionAddress = 5, ///< i.e. fetch from the middle of a 4-byte instruction
     ProgramExit = 6,
 };
 
+namespace rv64 {
+    class CacheHierarchy;
+    class TraceRecorder;
+}
+
 class Memory {
 public:
     static constexpr size_t PROGRAM_MEM_LIMIT = 1024 * 1024 * 8; // 8 MiB
@@ -55,9 +64,69 @@ public:
 
     [[nodiscard]] MemErr store(uint64_t address, std::integral auto value);
 
+    /// @brief while set, load() and store() report every access to the cache model
+    /// (accesses through load_string and host_spans are not reported); nullptr detaches it
+    void set_cache_model(rv64::CacheHierarchy *cache) noexcept { m_cache = cache; }
+    /// @brief while set, load() and store() report every access to the trace recorder, as for
+    /// the cache model; nullptr detaches it
+    void set_trace_recorder(rv64::TraceRecorder *trace) noexcept { m_trace = trace; }
+
+    /// @brief Previous contents of a location overwritten by store()
+    struct StoreRecord {
+        uint64_t address;
+        uint64_t old_value;
+        uint8_t size;
+    };
+
+    /// @brief while set, successful store() calls append what they overwrote to the journal, as do
+    /// host_spans() calls for writing (for the whole range); nullptr stops recording
+    void set_store_journal(std::vector<StoreRecord> *journal) noexcept { m_store_journal = journal; }
+    [[nodiscard]] std::vector<StoreRecord> *get_store_journal() const noexcept { return m_store_journal; }
+    /// @brief reverts journaled stores, newest first
+    void undo_stores(std::span<const StoreRecord> journal);
+    /// @return current contents of every journaled location, in journal order
+    [[nodiscard]] std::vector<uint64_t> journaled_values(std::span<const StoreRecord> journal) const;
+    /// @return true if both journals wrote the same locations in the same order
+    /// and the locations now hold the same values
+    [[nodiscard]] static bool same_stores(const Memory &a, std::span<const StoreRecord> a_journal,
+                                          const Memory &b, std::span<const StoreRecord> b_journal);
+
     [[nodiscard]] std::string load_string(uint64_t address, MemErr &err) const;
 
-    void load_program(const asm_parsing::ParsedInstVec &instructions);
+    /// @brief appends host views of the guest range [address, address + size) to out, one per page,
+    /// for zero-copy I/O; the range must lie within one memory region
+    /// @param write the views will be written to
+    /// @return MemErr::SegFault if the range is not mapped (or not writable)
+    [[nodiscard]] MemErr host_spans(uint64_t address, size_t size, std::vector<std::span<uint8_t>> &out,
+                                    bool write);
+
+    /// @return number of bytes from the address to the end of its memory region, 0 if it is not mapped
+    [[nodiscard]] size_t mapped_size(uint64_t address) const noexcept;
+
+    /// @brief takes ownership of the instructions and encodes them straight into the data segment
+    void load_program(asm_parsing::ParsedInstVec instructions);
+
+    /// @brief loads a program whose bytecode was already assembled (e.g. from ProgramCache)
+    void load_program(asm_parsing::ParsedInstVec instructions, std::span<const uint8_t> bytecode);
+
+    /// Part of a linked executable (e.g. an ELF PT_LOAD segment)
+    struct ImageSegment {
+        uint64_t address;
+        std::span<const uint8_t> bytes;
+        uint64_t mem_size; ///< >= bytes.size(), the remainder is zero-filled
+    };
+
+    struct AddressRange {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    /// @brief loads a linked executable: copies the segments to their addresses in the data
+    /// segment (the heap starts after the last one) and decodes the machine code in the given
+    /// ranges (sorted, non-overlapping) into instructions
+    /// @return optional string with error message
+    [[nodiscard]] std::optional<std::string> load_image(std::span<const ImageSegment> segments,
+                                                        std::span<const AddressRange> code);
 
     // Return a copy of the instruction and optional source-line mapping.
     struct InstructionFetch {
@@ -67,8 +136,27 @@ public:
 
     [[nodiscard]] InstructionFetch get_instruction_at(uint64_t address, MemErr &err) const;
 
+    /// @brief finds the superinstructions of the loaded program (see rv64::fuse_program),
+    /// or drops them; a new program starts without
+    void set_fusion(bool enabled);
+
+    /// @return superinstruction starting at the address, nullptr if no idiom starts there
+    /// or fusion is off
+    [[nodiscard]] const rv64::FusedOp *get_fused_at(uint64_t address) const noexcept;
+
+    [[nodiscard]] uint64_t get_instruction_begin_addr() const noexcept;
+    /// @return size in bytes of the instruction starting at the address, 0 if none starts there
+    [[nodiscard]] size_t get_instruction_size(uint64_t address) const noexcept;
     [[nodiscard]] uint64_t get_instruction_end_addr() const;
 
+    static constexpr uint32_t NOT_AN_INSTRUCTION = UINT32_MAX;
+
+    /// @return dense index of the instruction starting at the address (0 for the first instruction
+    /// of the program), NOT_AN_INSTRUCTION if no instruction starts there
+    [[nodiscard]] uint32_t get_program_index(uint64_t address) const noexcept;
+    /// @return number of instructions of the loaded program
+    [[nodiscard]] size_t get_program_size() const noexcept;
+
     uint64_t sbrk(int64_t inc, MemErr &err);
     [[nodiscard]] uint64_t get_brk() const;
     [[nodiscard]] size_t get_data_size() const;
@@ -77,14 +165,40 @@ public:
     /// @return optional string with error message
     static std::optional<std::string> validate_layout(const Layout &layout);
 
+    /// @brief maps a whole host file at the guest address; loads read the host page cache directly,
+    /// stores fault (ReadOnly) or go to private page copies (CopyOnWrite)
+    /// @return optional string with error message
+    [[nodiscard]] std::optional<std::string> map_file(uint64_t address, const std::filesystem::path &path,
+                                                      FileMapping::Mode mode);
+    void unmap_files();
+
 private:
     [[nodiscard]] bool in_stack(uint64_t address, size_t obj_size = 0) const noexcept;
     [[nodiscard]] bool in_data(uint64_t address, size_t obj_size = 0) const noexcept;
     [[nodiscard]] uint64_t to_stack_offset(uint64_t address) const noexcept;
     [[nodiscard]] uint64_t to_data_offset(uint64_t address) const noexcept;
+    /// @brief accounts for code_size bytes of program at the start of the data segment
+    void reserve_program(size_t code_size);
+    /// @brief stores the instructions densely and builds the PC -> instruction index map
+    void index_program(asm_parsing::ParsedInstVec &&instructions, uint64_t code_base, size_t code_size);
     /// @brief Get address of stack end (exclusive upper bound)
     [[nodiscard]] uint64_t stack_end_addr() const noexcept;
 
+    struct MappedFile {
+        uint64_t address;
+        std::unique_ptr<FileMapping> mapping;
+    };
+
+    template<std::integral T>
+    [[nodiscard]] T load_unobserved(uint64_t address, MemErr &err) const;
+    template<std::integral T>
+    [[nodiscard]] MemErr store_unjournaled(uint64_t address, T value);
+    /// @brief appends the contents of [address, address + size) to the store journal
+    void journal_range(uint64_t address, size_t size);
+
+    /// @return file mapping containing [address, address + size), nullptr if none
+    [[nodiscard]] const MappedFile *find_mapped(uint64_t address, size_t size) const noexcept;
+
 private:
     Layout m_layout;
     uint64_t m_stack_bottom;
@@ -93,6 +207,19 @@ private:
 
     PagedMemory m_stack;
     PagedMemory m_data;
-
-    asm_parsing::ParsedInstVec m_instructions;
+    std::vector<MappedFile> m_mapped_files; ///< checked after the stack and data segment
+    std::vector<StoreRecord> *m_store_journal = nullptr;
+    rv64::CacheHierarchy *m_cache = nullptr;
+    rv64::TraceRecorder *m_trace = nullptr;
+
+    static constexpr uint32_t NO_LINE = UINT32_MAX;
+
+    // loaded program: one entry per instruction, no padding
+    uint64_t m_code_base = 0;
+    std::vector<Instruction> m_program;
+    std::vector<uint32_t> m_program_lines; ///< NO_LINE for code without source (e.g. ELF executables)
+    /// index into m_program for every halfword of code, NOT_AN_INSTRUCTION for the
+    /// upper half of 4-byte instructions
+    std::vector<uint32_t> m_pc_index;
+    rv64::FusedProgram m_fused; ///< empty unless set_fusion(true)
 };
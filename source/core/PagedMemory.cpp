@@ -81,6 +81,13 @@ uint8_t PagedMemory::read_byte(uint64_t addr) const noexcept {
     return m_page_table[page][addr % PageSize];
 }
 
+std::span<uint8_t> PagedMemory::page_span(uint64_t addr, size_t max_size) noexcept {
+    auto page = which_page_w_alloc(addr);
+    size_t offset = addr % PageSize;
+    size_t len = std::min({max_size, PageSize - offset, size() - addr});
+    return {m_page_table[page].get() + offset, len};
+}
+
 size_t PagedMemory::which_page(uint64_t addr) noexcept {
     return addr / PageSize;
 }
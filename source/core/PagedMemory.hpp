@@ -3,6 +3,7 @@
 #include <bit>
 #include <memory>
 #include <iterator>
+#include <span>
 
 class PagedMemory {
     static constexpr size_t PageSize = 4096; // Memory page size in bytes
@@ -75,6 +76,10 @@ public:
     /// @brief Read byte at address without allocating (returns 0 for unallocated)
     [[nodiscard]] uint8_t read_byte(uint64_t addr) const noexcept;
 
+    /// @brief Contiguous view of the bytes from addr up to the end of its page (allocates the page)
+    /// @param max_size upper bound of the view size
+    [[nodiscard]] std::span<uint8_t> page_span(uint64_t addr, size_t max_size) noexcept;
+
 private:
     /// @brief Calculate page index for address
     [[nodiscard]] static size_t which_page(uint64_t addr) noexcept;
@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "common.hpp"
+
+/// @brief Immutable, case-insensitive string -> V map built entirely at compile time.
+///
+/// The constructor searches for a hash seed that places every key in its own slot,
+/// so a lookup is a single hash + one key comparison, allocates nothing and the map
+/// needs no static initialization at startup. Keys must be lowercase and unique.
+///
+/// Usage:
+/// static constexpr PerfectHashMap<int, 2> map{{{{"one"sv, 1}, {"two"sv, 2}}}};
+/// const int *v = map.find("ONE"); // -> 1
+template<typename V, size_t N>
+class PerfectHashMap {
+    static_assert(N > 0 && N < std::numeric_limits<uint16_t>::max());
+    static_assert(std::is_trivially_copyable_v<V>);
+
+public:
+    using Entry = std::pair<std::string_view, V>;
+
+    /// Number of slots; sparse enough that a collision-free seed is found in a few tries
+    static constexpr size_t TABLE_SIZE = std::bit_ceil(N) * 16;
+
+    consteval explicit PerfectHashMap(const std::array<Entry, N> &entries) : m_entries(entries) {
+        for (const auto &[key, _]: m_entries) {
+            for (char c: key) {
+                if (c != ascii_tolower(c))
+                    throw "PerfectHashMap: keys must be lowercase";
+            }
+        }
+
+        constexpr uint64_t MAX_SEED_TRIES = 10'000;
+        for (uint64_t seed = 1; seed < MAX_SEED_TRIES; ++seed) {
+            if (try_seed(seed))
+                return;
+        }
+        throw "PerfectHashMap: no perfect seed found (duplicate keys?)";
+    }
+
+    /// @return pointer to the value or nullptr if the key is not present (case-insensitive)
+    [[nodiscard]] constexpr const V *find(std::string_view key) const noexcept {
+        auto idx = m_slots[slot_of(key, m_seed)];
+        if (idx == EMPTY)
+            return nullptr;
+
+        const auto &entry = m_entries[idx];
+        if (entry.first.size() != key.size())
+            return nullptr;
+        for (size_t i = 0; i < key.size(); ++i) {
+            if (entry.first[i] != ascii_tolower(key[i]))
+                return nullptr;
+        }
+        return &entry.second;
+    }
+
+    [[nodiscard]] constexpr bool contains(std::string_view key) const noexcept { return find(key) != nullptr; }
+
+    [[nodiscard]] constexpr const std::array<Entry, N> &entries() const noexcept { return m_entries; }
+
+    [[nodiscard]] static constexpr size_t size() noexcept { return N; }
+
+private:
+    static constexpr uint16_t EMPTY = std::numeric_limits<uint16_t>::max();
+
+    /// FNV-1a over the lowercased key, followed by a murmur3 finalizer
+    [[nodiscard]] static constexpr size_t slot_of(std::string_view key, uint64_t seed) noexcept {
+        uint64_t h = 0xcbf29ce484222325ull ^ (seed * 0x9e3779b97f4a7c15ull);
+        for (char c: key) {
+            h ^= static_cast<uint8_t>(ascii_tolower(c));
+            h *= 0x100000001b3ull;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return static_cast<size_t>(h & (TABLE_SIZE - 1));
+    }
+
+    constexpr bool try_seed(uint64_t seed) {
+        m_slots.fill(EMPTY);
+        for (size_t i = 0; i < N; ++i) {
+            auto slot = slot_of(m_entries[i].first, seed);
+            if (m_slots[slot] != EMPTY)
+                return false;
+            m_slots[slot] = static_cast<uint16_t>(i);
+        }
+        m_seed = seed;
+        return true;
+    }
+
+    std::array<Entry, N> m_entries;
+    std::array<uint16_t, TABLE_SIZE> m_slots{};
+    uint64_t m_seed = 0;
+};
@@ -0,0 +1,492 @@
+#include "ProgramCache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <fstream>
+#include <type_traits>
+
+#include "rv64/AssemblerUnit.hpp"
+#include "rv64/instruction_sets/Rv64IMC.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr std::array<char, 8> IMAGE_MAGIC{'R', 'V', '6', '4', 'P', 'R', 'G', '\0'};
+    constexpr std::string_view IMAGE_EXT = ".rv64c";
+
+    // Image layout (host endianness, every section 8-byte aligned):
+    // [ImageHeader][source][InstRecord x inst_count][SymbolRecord x symbol_count][names][bytecode]
+    // The source is compared on load, so a key collision is a miss rather than the wrong program.
+    struct ImageHeader {
+        std::array<char, 8> magic;
+        uint32_t version;
+        uint32_t host_endian;
+        uint64_t key;
+        uint64_t isa_fingerprint; // see AssemblerUnit::isa_fingerprint
+        uint64_t source_size;     // padded to 8 bytes in the image
+        uint64_t inst_count;
+        uint64_t symbol_count;
+        uint64_t names_size; // padded to 8 bytes
+        uint64_t code_size;
+    };
+
+    struct InstRecord {
+        uint64_t lineno;
+        int32_t proto_id;
+        std::array<uint8_t, 3> arg_kinds; // InstArg variant index
+        uint8_t reserved;
+        std::array<int64_t, 3> arg_values;
+    };
+
+    struct SymbolRecord {
+        uint64_t address;
+        uint32_t name_offset;
+        uint32_t name_size;
+        uint8_t defined;
+        std::array<uint8_t, 7> reserved;
+    };
+
+    static_assert(std::is_trivially_copyable_v<ImageHeader> && sizeof(ImageHeader) % 8 == 0);
+    static_assert(std::is_trivially_copyable_v<InstRecord> && sizeof(InstRecord) % 8 == 0);
+    static_assert(std::is_trivially_copyable_v<SymbolRecord> && sizeof(SymbolRecord) % 8 == 0);
+
+    constexpr size_t align8(size_t n) noexcept { return (n + 7) & ~size_t(7); }
+
+    constexpr uint64_t fnv1a(uint64_t hash, std::span<const uint8_t> bytes) noexcept {
+        for (uint8_t b: bytes) {
+            hash ^= b;
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    template<typename T>
+    uint64_t fnv1a_value(uint64_t hash, const T &value) noexcept {
+        return fnv1a(hash, {reinterpret_cast<const uint8_t *>(&value), sizeof(T)});
+    }
+
+    int64_t arg_value(const InstArg &arg) {
+        return std::visit([]<typename T>(const T &a) -> int64_t {
+            if constexpr (std::is_same_v<T, std::monostate>)
+                return 0;
+            else if constexpr (std::is_same_v<T, rv64::Reg>)
+                return a.idx();
+            else
+                return static_cast<int64_t>(a);
+        }, arg);
+    }
+
+    template<size_t I = 0>
+    InstArg make_arg(size_t kind, int64_t value) {
+        if constexpr (I == std::variant_size_v<InstArg>) {
+            return InstArg(std::in_place_index<0>);
+        } else {
+            if (kind != I)
+                return make_arg<I + 1>(kind, value);
+
+            using T = std::variant_alternative_t<I, InstArg>;
+            if constexpr (std::is_same_v<T, std::monostate>)
+                return InstArg(std::in_place_index<0>);
+            else if constexpr (std::is_same_v<T, rv64::Reg>)
+                return rv64::Reg(static_cast<int>(value));
+            else
+                return InstArg(std::in_place_index<I>, T(value));
+        }
+    }
+
+    [[nodiscard]] bool is_valid_record(const InstRecord &rec) {
+        if (!rv64::is::Rv64IMC::get_inst_proto(rec.proto_id).is_valid())
+            return false;
+
+        for (size_t i = 0; i < rec.arg_kinds.size(); ++i) {
+            if (rec.arg_kinds[i] >= std::variant_size_v<InstArg>)
+                return false;
+            if (rec.arg_kinds[i] == 1 && (rec.arg_values[i] < 0 || rec.arg_values[i] > 31))
+                return false; // rv64::Reg
+        }
+        return true;
+    }
+
+    /// @brief creates the directory (mode 0700) if asked and checks that only the current user can
+    /// write to it, so nobody else can plant images the simulator would load and run
+    [[nodiscard]] bool secure_directory(const fs::path &directory, bool create) {
+        std::error_code ec;
+#ifdef _WIN32
+        // the default directory is under the per-user LOCALAPPDATA
+        if (create)
+            fs::create_directories(directory, ec);
+        return fs::is_directory(directory, ec);
+#else
+        if (create) {
+            fs::create_directories(directory.parent_path(), ec);
+            if (::mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST)
+                return false;
+        }
+        struct stat st{};
+        if (::lstat(directory.c_str(), &st) != 0)
+            return false;
+        return S_ISDIR(st.st_mode) && st.st_uid == ::geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+    }
+
+    /// @brief creates an empty file with a unique name next to path
+    /// @return its path, nullopt on failure
+    [[nodiscard]] std::optional<fs::path> create_temp_file(const fs::path &path) {
+#ifdef _WIN32
+        static std::atomic<uint64_t> counter = 0;
+        auto tmp_path = path;
+        tmp_path += std::format(".{}.{}.tmp", GetCurrentProcessId(), counter++);
+        HANDLE file = CreateFileW(tmp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_NEW,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return std::nullopt;
+        CloseHandle(file);
+        return tmp_path;
+#else
+        std::string tmp_path = path.string() + ".tmp.XXXXXX";
+        int fd = ::mkstemp(tmp_path.data());
+        if (fd < 0)
+            return std::nullopt;
+        ::close(fd);
+        return fs::path(tmp_path);
+#endif
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Mapping
+// ---------------------------------------------------------------------------
+
+class CachedProgram::Mapping {
+public:
+    ~Mapping() {
+#ifdef _WIN32
+        if (m_data)
+            UnmapViewOfFile(m_data);
+#else
+        if (m_data)
+            munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+    }
+
+    /// @return mapping of the whole file or nullptr if it cannot be mapped
+    static std::unique_ptr<Mapping> open(const fs::path &path) {
+        auto mapping = std::unique_ptr<Mapping>(new Mapping());
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return nullptr;
+
+        LARGE_INTEGER size{};
+        HANDLE map = nullptr;
+        if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            map = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!map)
+            return nullptr;
+
+        void *view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(map); // the view keeps the mapping alive
+        if (!view)
+            return nullptr;
+
+        mapping->m_data = static_cast<const uint8_t *>(view);
+        mapping->m_size = static_cast<size_t>(size.QuadPart);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW);
+        if (fd < 0)
+            return nullptr;
+
+        struct stat st{};
+        void *addr = MAP_FAILED;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+            addr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping stays valid after close
+        if (addr == MAP_FAILED)
+            return nullptr;
+
+        mapping->m_data = static_cast<const uint8_t *>(addr);
+        mapping->m_size = static_cast<size_t>(st.st_size);
+#endif
+        return mapping;
+    }
+
+    [[nodiscard]] const ImageHeader &header() const noexcept {
+        return *reinterpret_cast<const ImageHeader *>(m_data);
+    }
+
+    [[nodiscard]] std::string_view source() const noexcept {
+        return {reinterpret_cast<const char *>(m_data + sizeof(ImageHeader)), header().source_size};
+    }
+
+    [[nodiscard]] std::span<const InstRecord> inst_records() const noexcept {
+        auto *begin = m_data + sizeof(ImageHeader) + align8(header().source_size);
+        return {reinterpret_cast<const InstRecord *>(begin), header().inst_count};
+    }
+
+    [[nodiscard]] std::span<const SymbolRecord> symbol_records() const noexcept {
+        auto *begin = reinterpret_cast<const SymbolRecord *>(inst_records().data() + header().inst_count);
+        return {begin, header().symbol_count};
+    }
+
+    [[nodiscard]] const char *names() const noexcept {
+        return reinterpret_cast<const char *>(symbol_records().data() + header().symbol_count);
+    }
+
+    [[nodiscard]] std::span<const uint8_t> code() const noexcept {
+        auto *begin = reinterpret_cast<const uint8_t *>(names()) + header().names_size;
+        return {begin, header().code_size};
+    }
+
+    /// @brief checks that the image is complete and was built from source by this instruction set
+    [[nodiscard]] bool validate(uint64_t key, std::string_view source) const {
+        if (m_size < sizeof(ImageHeader))
+            return false;
+
+        const auto &hdr = header();
+        if (hdr.magic != IMAGE_MAGIC || hdr.version != ProgramCache::FORMAT_VERSION
+            || hdr.host_endian != static_cast<uint32_t>(std::endian::native)
+            || hdr.key != key || hdr.isa_fingerprint != rv64::AssemblerUnit::isa_fingerprint()
+            || hdr.source_size != source.size())
+            return false;
+
+        // guard against overflow before summing section sizes
+        if (hdr.source_size > m_size || hdr.inst_count > m_size / sizeof(InstRecord)
+            || hdr.symbol_count > m_size / sizeof(SymbolRecord) || hdr.names_size > m_size
+            || hdr.code_size > m_size || hdr.names_size % 8 != 0)
+            return false;
+
+        uint64_t expected = sizeof(ImageHeader) + align8(hdr.source_size) + hdr.inst_count * sizeof(InstRecord)
+                            + hdr.symbol_count * sizeof(SymbolRecord) + hdr.names_size + hdr.code_size;
+        if (expected != m_size || this->source() != source)
+            return false;
+
+        for (const auto &sym: symbol_records()) {
+            if (uint64_t(sym.name_offset) + sym.name_size > hdr.names_size)
+                return false;
+        }
+        return std::ranges::all_of(inst_records(), is_valid_record);
+    }
+
+private:
+    Mapping() = default;
+
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// ---------------------------------------------------------------------------
+// CachedProgram
+// ---------------------------------------------------------------------------
+
+CachedProgram::CachedProgram(std::unique_ptr<Mapping> mapping) : m_mapping(std::move(mapping)) {}
+
+CachedProgram::CachedProgram(CachedProgram &&) noexcept = default;
+
+CachedProgram &CachedProgram::operator=(CachedProgram &&) noexcept = default;
+
+CachedProgram::~CachedProgram() = default;
+
+asm_parsing::ParsedInstVec CachedProgram::instructions() const {
+    asm_parsing::ParsedInstVec result;
+    result.reserve(instruction_count());
+
+    for (const auto &rec: m_mapping->inst_records()) {
+        std::array<InstArg, 3> args{};
+        for (size_t i = 0; i < args.size(); ++i)
+            args[i] = make_arg(rec.arg_kinds[i], rec.arg_values[i]);
+        result.push_back(asm_parsing::ParsedInst{rec.lineno, Instruction::create(rec.proto_id, args)});
+    }
+    return result;
+}
+
+std::span<const uint8_t> CachedProgram::bytecode() const noexcept {
+    return m_mapping->code();
+}
+
+std::vector<CachedProgram::SymbolView> CachedProgram::symbols() const {
+    std::vector<SymbolView> result;
+    result.reserve(m_mapping->header().symbol_count);
+
+    const char *names = m_mapping->names();
+    for (const auto &sym: m_mapping->symbol_records()) {
+        result.push_back(SymbolView{
+            .name = std::string_view(names + sym.name_offset, sym.name_size),
+            .address = sym.address,
+            .defined = sym.defined != 0
+        });
+    }
+    return result;
+}
+
+size_t CachedProgram::instruction_count() const noexcept {
+    return m_mapping->header().inst_count;
+}
+
+// ---------------------------------------------------------------------------
+// ProgramCache
+// ---------------------------------------------------------------------------
+
+ProgramCache::ProgramCache(fs::path directory) : m_directory(std::move(directory)) {}
+
+fs::path ProgramCache::default_directory() {
+#ifdef _WIN32
+    if (const char *local = std::getenv("LOCALAPPDATA"); local && *local)
+        return fs::path(local) / "rv64sim" / "cache";
+#else
+    // XDG base directory spec: relative paths are ignored
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg == '/')
+        return fs::path(xdg) / "rv64sim";
+    if (const char *home = std::getenv("HOME"); home && *home == '/')
+        return fs::path(home) / ".cache" / "rv64sim";
+#endif
+    std::error_code ec;
+    auto tmp = fs::temp_directory_path(ec);
+    if (ec)
+        tmp = fs::current_path(ec);
+#ifdef _WIN32
+    return tmp / "rv64sim-cache";
+#else
+    return tmp / std::format("rv64sim-cache-{}", ::geteuid());
+#endif
+}
+
+uint64_t ProgramCache::make_key(std::string_view source, uint64_t data_offset, std::endian endianness) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = fnv1a(hash, {reinterpret_cast<const uint8_t *>(source.data()), source.size()});
+    hash = fnv1a_value(hash, data_offset);
+    hash = fnv1a_value(hash, static_cast<uint32_t>(endianness));
+    hash = fnv1a_value(hash, FORMAT_VERSION);
+    hash = fnv1a_value(hash, rv64::AssemblerUnit::isa_fingerprint());
+    return hash;
+}
+
+std::optional<CachedProgram> ProgramCache::load(std::string_view source, uint64_t data_offset,
+                                                std::endian endianness) const {
+    if (!secure_directory(m_directory, false))
+        return std::nullopt;
+    auto key = make_key(source, data_offset, endianness);
+    auto mapping = CachedProgram::Mapping::open(path_for(key));
+    if (!mapping || !mapping->validate(key, source))
+        return std::nullopt;
+    return CachedProgram(std::move(mapping));
+}
+
+bool ProgramCache::store(std::string_view source, uint64_t data_offset, std::endian endianness,
+                         const asm_parsing::ParsedInstVec &instructions,
+                         const asm_parsing::SymbolTable &symbols) const {
+    auto bytecode = rv64::AssemblerUnit::assemble(instructions, endianness);
+
+    std::vector<InstRecord> inst_records;
+    inst_records.reserve(instructions.size());
+    for (const auto &pinst: instructions) {
+        InstRecord rec{.lineno = pinst.lineno, .proto_id = pinst.inst.get_prototype().id,
+                       .arg_kinds = {}, .reserved = 0, .arg_values = {}};
+        const auto &args = pinst.inst.get_args();
+        for (size_t i = 0; i < args.size(); ++i) {
+            rec.arg_kinds[i] = static_cast<uint8_t>(args[i].index());
+            rec.arg_values[i] = arg_value(args[i]);
+        }
+        inst_records.push_back(rec);
+    }
+
+    std::vector<SymbolRecord> sym_records;
+    std::string names;
+    sym_records.reserve(symbols.size());
+    for (const auto &sym: symbols.symbols()) {
+        sym_records.push_back(SymbolRecord{
+            .address = sym.address,
+            .name_offset = static_cast<uint32_t>(names.size()),
+            .name_size = static_cast<uint32_t>(sym.name.size()),
+            .defined = sym.defined,
+            .reserved = {}
+        });
+        names += sym.name;
+    }
+    names.resize(align8(names.size()), '\0');
+
+    ImageHeader header{
+        .magic = IMAGE_MAGIC,
+        .version = FORMAT_VERSION,
+        .host_endian = static_cast<uint32_t>(std::endian::native),
+        .key = make_key(source, data_offset, endianness),
+        .isa_fingerprint = rv64::AssemblerUnit::isa_fingerprint(),
+        .source_size = source.size(),
+        .inst_count = inst_records.size(),
+        .symbol_count = sym_records.size(),
+        .names_size = names.size(),
+        .code_size = bytecode.size()
+    };
+
+    if (!secure_directory(m_directory, true))
+        return false;
+
+    // write to a temporary file of its own first, so readers never map a partially written
+    // image and concurrent writers don't interleave
+    auto path = path_for(header.key);
+    auto tmp = create_temp_file(path);
+    if (!tmp)
+        return false;
+    const auto &tmp_path = *tmp;
+    std::error_code ec;
+    {
+        std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            fs::remove(tmp_path, ec);
+            return false;
+        }
+        constexpr std::array<char, 8> padding{};
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(source.data(), static_cast<std::streamsize>(source.size()));
+        out.write(padding.data(), static_cast<std::streamsize>(align8(source.size()) - source.size()));
+        out.write(reinterpret_cast<const char *>(inst_records.data()),
+                  static_cast<std::streamsize>(inst_records.size() * sizeof(InstRecord)));
+        out.write(reinterpret_cast<const char *>(sym_records.data()),
+                  static_cast<std::streamsize>(sym_records.size() * sizeof(SymbolRecord)));
+        out.write(names.data(), static_cast<std::streamsize>(names.size()));
+        out.write(reinterpret_cast<const char *>(bytecode.data()), static_cast<std::streamsize>(bytecode.size()));
+        if (!out) {
+            out.close();
+            fs::remove(tmp_path, ec);
+            return false;
+        }
+    }
+
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        fs::remove(tmp_path, ec);
+        return false;
+    }
+    return true;
+}
+
+void ProgramCache::clear() const {
+    std::error_code ec;
+    if (!secure_directory(m_directory, false))
+        return;
+    for (const auto &entry: fs::directory_iterator(m_directory, ec)) {
+        // images and the temporary files of interrupted stores
+        if (entry.path().extension() == IMAGE_EXT || entry.path().filename().string().find(".tmp") != std::string::npos)
+            fs::remove(entry.path(), ec);
+    }
+}
+
+fs::path ProgramCache::path_for(uint64_t key) const {
+    return m_directory / std::format("{:016x}{}", key, IMAGE_EXT);
+}
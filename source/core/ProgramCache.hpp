@@ -0,0 +1,88 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "parser/asm_parsing.hpp"
+
+/// @brief Read-only view of a precompiled program image.
+/// The image is memory-mapped; instruction records, symbol names and bytecode are
+/// read directly from the mapping and stay valid for the lifetime of this object.
+class CachedProgram {
+public:
+    struct SymbolView {
+        std::string_view name;
+        uint64_t address;
+        bool defined;
+    };
+
+    CachedProgram(CachedProgram &&) noexcept;
+    CachedProgram &operator=(CachedProgram &&) noexcept;
+    ~CachedProgram();
+
+    /// @return decoded instructions with their source lines
+    [[nodiscard]] asm_parsing::ParsedInstVec instructions() const;
+
+    /// @return assembled machine code, ready to be copied into the data segment
+    [[nodiscard]] std::span<const uint8_t> bytecode() const noexcept;
+
+    [[nodiscard]] std::vector<SymbolView> symbols() const;
+
+    [[nodiscard]] size_t instruction_count() const noexcept;
+
+private:
+    friend class ProgramCache;
+    class Mapping;
+
+    explicit CachedProgram(std::unique_ptr<Mapping> mapping);
+
+    std::unique_ptr<Mapping> m_mapping;
+};
+
+/// @brief On-disk cache of assembled programs.
+/// Entries are keyed by a hash of the source text and everything that affects the
+/// resolved program (data offset, endianness, image format version and the instruction set
+/// fingerprint), so a hit skips parsing, symbol resolution and assembly entirely. Images also
+/// hold the source, which is compared on load, so a hash collision is a miss.
+/// The directory must be owned by the current user and not writable by others (images are
+/// executed as they are); otherwise the cache is disabled.
+class ProgramCache {
+public:
+    /// Bump whenever the image layout changes (encodings are covered by the ISA fingerprint)
+    static constexpr uint32_t FORMAT_VERSION = 3;
+
+    /// @param directory where cache images are stored; created with mode 0700 on first store()
+    explicit ProgramCache(std::filesystem::path directory = default_directory());
+
+    /// @return per-user cache directory: $XDG_CACHE_HOME/rv64sim, ~/.cache/rv64sim or
+    /// %LOCALAPPDATA%/rv64sim/cache, falling back to <system temp dir>/rv64sim-cache-<uid>
+    [[nodiscard]] static std::filesystem::path default_directory();
+
+    [[nodiscard]] static uint64_t make_key(std::string_view source, uint64_t data_offset, std::endian endianness);
+
+    /// @return mapped image or nullopt on miss (also for stale, corrupted or colliding images, and
+    /// when the directory is not private to the current user)
+    [[nodiscard]] std::optional<CachedProgram> load(std::string_view source, uint64_t data_offset,
+                                                    std::endian endianness) const;
+
+    /// @brief writes a program image for the given source
+    /// @return true if the image was written
+    bool store(std::string_view source, uint64_t data_offset, std::endian endianness,
+               const asm_parsing::ParsedInstVec &instructions,
+               const asm_parsing::SymbolTable &symbols) const;
+
+    /// @brief removes all cache images from the directory
+    void clear() const;
+
+    [[nodiscard]] const std::filesystem::path &directory() const noexcept { return m_directory; }
+
+private:
+    [[nodiscard]] std::filesystem::path path_for(uint64_t key) const;
+
+    std::filesystem::path m_directory;
+};
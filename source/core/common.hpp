@@ -1,5 +1,6 @@
 #pragma once
 #include <algorithm>
+#include <array>
 #include <cmath>
 #include <cstdint>
 #include <iostream>
@@ -26,6 +27,41 @@ inline std::string to_lowercase(std::string_view str) {
     return result;
 }
 
+[[nodiscard]] constexpr char ascii_tolower(char c) noexcept {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+/// @brief Fixed-capacity string stored inline (no heap allocation).
+/// Input longer than the capacity is truncated; assign reports it so callers can reject it.
+template<size_t N>
+class SmallString {
+    static_assert(N > 0 && N <= UINT8_MAX);
+
+public:
+    constexpr SmallString() noexcept = default;
+    constexpr explicit SmallString(std::string_view str, bool lowercase = false) noexcept { assign(str, lowercase); }
+
+    /// @return false if str did not fit and was truncated
+    constexpr bool assign(std::string_view str, bool lowercase = false) noexcept {
+        m_size = static_cast<uint8_t>(std::min(str.size(), N));
+        for (size_t i = 0; i < m_size; ++i)
+            m_data[i] = lowercase ? ascii_tolower(str[i]) : str[i];
+        return str.size() <= N;
+    }
+
+    constexpr void clear() noexcept { m_size = 0; }
+
+    [[nodiscard]] constexpr std::string_view view() const noexcept { return {m_data.data(), m_size}; }
+    [[nodiscard]] constexpr size_t size() const noexcept { return m_size; }
+    [[nodiscard]] constexpr bool empty() const noexcept { return m_size == 0; }
+
+    constexpr bool operator==(std::string_view other) const noexcept { return view() == other; }
+
+private:
+    std::array<char, N> m_data{};
+    uint8_t m_size = 0;
+};
+
 // Helpers for instantiating templates for all integer types
 // Use like this:
 // MY_TEMPLATE_INSTANTIATION_MACRO(type) { template ... }
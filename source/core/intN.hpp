@@ -2,6 +2,7 @@
 #include <cstdint>
 #include <bit>
 #include <concepts>
+#include <type_traits>
 
 namespace helper {
     template<std::integral T = int64_t>
@@ -14,6 +15,9 @@ template<size_t NBits>
 struct intN {
     static_assert(NBits < 64);
 
+    /// narrowest type holding NBits; keeps InstArg (and so Instruction) small
+    using storage_type = std::conditional_t<(NBits <= 32), int32_t, int64_t>;
+
     constexpr intN(int64_t v); // NOLINT(*-explicit-constructor)
 
     constexpr operator int64_t() const; // NOLINT(*-explicit-constructor)
@@ -28,43 +32,43 @@ struct intN {
     static constexpr int64_t MIN = -helper::_2sqr_n(NBits - 1);
 
 private:
-    int64_t m_val;
+    storage_type m_val;
 };
 
 template<size_t NBits>
-constexpr intN<NBits>::intN(int64_t v): m_val(v) {
+constexpr intN<NBits>::intN(int64_t v): m_val(static_cast<storage_type>(v)) {
     if (!(v & helper::_2sqr_n(NBits - 1))) return;
-    m_val = INT64_C(-1) << NBits;
-    m_val |= v;
+    m_val = static_cast<storage_type>((INT64_C(-1) << NBits) | v);
 }
 
 template<size_t NBits>
 constexpr intN<NBits>::operator int64_t() const {
-    return std::bit_cast<int64_t>(m_val);
+    return m_val;
 }
 
 template<size_t NBits>
 constexpr intN<NBits>::operator int32_t() const {
-    return std::bit_cast<int64_t>(m_val);
+    return static_cast<int32_t>(m_val);
 }
 
 template<size_t NBits>
 constexpr int32_t intN<NBits>::as_i32() const {
-    return std::bit_cast<int64_t>(m_val);
+    return static_cast<int32_t>(m_val);
 }
 
 template<size_t NBits>
 constexpr uint64_t intN<NBits>::zero_extended() const {
-    return m_val & (helper::_2sqr_n(NBits) - 1);
+    return static_cast<int64_t>(m_val) & (helper::_2sqr_n(NBits) - 1);
 }
 
 template<size_t NBits>
 struct uintN {
     static_assert(NBits < 64);
 
-    uintN(uint64_t v) : m_val(v) { // NOLINT(*-explicit-constructor)
-        m_val &= (helper::_2sqr_n(NBits) - 1);
-    }
+    using storage_type = std::conditional_t<(NBits <= 32), uint32_t, uint64_t>;
+
+    uintN(uint64_t v) // NOLINT(*-explicit-constructor)
+        : m_val(static_cast<storage_type>(v & (helper::_2sqr_n(NBits) - 1))) {}
 
     constexpr operator uint64_t() const { // NOLINT(*-explicit-constructor)
         return m_val & (helper::_2sqr_n(NBits) - 1);
@@ -74,5 +78,5 @@ struct uintN {
     static constexpr uint64_t MIN = 0;
 
 private:
-    uint64_t m_val = 0;
+    storage_type m_val = 0;
 };
@@ -1,66 +1,375 @@
+#include <algorithm>
+#include <atomic>
 #include <format>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <thread>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <cstdint>
+#include <rv64/Lockstep.hpp>
+#include <rv64/Sampling.hpp>
+#include <rv64/Trace.hpp>
 #include <rv64/VM.hpp>
+#include <ProgramCache.hpp>
 
-int main() {
-    rv64::VM vm{};
+namespace {
+    enum class Mode {
+        Interactive, ///< assembly from stdin, executed step by step with the line trace
+        Run,         ///< ELF executable run to completion
+        Lockstep,    ///< block engine checked against the Interpreter, one ELF executable per core
+        Trace,       ///< execution of an ELF executable recorded to a binary trace
+        DecodeTrace, ///< trace decoded to text or CSV
+        Profile,     ///< hot-spot report
+        Mix,         ///< instruction mix (JSON)
+        Cache,       ///< cache statistics
+        Branches,    ///< branch prediction statistics
+        Pipeline,    ///< pipeline timing on top of the default cache and branch models
+        Sample       ///< pipeline totals estimated from periodic detailed windows
+    };
+
+    struct Options {
+        Mode mode = Mode::Interactive;
+        std::vector<std::string> paths; ///< ELF executables, or the trace of Mode::DecodeTrace
+        std::string trace_path;         ///< output of Mode::Trace
+        std::optional<rv64::PredictorKind> predictor;
+        rv64::TraceFilter filter;
+        rv64::TraceOutput trace_format = rv64::TraceOutput::Text;
+    };
+
+    constexpr std::string_view USAGE = R"(Usage:
+  rv64sim < program.s                       step through an assembly program
+  rv64sim <elf>                             run an ELF executable
+  rv64sim --lockstep <elf>...               check the fused and block engines against the Interpreter
+  rv64sim --trace=<file> <elf>              record the execution to a binary trace
+  rv64sim --decode-trace <file> [--csv] [--pc=<begin>:<end>] [--line=<n>] [--reg=<name>]
+  rv64sim --profile <elf>                   hot-spot report
+  rv64sim --mix <elf>                       instruction mix (JSON)
+  rv64sim --cache <elf>                     cache statistics
+  rv64sim --branches[=<predictor>] <elf>    branch prediction (static, bimodal, gshare or tage)
+  rv64sim --pipeline <elf>                  pipeline timing with the cache and branch models
+  rv64sim --sample <elf>                    pipeline totals estimated from sampled windows
+)";
+
+    /// @return optional string with error message
+    std::optional<std::string> parse_trace_filter(std::span<const std::string_view> args, Options &opt) {
+        try {
+            for (auto arg: args) {
+                auto value = std::string(arg.substr(std::min(arg.find('=') + 1, arg.size())));
+                if (arg == "--csv") {
+                    opt.trace_format = rv64::TraceOutput::Csv;
+                } else if (arg.starts_with("--pc=") && value.find(':') != std::string::npos) {
+                    opt.filter.pc_begin = std::stoull(value.substr(0, value.find(':')), nullptr, 0);
+                    opt.filter.pc_end = std::stoull(value.substr(value.find(':') + 1), nullptr, 0);
+                } else if (arg.starts_with("--line=")) {
+                    opt.filter.line = std::stoull(value);
+                } else if (arg.starts_with("--reg=") && rv64::Reg(value)) {
+                    opt.filter.reg = static_cast<uint8_t>(rv64::Reg(value).idx());
+                } else {
+                    return std::format("invalid option {}", arg);
+                }
+            }
+        } catch (const std::exception &) {
+            return std::string("invalid number in the trace filter");
+        }
+        return std::nullopt;
+    }
+
+    /// @return optional string with error message
+    std::optional<std::string> parse_options(int argc, char **argv, Options &opt) {
+        static const std::unordered_map<std::string_view, Mode> modes{
+            {"--lockstep", Mode::Lockstep}, {"--trace", Mode::Trace}, {"--decode-trace", Mode::DecodeTrace},
+            {"--profile", Mode::Profile}, {"--mix", Mode::Mix}, {"--cache", Mode::Cache},
+            {"--branches", Mode::Branches}, {"--pipeline", Mode::Pipeline}, {"--sample", Mode::Sample}
+        };
+        std::vector<std::string_view> args(argv + 1, argv + argc);
+        if (args.empty())
+            return std::nullopt;
+
+        std::string_view first = args.front();
+        std::span<const std::string_view> rest(args.begin() + 1, args.end());
+        if (!first.starts_with("--")) {
+            if (!rest.empty())
+                return std::string("expected a single ELF executable");
+            opt.mode = Mode::Run;
+            opt.paths.emplace_back(first);
+            return std::nullopt;
+        }
+
+        auto eq = first.find('=');
+        auto it = modes.find(first.substr(0, eq));
+        if (it == modes.end())
+            return std::format("unknown option {}", first);
+        opt.mode = it->second;
+        std::string_view value = eq == std::string_view::npos ? "" : first.substr(eq + 1);
+        if (opt.mode == Mode::Trace) {
+            if (value.empty())
+                return std::string("--trace needs the output file: --trace=<file>");
+            opt.trace_path = value;
+        } else if (opt.mode == Mode::Branches && eq != std::string_view::npos) {
+            opt.predictor = rv64::predictor_kind_from_name(value);
+            if (!opt.predictor)
+                return std::string("unknown branch predictor");
+        } else if (eq != std::string_view::npos) {
+            return std::format("{} takes no value", it->first);
+        }
+
+        if (rest.empty())
+            return std::format("{} needs a file", it->first);
+        if (opt.mode == Mode::DecodeTrace) {
+            opt.paths.emplace_back(rest.front());
+            return parse_trace_filter(rest.subspan(1), opt);
+        }
+        if (opt.mode != Mode::Lockstep && rest.size() > 1)
+            return std::format("{} takes a single ELF executable", it->first);
+        opt.paths.assign(rest.begin(), rest.end());
+        return std::nullopt;
+    }
+
+    int exit_code(const rv64::VM &vm) {
+        return vm.get_state() == rv64::VMState::Error || vm.get_state() == rv64::VMState::LimitExceeded ? 1 : 0;
+    }
+
+    /// @return false (after printing the error) if the executable could not be loaded
+    bool load(rv64::VM &vm, const std::string &path) {
+        if (auto err = vm.load_elf(path)) {
+            std::cerr << "Error: " << *err << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief checks the fused Interpreter and the block engine against the plain Interpreter
+    /// @return "ok" or what went wrong
+    std::string check_lockstep(const std::string &path) {
+        rv64::VMConfig plain{};
+        plain.m_rng_seed = 0;
+        plain.m_engine = rv64::ExecEngine::Interpreter;
+        plain.m_fuse_instructions = false;
+        rv64::VMConfig fused = plain, blocks = plain;
+        fused.m_fuse_instructions = true;
+        blocks.m_engine = rv64::ExecEngine::Blocks;
+
+        std::string report;
+        for (const auto &[name, config]: {std::pair{"fused", fused}, std::pair{"blocks", blocks}}) {
+            auto reference = std::make_unique<rv64::VM>(plain);
+            auto candidate = std::make_unique<rv64::VM>(config);
+            for (auto *vm: {reference.get(), candidate.get()}) {
+                if (auto err = vm->load_elf(path))
+                    return "error: " + *err;
+            }
+            if (auto divergence = rv64::run_lockstep(*reference, *candidate))
+                report += std::format("{}{}: {}", report.empty() ? "" : "; ", name, divergence->to_string());
+        }
+        return report.empty() ? "ok" : report;
+    }
 
-    std::vector<std::string> lines;
-    std::string whole_input;
-    std::string line;
+    int run_lockstep_mode(const std::vector<std::string> &paths) {
+        std::vector<std::string> reports(paths.size());
+        std::atomic<size_t> next = 0;
+        {
+            std::vector<std::jthread> workers;
+            size_t thread_cnt = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, paths.size());
+            for (size_t t = 0; t < thread_cnt; t++) {
+                workers.emplace_back([&] {
+                    for (size_t i; (i = next++) < paths.size();)
+                        reports[i] = check_lockstep(paths[i]);
+                });
+            }
+        }
+        bool all_ok = true;
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::cout << paths[i] << ": " << reports[i] << '\n';
+            all_ok &= reports[i] == "ok";
+        }
+        return all_ok ? 0 : 1;
+    }
 
-    while (std::getline(std::cin, line)) {
-        whole_input.append(line + '\n');
-        lines.push_back(line);
+    int run_trace_mode(const Options &opt) {
+        rv64::VMConfig config{};
+        config.m_trace = rv64::TraceRecorder::Config{.path = opt.trace_path};
+        rv64::VM vm{config};
+        if (!load(vm, opt.paths.front()) || !vm.m_trace_recorder.is_open())
+            return 1;
+        vm.run_until_stop();
+        uint64_t records = vm.m_trace_recorder.record_count(), bytes = vm.m_trace_recorder.byte_count();
+        if (auto err = vm.m_trace_recorder.close()) {
+            std::cerr << "Error: " << *err << '\n';
+            return 1;
+        }
+        std::cout << std::format("{} instructions traced in {} bytes ({:.2f} bytes per instruction)\n", records,
+                                 bytes, records ? double(bytes) / double(records) : 0.0);
+        return exit_code(vm);
     }
 
-    if (lines.empty()) {
+    int run_decode_trace_mode(const Options &opt) {
+        if (auto err = rv64::decode_trace(opt.paths.front(), std::cout, opt.trace_format, opt.filter)) {
+            std::cerr << "Error: " << *err << '\n';
+            return 1;
+        }
         return 0;
     }
-    lines.emplace_back(" ");
 
-    // Parse and resolve in one step
-    asm_parsing::ParsedInstVec inst_vec;
-    int result = asm_parsing::parse_and_resolve(whole_input, inst_vec, vm.m_cpu.get_pc());
-    if (result != 0) {
-        std::cerr << "Error: Failed to process assembly code (error code " << result << ")\n";
-        return 1;
+    /// @brief runs the executable of opt with config, then prints its report
+    template<typename Report>
+    int run_report_mode(const Options &opt, const rv64::VMConfig &config, Report report) {
+        rv64::VM vm{config};
+        if (!load(vm, opt.paths.front()))
+            return 1;
+        vm.run_until_stop();
+        report(vm);
+        return exit_code(vm);
     }
-    vm.load_program(inst_vec);
 
-    auto print_separator = [](bool nl_before = false) {
-        std::cout << (nl_before ? "\n\n" : "")
-                << "\033[0;32m----------------------------------------------"
-                "--------------------------------------------------\033[0m\n";
-    };
+    int run_profile_mode(const Options &opt) {
+        rv64::VMConfig config{};
+        config.m_profile = true;
+        return run_report_mode(opt, config, [](rv64::VM &vm) { std::cout << vm.m_profiler.report(vm); });
+    }
 
-    auto print_lines = [&](int64_t current_lineno) {
-        for (size_t i = 0; i < lines.size(); i++) {
-            bool is_current = (i == current_lineno - 1);
-            std::cout << (is_current ? "\033[0;34m> \033[7m" : "  ")
-                    << std::format("{:<92}", lines.at(i)) << "\033[0m\n";
+    int run_mix_mode(const Options &opt) {
+        rv64::VMConfig config{};
+        config.m_instruction_mix = true;
+        return run_report_mode(opt, config, [](rv64::VM &vm) { std::cout << vm.m_instruction_mix.to_json(); });
+    }
+
+    int run_cache_mode(const Options &opt) {
+        rv64::VMConfig config{};
+        config.m_cache_model = rv64::CacheHierarchy::Config{};
+        return run_report_mode(opt, config, [](rv64::VM &vm) { std::cout << vm.m_cache_model->report(vm); });
+    }
+
+    int run_branches_mode(const Options &opt) {
+        rv64::VMConfig config{};
+        config.m_branch_model = rv64::BranchModel::Config{};
+        if (opt.predictor)
+            config.m_branch_model->predictor = *opt.predictor;
+        return run_report_mode(opt, config, [](rv64::VM &vm) { std::cout << vm.m_branch_model->report(vm); });
+    }
+
+    rv64::VMConfig pipeline_config() {
+        rv64::VMConfig config{};
+        config.m_cache_model = rv64::CacheHierarchy::Config{};
+        config.m_branch_model = rv64::BranchModel::Config{};
+        config.m_pipeline_model = rv64::PipelineModel::Config{};
+        return config;
+    }
+
+    int run_pipeline_mode(const Options &opt) {
+        return run_report_mode(opt, pipeline_config(),
+                               [](rv64::VM &vm) { std::cout << vm.m_pipeline_model->report(vm); });
+    }
+
+    int run_sample_mode(const Options &opt) {
+        rv64::VM vm{pipeline_config()};
+        if (!load(vm, opt.paths.front()))
+            return 1;
+        std::cout << rv64::run_sampled(vm, rv64::SamplingConfig{}).report();
+        return exit_code(vm);
+    }
+
+    // An ELF executable given on the command line runs to completion without the line trace
+    int run_elf_mode(const Options &opt) {
+        rv64::VM vm{};
+        if (!load(vm, opt.paths.front()))
+            return 1;
+        vm.run_until_stop();
+        vm.m_cpu.print_cpu_state();
+        return exit_code(vm);
+    }
+
+    int run_interactive_mode() {
+        rv64::VM vm{};
+
+        std::vector<std::string> lines;
+        std::string whole_input;
+        std::string line;
+
+        while (std::getline(std::cin, line)) {
+            whole_input.append(line + '\n');
+            lines.push_back(line);
         }
-    };
 
-    print_separator(true);
-    print_lines(1);
-    print_separator();
-    vm.m_cpu.print_cpu_state();
+        if (lines.empty()) {
+            return 0;
+        }
+        lines.emplace_back(" ");
+
+        // Reuse the precompiled image if this exact source was built before
+        ProgramCache cache;
+        uint64_t data_offset = vm.m_cpu.get_pc();
+        std::endian endianness = vm.get_memory_layout().endianness;
+        if (auto cached = cache.load(whole_input, data_offset, endianness)) {
+            vm.load_program(cached->instructions(), cached->bytecode());
+        } else {
+            auto parsed = asm_parsing::parse(whole_input);
+            asm_parsing::ParsedInstVec inst_vec;
+            int result = parsed.error_code != 0 ? 1 : std::move(parsed).resolve_instructions(inst_vec, data_offset);
+            if (result != 0) {
+                std::cerr << "Error: Failed to process assembly code (error code " << result << ")\n";
+                return 1;
+            }
+            cache.store(whole_input, data_offset, endianness, inst_vec, parsed.symbol_table);
+            vm.load_program(std::move(inst_vec));
+        }
+
+        auto print_separator = [](bool nl_before = false) {
+            std::cout << (nl_before ? "\n\n" : "")
+                    << "\033[0;32m----------------------------------------------"
+                    "--------------------------------------------------\033[0m\n";
+        };
+
+        auto print_lines = [&](int64_t current_lineno) {
+            for (size_t i = 0; i < lines.size(); i++) {
+                bool is_current = (i == current_lineno - 1);
+                std::cout << (is_current ? "\033[0;34m> \033[7m" : "  ")
+                        << std::format("{:<92}", lines.at(i)) << "\033[0m\n";
+            }
+        };
 
-    auto current_lineno = (int64_t)vm.get_current_line();
-    while (vm.get_state() != rv64::VMState::Error &&
-           vm.get_state() != rv64::VMState::Finished) {
-        vm.run_step();
-        current_lineno = vm.get_current_line();
         print_separator(true);
-        print_lines(current_lineno);
+        print_lines(1);
         print_separator();
         vm.m_cpu.print_cpu_state();
+
+        auto current_lineno = (int64_t)vm.get_current_line();
+        while (vm.get_state() != rv64::VMState::Error &&
+               vm.get_state() != rv64::VMState::Finished &&
+               vm.get_state() != rv64::VMState::LimitExceeded) {
+            vm.run_step();
+            current_lineno = vm.get_current_line();
+            print_separator(true);
+            print_lines(current_lineno);
+            print_separator();
+            vm.m_cpu.print_cpu_state();
+        }
+
+        return 0;
     }
+}
 
-    return 0;
+int main(int argc, char **argv) {
+    Options opt;
+    if (auto err = parse_options(argc, argv, opt)) {
+        std::cerr << "Error: " << *err << "\n\n" << USAGE;
+        return 1;
+    }
+    switch (opt.mode) {
+        case Mode::Interactive: return run_interactive_mode();
+        case Mode::Run: return run_elf_mode(opt);
+        case Mode::Lockstep: return run_lockstep_mode(opt.paths);
+        case Mode::Trace: return run_trace_mode(opt);
+        case Mode::DecodeTrace: return run_decode_trace_mode(opt);
+        case Mode::Profile: return run_profile_mode(opt);
+        case Mode::Mix: return run_mix_mode(opt);
+        case Mode::Cache: return run_cache_mode(opt);
+        case Mode::Branches: return run_branches_mode(opt);
+        case Mode::Pipeline: return run_pipeline_mode(opt);
+        case Mode::Sample: return run_sample_mode(opt);
+    }
+    return 1;
 }
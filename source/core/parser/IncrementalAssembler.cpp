@@ -0,0 +1,248 @@
+#include "IncrementalAssembler.hpp"
+#include <algorithm>
+
+namespace {
+    std::vector<std::string_view> split_lines(std::string_view source) {
+        std::vector<std::string_view> lines;
+        lines.reserve(std::ranges::count(source, '\n') + 1);
+        size_t start = 0;
+        while (true) {
+            size_t end = source.find('\n', start);
+            if (end == std::string_view::npos) {
+                lines.push_back(source.substr(start));
+                return lines;
+            }
+            lines.push_back(source.substr(start, end - start));
+            start = end + 1;
+        }
+    }
+}
+
+namespace asm_parsing {
+    int IncrementalAssembler::assemble(std::string_view source, ParsedInstVec &out_instructions,
+                                       std::stop_token stop) {
+        auto new_lines = split_lines(source);
+
+        // unchanged prefix and suffix keep their parse results
+        size_t max_common = std::min(new_lines.size(), m_lines.size());
+        size_t prefix = 0;
+        while (prefix < max_common && m_lines[prefix].text == new_lines[prefix])
+            ++prefix;
+        size_t suffix = 0;
+        while (suffix < max_common - prefix
+               && m_lines[m_lines.size() - 1 - suffix].text == new_lines[new_lines.size() - 1 - suffix])
+            ++suffix;
+
+        // re-parse the changed region in chunks (one parser run each), falling back to
+        // line-by-line parsing for chunks with syntax errors so every error gets reported
+        std::vector<Line> changed;
+        changed.reserve(new_lines.size() - prefix - suffix);
+        for (size_t begin = prefix; begin < new_lines.size() - suffix; begin += PARSE_CHUNK_LINES) {
+            if (stop.stop_requested())
+                return CANCELLED;
+
+            size_t end = std::min(begin + PARSE_CHUNK_LINES, new_lines.size() - suffix);
+            auto texts = std::span(new_lines).subspan(begin, end - begin);
+            size_t chunk_start = changed.size();
+            if (!parse_chunk(texts, begin + 1, changed)) {
+                changed.resize(chunk_start);
+                for (size_t i = begin; i < end; ++i)
+                    changed.push_back(parse_line(new_lines[i], i + 1));
+            }
+        }
+
+        auto first = m_lines.begin() + static_cast<ptrdiff_t>(prefix);
+        auto last = m_lines.end() - static_cast<ptrdiff_t>(suffix);
+        first = m_lines.erase(first, last);
+        m_lines.insert(first, std::make_move_iterator(changed.begin()), std::make_move_iterator(changed.end()));
+
+        m_stats = Stats{.lines = m_lines.size(), .reparsed_lines = changed.size(), .resolved_instructions = 0};
+        m_diagnostics.clear();
+
+        // syntax errors fail the build before layout, like parse_and_resolve()
+        for (size_t i = 0; i < m_lines.size(); ++i) {
+            if (m_lines[i].syntax_error) {
+                m_diagnostics.push_back(BuildError{
+                    .kind = BuildErrorKind::SyntaxError,
+                    .message = *m_lines[i].syntax_error,
+                    .line = i + 1
+                });
+            }
+        }
+        if (!m_diagnostics.empty())
+            return 1;
+
+        // layout: line start addresses and label definitions
+        m_symbols.clear_definitions();
+        m_line_pc.resize(m_lines.size());
+        uint64_t pc = 0;
+        for (size_t i = 0; i < m_lines.size(); ++i) {
+            const auto &line = m_lines[i];
+            m_line_pc[i] = pc;
+            if (line.label) {
+                if (auto err = m_symbols.define(*line.label, pc + line.label_offset)) {
+                    err->line = i + 1;
+                    m_diagnostics.push_back(std::move(*err));
+                }
+            }
+            pc += line.byte_size;
+        }
+        // duplicate labels fail the build like a parse error, as in parse_and_resolve()
+        if (!m_diagnostics.empty())
+            return 1;
+
+        int result = 0;
+        auto &out = out_instructions;
+        size_t out_base = out.size();
+        out.reserve(out_base + m_lines.size());
+        for (size_t i = 0; i < m_lines.size(); ++i) {
+            auto &line = m_lines[i];
+            if (!line.builder)
+                continue;
+
+            if (needs_resolve(line, m_line_pc[i])) {
+                resolve_line(line, m_line_pc[i]);
+                ++m_stats.resolved_instructions;
+            }
+
+            if (line.error) {
+                auto err = *line.error;
+                err.line = i + 1;
+                m_diagnostics.push_back(std::move(err));
+                if (result == 0)
+                    result = line.error_code;
+                continue;
+            }
+            if (result != 0)
+                continue;
+
+            out.push_back(ParsedInst{i + 1, *line.inst});
+        }
+
+        if (result != 0)
+            out.resize(out_base);
+        return result;
+    }
+
+    void IncrementalAssembler::reset() {
+        m_lines.clear();
+        m_line_pc.clear();
+        m_symbols.clear();
+        m_diagnostics.clear();
+        m_stats = {};
+    }
+
+    bool IncrementalAssembler::parse_chunk(std::span<const std::string_view> texts, size_t first_lineno,
+                                           std::vector<Line> &out) {
+        std::string chunk;
+        for (auto text: texts) {
+            chunk.append(text);
+            chunk.push_back('\n');
+        }
+        if (!chunk.empty())
+            chunk.pop_back();
+
+        auto result = parse(chunk, first_lineno, false);
+        if (result.error_code != 0)
+            return false;
+
+        size_t base = out.size();
+        for (auto text: texts)
+            out.emplace_back().text = text;
+        auto lines = std::span(out).subspan(base);
+
+        // move the chunk's symbols into the shared table
+        auto local_symbols = result.symbol_table.symbols();
+        std::vector<SymbolId> ids(local_symbols.size());
+        for (size_t i = 0; i < local_symbols.size(); ++i)
+            ids[i] = m_symbols.intern(local_symbols[i].name);
+
+        std::vector<uint64_t> line_start(lines.size() + 1, 0);
+        for (auto &uinst: result.unresolved_instructions)
+            attach_instruction(lines[uinst.lineno - first_lineno], std::move(uinst), ids);
+        for (size_t i = 0; i < lines.size(); ++i)
+            line_start[i + 1] = line_start[i] + lines[i].byte_size;
+
+        for (size_t i = 0; i < local_symbols.size(); ++i) {
+            const auto &sym = local_symbols[i];
+            if (!sym.defined)
+                continue;
+            auto &line = lines[sym.line - first_lineno];
+            line.label = ids[i];
+            line.label_offset = sym.address - line_start[sym.line - first_lineno];
+        }
+        return true;
+    }
+
+    IncrementalAssembler::Line IncrementalAssembler::parse_line(std::string_view text, size_t lineno) {
+        std::vector<Line> out;
+        if (parse_chunk(std::span(&text, 1), lineno, out))
+            return std::move(out.front());
+
+        // re-run only to capture the message of this line
+        Line line;
+        line.text = text;
+        line.syntax_error = parse(line.text, lineno, false).error_message;
+        return line;
+    }
+
+    void IncrementalAssembler::attach_instruction(Line &line, InstUnderConstruction &&uinst,
+                                                  std::span<const SymbolId> ids) {
+        line.byte_size = uinst.byte_size;
+        line.builder = std::move(uinst.builder);
+        line.pc_relative = line.builder->pc_relative_arg().has_value();
+        line.builder->remap_symbols([&](SymbolId id) {
+            if (line.dep_count < line.deps.size())
+                line.deps[line.dep_count++] = ids[id];
+            return ids[id];
+        });
+    }
+
+    bool IncrementalAssembler::needs_resolve(const Line &line, uint64_t pc) const noexcept {
+        if (!line.resolved)
+            return true;
+
+        // only the operands that encode a label matter: the distance to it for branches
+        // and jumps, its absolute address otherwise
+        for (size_t i = 0; i < line.dep_count; ++i) {
+            auto address = m_symbols.address_of(line.deps[i]);
+            const auto &old_address = line.dep_addrs[i];
+            if (!address || !old_address) {
+                if (address != old_address)
+                    return true;
+                continue;
+            }
+            bool moved = line.pc_relative
+                             ? *address - pc != *old_address - line.resolved_pc
+                             : *address != *old_address;
+            if (moved)
+                return true;
+        }
+        return false;
+    }
+
+    void IncrementalAssembler::resolve_line(Line &line, uint64_t pc) {
+        line.resolved = true;
+        line.resolved_pc = pc;
+        for (size_t i = 0; i < line.dep_count; ++i)
+            line.dep_addrs[i] = m_symbols.address_of(line.deps[i]);
+        line.inst.reset();
+        line.error.reset();
+        line.error_code = 0;
+
+        InstructionBuilder builder = *line.builder;
+        if (auto err = builder.resolve_symbols(m_symbols, pc)) {
+            line.error = std::move(err);
+            line.error_code = 2;
+            return;
+        }
+
+        auto build_result = builder.build();
+        if (auto *err = std::get_if<BuildError>(&build_result)) {
+            line.error = std::move(*err);
+            line.error_code = 3;
+            return;
+        }
+        line.inst = std::get<Instruction>(build_result);
+    }
+}
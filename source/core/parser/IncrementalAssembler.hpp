@@ -0,0 +1,89 @@
+#pragma once
+#include <array>
+#include <optional>
+#include <span>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "asm_parsing.hpp"
+
+namespace asm_parsing {
+    /// @brief Assembler that keeps per-line parse results between builds.
+    ///
+    /// Each call diffs the new source against the previous one by lines, re-parses only the
+    /// changed region and re-resolves only instructions that are new, or whose referenced
+    /// labels (or own PC, for symbol operands) moved. Produces the same ParsedInstVec as
+    /// parse_and_resolve() with data offset 0.
+    /// @attention Parsing uses the global parser state, so calls must not overlap with
+    /// any other parse() call.
+    class IncrementalAssembler {
+    public:
+        static constexpr int CANCELLED = -1;
+
+        struct Stats {
+            size_t lines = 0;
+            size_t reparsed_lines = 0;
+            size_t resolved_instructions = 0;
+        };
+
+        /// @brief assembles the source, reusing results of the previous call
+        /// @param stop checked while re-parsing; a cancelled call leaves the previous state intact
+        /// @return 0 on success, 1 on parse error (also a duplicate label), 2 on symbol resolution
+        /// error, 3 on validation error, CANCELLED if a stop was requested
+        [[nodiscard]] int assemble(std::string_view source, ParsedInstVec &out_instructions,
+                                   std::stop_token stop = {});
+
+        /// @return errors of the last assemble() call, in line order
+        [[nodiscard]] const std::vector<BuildError> &diagnostics() const noexcept { return m_diagnostics; }
+
+        [[nodiscard]] const Stats &stats() const noexcept { return m_stats; }
+
+        /// @return labels of the last successful layout, addresses relative to the program start
+        [[nodiscard]] const SymbolTable &symbol_table() const noexcept { return m_symbols; }
+
+        void reset();
+
+    private:
+        /// Lines per parser run; bounds the latency of a stop request
+        static constexpr size_t PARSE_CHUNK_LINES = 1024;
+
+        struct Line {
+            std::string text;
+
+            // parse results
+            std::optional<std::string> syntax_error;
+            std::optional<SymbolId> label;
+            uint64_t label_offset = 0; ///< label address relative to the line start
+            std::optional<InstructionBuilder> builder;
+            uint8_t byte_size = 0;
+            std::array<SymbolId, 3> deps{};
+            uint8_t dep_count = 0;
+            bool pc_relative = false; ///< symbol operands are offsets from the instruction's PC
+
+            // resolution cache
+            bool resolved = false;
+            uint64_t resolved_pc = 0;
+            std::array<std::optional<uint64_t>, 3> dep_addrs{};
+            std::optional<Instruction> inst;
+            std::optional<BuildError> error;
+            int error_code = 0;
+        };
+
+        /// @brief parses consecutive lines with one parser run
+        /// @return false on a syntax error (out is left unchanged)
+        [[nodiscard]] bool parse_chunk(std::span<const std::string_view> texts, size_t first_lineno,
+                                       std::vector<Line> &out);
+        [[nodiscard]] Line parse_line(std::string_view text, size_t lineno);
+        void attach_instruction(Line &line, InstUnderConstruction &&uinst, std::span<const SymbolId> ids);
+        [[nodiscard]] bool needs_resolve(const Line &line, uint64_t pc) const noexcept;
+        void resolve_line(Line &line, uint64_t pc);
+
+        std::vector<Line> m_lines;
+        std::vector<uint64_t> m_line_pc;
+        SymbolTable m_symbols;
+        std::vector<BuildError> m_diagnostics;
+        Stats m_stats;
+    };
+}
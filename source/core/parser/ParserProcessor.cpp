@@ -1,9 +1,8 @@
 #include "ParserProcessor.hpp"
 #include <InstructionBuilder.hpp>
-#include <ui.hpp>
 #include <cassert>
 #include <algorithm>
-#include <unordered_set>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
 
 ParserProcessor::ParserProcessor() : m_sym_table(0) {
     m_inst_builders.reserve(32);
@@ -17,60 +16,63 @@ void ParserProcessor::push_param(const std::string &str) {
     m_parm_n++;
 }
 
-void ParserProcessor::add_label(std::string_view name) {
-    if (auto err = m_sym_table.add_label(name, m_byte_offset)) {
-        ui::print_error(err->format());
+void ParserProcessor::add_label(std::string_view name, size_t line) {
+    if (auto err = m_sym_table.add_label(name, m_byte_offset, line)) {
+        err->line = line;
+        m_label_errors.push_back(std::move(*err));
     }
 }
 
-void ParserProcessor::push_instruction(std::string str, size_t line) {
-    str = to_lowercase(str);
-
+void ParserProcessor::push_instruction(std::string_view str, size_t line) {
     InstructionBuilder builder(str);
 
-    static const std::unordered_set<std::string_view> branch_instr{
-        "beq","bne","blt","bltu","bge","bgeu"
-    };
+    using Id = rv64::is::IBaseI::InstId;
+    auto id = static_cast<Id>(builder.get_proto_id());
 
-    bool is_branch = branch_instr.contains(str);
-    bool is_jal = (str == "jal");
+    bool is_branch = id == Id::beq || id == Id::bne || id == Id::blt ||
+                     id == Id::bltu || id == Id::bge || id == Id::bgeu;
+    bool is_jal = (id == Id::jal);
 
     for (size_t i = 0; i < m_parm_n; ++i) {
         bool is_offset_arg = (is_branch && i == 2) || (is_jal && i == 1);
         if (is_offset_arg) {
-            try {
-                int64_t imm = std::stoll(m_parms[i]);
-                builder.add_imm(imm / 2);
-            } catch (...) {
-                builder.add_symbol(m_parms[i], 0);
+            if (auto imm = InstructionBuilder::parse_immediate(m_parms[i])) {
+                builder.add_imm(imm->value / 2);
+            } else {
+                builder.add_symbol(m_sym_table.intern(m_parms[i]), 0);
             }
         } else {
-            builder.add_arg(m_parms[i]);
+            builder.add_arg(m_parms[i], m_sym_table);
         }
     }
 
-    m_inst_builders.emplace_back(asm_parsing::InstUnderConstruction{line, std::move(builder)});
-
-    if (str[0] != 'c' || (str.size() > 1 && str[1] != '.')) {
-        m_inst_builders.emplace_back(asm_parsing::InstUnderConstruction{SIZE_MAX, InstructionBuilder()});
-        m_byte_offset += 4;
-    } else {
-        m_byte_offset += 2;
-    }
+    bool is_compressed = str.size() > 1 && ascii_tolower(str[0]) == 'c' && str[1] == '.';
+    uint8_t byte_size = is_compressed ? 2 : 4;
+    m_inst_builders.emplace_back(asm_parsing::InstUnderConstruction{line, std::move(builder), byte_size});
+    m_byte_offset += byte_size;
 
     m_parm_n = 0;
 }
 
 asm_parsing::ParsedInstVec ParserProcessor::get_parsed_instructions() const {
     asm_parsing::ParsedInstVec out;
-    asm_parsing::ParsingResult pr{m_inst_builders, m_sym_table};
+    asm_parsing::ParsingResult pr{
+        .unresolved_instructions = m_inst_builders, .symbol_table = m_sym_table, .error_code = 0, .error_message = {}
+    };
     int rv = pr.resolve_instructions(out, 0);
     (void)rv; // TODO: handle errors
     return out;
 }
 
-asm_parsing::ParsingResult ParserProcessor::get_parsing_result() const {
-    return asm_parsing::ParsingResult{m_inst_builders, m_sym_table};
+asm_parsing::ParsingResult ParserProcessor::take_parsing_result() {
+    bool duplicate_labels = !m_label_errors.empty();
+    asm_parsing::ParsingResult result{
+        .unresolved_instructions = std::move(m_inst_builders), .symbol_table = std::move(m_sym_table),
+        .error_code = duplicate_labels ? 1 : 0,
+        .error_message = duplicate_labels ? m_label_errors.front().message : std::string()
+    };
+    reset();
+    return result;
 }
 
 void ParserProcessor::reset() {
@@ -80,5 +82,6 @@ void ParserProcessor::reset() {
     m_inst_builders.reserve(32);
     m_sym_table.clear();
     m_byte_offset = 0;
+    m_label_errors.clear();
     for (auto &p : m_parms) p.clear();
 }
@@ -9,12 +9,17 @@ public:
 
     ParserProcessor();
     void push_param(const std::string &str);
-    void push_instruction(std::string str, size_t line);
-    void add_label(std::string_view name);
+    void push_instruction(std::string_view str, size_t line);
+    void add_label(std::string_view name, size_t line = 0);
 
     [[nodiscard]] asm_parsing::ParsedInstVec get_parsed_instructions() const;
 
-    [[nodiscard]] asm_parsing::ParsingResult get_parsing_result() const;
+    /// @brief moves the collected builders and symbols out and resets the processor
+    /// @return result with error_code 1 if a label was defined twice
+    [[nodiscard]] asm_parsing::ParsingResult take_parsing_result();
+
+    /// @return duplicate label errors since the last reset, in source order
+    [[nodiscard]] const std::vector<BuildError> &label_errors() const noexcept { return m_label_errors; }
 
     void reset();
 
@@ -27,4 +32,5 @@ private:
 
     std::vector<asm_parsing::InstUnderConstruction> m_inst_builders; // line and instruction
     asm_parsing::SymbolTable m_sym_table;
+    std::vector<BuildError> m_label_errors;
 };
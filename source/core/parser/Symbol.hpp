@@ -3,6 +3,9 @@
 #include <string>
 
 namespace asm_parsing {
+    /// @brief Index of an interned symbol name in the SymbolTable
+    using SymbolId = uint32_t;
+
     struct Symbol {
         enum class Type {
             Label = 0,
@@ -11,5 +14,7 @@ namespace asm_parsing {
         Type type;
         std::string name;
         uint64_t address = 0;
+        bool defined = false; ///< false if the symbol was only referenced so far
+        size_t line = 0; ///< source line of the definition, 0 if unknown
     };
 }
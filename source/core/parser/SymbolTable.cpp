@@ -1,35 +1,57 @@
 #include "SymbolTable.hpp"
 #include <format>
 
-std::optional<BuildError> asm_parsing::SymbolTable::add_label(std::string_view name, uint64_t address) {
-    auto str = std::string{name};
-    if (m_symbols.contains(str)) {
+std::optional<BuildError> asm_parsing::SymbolTable::add_label(std::string_view name, uint64_t address, size_t line) {
+    return define(intern(name), address, line);
+}
+
+std::optional<BuildError> asm_parsing::SymbolTable::define(SymbolId id, uint64_t address, size_t line) {
+    auto &sym = m_symbols[id];
+    if (sym.defined) {
         return BuildError{
             .kind = BuildErrorKind::DuplicateLabel,
-            .message = std::format("Duplicate label '{}'", str)
+            .message = std::format("Duplicate label '{}'", sym.name)
         };
     }
-    m_symbols[str] = Symbol{
-        .type = Symbol::Type::Label,
-        .name = str,
-        .address = address + m_data_offset
-    };
+    sym.type = Symbol::Type::Label;
+    sym.address = address + m_data_offset;
+    sym.defined = true;
+    sym.line = line;
     return std::nullopt;
 }
 
-void asm_parsing::SymbolTable::clear() {
-    m_symbols.clear();
+asm_parsing::SymbolId asm_parsing::SymbolTable::intern(std::string_view name) {
+    if (auto it = m_ids.find(name); it != m_ids.end())
+        return it->second;
+
+    auto id = static_cast<SymbolId>(m_symbols.size());
+    m_symbols.push_back(Symbol{.type = Symbol::Type::Label, .name = std::string(name)});
+    m_ids.emplace(std::string(name), id);
+    return id;
+}
+
+std::optional<uint64_t> asm_parsing::SymbolTable::address_of(SymbolId id) const noexcept {
+    if (id >= m_symbols.size() || !m_symbols[id].defined)
+        return std::nullopt;
+    return m_symbols[id].address;
 }
 
-asm_parsing::SymbolTable::~SymbolTable() {
-    clear();
+std::string_view asm_parsing::SymbolTable::name_of(SymbolId id) const noexcept {
+    if (id >= m_symbols.size())
+        return {};
+    return m_symbols[id].name;
 }
 
-std::unordered_map<std::string, uint64_t> asm_parsing::SymbolTable::export_symbol_map() const {
-    std::unordered_map<std::string, uint64_t> result;
-    result.reserve(m_symbols.size());
-    for (const auto &p : m_symbols) {
-        result.emplace(p.first, p.second.address);
+void asm_parsing::SymbolTable::clear_definitions() noexcept {
+    for (auto &sym: m_symbols) {
+        sym.defined = false;
+        sym.address = 0;
+        sym.line = 0;
     }
-    return result;
 }
+
+void asm_parsing::SymbolTable::clear() {
+    m_symbols.clear();
+    m_ids.clear();
+}
+
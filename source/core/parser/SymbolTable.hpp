@@ -3,23 +3,49 @@
 #include <BuildError.hpp>
 #include <unordered_map>
 #include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
 
 namespace asm_parsing {
     class SymbolTable {
     public:
         SymbolTable() : m_data_offset(0) {}
         explicit SymbolTable(uint64_t data_offset) : m_data_offset(data_offset) {}
-        ~SymbolTable();
 
         /// @return nullopt on success, BuildError on duplicate label
-        [[nodiscard]] std::optional<BuildError> add_label(std::string_view name, uint64_t address);
+        [[nodiscard]] std::optional<BuildError> add_label(std::string_view name, uint64_t address, size_t line = 0);
 
-        void clear();
+        /// @brief defines an interned symbol at the given address (relative to the data offset)
+        /// @return nullopt on success, BuildError if the symbol is already defined
+        [[nodiscard]] std::optional<BuildError> define(SymbolId id, uint64_t address, size_t line = 0);
+
+        /// @brief marks every symbol as undefined while keeping the interned ids
+        void clear_definitions() noexcept;
+
+        /// @brief returns the id of the symbol, registering it (undefined) if it was not seen before
+        [[nodiscard]] SymbolId intern(std::string_view name);
+
+        /// @return absolute address of the symbol or nullopt if it was never defined
+        [[nodiscard]] std::optional<uint64_t> address_of(SymbolId id) const noexcept;
+
+        [[nodiscard]] std::string_view name_of(SymbolId id) const noexcept;
 
-        [[nodiscard]] std::unordered_map<std::string, uint64_t> export_symbol_map() const;
+        [[nodiscard]] size_t size() const noexcept { return m_symbols.size(); }
+
+        /// @return all interned symbols, indexed by SymbolId
+        [[nodiscard]] std::span<const Symbol> symbols() const noexcept { return m_symbols; }
+
+        void clear();
 
     private:
+        struct NameHash {
+            using is_transparent = void;
+            size_t operator()(std::string_view str) const noexcept { return std::hash<std::string_view>{}(str); }
+        };
+
         uint64_t m_data_offset = 0;
-        std::unordered_map<std::string, Symbol> m_symbols;
+        std::vector<Symbol> m_symbols; // indexed by SymbolId
+        std::unordered_map<std::string, SymbolId, NameHash, std::equal_to<>> m_ids;
     };
 }
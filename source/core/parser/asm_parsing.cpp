@@ -1,50 +1,66 @@
 #include "asm_parsing.hpp"
 #include <ui.hpp>
+#include <type_traits>
 
-namespace asm_parsing {
-    int ParsingResult::resolve_instructions(ParsedInstVec &out_instructions, uint64_t data_off) const {
-        auto sym_map = symbol_table.export_symbol_map();
+namespace {
+    using namespace asm_parsing;
 
-        ParsedInstVec result;
-        result.reserve(unresolved_instructions.size());
+    /// @brief emits resolved instructions directly into out; a const builder vector is resolved
+    /// through per-instruction copies, a mutable one in place
+    template<typename Builders>
+    int resolve_into(Builders &builders, const SymbolTable &symbol_table, ParsedInstVec &out, uint64_t data_off) {
+        size_t out_base = out.size();
+        out.reserve(out_base + builders.size());
 
         uint64_t current_pc = data_off;
 
-        for (const auto &uinst: unresolved_instructions) {
-            if (uinst.lineno == SIZE_MAX) {
-                result.push_back(ParsedInst{SIZE_MAX, Instruction::invalid_cref()});
-                continue;
+        for (auto &uinst: builders) {
+            InstructionBuilder copy;
+            InstructionBuilder *builder;
+            if constexpr (std::is_const_v<Builders>) {
+                copy = uinst.builder;
+                builder = &copy;
+            } else {
+                builder = &uinst.builder;
             }
 
-            InstructionBuilder builder = uinst.builder;
-
-            if (auto err = builder.resolve_symbols(sym_map, current_pc)) {
+            if (auto err = builder->resolve_symbols(symbol_table, current_pc)) {
                 err->line = uinst.lineno;
                 ui::print_error(err->format());
+                out.resize(out_base);
                 return 2;
             }
 
-            auto build_result = builder.build();
+            auto build_result = builder->build();
             if (auto *err = std::get_if<BuildError>(&build_result)) {
                 err->line = uinst.lineno;
                 ui::print_error(err->format());
+                out.resize(out_base);
                 return 3;
             }
 
             auto &inst = std::get<Instruction>(build_result);
-            result.push_back(ParsedInst{uinst.lineno, inst});
             current_pc += inst.byte_size();
+            out.push_back(ParsedInst{uinst.lineno, std::move(inst)});
         }
-
-        out_instructions.insert(out_instructions.end(), result.begin(), result.end());
         return 0;
     }
+}
+
+namespace asm_parsing {
+    int ParsingResult::resolve_instructions(ParsedInstVec &out_instructions, uint64_t data_off) const & {
+        return resolve_into(unresolved_instructions, symbol_table, out_instructions, data_off);
+    }
+
+    int ParsingResult::resolve_instructions(ParsedInstVec &out_instructions, uint64_t data_off) && {
+        return resolve_into(unresolved_instructions, symbol_table, out_instructions, data_off);
+    }
 
     int parse_and_resolve(const std::string &source, ParsedInstVec &out_instructions, uint64_t data_offset) {
         auto result = parse(source);
         if (result.error_code != 0)
             return 1;
 
-        return result.resolve_instructions(out_instructions, data_offset);
+        return std::move(result).resolve_instructions(out_instructions, data_offset);
     }
 }
\ No newline at end of file
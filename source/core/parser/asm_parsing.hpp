@@ -13,15 +13,12 @@ namespace asm_parsing {
     struct ParsedInst {
         size_t lineno = SIZE_MAX;
         Instruction inst;
-
-        [[nodiscard]] bool is_padding() const {
-            return lineno == SIZE_MAX;
-        }
     };
 
     struct InstUnderConstruction {
         size_t lineno = SIZE_MAX;
         InstructionBuilder builder;
+        uint8_t byte_size = 4; ///< size the parser laid the instruction out with
     };
 
     using ParsedInstVec = std::vector<ParsedInst>;
@@ -31,19 +28,29 @@ namespace asm_parsing {
         InstBuilderVec unresolved_instructions;
         SymbolTable symbol_table;
 
-        int error_code = 0;
-        [[nodiscard]] int resolve_instructions(ParsedInstVec &out_instructions, uint64_t data_off = 0) const;
+        int error_code = 0; ///< non-zero on a syntax error or a label defined twice
+        std::string error_message; ///< parser message if error_code != 0
+        /// @brief resolves copies of the builders and appends the instructions to out_instructions
+        /// @return 0 on success, 2 on symbol resolution error, 3 on validation error (output left unchanged)
+        [[nodiscard]] int resolve_instructions(ParsedInstVec &out_instructions, uint64_t data_off = 0) const &;
+
+        /// @brief same as above, but resolves the builders in place (consuming them); symbol_table stays valid
+        [[nodiscard]] int resolve_instructions(ParsedInstVec &out_instructions, uint64_t data_off = 0) &&;
     };
 
     /// @brief Parse assembly source code into unresolved instructions
     /// @param source Assembly source code
+    /// @param first_line line number of the first line of source (for instructions and messages)
+    /// @param print_errors report syntax errors through ui::print_error
     /// @return ParsingResult containing unresolved instructions and symbol table
-    [[nodiscard]] ParsingResult parse(const std::string &source);
+    /// @attention Uses global parser state; not safe to call from several threads at once.
+    [[nodiscard]] ParsingResult parse(const std::string &source, size_t first_line = 1, bool print_errors = true);
 
     /// @brief Parse and resolve assembly source code into executable instructions
     /// @param source Assembly source code
     /// @param out_instructions Output vector for resolved instructions
     /// @param data_offset
-    /// @return 0 on success, 1 on parse error, 2 on symbol resolution error, 3 on validation error
+    /// @return 0 on success, 1 on parse error (also a duplicate label), 2 on symbol resolution error,
+    /// 3 on validation error
     [[nodiscard]] int parse_and_resolve(const std::string &source, ParsedInstVec &out_instructions, uint64_t data_offset);
 }
\ No newline at end of file
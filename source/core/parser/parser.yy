@@ -18,6 +18,8 @@
     extern int yyparse(void);
     extern void yyset_istream(std::istream *in);
     static ParserProcessor m_pproc{};
+    static bool m_print_errors = true;
+    static std::string m_error_message;
 }
 
 %token<std::string> Instruction
@@ -40,14 +42,14 @@ program
 final_line
     : statement
     | Label statement_opt
-        { m_pproc.add_label($1); }
+        { m_pproc.add_label($1, yylineno); }
     ;
 
 line
     : NewLine
     | statement NewLine
     | Label statement_opt NewLine
-        { m_pproc.add_label($1); }
+        { m_pproc.add_label($1, yylineno); }
     ;
 
 statement_opt
@@ -87,20 +89,31 @@ operand
 %%
 
 void yy::parser::error(const std::string& msg){
-    ui::print_error(std::format("[parsing] line: {}:{}", yylineno, msg));
+    m_error_message = msg;
+    if (m_print_errors)
+        ui::print_error(std::format("[parsing] line: {}:{}", yylineno, msg));
 }
 
 namespace asm_parsing {
-    ParsingResult parse(const std::string &str) {
+    ParsingResult parse(const std::string &str, size_t first_line, bool print_errors) {
         m_pproc.reset();
+        m_print_errors = print_errors;
+        m_error_message.clear();
         std::stringstream ss(str);
         yyset_istream(&ss);
 
         yy::parser parser;
-        yylineno = 0;
+        yylineno = first_line - 1;
         auto parsing_error = parser.parse();
-        auto result = m_pproc.get_parsing_result();
-        result.error_code = parsing_error;
+        if (print_errors) {
+            for (const auto &err: m_pproc.label_errors())
+                ui::print_error(err.format());
+        }
+        auto result = m_pproc.take_parsing_result();
+        if (parsing_error != 0) {
+            result.error_code = parsing_error;
+            result.error_message = m_error_message;
+        }
         return result;
     }
 }
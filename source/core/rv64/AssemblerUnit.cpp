@@ -4,7 +4,8 @@
 #include <cstring>
 #include <numeric>
 #include <endianness.hpp>
-#include <unordered_map>
+#include <PerfectHashMap.hpp>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
 
 /// Custom I-format variants for instruction encoding
 /// * Shift - funct6[31:26], imm[25:20], rs1[19:15], funct3[14:12], rd[11:7], opcode[6:0]
@@ -21,7 +22,7 @@ struct IEncoding {
 };
 
 // clang-format off
-std::unordered_map<std::string_view, IEncoding> enc_map {
+static constexpr PerfectHashMap<IEncoding, 98> enc_map{{{
     //=== (RV64I) Base Integer Instructions ===
     {"addi",  {.format = IFormat::I, .opcode = 0b0010011, .funct0 = 0b000}},
     {"slti",  {.format = IFormat::I, .opcode = 0b0010011, .funct0 = 0b010}},
@@ -138,9 +139,20 @@ std::unordered_map<std::string_view, IEncoding> enc_map {
 
     {"fence",   {.format = IFormat::I, .opcode = 0b0001111, .funct0 = 0b000}},
     {"fence.i", {.format = IFormat::I, .opcode = 0b0001111, .funct0 = 0b001}},
-};
+}}};
 // clang-format on
 
+// Every encodable instruction from the instruction set lists must have an encoding
+// (nop/c.nop are rewritten to addi/c.addi, floating point ones are not supported)
+static_assert([] {
+    for (const auto &[mnemonic, _]: rv64::is::detail::list_mnemonics()) {
+        bool skipped = mnemonic == "nop" || mnemonic == "c.nop" || mnemonic.starts_with("c.f");
+        if (!skipped && !enc_map.contains(mnemonic))
+            return false;
+    }
+    return true;
+}());
+
 uint32_t imm6_to_u32(const InstArg &imm6) {
     uint32_t result = 0;
     std::visit([&]<typename T>(T &&arg) {
@@ -174,17 +186,43 @@ namespace rv64 {
 
     std::vector<uint8_t> AssemblerUnit::assemble(const asm_parsing::ParsedInstVec &insts, std::endian endian) {
         std::vector<uint8_t> bytecode;
+        bytecode.reserve(code_size(insts));
+        assemble_into(insts, endian, std::back_inserter(bytecode));
+        return bytecode;
+    }
 
-        for (const auto &parsed: insts) {
-            if (parsed.is_padding()) continue;
-
-            auto encoded = encode_instruction(parsed.inst, endian);
-            std::visit([&](const auto &data) {
-                bytecode.insert(bytecode.end(), data.begin(), data.end());
-            }, encoded);
-        }
+    size_t AssemblerUnit::code_size(const asm_parsing::ParsedInstVec &insts) noexcept {
+        return std::transform_reduce(
+            insts.begin(), insts.end(), size_t{0}, std::plus{},
+            [](const auto &parsed) { return parsed.inst.byte_size(); }
+        );
+    }
 
-        return bytecode;
+    uint64_t AssemblerUnit::isa_fingerprint() noexcept {
+        static constexpr uint64_t fingerprint = [] {
+            uint64_t hash = 0xcbf29ce484222325ull; // FNV-1a
+            auto mix = [&](uint64_t value) {
+                for (int i = 0; i < 8; ++i) {
+                    hash ^= (value >> (i * 8)) & 0xff;
+                    hash *= 0x100000001b3ull;
+                }
+            };
+            for (const auto &[mnemonic, id]: is::detail::list_mnemonics()) {
+                for (char c: mnemonic)
+                    mix(static_cast<uint8_t>(c));
+                mix(static_cast<uint64_t>(id));
+                for (auto arg: is::Rv64IMC::get_inst_proto(id).args)
+                    mix(static_cast<uint64_t>(arg));
+                if (const IEncoding *enc = enc_map.find(mnemonic)) {
+                    mix(static_cast<uint64_t>(enc->format));
+                    mix(enc->opcode);
+                    mix(enc->funct0);
+                    mix(enc->funct1);
+                }
+            }
+            return hash;
+        }();
+        return fingerprint;
     }
 
     std::variant<std::array<uint8_t, 2>, std::array<uint8_t, 4> >
@@ -194,7 +232,7 @@ namespace rv64 {
         }
 
         size_t size = inst.byte_size();
-        std::string mnemonic = std::string(inst.get_prototype().mnemonic);
+        std::string_view mnemonic = inst.get_prototype().mnemonic;
 
         // NOP instruction converting
         Instruction instruction = inst;
@@ -205,13 +243,14 @@ namespace rv64 {
         } else {
             instruction = inst;
         }
-        mnemonic = std::string(instruction.get_prototype().mnemonic);
+        mnemonic = instruction.get_prototype().mnemonic;
 
 
         const auto &args = instruction.get_args();
 
-        assert(enc_map.contains(mnemonic));
-        auto [format, opcode, functHi, functLo] = enc_map[mnemonic];
+        const IEncoding *encoding = enc_map.find(mnemonic);
+        assert(encoding);
+        auto [format, opcode, functHi, functLo] = *encoding;
 
         uint32_t encoded = opcode;
 
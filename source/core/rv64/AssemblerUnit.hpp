@@ -1,5 +1,7 @@
 #pragma once
 #include <Instruction.hpp>
+#include <algorithm>
+#include <iterator>
 #include <span>
 #include <vector>
 #include <bit>
@@ -14,6 +16,25 @@ namespace rv64 {
 
         static std::vector<uint8_t> assemble(const asm_parsing::ParsedInstVec &insts,
                                              std::endian endian = std::endian::native);
+
+        /// @brief encodes instructions straight into out (e.g. guest memory) without an intermediate buffer
+        /// @return iterator past the last written byte
+        template<std::output_iterator<uint8_t> Out>
+        static Out assemble_into(const asm_parsing::ParsedInstVec &insts, std::endian endian, Out out) {
+            for (const auto &parsed: insts) {
+                std::visit([&](const auto &data) {
+                    out = std::ranges::copy(data, out).out;
+                }, encode_instruction(parsed.inst, endian));
+            }
+            return out;
+        }
+
+        /// @return number of bytes the instructions occupy once assembled
+        static size_t code_size(const asm_parsing::ParsedInstVec &insts) noexcept;
+
+        /// @return hash of the instruction set table (mnemonics, operands, ids) and the encodings;
+        /// changes whenever assembled code would, e.g. to invalidate caches of assembled programs
+        static uint64_t isa_fingerprint() noexcept;
     private:
         static std::variant<std::array<uint8_t, 2>, std::array<uint8_t, 4>>
         encode_instruction(const Instruction &inst, std::endian endian);
@@ -0,0 +1,236 @@
+#include "BlockIR.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <Memory.hpp>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
+
+namespace {
+    using namespace rv64;
+    using I = is::IBaseI::InstId;
+    using C = is::IExtensionC::InstId;
+    using Code = IrOp::Code;
+
+    constexpr size_t REG_CNT = 32;
+
+    bool is_jump(int id) {
+        switch (id) {
+            case (int) I::jal: case (int) I::jalr:
+            case (int) I::beq: case (int) I::bne: case (int) I::blt:
+            case (int) I::bge: case (int) I::bltu: case (int) I::bgeu:
+            case (int) C::c_j: case (int) C::c_jr: case (int) C::c_jalr:
+            case (int) C::c_beqz: case (int) C::c_bnez:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /// @return true for instructions that have to run outside a block
+    bool ends_block_before(const Instruction &inst) {
+        auto id = inst.get_prototype().id;
+        return !inst.is_valid() || id == (int) I::ecall || id == (int) I::ebreak;
+    }
+
+    IrOp lower(const Instruction &inst, uint16_t index) {
+        const auto &args = inst.get_args();
+        auto reg = [&](size_t i) { return static_cast<uint8_t>(std::get<Reg>(args[i]).idx()); };
+        auto load = [&](uint8_t rd, uint8_t base, int64_t offset, uint8_t width) {
+            return IrOp{.code = Code::Load, .rd = rd, .rs1 = base, .width = width, .inst = index, .imm = offset};
+        };
+        auto store = [&](uint8_t src, uint8_t base, int64_t offset, uint8_t width) {
+            return IrOp{.code = Code::Store, .rs1 = base, .rs2 = src, .width = width, .inst = index, .imm = offset};
+        };
+
+        switch (inst.get_prototype().id) {
+            case (int) I::lui:
+                return {.code = Code::Const, .rd = reg(0), .inst = index,
+                        .imm = static_cast<int32_t>(std::get<int20>(args[1]) << 12)};
+            case (int) I::addi:
+                if (reg(1) == 0)
+                    return {.code = Code::Const, .rd = reg(0), .inst = index, .imm = std::get<int12>(args[2])};
+                return {.code = Code::AddImm, .rd = reg(0), .rs1 = reg(1), .inst = index, .imm = std::get<int12>(args[2])};
+            case (int) I::addiw:
+                return {.code = Code::AddImmW, .rd = reg(0), .rs1 = reg(1), .inst = index, .imm = std::get<int12>(args[2])};
+            case (int) I::ld: return load(reg(0), reg(1), std::get<int12>(args[2]), 8);
+            case (int) I::lw: return load(reg(0), reg(1), std::get<int12>(args[2]), 4);
+            case (int) I::sd: return store(reg(0), reg(1), std::get<int12>(args[2]), 8);
+            case (int) I::sw: return store(reg(0), reg(1), std::get<int12>(args[2]), 4);
+            case (int) C::c_ld: return load(reg(0), reg(1), int64_t(std::get<int5>(args[2])) << 3, 8);
+            case (int) C::c_lw: return load(reg(0), reg(1), int64_t(std::get<int5>(args[2])) << 2, 4);
+            case (int) C::c_sd: return store(reg(0), reg(1), int64_t(std::get<int5>(args[2])) << 3, 8);
+            case (int) C::c_sw: return store(reg(0), reg(1), int64_t(std::get<int5>(args[2])) << 2, 4);
+            case (int) C::c_ldsp: return load(reg(0), 2, int64_t(std::get<int6>(args[1])) << 3, 8);
+            case (int) C::c_lwsp: return load(reg(0), 2, int64_t(std::get<int6>(args[1])) << 2, 4);
+            case (int) C::c_sdsp: return store(reg(0), 2, int64_t(std::get<int6>(args[1])) << 3, 8);
+            case (int) C::c_swsp: return store(reg(0), 2, int64_t(std::get<int6>(args[1])) << 2, 4);
+            default:
+                return {.code = Code::Exec, .inst = index};
+        }
+    }
+
+    void eliminate_x0_writes(std::vector<IrOp> &ops) {
+        std::erase_if(ops, [](const IrOp &op) { return op.is_pure() && op.rd == 0; });
+    }
+
+    /// @brief replaces loads of a stack slot (or any other base + offset) that was stored or loaded
+    /// earlier in the block by a register move, as long as neither register has changed since
+    void forward_loads(std::vector<IrOp> &ops) {
+        struct Slot {
+            uint8_t base, value, width;
+            int64_t offset;
+        };
+        std::vector<Slot> slots;
+        auto redefine = [&](uint8_t reg) {
+            std::erase_if(slots, [reg](const Slot &s) { return s.base == reg || s.value == reg; });
+        };
+
+        for (auto &op: ops) {
+            switch (op.code) {
+                case Code::Load: {
+                    // a load into x0 can still fail on an illegal encoding, keep it
+                    auto it = std::ranges::find_if(slots, [&](const Slot &s) {
+                        return s.base == op.rs1 && s.offset == op.imm && s.width == op.width;
+                    });
+                    if (op.rd != 0 && it != slots.end()) {
+                        op = IrOp{.code = op.width == 8 ? Code::Mov : Code::SextW, .rd = op.rd, .rs1 = it->value,
+                                  .inst = op.inst};
+                        redefine(op.rd);
+                        break;
+                    }
+                    uint8_t base = op.rs1, width = op.width;
+                    int64_t offset = op.imm;
+                    redefine(op.rd);
+                    if (op.rd != 0 && op.rd != base)
+                        slots.push_back({base, op.rd, width, offset});
+                    break;
+                }
+                case Code::Store:
+                    // another base register may alias anything
+                    std::erase_if(slots, [&](const Slot &s) {
+                        return s.base != op.rs1 || (s.offset < op.imm + op.width && op.imm < s.offset + s.width);
+                    });
+                    slots.push_back({op.rs1, op.rs2, op.width, op.imm});
+                    break;
+                case Code::Exec:
+                    slots.clear();
+                    break;
+                default:
+                    redefine(op.rd);
+                    break;
+            }
+        }
+    }
+
+    /// @brief folds lui/addi chains (and moves of known values) into constants
+    void propagate_constants(std::vector<IrOp> &ops) {
+        std::array<std::optional<int64_t>, REG_CNT> known{};
+        known[0] = 0;
+
+        for (auto &op: ops) {
+            std::optional<int64_t> value;
+            switch (op.code) {
+                case Code::Const:
+                    value = op.imm;
+                    break;
+                case Code::Mov:
+                    value = known[op.rs1];
+                    break;
+                case Code::AddImm:
+                    if (known[op.rs1])
+                        value = std::bit_cast<int64_t>(uint64_t(*known[op.rs1]) + uint64_t(op.imm));
+                    break;
+                case Code::AddImmW:
+                    if (known[op.rs1])
+                        value = static_cast<int32_t>(uint32_t(*known[op.rs1]) + uint32_t(op.imm));
+                    break;
+                case Code::SextW:
+                    if (known[op.rs1])
+                        value = static_cast<int32_t>(*known[op.rs1]);
+                    break;
+                case Code::Load:
+                    known[op.rd] = std::nullopt;
+                    break;
+                case Code::Store:
+                    break;
+                case Code::Exec:
+                    known.fill(std::nullopt);
+                    break;
+            }
+            if (op.is_pure()) {
+                if (value)
+                    op = IrOp{.code = Code::Const, .rd = op.rd, .inst = op.inst, .imm = *value};
+                known[op.rd] = value;
+            }
+            known[0] = 0;
+        }
+    }
+
+    /// @brief removes pure ops whose result is overwritten before it is read; every register is
+    /// live at the end of the block and at every barrier
+    void eliminate_dead_temporaries(std::vector<IrOp> &ops) {
+        std::array<bool, REG_CNT> live;
+        live.fill(true);
+        std::vector<bool> dead(ops.size(), false);
+
+        for (size_t i = ops.size(); i-- > 0;) {
+            const auto &op = ops[i];
+            if (!op.is_pure()) {
+                live.fill(true);
+                continue;
+            }
+            if (!live[op.rd]) {
+                dead[i] = true;
+                continue;
+            }
+            live[op.rd] = false;
+            if (op.code != Code::Const)
+                live[op.rs1] = true;
+        }
+
+        size_t i = 0;
+        std::erase_if(ops, [&](const IrOp &) { return dead[i++]; });
+    }
+}
+
+namespace rv64 {
+    std::optional<IrBlock> translate_block(const Memory &memory, uint64_t pc, bool optimize) {
+        IrBlock block;
+        block.start_pc = pc;
+        while (block.insts.size() < IrBlock::MAX_INSTRUCTIONS) {
+            MemErr err;
+            auto fetch = memory.get_instruction_at(pc, err);
+            if (err != MemErr::None || ends_block_before(fetch.inst))
+                break;
+
+            pc += fetch.inst.byte_size();
+            if (!block.insts.empty())
+                block.inner_lines.push_back(fetch.lineno ? static_cast<uint32_t>(*fetch.lineno) : IrBlock::NO_LINE);
+            block.ops.push_back(lower(fetch.inst, static_cast<uint16_t>(block.insts.size())));
+            block.next_pcs.push_back(pc);
+            block.ends_with_jump = is_jump(fetch.inst.get_prototype().id);
+            block.insts.push_back(std::move(fetch.inst));
+            if (block.ends_with_jump)
+                break;
+        }
+        if (block.insts.empty())
+            return std::nullopt;
+        block.end_pc = pc;
+        block.mix = InstructionMix::summarize(block.insts);
+
+        if (optimize) {
+            eliminate_x0_writes(block.ops);
+            forward_loads(block.ops);
+            propagate_constants(block.ops);
+            eliminate_dead_temporaries(block.ops);
+        }
+        return block;
+    }
+
+    const IrBlock *BlockCache::get(const Memory &memory, uint64_t pc) {
+        auto it = m_blocks.find(pc);
+        if (it == m_blocks.end())
+            it = m_blocks.emplace(pc, translate_block(memory, pc)).first;
+        return it->second ? &*it->second : nullptr;
+    }
+}
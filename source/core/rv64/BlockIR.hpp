@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <Instruction.hpp>
+#include <rv64/InstructionMix.hpp>
+
+class Memory;
+
+namespace rv64 {
+    /// @brief Operation of the block IR. Registers are indices; every register is written by at
+    /// most the op's rd, so a block reads as a def-use chain in program order.
+    struct IrOp {
+        enum class Code : uint8_t {
+            Const,   ///< rd = imm
+            Mov,     ///< rd = rs1
+            AddImm,  ///< rd = rs1 + imm
+            AddImmW, ///< rd = sign_extend((rs1 + imm)[31:0])
+            SextW,   ///< rd = sign_extend(rs1[31:0])
+            Load,    ///< rd = signed width-byte load from rs1 + imm, executed by the Interpreter
+            Store,   ///< width-byte store of rs2 to rs1 + imm, executed by the Interpreter
+            Exec     ///< any other instruction, executed by Interpreter::exec_instruction
+        };
+
+        Code code;
+        uint8_t rd = 0, rs1 = 0, rs2 = 0;
+        uint8_t width = 0;  ///< Load/Store access size in bytes
+        uint16_t inst = 0;  ///< index of the guest instruction in IrBlock::insts
+        int64_t imm = 0;
+
+        /// @return true for ops without side effects besides writing rd
+        [[nodiscard]] bool is_pure() const noexcept { return code < Code::Load; }
+    };
+
+    /// @brief Straight-line run of guest instructions ending at a jump/branch, before an
+    /// instruction with effects outside the CPU and memory (ecall, ebreak, invalid), or at
+    /// MAX_INSTRUCTIONS.
+    ///
+    /// Loads, stores and Exec ops are barriers: when one of them stops the VM with an error,
+    /// every register holds the value the reference Interpreter would have left.
+    struct IrBlock {
+        static constexpr size_t MAX_INSTRUCTIONS = 64;
+        static constexpr uint32_t NO_LINE = UINT32_MAX;
+
+        uint64_t start_pc = 0;
+        uint64_t end_pc = 0;         ///< address after the last instruction
+        bool ends_with_jump = false; ///< the last instruction sets the pc
+        std::vector<Instruction> insts;
+        std::vector<uint64_t> next_pcs;    ///< pc after each instruction, as seen by the Interpreter
+        std::vector<uint32_t> inner_lines; ///< source lines of all instructions but the first
+        std::vector<IrOp> ops;
+        InstructionMix::Summary mix; ///< static instruction mix, added once per executed block
+    };
+
+    /// @brief translates the block starting at pc and, if requested, runs the optimization passes:
+    /// x0 write elimination, stack slot store-to-load forwarding, constant propagation of
+    /// lui/addi chains and dead temporary elimination
+    /// @return nullopt if no block can start at pc
+    [[nodiscard]] std::optional<IrBlock> translate_block(const Memory &memory, uint64_t pc, bool optimize = true);
+
+    /// @brief Translated blocks of the loaded program, keyed by their start address
+    class BlockCache {
+    public:
+        /// @return block starting at pc (translated on first use), nullptr if none can start there
+        [[nodiscard]] const IrBlock *get(const Memory &memory, uint64_t pc);
+        void clear() noexcept { m_blocks.clear(); }
+
+    private:
+        std::unordered_map<uint64_t, std::optional<IrBlock>> m_blocks;
+    };
+}
@@ -0,0 +1,356 @@
+#include "BranchPredictor.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <format>
+#include <ranges>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
+
+#include "VM.hpp"
+
+namespace {
+    using namespace rv64;
+    using I = is::IBaseI::InstId;
+    using C = is::IExtensionC::InstId;
+
+    /// 2-bit saturating counters, initialized to weakly not taken
+    class CounterTable {
+    public:
+        explicit CounterTable(uint32_t bits) : m_counters(size_t(1) << bits, 1), m_mask((uint64_t(1) << bits) - 1) {}
+
+        [[nodiscard]] bool taken(uint64_t index) const noexcept { return m_counters[index & m_mask] >= 2; }
+
+        void train(uint64_t index, bool taken) noexcept {
+            auto &counter = m_counters[index & m_mask];
+            if (taken && counter < 3)
+                ++counter;
+            else if (!taken && counter > 0)
+                --counter;
+        }
+
+    private:
+        std::vector<uint8_t> m_counters;
+        uint64_t m_mask;
+    };
+
+    class StaticPredictor final : public BranchPredictor {
+    public:
+        bool predict(uint64_t pc, uint64_t target) override { return target <= pc; }
+        void update(uint64_t, uint64_t, bool) override {}
+        std::string_view name() const noexcept override { return "static"; }
+    };
+
+    class BimodalPredictor final : public BranchPredictor {
+    public:
+        explicit BimodalPredictor(uint32_t bits) : m_table(bits) {}
+
+        bool predict(uint64_t pc, uint64_t) override { return m_table.taken(pc >> 1); }
+        void update(uint64_t pc, uint64_t, bool taken) override { m_table.train(pc >> 1, taken); }
+        std::string_view name() const noexcept override { return "bimodal"; }
+
+    private:
+        CounterTable m_table;
+    };
+
+    class GsharePredictor final : public BranchPredictor {
+    public:
+        explicit GsharePredictor(uint32_t bits) : m_table(bits), m_history_mask((uint64_t(1) << bits) - 1) {}
+
+        bool predict(uint64_t pc, uint64_t) override { return m_table.taken((pc >> 1) ^ m_history); }
+
+        void update(uint64_t pc, uint64_t, bool taken) override {
+            m_table.train((pc >> 1) ^ m_history, taken);
+            m_history = ((m_history << 1) | uint64_t(taken)) & m_history_mask;
+        }
+
+        std::string_view name() const noexcept override { return "gshare"; }
+
+    private:
+        CounterTable m_table;
+        uint64_t m_history = 0;
+        uint64_t m_history_mask;
+    };
+
+    /// @brief TAGE with four tagged tables; the longest matching history provides the prediction
+    class TagePredictor final : public BranchPredictor {
+    public:
+        explicit TagePredictor(uint32_t bits)
+            : m_base(bits), m_index_bits(std::max<uint32_t>(bits - 1, 1)) {
+            for (auto &table: m_tables)
+                table.resize(size_t(1) << m_index_bits);
+        }
+
+        bool predict(uint64_t pc, uint64_t) override { return lookup(pc).prediction; }
+
+        void update(uint64_t pc, uint64_t, bool taken) override {
+            auto match = lookup(pc);
+            if (match.provider >= 0) {
+                auto &entry = m_tables[match.provider][match.indices[match.provider]];
+                if (match.prediction != match.alternate)
+                    entry.useful = match.prediction == taken ? std::min(entry.useful + 1, 3) : std::max(entry.useful - 1, 0);
+                entry.counter = taken ? std::min(entry.counter + 1, 3) : std::max(entry.counter - 1, -4);
+            } else {
+                m_base.train(pc >> 1, taken);
+            }
+
+            // on a misprediction, allocate an entry with a longer history
+            if (match.prediction != taken && match.provider + 1 < int(TABLE_CNT)) {
+                bool allocated = false;
+                for (size_t t = match.provider + 1; t < TABLE_CNT && !allocated; ++t) {
+                    auto &entry = m_tables[t][match.indices[t]];
+                    if (entry.useful == 0) {
+                        entry = {.counter = int8_t(taken ? 0 : -1), .tag = match.tags[t], .useful = 0, .valid = true};
+                        allocated = true;
+                    }
+                }
+                for (size_t t = match.provider + 1; t < TABLE_CNT && !allocated; ++t) {
+                    auto &entry = m_tables[t][match.indices[t]];
+                    entry.useful = std::max(entry.useful - 1, 0);
+                }
+            }
+            m_history = (m_history << 1) | uint64_t(taken);
+        }
+
+        std::string_view name() const noexcept override { return "tage"; }
+
+    private:
+        static constexpr size_t TABLE_CNT = 4;
+        static constexpr std::array<uint32_t, TABLE_CNT> HISTORY_LENGTHS{5, 12, 27, 60};
+        static constexpr uint32_t TAG_BITS = 9;
+
+        struct Entry {
+            int8_t counter = 0; ///< 3-bit signed, taken if >= 0
+            uint16_t tag = 0;
+            int useful = 0;     ///< 0..3
+            bool valid = false;
+        };
+
+        struct Match {
+            int provider = -1; ///< longest matching table
+            bool prediction = false;
+            bool alternate = false; ///< prediction without the provider
+            std::array<size_t, TABLE_CNT> indices{};
+            std::array<uint16_t, TABLE_CNT> tags{};
+        };
+
+        /// @return the newest length bits of the global history folded to bits bits
+        [[nodiscard]] uint64_t fold(uint32_t length, uint32_t bits) const noexcept {
+            uint64_t history = length < 64 ? m_history & ((uint64_t(1) << length) - 1) : m_history;
+            uint64_t folded = 0;
+            for (; history != 0; history >>= bits)
+                folded ^= history & ((uint64_t(1) << bits) - 1);
+            return folded;
+        }
+
+        [[nodiscard]] Match lookup(uint64_t pc) const noexcept {
+            Match match;
+            uint64_t address = pc >> 1;
+            uint64_t index_mask = (uint64_t(1) << m_index_bits) - 1;
+            uint64_t tag_mask = (uint64_t(1) << TAG_BITS) - 1;
+            bool base = m_base.taken(address);
+            match.prediction = match.alternate = base;
+
+            for (size_t t = 0; t < TABLE_CNT; ++t) {
+                uint32_t length = HISTORY_LENGTHS[t];
+                match.indices[t] = (address ^ (address >> m_index_bits) ^ fold(length, m_index_bits)) & index_mask;
+                match.tags[t] = static_cast<uint16_t>(
+                    (address ^ fold(length, TAG_BITS) ^ (fold(length, TAG_BITS - 1) << 1)) & tag_mask);
+                const auto &entry = m_tables[t][match.indices[t]];
+                if (entry.valid && entry.tag == match.tags[t]) {
+                    match.alternate = match.prediction;
+                    match.prediction = entry.counter >= 0;
+                    match.provider = static_cast<int>(t);
+                }
+            }
+            return match;
+        }
+
+        CounterTable m_base;
+        uint32_t m_index_bits;
+        std::array<std::vector<Entry>, TABLE_CNT> m_tables;
+        uint64_t m_history = 0;
+    };
+
+    bool is_link(size_t reg) {
+        return reg == 1 || reg == 5;
+    }
+
+    std::optional<uint64_t> branch_target(uint64_t pc, const Instruction &inst) {
+        const auto &args = inst.get_args();
+        switch (inst.get_prototype().id) {
+            case (int) I::beq: case (int) I::bne: case (int) I::blt:
+            case (int) I::bge: case (int) I::bltu: case (int) I::bgeu:
+                return pc + int64_t(std::get<int12>(args[2])) * 2;
+            case (int) C::c_beqz: case (int) C::c_bnez:
+                return pc + int64_t(std::get<int8>(args[1])) * 2;
+            default:
+                return std::nullopt;
+        }
+    }
+}
+
+namespace rv64 {
+    std::optional<PredictorKind> predictor_kind_from_name(std::string_view name) noexcept {
+        if (name == "static") return PredictorKind::Static;
+        if (name == "bimodal") return PredictorKind::Bimodal;
+        if (name == "gshare") return PredictorKind::Gshare;
+        if (name == "tage") return PredictorKind::Tage;
+        return std::nullopt;
+    }
+
+    std::unique_ptr<BranchPredictor> make_branch_predictor(PredictorKind kind, uint32_t table_bits) {
+        switch (kind) {
+            case PredictorKind::Static: return std::make_unique<StaticPredictor>();
+            case PredictorKind::Bimodal: return std::make_unique<BimodalPredictor>(table_bits);
+            case PredictorKind::Gshare: return std::make_unique<GsharePredictor>(table_bits);
+            case PredictorKind::Tage: return std::make_unique<TagePredictor>(table_bits);
+        }
+        return nullptr;
+    }
+
+    std::optional<std::string> BranchModel::validate(const Config &config) {
+        if (config.table_bits < 1 || config.table_bits > 24)
+            return std::format("Branch predictor table size of 2^{} entries is outside 2^1..2^24", config.table_bits);
+        if (!std::has_single_bit(config.btb_entries))
+            return std::format("BTB entry count {} is not a power of two", config.btb_entries);
+        if (config.ras_depth == 0)
+            return std::string("Return address stack depth must be at least 1");
+        return std::nullopt;
+    }
+
+    BranchModel::BranchModel(const Config &config, size_t program_size)
+        : m_config(config)
+        , m_predictor(make_branch_predictor(config.predictor, config.table_bits))
+        , m_btb(config.btb_entries)
+        , m_ras(config.ras_depth)
+        , m_branches(program_size) {}
+
+    bool BranchModel::is_control_flow(const Instruction &inst) noexcept {
+        switch (inst.get_prototype().id) {
+            case (int) I::beq: case (int) I::bne: case (int) I::blt:
+            case (int) I::bge: case (int) I::bltu: case (int) I::bgeu:
+            case (int) I::jal: case (int) I::jalr:
+            case (int) C::c_beqz: case (int) C::c_bnez:
+            case (int) C::c_j: case (int) C::c_jr: case (int) C::c_jalr:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void BranchModel::record(uint64_t pc, uint32_t index, const Instruction &inst, uint64_t next_pc) {
+        uint64_t fall_through = pc + inst.byte_size();
+        if (auto target = branch_target(pc, inst)) {
+            bool taken = next_pc != fall_through;
+            bool predicted = m_predictor->predict(pc, *target);
+            m_predictor->update(pc, *target, taken);
+            ++m_stats.branches;
+            m_stats.taken += taken;
+            m_stats.mispredicted += predicted != taken;
+            // the BTB learns every taken branch; a miss only costs when the direction was right
+            if (taken && !btb_lookup(pc, *target) && predicted)
+                ++m_stats.btb_misses;
+            if (index < m_branches.size()) {
+                auto &branch = m_branches[index];
+                ++branch.executed;
+                branch.taken += taken;
+                branch.mispredicted += predicted != taken;
+            }
+            return;
+        }
+
+        const auto &args = inst.get_args();
+        auto reg = [&](size_t i) { return std::get<Reg>(args[i]).idx(); };
+        size_t rd, rs1 = 0;
+        bool indirect = true;
+        switch (inst.get_prototype().id) {
+            case (int) I::jal: rd = reg(0); indirect = false; break;
+            case (int) C::c_j: rd = 0; indirect = false; break;
+            case (int) I::jalr: rd = reg(0); rs1 = reg(1); break;
+            case (int) C::c_jr: rd = 0; rs1 = reg(0); break;
+            case (int) C::c_jalr: rd = 1; rs1 = reg(0); break;
+            default: return;
+        }
+
+        // return address stack hints of the RISC-V ISA manual (link registers x1 and x5)
+        bool pop = indirect && is_link(rs1) && (!is_link(rd) || rd != rs1);
+        if (pop) {
+            ++m_stats.returns;
+            auto predicted = ras_pop();
+            if (!predicted || *predicted != next_pc)
+                ++m_stats.ras_mispredicted;
+        } else {
+            ++m_stats.jumps;
+            if (!btb_lookup(pc, next_pc))
+                ++m_stats.btb_misses;
+        }
+        if (is_link(rd))
+            ras_push(fall_through);
+    }
+
+    bool BranchModel::btb_lookup(uint64_t pc, uint64_t target) {
+        auto &entry = m_btb[(pc >> 1) & (m_btb.size() - 1)];
+        bool hit = entry.valid && entry.pc == pc && entry.target == target;
+        entry = {pc, target, true};
+        return hit;
+    }
+
+    void BranchModel::ras_push(uint64_t address) {
+        m_ras_top = (m_ras_top + 1) % m_ras.size();
+        m_ras[m_ras_top] = address;
+        m_ras_size = std::min(m_ras_size + 1, m_ras.size());
+    }
+
+    std::optional<uint64_t> BranchModel::ras_pop() {
+        if (m_ras_size == 0)
+            return std::nullopt;
+        uint64_t address = m_ras[m_ras_top];
+        m_ras_top = (m_ras_top + m_ras.size() - 1) % m_ras.size();
+        --m_ras_size;
+        return address;
+    }
+
+    std::string BranchModel::report(const VM &vm, size_t top_n) const {
+        auto percent = [](uint64_t part, uint64_t whole) { return whole ? 100.0 * double(part) / double(whole) : 0.0; };
+        const auto &s = m_stats;
+        std::string out = std::format("predictor: {} (2^{} entries), BTB: {} entries, RAS: {} entries\n",
+                                      m_predictor->name(), m_config.table_bits, m_config.btb_entries,
+                                      m_config.ras_depth);
+        out += std::format("conditional branches: {} ({:.2f}% taken), mispredicted: {} ({:.2f}%)\n", s.branches,
+                           percent(s.taken, s.branches), s.mispredicted, 100.0 * s.mispredict_rate());
+        out += std::format("jumps: {}, BTB misses: {}\n", s.jumps, s.btb_misses);
+        out += std::format("returns: {}, RAS mispredicted: {} ({:.2f}%)\n", s.returns, s.ras_mispredicted,
+                           percent(s.ras_mispredicted, s.returns));
+
+        struct Row {
+            uint64_t pc;
+            BranchStats stats;
+        };
+        std::vector<Row> rows;
+        const auto &memory = vm.m_memory;
+        for (uint64_t pc = memory.get_instruction_begin_addr(); pc < memory.get_instruction_end_addr();
+             pc += memory.get_instruction_size(pc) ? memory.get_instruction_size(pc) : 2) {
+            auto index = memory.get_program_index(pc);
+            if (index < m_branches.size() && m_branches[index].executed)
+                rows.push_back({pc, m_branches[index]});
+        }
+        std::ranges::stable_sort(rows, std::greater{}, [](const Row &row) { return row.stats.mispredicted; });
+        if (rows.empty())
+            return out;
+
+        out += std::format("\n{:>18} {:>6} {:>12} {:>7} {:>12} {:>7}  {}\n", "pc", "line", "executed", "taken",
+                           "mispredicted", "rate", "instruction");
+        for (const auto &row: rows | std::views::take(top_n)) {
+            MemErr err;
+            auto fetch = memory.get_instruction_at(row.pc, err);
+            auto text = fetch.inst.to_string();
+            if (const auto *symbol = vm.find_symbol(row.pc))
+                text = std::format("{:<28} <{}+{:#x}>", text, symbol->name, row.pc - symbol->address);
+            out += std::format("{:#18x} {:>6} {:>12} {:>6.2f}% {:>12} {:>6.2f}%  {}\n", row.pc,
+                               fetch.lineno ? std::to_string(*fetch.lineno) : "-", row.stats.executed,
+                               percent(row.stats.taken, row.stats.executed), row.stats.mispredicted,
+                               percent(row.stats.mispredicted, row.stats.executed), text);
+        }
+        return out;
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <Instruction.hpp>
+
+namespace rv64 {
+    class VM;
+
+    /// @brief Conditional branch direction predictor. predict() and update() are called in pairs
+    /// for every executed branch, in execution order.
+    class BranchPredictor {
+    public:
+        virtual ~BranchPredictor() = default;
+
+        /// @param target address the branch jumps to when taken
+        [[nodiscard]] virtual bool predict(uint64_t pc, uint64_t target) = 0;
+        virtual void update(uint64_t pc, uint64_t target, bool taken) = 0;
+        [[nodiscard]] virtual std::string_view name() const noexcept = 0;
+    };
+
+    enum class PredictorKind {
+        Static,  ///< backward taken, forward not taken
+        Bimodal, ///< 2-bit saturating counters indexed by pc
+        Gshare,  ///< 2-bit counters indexed by pc xor global history
+        Tage     ///< bimodal base plus tagged tables of geometrically growing history lengths
+    };
+
+    /// @return PredictorKind with the given name (as listed in PredictorKind), nullopt if none
+    [[nodiscard]] std::optional<PredictorKind> predictor_kind_from_name(std::string_view name) noexcept;
+
+    /// @param table_bits log2 of the number of entries of each table
+    [[nodiscard]] std::unique_ptr<BranchPredictor> make_branch_predictor(PredictorKind kind, uint32_t table_bits);
+
+    /// @brief Branch prediction model of the fetch stage: a direction predictor for conditional
+    /// branches, a direct-mapped branch target buffer for taken branches and jumps, and a return
+    /// address stack driven by the link register hints of jal/jalr (x1 and x5 are link registers).
+    class BranchModel {
+    public:
+        struct Config {
+            PredictorKind predictor = PredictorKind::Gshare;
+            uint32_t table_bits = 12; ///< 1..24
+            uint32_t btb_entries = 512; ///< power of two
+            uint32_t ras_depth = 16;
+        };
+
+        struct Stats {
+            uint64_t branches = 0;       ///< executed conditional branches
+            uint64_t taken = 0;
+            uint64_t mispredicted = 0;   ///< wrong direction
+            uint64_t jumps = 0;          ///< jal/jalr other than returns
+            uint64_t btb_misses = 0;     ///< taken branches and jumps without the right target in the BTB
+            uint64_t returns = 0;
+            uint64_t ras_mispredicted = 0;
+
+            [[nodiscard]] double mispredict_rate() const noexcept {
+                return branches ? double(mispredicted) / double(branches) : 0.0;
+            }
+        };
+
+        /// Statistics of one conditional branch instruction
+        struct BranchStats {
+            uint64_t executed = 0;
+            uint64_t taken = 0;
+            uint64_t mispredicted = 0;
+        };
+
+        /// @return optional string with error message
+        [[nodiscard]] static std::optional<std::string> validate(const Config &config);
+
+        /// @param config must be valid (see validate)
+        /// @param program_size number of instruction slots of the loaded program
+        BranchModel(const Config &config, size_t program_size);
+
+        /// @brief feeds an executed instruction; anything but branches and jumps is ignored
+        /// @param index instruction slot (see Memory::get_program_index)
+        /// @param next_pc pc after the instruction
+        void record(uint64_t pc, uint32_t index, const Instruction &inst, uint64_t next_pc);
+
+        /// @return true if the instruction is a conditional branch or a jump
+        [[nodiscard]] static bool is_control_flow(const Instruction &inst) noexcept;
+
+        [[nodiscard]] const Stats &stats() const noexcept { return m_stats; }
+        /// @return statistics per instruction slot, all zero for instructions that are not branches
+        [[nodiscard]] const std::vector<BranchStats> &branch_stats() const noexcept { return m_branches; }
+        [[nodiscard]] const BranchPredictor &predictor() const noexcept { return *m_predictor; }
+
+        /// @brief totals followed by the branches with the most mispredictions
+        [[nodiscard]] std::string report(const VM &vm, size_t top_n = 20) const;
+
+    private:
+        struct BtbEntry {
+            uint64_t pc = 0;
+            uint64_t target = 0;
+            bool valid = false;
+        };
+
+        /// @brief looks up the BTB and trains it with the actual target
+        /// @return true if the BTB held the target
+        bool btb_lookup(uint64_t pc, uint64_t target);
+        void ras_push(uint64_t address);
+        [[nodiscard]] std::optional<uint64_t> ras_pop();
+
+        Config m_config;
+        std::unique_ptr<BranchPredictor> m_predictor;
+        std::vector<BtbEntry> m_btb;
+        std::vector<uint64_t> m_ras; ///< circular, the oldest entries are overwritten
+        size_t m_ras_top = 0;
+        size_t m_ras_size = 0;
+        Stats m_stats;
+        std::vector<BranchStats> m_branches;
+    };
+}
@@ -0,0 +1,269 @@
+#include "CacheModel.hpp"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <map>
+#include <ranges>
+
+#include "VM.hpp"
+
+namespace {
+    using namespace rv64;
+    using Level = CacheHierarchy::Level;
+    using Region = CacheHierarchy::Region;
+
+    constexpr uint64_t MIN_INSTR_SIZE = 2;
+    constexpr uint32_t LRU_BITS = 4; // bits per way index in the packed LRU order
+
+    std::string_view level_name(size_t level) {
+        constexpr std::array<std::string_view, CacheHierarchy::LEVEL_CNT> names{"L1I", "L1D", "L2"};
+        return names[level];
+    }
+
+    std::string_view region_name(size_t region) {
+        constexpr std::array<std::string_view, CacheHierarchy::REGION_CNT> names{"code", "data", "stack"};
+        return names[region];
+    }
+
+    std::string stats_row(std::string_view name, const CacheStats &s) {
+        return std::format("  {:<6} {:>12} {:>12} {:>12} {:>7.2f}% {:>10} {:>10}\n", name, s.accesses(), s.hits,
+                           s.misses, 100.0 * s.miss_rate(), s.evictions, s.writebacks);
+    }
+}
+
+namespace rv64 {
+    CacheStats &CacheStats::operator+=(const CacheStats &other) noexcept {
+        hits += other.hits;
+        misses += other.misses;
+        evictions += other.evictions;
+        writebacks += other.writebacks;
+        return *this;
+    }
+
+    std::optional<std::string> Cache::validate(const Config &config) {
+        if (!std::has_single_bit(config.sets))
+            return std::format("Cache set count {} is not a power of two", config.sets);
+        if (!std::has_single_bit(config.line_size) || config.line_size < 4)
+            return std::format("Cache line size {} is not a power of two of at least 4 bytes", config.line_size);
+        if (config.ways == 0 || config.ways > MAX_WAYS)
+            return std::format("Cache associativity {} is outside 1..{}", config.ways, MAX_WAYS);
+        if (config.replacement == Replacement::PseudoLru && !std::has_single_bit(config.ways))
+            return std::format("Pseudo-LRU needs a power-of-two number of ways, not {}", config.ways);
+        return std::nullopt;
+    }
+
+    Cache::Cache(const Config &config)
+        : m_config(config)
+        , m_line_bits(static_cast<uint32_t>(std::countr_zero(config.line_size)))
+        , m_tags(size_t(config.sets) * config.ways, 0)
+        , m_policy(config.sets, 0) {
+        if (m_config.replacement == Replacement::Lru) {
+            uint64_t order = 0;
+            for (uint32_t way = 0; way < m_config.ways; ++way)
+                order |= uint64_t(way) << (way * LRU_BITS);
+            std::ranges::fill(m_policy, order);
+        }
+    }
+
+    Cache::Result Cache::access(uint64_t address, bool write) {
+        Result result;
+        uint64_t line = address >> m_line_bits;
+        auto set = static_cast<uint32_t>(line & (m_config.sets - 1));
+        uint64_t *ways = &m_tags[size_t(set) * m_config.ways];
+        bool dirty = write && m_config.write_back;
+
+        for (uint32_t way = 0; way < m_config.ways; ++way) {
+            if ((ways[way] & VALID) && (ways[way] >> 2) == line) {
+                if (dirty)
+                    ways[way] |= DIRTY;
+                touch(set, way);
+                ++m_stats.hits;
+                result.hit = true;
+                return result;
+            }
+        }
+
+        ++m_stats.misses;
+        if (write && !m_config.write_allocate)
+            return result;
+
+        auto way = static_cast<uint32_t>(std::ranges::find_if(ways, ways + m_config.ways, [](uint64_t tag) {
+            return !(tag & VALID);
+        }) - ways);
+        if (way == m_config.ways) {
+            way = victim(set);
+            result.evicted = true;
+            result.writeback = ways[way] & DIRTY;
+            result.victim_address = (ways[way] >> 2) << m_line_bits;
+            ++m_stats.evictions;
+            m_stats.writebacks += result.writeback;
+        }
+        ways[way] = line << 2 | VALID | (dirty ? DIRTY : 0);
+        touch(set, way);
+        return result;
+    }
+
+    void Cache::touch(uint32_t set, uint32_t way) noexcept {
+        uint64_t &state = m_policy[set];
+        if (m_config.replacement == Replacement::Lru) {
+            // move the way to the front of the order
+            uint32_t pos = 0;
+            while (((state >> (pos * LRU_BITS)) & 0xF) != way)
+                ++pos;
+            uint64_t before = state & ((uint64_t(1) << (pos * LRU_BITS)) - 1);
+            uint64_t after = pos + 1 < MAX_WAYS ? state >> ((pos + 1) * LRU_BITS) << ((pos + 1) * LRU_BITS) : 0;
+            state = after | before << LRU_BITS | way;
+            return;
+        }
+        // tree node n (1-based, heap order) is bit n and points towards the next victim
+        uint32_t node = 1;
+        for (auto level = static_cast<uint32_t>(std::countr_zero(m_config.ways)); level-- > 0;) {
+            uint64_t bit = (way >> level) & 1;
+            state = (state & ~(uint64_t(1) << node)) | (bit ^ 1) << node;
+            node = node * 2 + static_cast<uint32_t>(bit);
+        }
+    }
+
+    uint32_t Cache::victim(uint32_t set) const noexcept {
+        uint64_t state = m_policy[set];
+        if (m_config.replacement == Replacement::Lru)
+            return static_cast<uint32_t>((state >> ((m_config.ways - 1) * LRU_BITS)) & 0xF);
+        uint32_t node = 1;
+        while (node < m_config.ways)
+            node = node * 2 + static_cast<uint32_t>((state >> node) & 1);
+        return node - m_config.ways;
+    }
+
+    std::optional<std::string> CacheHierarchy::validate(const Config &config) {
+        for (const auto *cache: {&config.l1i, &config.l1d, &config.l2}) {
+            if (auto err = Cache::validate(*cache))
+                return err;
+        }
+        return std::nullopt;
+    }
+
+    CacheHierarchy::CacheHierarchy(const Config &config, size_t program_size)
+        : m_caches{Cache(config.l1i), Cache(config.l1d), Cache(config.l2)}
+        , m_instructions(program_size) {}
+
+    void CacheHierarchy::set_regions(uint64_t code_begin, uint64_t code_end,
+                                     uint64_t stack_begin, uint64_t stack_end) noexcept {
+        m_code_begin = code_begin;
+        m_code_end = code_end;
+        m_stack_begin = stack_begin;
+        m_stack_end = stack_end;
+    }
+
+    void CacheHierarchy::access(Level level, uint64_t address, size_t size, bool write) {
+        const auto &l1 = cache(level);
+        uint64_t last = l1.line_of(address + std::max<size_t>(size, 1) - 1);
+        for (uint64_t line = l1.line_of(address);; line += l1.config().line_size) {
+            auto result = access_line(level, std::max(line, address), write);
+            if (m_current < m_instructions.size()) {
+                auto &stats = level == Level::L1I ? m_instructions[m_current].fetch : m_instructions[m_current].data;
+                stats.hits += result.hit;
+                stats.misses += !result.hit;
+                stats.evictions += result.evicted;
+                stats.writebacks += result.writeback;
+            }
+            if (line == last)
+                break;
+        }
+    }
+
+    Cache::Result CacheHierarchy::access_line(Level level, uint64_t address, bool write) {
+        auto &l1 = m_caches[static_cast<size_t>(level)];
+        auto &l2 = m_caches[static_cast<size_t>(Level::L2)];
+        auto l2_access = [&](uint64_t addr, bool l2_write) { count(Level::L2, addr, l2.access(addr, l2_write)); };
+
+        auto result = l1.access(address, write);
+        count(level, address, result);
+        if (result.writeback)
+            l2_access(result.victim_address, true);
+
+        // a miss fills the line from L2; write-through stores and stores that bypass L1 write to L2
+        bool allocated = !result.hit && (!write || l1.config().write_allocate);
+        if (allocated)
+            l2_access(address, false);
+        if (write && (!l1.config().write_back || (!result.hit && !allocated)))
+            l2_access(address, true);
+        return result;
+    }
+
+    void CacheHierarchy::count(Level level, uint64_t address, const Cache::Result &result) {
+        auto &stats = m_region_stats[static_cast<size_t>(level)][static_cast<size_t>(region_of(address))];
+        stats.hits += result.hit;
+        stats.misses += !result.hit;
+        stats.evictions += result.evicted;
+        stats.writebacks += result.writeback;
+    }
+
+    CacheHierarchy::Region CacheHierarchy::region_of(uint64_t address) const noexcept {
+        if (address >= m_code_begin && address < m_code_end)
+            return Region::Code;
+        if (address >= m_stack_begin && address < m_stack_end)
+            return Region::Stack;
+        return Region::Data;
+    }
+
+    std::string CacheHierarchy::report(const VM &vm, size_t top_n) const {
+        std::string out;
+        for (size_t level = 0; level < LEVEL_CNT; ++level) {
+            const auto &c = m_caches[level].config();
+            out += std::format("{}: {} KiB, {}-way, {} sets, {} B lines, {}, {}, {}\n", level_name(level),
+                               c.size() / 1024, c.ways, c.sets, c.line_size,
+                               c.replacement == Cache::Replacement::Lru ? "LRU" : "pseudo-LRU",
+                               c.write_back ? "write-back" : "write-through",
+                               c.write_allocate ? "write-allocate" : "no-write-allocate");
+            out += std::format("  {:<6} {:>12} {:>12} {:>12} {:>8} {:>10} {:>10}\n", "", "accesses", "hits",
+                               "misses", "miss", "evictions", "writebacks");
+            out += stats_row("total", m_caches[level].stats());
+            for (size_t region = 0; region < REGION_CNT; ++region) {
+                if (m_region_stats[level][region].accesses())
+                    out += stats_row(region_name(region), m_region_stats[level][region]);
+            }
+        }
+
+        // L1 statistics per source line; code without source is listed per instruction
+        struct Row {
+            std::string label;
+            InstructionStats stats;
+        };
+        std::map<size_t, InstructionStats> lines;
+        std::vector<Row> rows;
+        const auto &memory = vm.m_memory;
+        for (uint64_t pc = memory.get_instruction_begin_addr(); pc < memory.get_instruction_end_addr();
+             pc += MIN_INSTR_SIZE) {
+            auto index = memory.get_program_index(pc);
+            if (index >= m_instructions.size())
+                continue;
+            const auto &stats = m_instructions[index];
+            if (stats.fetch.accesses() == 0 && stats.data.accesses() == 0)
+                continue;
+            MemErr err;
+            auto fetch = memory.get_instruction_at(pc, err);
+            if (fetch.lineno) {
+                lines[*fetch.lineno].fetch += stats.fetch;
+                lines[*fetch.lineno].data += stats.data;
+            } else {
+                rows.push_back({std::format("{:#x}", pc), stats});
+            }
+        }
+        for (const auto &[line, stats]: lines)
+            rows.push_back({std::format("line {}", line), stats});
+        std::ranges::stable_sort(rows, std::greater{}, [](const Row &row) {
+            return row.stats.fetch.misses + row.stats.data.misses;
+        });
+
+        if (!rows.empty()) {
+            out += std::format("\n{:<12} {:>12} {:>12} {:>12} {:>12}\n", "", "L1I misses", "L1D accesses",
+                               "L1D misses", "L1D miss");
+            for (const auto &row: rows | std::views::take(top_n)) {
+                out += std::format("{:<12} {:>12} {:>12} {:>12} {:>11.2f}%\n", row.label, row.stats.fetch.misses,
+                                   row.stats.data.accesses(), row.stats.data.misses,
+                                   100.0 * row.stats.data.miss_rate());
+            }
+        }
+        return out;
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace rv64 {
+    class VM;
+
+    /// @brief Hit/miss counters of a cache (or of a part of its accesses)
+    struct CacheStats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;  ///< valid lines replaced
+        uint64_t writebacks = 0; ///< dirty lines written to the next level
+
+        [[nodiscard]] uint64_t accesses() const noexcept { return hits + misses; }
+        [[nodiscard]] double miss_rate() const noexcept {
+            return accesses() ? double(misses) / double(accesses()) : 0.0;
+        }
+        CacheStats &operator+=(const CacheStats &other) noexcept;
+    };
+
+    /// @brief Set-associative cache model; only tags are kept, the data lives in Memory.
+    ///
+    /// Every way is one word of the tag array (line address << 2 | dirty << 1 | valid) and the
+    /// replacement state of a set is a single word as well: the LRU order as 4-bit way indices
+    /// (most recent first) or the tree bits of pseudo-LRU.
+    class Cache {
+    public:
+        enum class Replacement {
+            Lru,
+            PseudoLru ///< tree pseudo-LRU, needs a power-of-two number of ways
+        };
+
+        struct Config {
+            uint32_t sets = 64;
+            uint32_t ways = 8;       ///< 1..MAX_WAYS
+            uint32_t line_size = 64; ///< bytes, power of two
+            Replacement replacement = Replacement::Lru;
+            bool write_back = true;     ///< false: write-through, stores also go to the next level
+            bool write_allocate = true; ///< false: store misses bypass the cache
+
+            [[nodiscard]] uint64_t size() const noexcept { return uint64_t(sets) * ways * line_size; }
+        };
+
+        static constexpr uint32_t MAX_WAYS = 16;
+
+        struct Result {
+            bool hit = false;
+            bool evicted = false;    ///< a valid line was replaced
+            bool writeback = false;  ///< the replaced line was dirty
+            uint64_t victim_address = 0;
+        };
+
+        /// @return optional string with error message
+        [[nodiscard]] static std::optional<std::string> validate(const Config &config);
+
+        /// @param config must be valid (see validate)
+        explicit Cache(const Config &config);
+
+        /// @brief looks up the line containing the address and, on a miss, allocates it
+        /// (unless it is a store and the cache does not allocate on writes)
+        Result access(uint64_t address, bool write);
+
+        [[nodiscard]] const Config &config() const noexcept { return m_config; }
+        [[nodiscard]] const CacheStats &stats() const noexcept { return m_stats; }
+        /// @return address of the first byte of the line containing the address
+        [[nodiscard]] uint64_t line_of(uint64_t address) const noexcept {
+            return address & ~uint64_t(m_config.line_size - 1);
+        }
+
+    private:
+        static constexpr uint64_t VALID = 1, DIRTY = 2;
+
+        void touch(uint32_t set, uint32_t way) noexcept;
+        [[nodiscard]] uint32_t victim(uint32_t set) const noexcept;
+
+        Config m_config;
+        uint32_t m_line_bits;
+        std::vector<uint64_t> m_tags;   ///< sets * ways entries
+        std::vector<uint64_t> m_policy; ///< replacement state, one word per set
+        CacheStats m_stats;
+    };
+
+    /// @brief Split L1 instruction and data caches backed by a unified L2. Fed with the guest's
+    /// instruction fetches (by VM) and loads and stores (by Memory, see Memory::set_cache_model);
+    /// statistics are kept per cache, per memory region and per executed instruction.
+    class CacheHierarchy {
+    public:
+        struct Config {
+            Cache::Config l1i{};
+            Cache::Config l1d{};
+            Cache::Config l2{.sets = 512};
+        };
+
+        enum class Level { L1I, L1D, L2, Count };
+        enum class Region { Code, Data, Stack, Count }; ///< Data covers everything outside code and stack
+        static constexpr size_t LEVEL_CNT = static_cast<size_t>(Level::Count);
+        static constexpr size_t REGION_CNT = static_cast<size_t>(Region::Count);
+        static constexpr uint32_t NO_INSTRUCTION = UINT32_MAX;
+
+        /// Statistics of the L1 accesses of one instruction
+        struct InstructionStats {
+            CacheStats fetch;
+            CacheStats data;
+        };
+
+        /// @return optional string with error message
+        [[nodiscard]] static std::optional<std::string> validate(const Config &config);
+
+        /// @param config must be valid (see validate)
+        /// @param program_size number of instruction slots of the loaded program
+        CacheHierarchy(const Config &config, size_t program_size);
+
+        /// @brief address ranges used for the per-region statistics
+        void set_regions(uint64_t code_begin, uint64_t code_end, uint64_t stack_begin, uint64_t stack_end) noexcept;
+        /// @brief attributes the following accesses to the instruction slot (NO_INSTRUCTION for none)
+        void set_current_instruction(uint32_t index) noexcept { m_current = index; }
+
+        void fetch(uint64_t address, size_t size) { access(Level::L1I, address, size, false); }
+        void load(uint64_t address, size_t size) { access(Level::L1D, address, size, false); }
+        void store(uint64_t address, size_t size) { access(Level::L1D, address, size, true); }
+
+        [[nodiscard]] const Cache &cache(Level level) const noexcept { return m_caches[static_cast<size_t>(level)]; }
+        [[nodiscard]] const CacheStats &region_stats(Level level, Region region) const noexcept {
+            return m_region_stats[static_cast<size_t>(level)][static_cast<size_t>(region)];
+        }
+        /// @return statistics per instruction slot (see Memory::get_program_index)
+        [[nodiscard]] const std::vector<InstructionStats> &instruction_stats() const noexcept { return m_instructions; }
+
+        /// @brief summary per cache and region followed by the source lines (or, without source,
+        /// instructions) with the most L1 misses
+        [[nodiscard]] std::string report(const VM &vm, size_t top_n = 20) const;
+
+    private:
+        void access(Level level, uint64_t address, size_t size, bool write);
+        /// @return the Cache::Result of the L1 cache
+        Cache::Result access_line(Level level, uint64_t address, bool write);
+        void count(Level level, uint64_t address, const Cache::Result &result);
+        [[nodiscard]] Region region_of(uint64_t address) const noexcept;
+
+        std::array<Cache, LEVEL_CNT> m_caches;
+        std::array<std::array<CacheStats, REGION_CNT>, LEVEL_CNT> m_region_stats{};
+        std::vector<InstructionStats> m_instructions;
+        uint32_t m_current = NO_INSTRUCTION;
+        uint64_t m_code_begin = 0, m_code_end = 0;
+        uint64_t m_stack_begin = 0, m_stack_end = 0;
+    };
+}
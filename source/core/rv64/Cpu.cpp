@@ -1,6 +1,7 @@
 #include "Cpu.hpp"
 #include <cassert>
 #include <format>
+#include <algorithm>
 #include <ui.hpp>
 
 #include "VM.hpp"
@@ -45,9 +46,7 @@ namespace rv64 {
 
     bool Cpu::next_cycle() {
         MemErr mem_err;
-        // preserve previous reg states
-        for (int i = 0; i < m_int_regs.size(); i++)
-            m_int_regs_prev_vals[i] = m_int_regs[i].val();
+        save_prev_reg_vals();
 
         auto fetch = m_vm.m_memory.get_instruction_at(get_pc(), mem_err);
         if (mem_err != MemErr::None) {
@@ -60,7 +59,187 @@ namespace rv64 {
 
         m_pc += fetch.inst.byte_size();
         m_interpreter.exec_instruction(fetch.inst);
+        return finish_cycle();
+    }
+
+    bool Cpu::next_fused_cycle(uint64_t max_instructions, uint64_t &executed) {
+        const FusedOp *op = m_vm.m_memory.get_fused_at(m_pc);
+        bool split = !op || op->count > max_instructions;
+        // stepping must stop before an inner instruction whose line has a breakpoint
+        if (!split && !m_breakpoints.empty()) {
+            for (size_t i = 0; i + 1 < op->count; ++i)
+                split |= m_breakpoints.contains(op->inner_lines[i]);
+        }
+        if (split) {
+            executed = 1;
+            return next_cycle();
+        }
+
+        save_prev_reg_vals();
+        executed = op->count;
+        exec_fused(*op);
+        return finish_cycle();
+    }
+
+    void Cpu::exec_fused(const FusedOp &op) {
+        uint64_t pc = m_pc;
+        m_pc += op.byte_size;
+        switch (op.kind) {
+            case FusedOp::Kind::LoadImmediate:
+                m_int_regs[op.rd] = op.imm;
+                break;
+            case FusedOp::Kind::FarJump: {
+                m_int_regs[op.rs1] = pc + op.imm;
+                uint64_t target = m_int_regs[op.rs1].sval() + op.imm2;
+                m_int_regs[op.rd] = m_pc;
+                set_pc(target);
+                break;
+            }
+            case FusedOp::Kind::AddiBranch: {
+                m_int_regs[op.rd] = m_int_regs[op.rs1].sval() + op.imm;
+                const auto &lhs = m_int_regs[op.rs2], &rhs = m_int_regs[op.rs3];
+                bool taken = false;
+                switch (op.cond) {
+                    case FusedOp::Cond::Eq: taken = lhs.val() == rhs.val(); break;
+                    case FusedOp::Cond::Ne: taken = lhs.val() != rhs.val(); break;
+                    case FusedOp::Cond::Lt: taken = lhs.sval() < rhs.sval(); break;
+                    case FusedOp::Cond::Ge: taken = lhs.sval() >= rhs.sval(); break;
+                    case FusedOp::Cond::Ltu: taken = lhs.val() < rhs.val(); break;
+                    case FusedOp::Cond::Geu: taken = lhs.val() >= rhs.val(); break;
+                }
+                if (taken) // relative to the branch, which is the 4-byte addi's successor
+                    set_pc(pc + 4 + op.imm2);
+                break;
+            }
+            case FusedOp::Kind::IndexedLoad:
+                m_int_regs[op.rs1] = m_int_regs[op.rs2].val() << op.imm;
+                m_int_regs[op.rs1] = m_int_regs[op.rs3].sval() + m_int_regs[op.rs1].sval();
+                m_interpreter.ld(m_int_regs[op.rd], m_int_regs[op.rs1], op.imm2);
+                break;
+            case FusedOp::Kind::None:
+                assert(false && "None is never returned by get_fused_at");
+                break;
+        }
+    }
+
+    bool Cpu::next_block(uint64_t max_instructions, uint64_t &executed) {
+        const IrBlock *block = m_vm.m_blocks.get(m_vm.m_memory, m_pc);
+        bool split = !block || block->insts.size() > max_instructions;
+        if (!split && !m_breakpoints.empty()) {
+            for (auto line: block->inner_lines)
+                split |= m_breakpoints.contains(line);
+        }
+        if (split) {
+            executed = 1;
+            return next_cycle();
+        }
+
+        save_prev_reg_vals();
+        executed = m_vm.get_config().m_validate_blocks ? exec_block_validated(*block) : exec_block(*block);
+        return finish_cycle();
+    }
+
+    size_t Cpu::exec_block(const IrBlock &block) {
+        for (const auto &op: block.ops) {
+            switch (op.code) {
+                case IrOp::Code::Const:
+                    m_int_regs[op.rd] = op.imm;
+                    break;
+                case IrOp::Code::Mov:
+                    m_int_regs[op.rd] = m_int_regs[op.rs1].val();
+                    break;
+                case IrOp::Code::AddImm:
+                    m_int_regs[op.rd] = m_int_regs[op.rs1].val() + uint64_t(op.imm);
+                    break;
+                case IrOp::Code::AddImmW:
+                    m_int_regs[op.rd] = static_cast<int32_t>(m_int_regs[op.rs1].as_u32() + uint32_t(op.imm));
+                    break;
+                case IrOp::Code::SextW:
+                    m_int_regs[op.rd] = m_int_regs[op.rs1].as_i32();
+                    break;
+                case IrOp::Code::Load:
+                case IrOp::Code::Store:
+                case IrOp::Code::Exec:
+                    m_pc = block.next_pcs[op.inst];
+                    m_interpreter.exec_instruction(block.insts[op.inst]);
+                    if (m_vm.get_state() == VMState::Error)
+                        return op.inst + 1;
+                    break;
+            }
+        }
+        if (!block.ends_with_jump)
+            m_pc = block.end_pc;
+        return block.insts.size();
+    }
+
+    size_t Cpu::exec_block_validated(const IrBlock &block) {
+        auto regs_before = m_int_regs;
+        uint64_t pc_before = m_pc;
+        size_t line = m_interpreter.get_current_line();
+        std::vector<Memory::StoreRecord> journal;
+        auto *outer_journal = m_vm.m_memory.get_store_journal(); // e.g. History's
+
+        // reference run, fetching from memory rather than from the block
+        m_vm.m_memory.set_store_journal(&journal);
+        size_t ref_executed = 0;
+        while (ref_executed < block.insts.size() && m_vm.get_state() == VMState::Running) {
+            MemErr err;
+            auto fetch = m_vm.m_memory.get_instruction_at(m_pc, err);
+            m_pc += fetch.inst.byte_size();
+            m_interpreter.exec_instruction(fetch.inst);
+            ++ref_executed;
+        }
+        m_vm.m_memory.set_store_journal(outer_journal);
+        if (outer_journal)
+            outer_journal->insert(outer_journal->end(), journal.begin(), journal.end());
+        if (m_vm.get_state() != VMState::Running)
+            return ref_executed; // the reference result stands
+
+        auto ref_regs = m_int_regs;
+        uint64_t ref_pc = m_pc;
+        auto ref_journal = std::move(journal);
+        auto ref_values = m_vm.m_memory.journaled_values(ref_journal);
+        m_vm.m_memory.undo_stores(ref_journal);
+        m_int_regs = regs_before;
+        m_pc = pc_before;
+
+        journal.clear();
+        m_vm.m_memory.set_store_journal(&journal);
+        size_t executed = exec_block(block);
+        m_vm.m_memory.set_store_journal(outer_journal);
+        if (outer_journal)
+            outer_journal->insert(outer_journal->end(), journal.begin(), journal.end());
+        bool same_stores = std::ranges::equal(journal, ref_journal, [](const auto &a, const auto &b) {
+            return a.address == b.address && a.size == b.size;
+        }) && m_vm.m_memory.journaled_values(journal) == ref_values;
+
+        std::string diff;
+        if (m_vm.get_state() != VMState::Running) {
+            diff = "the IR stopped with an error";
+        } else if (m_pc != ref_pc) {
+            diff = std::format("pc = 0x{:x}, expected 0x{:x}", m_pc, ref_pc);
+        } else if (!same_stores) {
+            diff = "the IR wrote different memory";
+        } else {
+            for (size_t i = 0; i < INT_REG_CNT && diff.empty(); i++) {
+                if (m_int_regs[i].val() != ref_regs[i].val())
+                    diff = std::format("x{} = 0x{:x}, expected 0x{:x}", i, m_int_regs[i].val(), ref_regs[i].val());
+            }
+        }
+        if (!diff.empty()) {
+            ui::print_error(std::format("Block validation failed for the block at 0x{:x} (line {}): {}",
+                                        block.start_pc, line, diff));
+            m_vm.error_stop();
+        }
+        return executed;
+    }
+
+    void Cpu::save_prev_reg_vals() noexcept {
+        for (size_t i = 0; i < m_int_regs.size(); i++)
+            m_int_regs_prev_vals[i] = m_int_regs[i].val();
+    }
 
+    bool Cpu::finish_cycle() {
         // update current source line via interpreter
         MemErr next_err;
         auto next_fetch = m_vm.m_memory.get_instruction_at(get_pc(), next_err);
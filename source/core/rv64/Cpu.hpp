@@ -4,6 +4,7 @@
 #include <rv64/GPIntReg.hpp>
 #include <set>
 
+#include "BlockIR.hpp"
 #include "Interpreter.hpp"
 
 namespace rv64 {
@@ -34,6 +35,8 @@ namespace rv64 {
         [[nodiscard]] const GPIntReg &reg(int i) const noexcept;
         [[nodiscard]] GPIntReg &reg(Reg reg) noexcept;
         [[nodiscard]] const GPIntReg &reg(Reg reg) const noexcept;
+        /// @return all integer registers, x0 first
+        [[nodiscard]] const std::array<GPIntReg, INT_REG_CNT> &int_regs() const noexcept { return m_int_regs; }
 
         void print_cpu_state() const;
 
@@ -41,8 +44,35 @@ namespace rv64 {
         /// @return false if reached the last instruction, true otherwise
         bool next_cycle();
 
+        /// @brief like next_cycle, but a fused idiom (see FusedOp) starting at pc is executed
+        /// as a single step if it covers at most max_instructions and no breakpoint is set on
+        /// its inner lines; otherwise a single instruction is executed
+        /// @param executed set to the number of executed instructions
+        /// @return false if reached the last instruction, true otherwise
+        bool next_fused_cycle(uint64_t max_instructions, uint64_t &executed);
+
+        /// @brief like next_fused_cycle, but the whole translated block (see IrBlock) starting at
+        /// pc is executed if it covers at most max_instructions and no breakpoint is set on its
+        /// inner lines; with VMConfig::m_validate_blocks the block is checked against the
+        /// reference Interpreter first
+        /// @param executed set to the number of executed instructions
+        /// @return false if reached the last instruction, true otherwise
+        bool next_block(uint64_t max_instructions, uint64_t &executed);
+
         Interpreter m_interpreter;
     private:
+        void save_prev_reg_vals() noexcept;
+        /// @brief updates the current line and checks for a breakpoint after pc has moved
+        /// @return false if reached the last instruction, true otherwise
+        bool finish_cycle();
+        void exec_fused(const FusedOp &op);
+        /// @return number of executed instructions (fewer than the block's if it stopped with an error)
+        size_t exec_block(const IrBlock &block);
+        /// @brief runs the block with the reference Interpreter, rolls registers and memory back,
+        /// runs it through the IR and stops the VM with an error at the first difference
+        /// @return number of executed instructions
+        size_t exec_block_validated(const IrBlock &block);
+
         template<std::size_t... Is>
         static constexpr std::array<GPIntReg, sizeof...(Is)>
         reg_array_construct(std::index_sequence<Is...>) {
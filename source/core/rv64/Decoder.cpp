@@ -0,0 +1,281 @@
+#include "Decoder.hpp"
+#include <rv64/instruction_sets/Rv64IMC.hpp>
+
+namespace {
+    using namespace rv64;
+    using I = is::IBaseI::InstId;
+    using M = is::IExtensionM::InstId;
+    using C = is::IExtensionC::InstId;
+
+    template<typename Id>
+    Instruction make(Id id, InstArg a0 = {}, InstArg a1 = {}, InstArg a2 = {}) {
+        return Instruction::create(static_cast<int>(id), {a0, a1, a2});
+    }
+
+    /// sign-extends the low `bits` bits of value
+    constexpr int64_t sext(uint32_t value, int bits) {
+        auto shift = 64 - bits;
+        return static_cast<int64_t>(static_cast<uint64_t>(value) << shift) >> shift;
+    }
+
+    /// scaled compressed offsets are unsigned in the ISA but signed in the simulator
+    template<typename T>
+    constexpr bool fits(uint32_t scaled) {
+        return static_cast<int64_t>(scaled) <= T::MAX;
+    }
+
+    Instruction decode_op(uint32_t funct7, uint32_t funct3, Reg rd, Reg rs1, Reg rs2) {
+        static constexpr std::array<I, 8> base{I::add, I::sll, I::slt, I::sltu, I::xor_, I::srl, I::or_, I::and_};
+        static constexpr std::array<M, 8> mul{M::mul, M::mulh, M::mulhsu, M::mulhu, M::div, M::divu, M::rem, M::remu};
+
+        if (funct7 == 0b0000000)
+            return make(base[funct3], rd, rs1, rs2);
+        if (funct7 == 0b0000001)
+            return make(mul[funct3], rd, rs1, rs2);
+        if (funct7 == 0b0100000 && funct3 == 0b000)
+            return make(I::sub, rd, rs1, rs2);
+        if (funct7 == 0b0100000 && funct3 == 0b101)
+            return make(I::sra, rd, rs1, rs2);
+        return Instruction::invalid();
+    }
+
+    Instruction decode_op32(uint32_t funct7, uint32_t funct3, Reg rd, Reg rs1, Reg rs2) {
+        if (funct7 == 0b0000001) {
+            switch (funct3) {
+                case 0b000: return make(M::mulw, rd, rs1, rs2);
+                case 0b100: return make(M::divw, rd, rs1, rs2);
+                case 0b101: return make(M::divuw, rd, rs1, rs2);
+                case 0b110: return make(M::remw, rd, rs1, rs2);
+                case 0b111: return make(M::remuw, rd, rs1, rs2);
+                default: return Instruction::invalid();
+            }
+        }
+        if (funct7 == 0b0000000) {
+            switch (funct3) {
+                case 0b000: return make(I::addw, rd, rs1, rs2);
+                case 0b001: return make(I::sllw, rd, rs1, rs2);
+                case 0b101: return make(I::srlw, rd, rs1, rs2);
+                default: return Instruction::invalid();
+            }
+        }
+        if (funct7 == 0b0100000 && funct3 == 0b000)
+            return make(I::subw, rd, rs1, rs2);
+        if (funct7 == 0b0100000 && funct3 == 0b101)
+            return make(I::sraw, rd, rs1, rs2);
+        return Instruction::invalid();
+    }
+}
+
+namespace rv64 {
+    Instruction Decoder::decode(uint32_t raw) {
+        if (instruction_length(static_cast<uint16_t>(raw)) == 2)
+            return decode_compressed(static_cast<uint16_t>(raw));
+
+        uint32_t opcode = raw & 0x7F;
+        uint32_t funct3 = (raw >> 12) & 0x7;
+        uint32_t funct7 = raw >> 25;
+        Reg rd(static_cast<int>((raw >> 7) & 0x1F));
+        Reg rs1(static_cast<int>((raw >> 15) & 0x1F));
+        Reg rs2(static_cast<int>((raw >> 20) & 0x1F));
+
+        int64_t imm_i = sext(raw >> 20, 12);
+        int64_t imm_s = sext(((raw >> 20) & 0xFE0) | ((raw >> 7) & 0x1F), 12);
+        // branch and jump offsets are kept in halfwords, as resolve_symbols() produces them
+        int64_t imm_b = sext(((raw >> 19) & 0x1000) | ((raw << 4) & 0x800)
+                             | ((raw >> 20) & 0x7E0) | ((raw >> 7) & 0x1E), 13) / 2;
+        int64_t imm_j = sext(((raw >> 11) & 0x100000) | (raw & 0xFF000)
+                             | ((raw >> 9) & 0x800) | ((raw >> 20) & 0x7FE), 21) / 2;
+
+        switch (opcode) {
+            case 0b0110111: return make(I::lui, rd, int20(raw >> 12));
+            case 0b0010111: return make(I::auipc, rd, int20(raw >> 12));
+            case 0b1101111: return make(I::jal, rd, int20(imm_j));
+            case 0b1100111:
+                return funct3 == 0 ? make(I::jalr, rd, rs1, int12(imm_i)) : Instruction::invalid();
+
+            case 0b1100011: {
+                static constexpr std::array<int, 8> ids{
+                    (int) I::beq, (int) I::bne, -1, -1, (int) I::blt, (int) I::bge, (int) I::bltu, (int) I::bgeu
+                };
+                if (ids[funct3] < 0)
+                    return Instruction::invalid();
+                return make(ids[funct3], rs1, rs2, int12(imm_b));
+            }
+            case 0b0000011: {
+                static constexpr std::array<int, 8> ids{
+                    (int) I::lb, (int) I::lh, (int) I::lw, (int) I::ld, (int) I::lbu, (int) I::lhu, (int) I::lwu, -1
+                };
+                if (ids[funct3] < 0)
+                    return Instruction::invalid();
+                return make(ids[funct3], rd, rs1, int12(imm_i));
+            }
+            case 0b0100011: {
+                static constexpr std::array<I, 4> ids{I::sb, I::sh, I::sw, I::sd};
+                if (funct3 >= ids.size())
+                    return Instruction::invalid();
+                return make(ids[funct3], rs2, rs1, int12(imm_s));
+            }
+            case 0b0010011: {
+                uint32_t funct6 = raw >> 26;
+                uint6 shamt((raw >> 20) & 0x3F);
+                switch (funct3) {
+                    case 0b000: return make(I::addi, rd, rs1, int12(imm_i));
+                    case 0b010: return make(I::slti, rd, rs1, int12(imm_i));
+                    case 0b011: return make(I::sltiu, rd, rs1, int12(imm_i));
+                    case 0b100: return make(I::xori, rd, rs1, int12(imm_i));
+                    case 0b110: return make(I::ori, rd, rs1, int12(imm_i));
+                    case 0b111: return make(I::andi, rd, rs1, int12(imm_i));
+                    case 0b001:
+                        return funct6 == 0 ? make(I::slli, rd, rs1, shamt) : Instruction::invalid();
+                    case 0b101:
+                        if (funct6 == 0b000000) return make(I::srli, rd, rs1, shamt);
+                        if (funct6 == 0b010000) return make(I::srai, rd, rs1, shamt);
+                        return Instruction::invalid();
+                    default: return Instruction::invalid();
+                }
+            }
+            case 0b0011011: {
+                uint5 shamt((raw >> 20) & 0x1F);
+                switch (funct3) {
+                    case 0b000: return make(I::addiw, rd, rs1, int12(imm_i));
+                    case 0b001:
+                        return funct7 == 0 ? make(I::slliw, rd, rs1, shamt) : Instruction::invalid();
+                    case 0b101:
+                        if (funct7 == 0b0000000) return make(I::srliw, rd, rs1, shamt);
+                        if (funct7 == 0b0100000) return make(I::sraiw, rd, rs1, shamt);
+                        return Instruction::invalid();
+                    default: return Instruction::invalid();
+                }
+            }
+            case 0b0110011: return decode_op(funct7, funct3, rd, rs1, rs2);
+            case 0b0111011: return decode_op32(funct7, funct3, rd, rs1, rs2);
+            case 0b0001111:
+                return funct3 == 0 ? make(I::fence) : Instruction::invalid();
+            case 0b1110011:
+                if (raw == 0x00000073) return make(I::ecall);
+                if (raw == 0x00100073) return make(I::ebreak);
+                return Instruction::invalid();
+            default:
+                return Instruction::invalid();
+        }
+    }
+
+    Instruction Decoder::decode_compressed(uint16_t raw) {
+        uint32_t funct3 = raw >> 13;
+        int rd_idx = (raw >> 7) & 0x1F;
+        Reg rd(rd_idx);
+        Reg rs2((raw >> 2) & 0x1F);
+        Reg rd_p(8 + ((raw >> 7) & 0x7)); // rd'/rs1' in bits 9:7
+        Reg rs2_p(8 + ((raw >> 2) & 0x7)); // rd'/rs2' in bits 4:2
+        uint32_t imm6 = ((raw >> 7) & 0x20) | ((raw >> 2) & 0x1F);
+
+        switch (((raw & 0b11) << 3) | funct3) {
+            // --- quadrant 0 ---
+            case 0b00'000: {
+                uint32_t uimm = ((raw >> 7) & 0x30) | ((raw >> 1) & 0x3C0) | ((raw >> 4) & 0x4) | ((raw >> 2) & 0x8);
+                if (uimm == 0)
+                    return Instruction::invalid(); // also the all-zero illegal instruction
+                return make(C::c_addi4spn, rs2_p, uint8(uimm >> 2));
+            }
+            case 0b00'010:
+            case 0b00'110: {
+                uint32_t scaled = (((raw >> 7) & 0x38) | ((raw >> 4) & 0x4) | ((raw << 1) & 0x40)) >> 2;
+                if (!fits<int5>(scaled))
+                    return Instruction::invalid();
+                return make(funct3 == 0b010 ? C::c_lw : C::c_sw, rs2_p, rd_p, int5(scaled));
+            }
+            case 0b00'011:
+            case 0b00'111: {
+                uint32_t scaled = (((raw >> 7) & 0x38) | ((raw << 1) & 0xC0)) >> 3;
+                if (!fits<int5>(scaled))
+                    return Instruction::invalid();
+                return make(funct3 == 0b011 ? C::c_ld : C::c_sd, rs2_p, rd_p, int5(scaled));
+            }
+
+            // --- quadrant 1 ---
+            case 0b01'000: return make(C::c_addi, rd, int6(sext(imm6, 6)));
+            case 0b01'001:
+                return rd_idx != 0 ? make(C::c_addiw, rd, int6(sext(imm6, 6))) : Instruction::invalid();
+            case 0b01'010: return make(C::c_li, rd, int6(sext(imm6, 6)));
+            case 0b01'011: {
+                if (rd_idx == 2) {
+                    uint32_t nzimm = ((raw >> 3) & 0x200) | ((raw >> 2) & 0x10) | ((raw << 1) & 0x40)
+                                     | ((raw << 4) & 0x180) | ((raw << 3) & 0x20);
+                    if (nzimm == 0)
+                        return Instruction::invalid();
+                    return make(C::c_addi16sp, rd, int6(sext(nzimm, 10) >> 4));
+                }
+                if (imm6 == 0)
+                    return Instruction::invalid();
+                return make(C::c_lui, rd, int6(sext(imm6, 6)));
+            }
+            case 0b01'100: {
+                switch ((raw >> 10) & 0x3) {
+                    case 0b00: return make(C::c_srli, rd_p, uint6(imm6));
+                    case 0b01: return make(C::c_srai, rd_p, uint6(imm6));
+                    case 0b10: return make(C::c_andi, rd_p, int6(sext(imm6, 6)));
+                    default: break;
+                }
+                static constexpr std::array<C, 4> ops{C::c_sub, C::c_xor, C::c_or, C::c_and};
+                static constexpr std::array<C, 2> ops_w{C::c_subw, C::c_addw};
+                uint32_t funct2 = (raw >> 5) & 0x3;
+                if (!(raw & 0x1000))
+                    return make(ops[funct2], rd_p, rs2_p);
+                if (funct2 < ops_w.size())
+                    return make(ops_w[funct2], rd_p, rs2_p);
+                return Instruction::invalid();
+            }
+            case 0b01'101: {
+                uint32_t offset = ((raw >> 1) & 0x800) | ((raw >> 7) & 0x10) | ((raw >> 1) & 0x300)
+                                  | ((raw << 2) & 0x400) | ((raw >> 1) & 0x40) | ((raw << 1) & 0x80)
+                                  | ((raw >> 2) & 0xE) | ((raw << 3) & 0x20);
+                return make(C::c_j, int11(sext(offset, 12) / 2));
+            }
+            case 0b01'110:
+            case 0b01'111: {
+                uint32_t offset = ((raw >> 4) & 0x100) | ((raw >> 7) & 0x18) | ((raw << 1) & 0xC0)
+                                  | ((raw >> 2) & 0x6) | ((raw << 3) & 0x20);
+                return make(funct3 == 0b110 ? C::c_beqz : C::c_bnez, rd_p, int8(sext(offset, 9) / 2));
+            }
+
+            // --- quadrant 2 ---
+            case 0b10'000: return make(C::c_slli, rd, uint6(imm6));
+            case 0b10'010: {
+                uint32_t scaled = (((raw >> 7) & 0x20) | ((raw >> 2) & 0x1C) | ((raw << 4) & 0xC0)) >> 2;
+                if (rd_idx == 0 || !fits<int6>(scaled))
+                    return Instruction::invalid();
+                return make(C::c_lwsp, rd, int6(scaled));
+            }
+            case 0b10'011: {
+                uint32_t scaled = (((raw >> 7) & 0x20) | ((raw >> 2) & 0x18) | ((raw << 4) & 0x1C0)) >> 3;
+                if (rd_idx == 0 || !fits<int6>(scaled))
+                    return Instruction::invalid();
+                return make(C::c_ldsp, rd, int6(scaled));
+            }
+            case 0b10'100: {
+                bool rs2_zero = rs2.idx() == 0;
+                if (!(raw & 0x1000)) {
+                    if (rs2_zero)
+                        return rd_idx != 0 ? make(C::c_jr, rd) : Instruction::invalid();
+                    return make(C::c_mv, rd, rs2);
+                }
+                // c.ebreak is c.jalr x0, which the interpreter executes as ebreak
+                return rs2_zero ? make(C::c_jalr, rd) : make(C::c_add, rd, rs2);
+            }
+            case 0b10'110: {
+                uint32_t scaled = (((raw >> 7) & 0x3C) | ((raw >> 1) & 0xC0)) >> 2;
+                if (!fits<int6>(scaled))
+                    return Instruction::invalid();
+                return make(C::c_swsp, rs2, int6(scaled));
+            }
+            case 0b10'111: {
+                uint32_t scaled = (((raw >> 7) & 0x38) | ((raw >> 1) & 0x1C0)) >> 3;
+                if (!fits<int6>(scaled))
+                    return Instruction::invalid();
+                return make(C::c_sdsp, rs2, int6(scaled));
+            }
+            default:
+                return Instruction::invalid();
+        }
+    }
+}
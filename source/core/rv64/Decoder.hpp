@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <Instruction.hpp>
+
+namespace rv64 {
+    /// @brief Decodes standard RV64IMC machine code (as emitted by GNU/LLVM toolchains)
+    /// into the simulator's Instruction representation.
+    ///
+    /// Compressed loads and stores whose offset does not fit the simulator's (signed)
+    /// compressed operand types, floating point, CSR and atomic instructions decode to
+    /// an invalid Instruction.
+    class Decoder {
+    public:
+        /// @param low_half first (lowest addressed) halfword of the instruction
+        /// @return 2 for compressed instructions, 4 otherwise
+        [[nodiscard]] static constexpr size_t instruction_length(uint16_t low_half) noexcept {
+            return (low_half & 0b11) == 0b11 ? 4 : 2;
+        }
+
+        /// @param raw instruction bits; for compressed instructions only the low 16 bits are used
+        /// @return decoded instruction or Instruction::invalid()
+        [[nodiscard]] static Instruction decode(uint32_t raw);
+
+    private:
+        [[nodiscard]] static Instruction decode_compressed(uint16_t raw);
+    };
+}
@@ -0,0 +1,213 @@
+#include "EcallRegistry.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include <ui.hpp>
+
+#include "VM.hpp"
+
+namespace {
+    void memory_error(rv64::VM &vm, MemErr err) {
+        ui::print_error("Memory access error: " + Memory::err_to_string(err));
+        vm.error_stop();
+    }
+
+    using Spans = std::vector<std::span<uint8_t>>;
+
+    /// @brief walks two equally long span lists in step, calling fn(a, b, len) for each common
+    /// piece until it returns false
+    template<typename Fn>
+    void zip_spans(const Spans &a, const Spans &b, Fn fn) {
+        size_t ia = 0, ib = 0, oa = 0, ob = 0;
+        while (ia < a.size() && ib < b.size()) {
+            size_t len = std::min(a[ia].size() - oa, b[ib].size() - ob);
+            if (!fn(a[ia].data() + oa, b[ib].data() + ob, len))
+                return;
+            oa += len;
+            ob += len;
+            if (oa == a[ia].size()) { ++ia; oa = 0; }
+            if (ob == b[ib].size()) { ++ib; ob = 0; }
+        }
+    }
+
+    // Bulk memory services work on host views of the guest pages: the whole range is checked
+    // once and each page piece is handled by the host's (vectorized) routines.
+
+    void guest_memcpy(rv64::VM &vm, uint64_t dst, uint64_t src, uint64_t size) {
+        Spans to, from;
+        if (vm.m_memory.host_spans(dst, size, to, true) != MemErr::None
+            || vm.m_memory.host_spans(src, size, from, false) != MemErr::None)
+            return memory_error(vm, MemErr::SegFault);
+
+        bool overlaps = dst < src + size && src < dst + size;
+        if (overlaps && dst != src) {
+            // memmove semantics; piecewise copies could read already overwritten bytes
+            std::vector<uint8_t> tmp;
+            tmp.reserve(size);
+            for (auto span: from)
+                tmp.insert(tmp.end(), span.begin(), span.end());
+            auto it = tmp.begin();
+            for (auto span: to) {
+                std::copy_n(it, span.size(), span.begin());
+                it += static_cast<ptrdiff_t>(span.size());
+            }
+            return;
+        }
+        zip_spans(to, from, [](uint8_t *d, const uint8_t *s, size_t len) {
+            std::memcpy(d, s, len);
+            return true;
+        });
+    }
+
+    void guest_memset(rv64::VM &vm, uint64_t dst, uint8_t value, uint64_t size) {
+        Spans to;
+        if (vm.m_memory.host_spans(dst, size, to, true) != MemErr::None)
+            return memory_error(vm, MemErr::SegFault);
+        for (auto span: to)
+            std::memset(span.data(), value, span.size());
+    }
+
+    /// @return -1, 0 or 1
+    int guest_memcmp(rv64::VM &vm, uint64_t lhs, uint64_t rhs, uint64_t size) {
+        Spans a, b;
+        if (vm.m_memory.host_spans(lhs, size, a, false) != MemErr::None
+            || vm.m_memory.host_spans(rhs, size, b, false) != MemErr::None) {
+            memory_error(vm, MemErr::SegFault);
+            return 0;
+        }
+
+        int result = 0;
+        zip_spans(a, b, [&result](const uint8_t *l, const uint8_t *r, size_t len) {
+            result = std::memcmp(l, r, len);
+            return result == 0;
+        });
+        return (result > 0) - (result < 0);
+    }
+
+    uint64_t guest_strlen(rv64::VM &vm, uint64_t str) {
+        size_t limit = vm.m_memory.mapped_size(str);
+        Spans spans;
+        if (limit == 0 || vm.m_memory.host_spans(str, limit, spans, false) != MemErr::None) {
+            memory_error(vm, MemErr::SegFault);
+            return 0;
+        }
+
+        uint64_t len = 0;
+        for (auto span: spans) {
+            if (auto *nul = std::memchr(span.data(), 0, span.size()))
+                return len + (static_cast<const uint8_t *>(nul) - span.data());
+            len += span.size();
+        }
+        memory_error(vm, MemErr::NotTermStr);
+        return 0;
+    }
+}
+
+namespace rv64 {
+    bool EcallRegistry::set_handler(int64_t code, Handler handler) {
+        if (code < 0 || code >= MAX_SERVICES)
+            return false;
+        m_handlers[code] = std::move(handler);
+        return true;
+    }
+
+    void EcallRegistry::remove_handler(int64_t code) {
+        if (code >= 0 && code < MAX_SERVICES)
+            m_handlers[code] = nullptr;
+    }
+
+    bool EcallRegistry::has_handler(int64_t code) const noexcept {
+        return code >= 0 && code < MAX_SERVICES && m_handlers[code];
+    }
+
+    bool EcallRegistry::dispatch(int64_t code, VM &vm) const {
+        if (!has_handler(code))
+            return false;
+        m_handlers[code](vm);
+        return true;
+    }
+
+    void register_default_ecalls(EcallRegistry &registry) {
+        // registers are accessed by index: a0 = x10, a1 = x11, a2 = x12
+        registry.set_handler(1, [](VM &vm) {
+            ui::print_output(std::to_string(vm.m_cpu.reg(11).sval()));
+        });
+        registry.set_handler(4, [](VM &vm) {
+            MemErr err = MemErr::None;
+            auto str = vm.m_memory.load_string(vm.m_cpu.reg(11).val(), err);
+            if (err != MemErr::None)
+                return memory_error(vm, err);
+            ui::print_output(str);
+        });
+        registry.set_handler(5, [](VM &vm) {
+            auto value = vm.m_input.read_int();
+            if (!value) {
+                ui::print_error("read_int: expected an integer in the input");
+                return vm.error_stop();
+            }
+            vm.m_cpu.reg(10) = *value;
+        });
+        registry.set_handler(8, [](VM &vm) {
+            // reads up to a2 - 1 bytes of the current line into a1 and NUL-terminates them
+            uint64_t buffer = vm.m_cpu.reg(11).val();
+            int64_t size = vm.m_cpu.reg(12).sval();
+            if (size <= 0)
+                return;
+            Spans spans;
+            if (vm.m_memory.host_spans(buffer, size, spans, true) != MemErr::None)
+                return memory_error(vm, MemErr::SegFault);
+            size_t count = vm.m_input.read_line(spans, size - 1);
+            (void) vm.m_memory.store(buffer + count, uint8_t{0});
+        });
+        registry.set_handler(9, [](VM &vm) {
+            MemErr err = MemErr::None;
+            vm.m_cpu.reg(10) = vm.m_memory.sbrk(vm.m_cpu.reg(11).sval(), err);
+            if (err != MemErr::None)
+                memory_error(vm, err);
+        });
+        registry.set_handler(10, [](VM &vm) {
+            vm.terminate(0);
+        });
+        registry.set_handler(11, [](VM &vm) {
+            char ch = static_cast<char>(vm.m_cpu.reg(11).val() & 0xFF);
+            ui::print_output(std::string_view(&ch, 1));
+        });
+        registry.set_handler(12, [](VM &vm) {
+            auto ch = vm.m_input.read_char();
+            vm.m_cpu.reg(10) = ch ? int64_t{*ch} : -1; // -1 at end of input
+        });
+        registry.set_handler(17, [](VM &vm) {
+            vm.terminate(static_cast<int>(vm.m_cpu.reg(11).sval()));
+        });
+        registry.set_handler(100, [](VM &vm) {
+            auto [lo, hi] = std::minmax(vm.m_cpu.reg(11).sval(), vm.m_cpu.reg(12).sval());
+            vm.m_cpu.reg(10) = std::uniform_int_distribution<int64_t>(lo, hi)(vm.rng());
+        });
+        registry.set_handler(101, [](VM &vm) {
+            vm.m_cpu.reg(10) = vm.get_cycle_count();
+        });
+
+        // bulk memory: a1, a2, a3 follow the C argument order, the result is returned in a0
+        registry.set_handler(200, [](VM &vm) {
+            auto &cpu = vm.m_cpu;
+            guest_memcpy(vm, cpu.reg(11).val(), cpu.reg(12).val(), cpu.reg(13).val());
+            cpu.reg(10) = cpu.reg(11).val();
+        });
+        registry.set_handler(201, [](VM &vm) {
+            auto &cpu = vm.m_cpu;
+            guest_memset(vm, cpu.reg(11).val(), static_cast<uint8_t>(cpu.reg(12).val()), cpu.reg(13).val());
+            cpu.reg(10) = cpu.reg(11).val();
+        });
+        registry.set_handler(202, [](VM &vm) {
+            auto &cpu = vm.m_cpu;
+            cpu.reg(10) = guest_memcmp(vm, cpu.reg(11).val(), cpu.reg(12).val(), cpu.reg(13).val());
+        });
+        registry.set_handler(203, [](VM &vm) {
+            vm.m_cpu.reg(10) = guest_strlen(vm, vm.m_cpu.reg(11).val());
+        });
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <functional>
+
+namespace rv64 {
+    class VM;
+
+    /// @brief Table of ecall services (EcallPersonality::Venus), indexed by the service code in a0.
+    /// Each VM has its own table, so embedders can add native services or replace the defaults.
+    class EcallRegistry {
+    public:
+        /// Arguments are read from and results written to the VM registers (a1, a2, ... / a0)
+        using Handler = std::function<void(VM &)>;
+
+        static constexpr int64_t MAX_SERVICES = 256;
+
+        /// @brief sets (or replaces) the handler of a service code
+        /// @return false if the code is out of [0, MAX_SERVICES)
+        bool set_handler(int64_t code, Handler handler);
+        void remove_handler(int64_t code);
+        [[nodiscard]] bool has_handler(int64_t code) const noexcept;
+
+        /// @brief calls the handler registered for the code
+        /// @return false if there is none
+        bool dispatch(int64_t code, VM &vm) const;
+
+    private:
+        std::array<Handler, MAX_SERVICES> m_handlers{};
+    };
+
+    /// @brief registers the standard services: print_int (1), print_string (4), read_int (5),
+    /// read_string (8), sbrk (9), exit (10), print_char (11), read_char (12), exit2 (17), random int in [a1, a2] (100),
+    /// cycle counter (101, see VM::get_cycle_count) and the host-accelerated
+    /// memcpy (200), memset (201), memcmp (202) and strlen (203)
+    void register_default_ecalls(EcallRegistry &registry);
+}
@@ -0,0 +1,107 @@
+#include "Fusion.hpp"
+#include <optional>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
+
+namespace {
+    using namespace rv64;
+    using I = is::IBaseI::InstId;
+    using Kind = FusedOp::Kind;
+    using Cond = FusedOp::Cond;
+
+    bool is(const Instruction &inst, I id) {
+        return inst.get_prototype().id == static_cast<int>(id);
+    }
+
+    uint8_t reg_arg(const Instruction &inst, size_t i) {
+        return static_cast<uint8_t>(std::get<Reg>(inst.get_args()[i]).idx());
+    }
+
+    template<typename T>
+    int64_t imm_arg(const Instruction &inst, size_t i) {
+        return std::get<T>(inst.get_args()[i]);
+    }
+
+    std::optional<Cond> branch_cond(const Instruction &inst) {
+        switch (inst.get_prototype().id) {
+            case (int) I::beq: return Cond::Eq;
+            case (int) I::bne: return Cond::Ne;
+            case (int) I::blt: return Cond::Lt;
+            case (int) I::bge: return Cond::Ge;
+            case (int) I::bltu: return Cond::Ltu;
+            case (int) I::bgeu: return Cond::Geu;
+            default: return std::nullopt;
+        }
+    }
+
+    /// @return the idiom starting at program[0] (Kind::None if there is none)
+    FusedOp match(std::span<const Instruction> program) {
+        FusedOp op;
+        if (program.size() < 2)
+            return op;
+        const auto &a = program[0];
+        const auto &b = program[1];
+
+        if (is(a, I::lui) && (is(b, I::addi) || is(b, I::addiw))
+            && reg_arg(b, 0) == reg_arg(a, 0) && reg_arg(b, 1) == reg_arg(a, 0)) {
+            op.kind = Kind::LoadImmediate;
+            op.rd = reg_arg(a, 0);
+            op.imm = int64_t(static_cast<int32_t>(imm_arg<int20>(a, 1) << 12)) + imm_arg<int12>(b, 2);
+            if (is(b, I::addiw))
+                op.imm = static_cast<int32_t>(op.imm);
+            op.count = 2;
+        } else if (is(a, I::auipc) && is(b, I::jalr) && reg_arg(a, 0) != 0 && reg_arg(b, 1) == reg_arg(a, 0)) {
+            op.kind = Kind::FarJump;
+            op.rs1 = reg_arg(a, 0);
+            op.rd = reg_arg(b, 0);
+            op.imm = imm_arg<int20>(a, 1) << 12;
+            op.imm2 = imm_arg<int12>(b, 2);
+            op.count = 2;
+        } else if (is(a, I::addi) && branch_cond(b)) {
+            op.kind = Kind::AddiBranch;
+            op.cond = *branch_cond(b);
+            op.rd = reg_arg(a, 0);
+            op.rs1 = reg_arg(a, 1);
+            op.imm = imm_arg<int12>(a, 2);
+            op.rs2 = reg_arg(b, 0);
+            op.rs3 = reg_arg(b, 1);
+            op.imm2 = imm_arg<int12>(b, 2) * 2; // branch offsets are stored in halfwords
+            op.count = 2;
+        } else if (program.size() >= 3 && is(a, I::slli) && is(b, I::add) && is(program[2], I::ld)) {
+            // slli t, i, sh; add t, base, t (or t, t, base); ld rd, off(t)
+            const auto &c = program[2];
+            uint8_t t = reg_arg(a, 0);
+            bool t_first = reg_arg(b, 1) == t, t_second = reg_arg(b, 2) == t;
+            if (reg_arg(b, 0) == t && t_first != t_second && reg_arg(c, 1) == t) {
+                op.kind = Kind::IndexedLoad;
+                op.rs1 = t;
+                op.rs2 = reg_arg(a, 1);
+                op.imm = imm_arg<uint6>(a, 2);
+                op.rs3 = t_first ? reg_arg(b, 2) : reg_arg(b, 1);
+                op.rd = reg_arg(c, 0);
+                op.imm2 = imm_arg<int12>(c, 2);
+                op.count = 3;
+            }
+        }
+
+        for (size_t i = 0; i < op.count && op.kind != Kind::None; ++i)
+            op.byte_size += static_cast<uint8_t>(program[i].byte_size());
+        return op;
+    }
+}
+
+namespace rv64 {
+    FusedProgram fuse_program(std::span<const Instruction> program, std::span<const uint32_t> lines) {
+        FusedProgram fused;
+        fused.index.assign(program.size(), FusedProgram::NO_OP);
+        for (size_t i = 0; i < program.size(); ++i) {
+            auto op = match(program.subspan(i, std::min<size_t>(3, program.size() - i)));
+            if (op.kind == FusedOp::Kind::None)
+                continue;
+            for (size_t j = 1; j < op.count; ++j)
+                op.inner_lines[j - 1] = lines[i + j];
+            fused.index[i] = static_cast<uint32_t>(fused.ops.size());
+            fused.ops.push_back(op);
+        }
+        return fused;
+    }
+}
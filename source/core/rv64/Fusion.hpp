@@ -0,0 +1,50 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <Instruction.hpp>
+
+namespace rv64 {
+    /// @brief Superinstruction standing for a short run of consecutive instructions that
+    /// run_until_stop executes with a single dispatch. Registers are stored as indices.
+    struct FusedOp {
+        enum class Kind : uint8_t {
+            None,
+            LoadImmediate, ///< lui rd, hi; addi[w] rd, rd, lo          -> rd = imm
+            FarJump,       ///< auipc rs1, hi; jalr rd, lo(rs1)         -> rs1 = pc + imm; jump to rs1 + imm2
+            AddiBranch,    ///< addi rd, rs1, imm; b<cond> rs2, rs3, off -> branch offset imm2 from the branch
+            IndexedLoad    ///< slli rs1, rs2, imm; add rs1, rs1, rs3; ld rd, imm2(rs1)
+        };
+
+        enum class Cond : uint8_t {
+            Eq, Ne, Lt, Ge, Ltu, Geu
+        };
+
+        static constexpr uint32_t NO_LINE = UINT32_MAX;
+
+        Kind kind = Kind::None;
+        Cond cond = Cond::Eq;
+        uint8_t count = 1;      ///< number of instructions covered
+        uint8_t byte_size = 0;  ///< number of bytes covered
+        uint8_t rd = 0, rs1 = 0, rs2 = 0, rs3 = 0;
+        int64_t imm = 0;
+        int64_t imm2 = 0;
+        /// source lines of the 2nd and 3rd instruction; a breakpoint on one of them splits the group
+        std::array<uint32_t, 2> inner_lines{NO_LINE, NO_LINE};
+    };
+
+    /// Fusable idioms of a program; few instructions start one, so only the matches are stored
+    struct FusedProgram {
+        static constexpr uint32_t NO_OP = UINT32_MAX;
+
+        std::vector<FusedOp> ops;    ///< in address order
+        std::vector<uint32_t> index; ///< per instruction: position in ops, NO_OP where no idiom starts
+    };
+
+    /// @brief finds the fusable idioms of a decoded program
+    /// @param program instructions in address order, without gaps
+    /// @param lines source line of every instruction (FusedOp::NO_LINE if there is none)
+    [[nodiscard]] FusedProgram fuse_program(std::span<const Instruction> program, std::span<const uint32_t> lines);
+}
@@ -0,0 +1,173 @@
+#include "History.hpp"
+#include <algorithm>
+#include <vector>
+#include <ui.hpp>
+
+#include "VM.hpp"
+
+namespace {
+    using namespace rv64;
+
+    bool can_run(VMState state) {
+        return state == VMState::Loaded || state == VMState::Running
+               || state == VMState::Stopped || state == VMState::Breakpoint;
+    }
+
+    size_t journal_bytes(const std::vector<Memory::StoreRecord> &stores) {
+        return stores.capacity() * sizeof(Memory::StoreRecord);
+    }
+
+    /// @brief the replayed instructions already printed their output
+    struct MutedOutput {
+        MutedOutput() { ui::set_muted(true); }
+        ~MutedOutput() { ui::set_muted(false); }
+        MutedOutput(const MutedOutput &) = delete;
+        MutedOutput &operator=(const MutedOutput &) = delete;
+    };
+}
+
+namespace rv64 {
+    struct History::Checkpoint {
+        VM::Snapshot snapshot;
+        std::vector<Memory::StoreRecord> stores; ///< overwritten since the checkpoint, oldest first
+    };
+
+    std::optional<std::string> History::validate(const Config &config) {
+        if (config.checkpoint_interval == 0)
+            return std::string("Checkpoint interval must be at least 1 instruction");
+        if (config.memory_budget == 0)
+            return std::string("History memory budget must not be 0");
+        return std::nullopt;
+    }
+
+    History::History(VM &vm) : m_vm(vm) {
+    }
+
+    History::~History() {
+        stop();
+    }
+
+    std::optional<std::string> History::start(const Config &config) {
+        stop();
+        if (m_vm.get_ecall_personality() == EcallPersonality::Linux)
+            return std::string("Reverse execution is not available for programs using Linux syscalls");
+        m_config = config;
+        m_recording = true;
+        m_vm.m_input.set_keep_consumed(true);
+        checkpoint();
+        return std::nullopt;
+    }
+
+    void History::stop() {
+        if (!m_recording)
+            return;
+        m_vm.m_memory.set_store_journal(nullptr);
+        m_vm.m_input.set_keep_consumed(false);
+        m_checkpoints.clear();
+        m_closed_bytes = 0;
+        m_next_checkpoint = UINT64_MAX;
+        m_recording = false;
+    }
+
+    uint64_t History::earliest() const noexcept {
+        if (m_checkpoints.empty())
+            return m_vm.get_instruction_count();
+        return m_checkpoints.front()->snapshot.instruction_count;
+    }
+
+    size_t History::memory_usage() const noexcept {
+        if (m_checkpoints.empty())
+            return 0;
+        return m_closed_bytes + journal_bytes(m_checkpoints.back()->stores) + m_vm.m_input.kept_size();
+    }
+
+    uint64_t History::travel_to(uint64_t target) {
+        uint64_t current = m_vm.get_instruction_count();
+        if (!m_recording || target >= current)
+            return current;
+        restore(target);
+        replay(target);
+        return m_vm.get_instruction_count();
+    }
+
+    uint64_t History::step_back(uint64_t n) {
+        uint64_t current = m_vm.get_instruction_count();
+        return travel_to(current - std::min(n, current));
+    }
+
+    bool History::reverse_continue(std::stop_token stop) {
+        if (!m_recording)
+            return false;
+        // search the checkpoint intervals newest first, single-stepping each for breakpoint lines
+        uint64_t end = m_vm.get_instruction_count();
+        while (end > earliest()) {
+            if (stop.stop_requested()) {
+                travel_to(end);
+                return false;
+            }
+            restore(end - 1);
+            uint64_t start = m_vm.get_instruction_count();
+            std::optional<uint64_t> hit;
+            {
+                MutedOutput muted;
+                while (m_vm.get_instruction_count() < end && can_run(m_vm.get_state())) {
+                    if (m_vm.check_breakpoint())
+                        hit = m_vm.get_instruction_count();
+                    m_vm.run_dispatch(1);
+                }
+            }
+            if (hit) {
+                travel_to(*hit);
+                return true;
+            }
+            end = start;
+        }
+        travel_to(earliest());
+        return false;
+    }
+
+    void History::checkpoint() {
+        if (!m_checkpoints.empty()) {
+            auto &stores = m_checkpoints.back()->stores;
+            stores.shrink_to_fit();
+            m_closed_bytes += journal_bytes(stores);
+        }
+        auto &added = m_checkpoints.emplace_back(std::make_unique<Checkpoint>());
+        added->snapshot = m_vm.save_snapshot();
+        m_closed_bytes += sizeof(Checkpoint);
+        m_vm.m_memory.set_store_journal(&added->stores);
+        m_next_checkpoint = added->snapshot.instruction_count + m_config.checkpoint_interval;
+        enforce_budget();
+    }
+
+    void History::enforce_budget() {
+        while (m_checkpoints.size() > 1 && memory_usage() > m_config.memory_budget) {
+            m_closed_bytes -= sizeof(Checkpoint) + journal_bytes(m_checkpoints.front()->stores);
+            m_checkpoints.pop_front();
+            m_vm.m_input.forget_before(m_checkpoints.front()->snapshot.input_position);
+        }
+    }
+
+    void History::restore(uint64_t target) {
+        while (m_checkpoints.size() > 1 && m_checkpoints.back()->snapshot.instruction_count > target) {
+            m_vm.m_memory.undo_stores(m_checkpoints.back()->stores);
+            m_closed_bytes -= sizeof(Checkpoint);
+            m_checkpoints.pop_back();
+            m_closed_bytes -= journal_bytes(m_checkpoints.back()->stores); // the newest journal again
+        }
+        auto &newest = *m_checkpoints.back();
+        m_vm.m_memory.undo_stores(newest.stores);
+        newest.stores.clear();
+        m_vm.m_memory.set_store_journal(&newest.stores);
+        m_vm.restore_snapshot(newest.snapshot);
+        m_next_checkpoint = newest.snapshot.instruction_count + m_config.checkpoint_interval;
+    }
+
+    void History::replay(uint64_t target) {
+        MutedOutput muted;
+        while (m_vm.get_instruction_count() < target && can_run(m_vm.get_state())) {
+            uint64_t stop = std::min(target, m_next_checkpoint);
+            m_vm.run_dispatch(stop - m_vm.get_instruction_count());
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <stop_token>
+#include <string>
+
+namespace rv64 {
+    class VM;
+
+    /// @brief Reverse execution of the loaded program. A checkpoint of the VM state (registers, pc,
+    /// instruction count, heap break, random engine and input position) is taken every
+    /// checkpoint_interval instructions, and every store after it is journaled with the value it
+    /// overwrote (see Memory::set_store_journal), so the memory of a checkpoint is restored by
+    /// undoing the stores made since, newest first. Going back to an instruction restores the
+    /// nearest checkpoint before it and executes the rest again with the configured engine; the
+    /// input consumed by the read ecalls is kept and read again, so the replay is deterministic.
+    ///
+    /// Output is muted during the replay. The statistics (profiler, models, trace) are not
+    /// rewound. Programs with the Linux personality are not recorded: their syscalls read and
+    /// write host file descriptors (stdin and stdout included), which can be neither kept for
+    /// the replay nor muted.
+    class History {
+    public:
+        struct Config {
+            uint64_t checkpoint_interval = 10'000; ///< instructions between checkpoints
+            /// bytes of checkpoints, store journals and kept input; beyond it the oldest
+            /// checkpoints are dropped, which limits how far back the program can go
+            size_t memory_budget = size_t(64) << 20;
+        };
+
+        /// @return optional string with error message
+        [[nodiscard]] static std::optional<std::string> validate(const Config &config);
+
+        explicit History(VM &vm);
+        ~History();
+        History(const History &) = delete;
+        History &operator=(const History &) = delete;
+
+        /// @brief takes the first checkpoint at the current instruction and starts journaling
+        /// @param config must be valid (see validate)
+        /// @return optional string with error message if the loaded program cannot be recorded
+        [[nodiscard]] std::optional<std::string> start(const Config &config);
+        /// @brief drops the checkpoints and stops journaling
+        void stop();
+        [[nodiscard]] bool is_recording() const noexcept { return m_recording; }
+
+        /// @brief takes a checkpoint if the interval has passed since the last one; the VM calls
+        /// this after every dispatch while recording
+        void record(uint64_t instruction_count) {
+            if (instruction_count >= m_next_checkpoint)
+                checkpoint();
+        }
+
+        /// @return earliest instruction count the program can go back to
+        [[nodiscard]] uint64_t earliest() const noexcept;
+        /// @brief goes back to the state after target instructions (not earlier than earliest())
+        /// @return instruction count reached
+        uint64_t travel_to(uint64_t target);
+        /// @brief goes back n instructions (not earlier than earliest())
+        /// @return instruction count reached
+        uint64_t step_back(uint64_t n = 1);
+        /// @brief goes back to the last stop at a breakpoint line before the current instruction
+        /// @param stop checked before searching each checkpoint interval
+        /// @return false if there is none since earliest() (the program is then at earliest()), or
+        /// if stopped (the program is then at the start of the intervals searched so far)
+        bool reverse_continue(std::stop_token stop = {});
+
+        [[nodiscard]] size_t checkpoint_count() const noexcept { return m_checkpoints.size(); }
+        /// @return bytes held by the checkpoints, store journals and kept input
+        [[nodiscard]] size_t memory_usage() const noexcept;
+
+    private:
+        struct Checkpoint;
+
+        void checkpoint();
+        /// @brief restores the newest checkpoint at or before target, dropping the later ones
+        void restore(uint64_t target);
+        /// @brief executes until target instructions with output muted, taking checkpoints on the way
+        void replay(uint64_t target);
+        void enforce_budget();
+
+        VM &m_vm;
+        Config m_config;
+        bool m_recording = false;
+        uint64_t m_next_checkpoint = UINT64_MAX;
+        std::deque<std::unique_ptr<Checkpoint>> m_checkpoints;
+        size_t m_closed_bytes = 0; ///< bytes of all checkpoints but the newest one's journal
+    };
+}
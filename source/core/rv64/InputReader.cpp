@@ -0,0 +1,185 @@
+#include "InputReader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+namespace {
+    bool is_space(char ch) {
+        return std::isspace(static_cast<unsigned char>(ch)) != 0;
+    }
+}
+
+namespace rv64 {
+    InputReader::~InputReader() {
+        close_source();
+    }
+
+    void InputReader::use_stdin() {
+        close_source();
+        m_fd = 0;
+    }
+
+    bool InputReader::use_file(const std::filesystem::path &path) {
+#ifdef _WIN32
+        int fd = _wopen(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+#endif
+        if (fd < 0)
+            return false;
+        close_source();
+        m_fd = fd;
+        m_owns_fd = true;
+        return true;
+    }
+
+    void InputReader::use_buffer(std::string data) {
+        close_source();
+        m_fd = NO_FD;
+        m_buffer.assign(data.begin(), data.end());
+        m_end = m_buffer.size();
+    }
+
+    std::optional<int64_t> InputReader::read_int() {
+        for (;;) {
+            while (m_pos < m_end && is_space(m_buffer[m_pos]))
+                ++m_pos;
+            if (m_pos < m_end)
+                break;
+            if (!refill())
+                return std::nullopt;
+        }
+
+        // the whole token has to be buffered before parsing
+        auto token_end = [this] {
+            return std::find_if(m_buffer.begin() + ptrdiff_t(m_pos), m_buffer.begin() + ptrdiff_t(m_end), is_space);
+        };
+        while (token_end() == m_buffer.begin() + ptrdiff_t(m_end) && refill()) {}
+
+        const char *first = m_buffer.data() + m_pos;
+        const char *last = m_buffer.data() + m_end;
+        if (*first == '+' && last - first > 1 && first[1] != '-')
+            ++first; // from_chars does not accept an explicit plus sign
+
+        int64_t value = 0;
+        auto [ptr, ec] = std::from_chars(first, last, value);
+        if (ec != std::errc{})
+            return std::nullopt;
+        m_pos = ptr - m_buffer.data();
+        return value;
+    }
+
+    std::optional<uint8_t> InputReader::read_char() {
+        if (m_pos == m_end && !refill())
+            return std::nullopt;
+        return static_cast<uint8_t>(m_buffer[m_pos++]);
+    }
+
+    size_t InputReader::read_line(std::span<const std::span<uint8_t>> dst, size_t max_size) {
+        size_t copied = 0;
+        size_t span_idx = 0, span_off = 0;
+        while (copied < max_size) {
+            if (m_pos == m_end && !refill())
+                break;
+
+            const char *src = m_buffer.data() + m_pos;
+            size_t available = std::min(m_end - m_pos, max_size - copied);
+            const auto *newline = static_cast<const char *>(std::memchr(src, '\n', available));
+            size_t count = newline ? size_t(newline - src) + 1 : available;
+
+            for (size_t done = 0; done < count;) {
+                auto span = dst[span_idx];
+                size_t len = std::min(count - done, span.size() - span_off);
+                std::memcpy(span.data() + span_off, src + done, len);
+                done += len;
+                span_off += len;
+                if (span_off == span.size()) {
+                    ++span_idx;
+                    span_off = 0;
+                }
+            }
+            m_pos += count;
+            copied += count;
+            if (newline)
+                break;
+        }
+        return copied;
+    }
+
+    bool InputReader::refill() {
+        if (m_fd == NO_FD)
+            return false;
+
+        if (m_buffer.size() < BUFFER_SIZE)
+            m_buffer.resize(BUFFER_SIZE);
+        if (m_keep_consumed)
+            m_kept.append(m_buffer.data(), m_pos);
+        m_buffer_start += m_pos;
+        std::copy(m_buffer.begin() + ptrdiff_t(m_pos), m_buffer.begin() + ptrdiff_t(m_end), m_buffer.begin());
+        m_end -= m_pos;
+        m_pos = 0;
+        if (m_end == m_buffer.size())
+            return false;
+
+#ifdef _WIN32
+        auto n = _read(m_fd, m_buffer.data() + m_end, static_cast<unsigned>(m_buffer.size() - m_end));
+#else
+        auto n = ::read(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end);
+#endif
+        if (n <= 0)
+            return false;
+        m_end += static_cast<size_t>(n);
+        return true;
+    }
+
+    void InputReader::close_source() {
+        if (m_owns_fd) {
+#ifdef _WIN32
+            _close(m_fd);
+#else
+            ::close(m_fd);
+#endif
+        }
+        m_owns_fd = false;
+        m_buffer.clear();
+        m_pos = m_end = 0;
+        m_buffer_start = 0;
+        m_kept.clear();
+    }
+
+    void InputReader::set_keep_consumed(bool keep) {
+        m_keep_consumed = keep;
+        if (!keep)
+            m_kept.clear();
+    }
+
+    void InputReader::rewind(uint64_t position) {
+        if (position >= m_buffer_start) {
+            m_pos = static_cast<size_t>(position - m_buffer_start);
+            return;
+        }
+        // the kept bytes after the position go back in front of the buffer
+        size_t keep = m_kept.size() - static_cast<size_t>(m_buffer_start - position);
+        m_buffer.insert(m_buffer.begin(), m_kept.begin() + ptrdiff_t(keep), m_kept.end());
+        m_end += m_kept.size() - keep;
+        m_kept.resize(keep);
+        m_buffer_start = position;
+        m_pos = 0;
+    }
+
+    void InputReader::forget_before(uint64_t position) {
+        if (position <= kept_start())
+            return;
+        m_kept.erase(0, static_cast<size_t>(std::min<uint64_t>(position - kept_start(), m_kept.size())));
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace rv64 {
+    /// @brief Buffered input of the read ecalls. The source is the host's standard input
+    /// (default), a host file or pipe, or an in-memory buffer supplied by the embedder.
+    class InputReader {
+    public:
+        static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+        InputReader() = default;
+        ~InputReader();
+
+        InputReader(const InputReader &) = delete;
+        InputReader &operator=(const InputReader &) = delete;
+
+        void use_stdin();
+        /// @return false if the file cannot be opened (the source is left unchanged)
+        [[nodiscard]] bool use_file(const std::filesystem::path &path);
+        void use_buffer(std::string data);
+
+        /// @brief skips whitespace and parses a decimal integer
+        /// @return nullopt at end of input or if the next token is not an integer
+        [[nodiscard]] std::optional<int64_t> read_int();
+
+        /// @return next byte, nullopt at end of input
+        [[nodiscard]] std::optional<uint8_t> read_char();
+
+        /// @brief copies the rest of the current line (including the newline) into dst,
+        /// at most max_size bytes
+        /// @return number of bytes copied
+        size_t read_line(std::span<const std::span<uint8_t>> dst, size_t max_size);
+
+        /// @return number of bytes consumed from the current source
+        [[nodiscard]] uint64_t position() const noexcept { return m_buffer_start + m_pos; }
+        /// @brief while set, consumed bytes are kept so that rewind can return them (see History)
+        void set_keep_consumed(bool keep);
+        /// @brief makes the bytes consumed after the position unread again
+        /// @param position between kept_start() and position()
+        void rewind(uint64_t position);
+        /// @brief drops the kept bytes before the position, they can no longer be rewound to
+        void forget_before(uint64_t position);
+        /// @return earliest position rewind can return to
+        [[nodiscard]] uint64_t kept_start() const noexcept { return m_buffer_start - m_kept.size(); }
+        [[nodiscard]] size_t kept_size() const noexcept { return m_kept.size(); }
+
+    private:
+        /// @brief moves the unread bytes to the front and reads more from the source
+        /// @return false if nothing could be read
+        bool refill();
+        void close_source();
+
+        static constexpr int NO_FD = -1;
+
+        int m_fd = 0; ///< host fd, NO_FD for an in-memory buffer
+        bool m_owns_fd = false;
+        std::vector<char> m_buffer;
+        size_t m_pos = 0;
+        size_t m_end = 0;
+        uint64_t m_buffer_start = 0; ///< position of m_buffer[0]
+        bool m_keep_consumed = false;
+        std::string m_kept; ///< consumed bytes before m_buffer, kept for rewind
+    };
+}
@@ -0,0 +1,177 @@
+#include "InstructionMix.hpp"
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
+
+namespace {
+    using namespace rv64;
+    using I = is::IBaseI::InstId;
+    using C = is::IExtensionC::InstId;
+    using Class = InstructionMix::Class;
+
+    size_t width_slot(unsigned width) {
+        return static_cast<size_t>(std::countr_zero(width));
+    }
+}
+
+namespace rv64 {
+    InstructionMix::Class InstructionMix::classify(const Instruction &inst) noexcept {
+        int id = inst.get_prototype().id;
+        if (access_width(inst) != 0) {
+            switch (id) {
+                case (int) I::sb: case (int) I::sh: case (int) I::sw: case (int) I::sd:
+                case (int) C::c_sw: case (int) C::c_sd: case (int) C::c_fsd:
+                case (int) C::c_swsp: case (int) C::c_sdsp: case (int) C::c_fsdsp:
+                    return Class::Store;
+                default:
+                    return Class::Load;
+            }
+        }
+        switch (id) {
+            case (int) I::beq: case (int) I::bne: case (int) I::blt:
+            case (int) I::bge: case (int) I::bltu: case (int) I::bgeu:
+            case (int) C::c_beqz: case (int) C::c_bnez:
+                return Class::BranchNotTaken;
+            case (int) I::jal: case (int) I::jalr:
+            case (int) C::c_j: case (int) C::c_jr: case (int) C::c_jalr:
+                return Class::Jump;
+            case (int) I::ecall:
+                return Class::Ecall;
+            case (int) I::fence: case (int) I::ebreak: case (int) I::nop: case (int) C::c_nop:
+                return Class::Other;
+            default:
+                break;
+        }
+        if (id >= is::IExtensionM::IS_ID && id < is::IExtensionC::IS_ID)
+            return Class::MulDiv;
+        return inst.is_valid() ? Class::Alu : Class::Other;
+    }
+
+    unsigned InstructionMix::access_width(const Instruction &inst) noexcept {
+        switch (inst.get_prototype().id) {
+            case (int) I::lb: case (int) I::lbu: case (int) I::sb:
+                return 1;
+            case (int) I::lh: case (int) I::lhu: case (int) I::sh:
+                return 2;
+            case (int) I::lw: case (int) I::lwu: case (int) I::sw:
+            case (int) C::c_lw: case (int) C::c_sw: case (int) C::c_lwsp: case (int) C::c_swsp:
+                return 4;
+            case (int) I::ld: case (int) I::sd:
+            case (int) C::c_ld: case (int) C::c_sd: case (int) C::c_ldsp: case (int) C::c_sdsp:
+            case (int) C::c_fld: case (int) C::c_fsd: case (int) C::c_fldsp: case (int) C::c_fsdsp:
+                return 8;
+            default:
+                return 0;
+        }
+    }
+
+    std::string_view InstructionMix::class_name(Class cls) noexcept {
+        switch (cls) {
+            case Class::Alu: return "alu";
+            case Class::MulDiv: return "mul_div";
+            case Class::Load: return "load";
+            case Class::Store: return "store";
+            case Class::BranchTaken: return "branch_taken";
+            case Class::BranchNotTaken: return "branch_not_taken";
+            case Class::Jump: return "jump";
+            case Class::Ecall: return "ecall";
+            default: return "other";
+        }
+    }
+
+    InstructionMix::Summary InstructionMix::summarize(std::span<const Instruction> instructions) {
+        Summary summary;
+        for (size_t i = 0; i < instructions.size(); ++i) {
+            const auto &inst = instructions[i];
+            int id = inst.get_prototype().id;
+            auto it = std::ranges::lower_bound(summary.opcodes, id, {}, &std::pair<int, uint64_t>::first);
+            if (it == summary.opcodes.end() || it->first != id)
+                it = summary.opcodes.insert(it, {id, 0});
+            ++it->second;
+
+            auto cls = classify(inst);
+            if (cls == Class::BranchNotTaken && i + 1 == instructions.size())
+                summary.ends_with_branch = true;
+            else
+                ++summary.classes[static_cast<size_t>(cls)];
+            if (auto width = access_width(inst))
+                ++summary.widths[width_slot(width)];
+            summary.compressed += inst.byte_size() == 2;
+            ++summary.instructions;
+        }
+        return summary;
+    }
+
+    void InstructionMix::add(const Summary &summary, bool branch_taken) noexcept {
+        for (auto [id, count]: summary.opcodes) {
+            if (id < 0)
+                continue;
+            if (static_cast<size_t>(id) >= m_opcodes.size())
+                m_opcodes.resize(id + 1, 0);
+            m_opcodes[id] += count;
+        }
+        for (size_t i = 0; i < CLASS_CNT; ++i)
+            m_classes[i] += summary.classes[i];
+        for (size_t i = 0; i < WIDTH_CNT; ++i)
+            m_widths[i] += summary.widths[i];
+        if (summary.ends_with_branch)
+            ++m_classes[static_cast<size_t>(branch_taken ? Class::BranchTaken : Class::BranchNotTaken)];
+        m_compressed += summary.compressed;
+        m_total += summary.instructions;
+    }
+
+    void InstructionMix::add(const Instruction &inst, bool branch_taken) noexcept {
+        int id = inst.get_prototype().id;
+        if (id >= 0) {
+            if (static_cast<size_t>(id) >= m_opcodes.size())
+                m_opcodes.resize(id + 1, 0);
+            ++m_opcodes[id];
+        }
+        auto cls = classify(inst);
+        if (cls == Class::BranchNotTaken && branch_taken)
+            cls = Class::BranchTaken;
+        ++m_classes[static_cast<size_t>(cls)];
+        if (auto width = access_width(inst))
+            ++m_widths[width_slot(width)];
+        m_compressed += inst.byte_size() == 2;
+        ++m_total;
+    }
+
+    void InstructionMix::reset() noexcept {
+        *this = InstructionMix{};
+    }
+
+    uint64_t InstructionMix::opcode_count(int id) const noexcept {
+        return id >= 0 && static_cast<size_t>(id) < m_opcodes.size() ? m_opcodes[id] : 0;
+    }
+
+    uint64_t InstructionMix::class_count(Class cls) const noexcept {
+        return m_classes[static_cast<size_t>(cls)];
+    }
+
+    uint64_t InstructionMix::width_count(unsigned width) const noexcept {
+        return std::has_single_bit(width) && width <= 8 ? m_widths[width_slot(width)] : 0;
+    }
+
+    std::string InstructionMix::to_json() const {
+        std::string out = std::format("{{\n  \"total\": {},\n  \"compressed\": {},\n  \"classes\": {{", m_total,
+                                      m_compressed);
+        for (size_t i = 0; i < CLASS_CNT; ++i)
+            out += std::format("{}\n    \"{}\": {}", i ? "," : "", class_name(Class(i)), m_classes[i]);
+        out += "\n  },\n  \"access_widths\": {";
+        for (size_t i = 0; i < WIDTH_CNT; ++i)
+            out += std::format("{}\n    \"{}\": {}", i ? "," : "", 1u << i, m_widths[i]);
+        out += "\n  },\n  \"opcodes\": {";
+        bool first = true;
+        for (size_t id = 0; id < m_opcodes.size(); ++id) {
+            if (m_opcodes[id] == 0)
+                continue;
+            auto mnemonic = is::Rv64IMC::get_inst_proto(static_cast<int>(id)).mnemonic;
+            out += std::format("{}\n    \"{}\": {}", first ? "" : ",", mnemonic, m_opcodes[id]);
+            first = false;
+        }
+        out += first ? "}\n}\n" : "\n  }\n}\n";
+        return out;
+    }
+}
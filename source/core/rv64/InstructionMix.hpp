@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Instruction.hpp>
+
+namespace rv64 {
+    /// @brief Dynamic instruction mix: executed instructions by opcode (InstProto::id), by class
+    /// and by memory access width. Filled by VM when VMConfig::m_instruction_mix is set.
+    class InstructionMix {
+    public:
+        enum class Class : uint8_t {
+            Alu,            ///< integer arithmetic, logic, shifts, lui/auipc
+            MulDiv,         ///< M extension
+            Load,
+            Store,
+            BranchTaken,    ///< conditional branch
+            BranchNotTaken, ///< conditional branch
+            Jump,           ///< jal, jalr and their compressed forms
+            Ecall,
+            Other,          ///< fence, ebreak, nop, invalid
+            Count
+        };
+
+        static constexpr size_t CLASS_CNT = static_cast<size_t>(Class::Count);
+        static constexpr size_t WIDTH_CNT = 4; ///< access widths 1, 2, 4 and 8 bytes
+
+        /// @brief Static mix of a run of instructions, e.g. an IrBlock. The class of a conditional
+        /// branch at the end is only known at run time and left out.
+        struct Summary {
+            std::vector<std::pair<int, uint64_t>> opcodes; ///< (InstProto::id, count), sorted by id
+            std::array<uint64_t, CLASS_CNT> classes{};
+            std::array<uint64_t, WIDTH_CNT> widths{};
+            uint64_t compressed = 0;
+            uint64_t instructions = 0;
+            bool ends_with_branch = false;
+        };
+
+        [[nodiscard]] static Summary summarize(std::span<const Instruction> instructions);
+        /// @return class of the instruction; conditional branches are reported as BranchNotTaken
+        [[nodiscard]] static Class classify(const Instruction &inst) noexcept;
+        /// @return memory access width of a load/store in bytes, 0 for other instructions
+        [[nodiscard]] static unsigned access_width(const Instruction &inst) noexcept;
+        [[nodiscard]] static std::string_view class_name(Class cls) noexcept;
+
+        /// @param branch_taken outcome of the summary's final conditional branch, if it has one
+        void add(const Summary &summary, bool branch_taken) noexcept;
+        /// @param branch_taken outcome if the instruction is a conditional branch
+        void add(const Instruction &inst, bool branch_taken) noexcept;
+        void reset() noexcept;
+
+        [[nodiscard]] uint64_t total() const noexcept { return m_total; }
+        [[nodiscard]] uint64_t opcode_count(int id) const noexcept;
+        [[nodiscard]] uint64_t class_count(Class cls) const noexcept;
+        /// @param width 1, 2, 4 or 8
+        [[nodiscard]] uint64_t width_count(unsigned width) const noexcept;
+        [[nodiscard]] uint64_t compressed_count() const noexcept { return m_compressed; }
+
+        /// @return the counters as a JSON object (opcodes by mnemonic, only those executed)
+        [[nodiscard]] std::string to_json() const;
+
+    private:
+        std::vector<uint64_t> m_opcodes; ///< indexed by InstProto::id, grown on demand
+        std::array<uint64_t, CLASS_CNT> m_classes{};
+        std::array<uint64_t, WIDTH_CNT> m_widths{};
+        uint64_t m_compressed = 0;
+        uint64_t m_total = 0;
+    };
+}
@@ -1,7 +1,6 @@
 #include "Interpreter.hpp"
 
 #include <any>
-#include <random>
 #include <cassert>
 #include <format>
 #include <rv64/Cpu.hpp>
@@ -63,7 +62,8 @@ namespace rv64 {
     }
 
     void Interpreter::auipc(GPIntReg &rd, int20 imm20) {
-        rd = m_vm.m_cpu.get_pc() + (imm20 << 12);
+        // Relative to current_pc, but PC already advanced by 4
+        rd = m_vm.m_cpu.get_pc() - 4 + (imm20 << 12);
     }
 
     void Interpreter::add(GPIntReg &rd, const GPIntReg &rs1, const GPIntReg &rs2) {
@@ -113,8 +113,9 @@ namespace rv64 {
     }
 
     void Interpreter::jalr(GPIntReg &rd, const GPIntReg &rs, int12 imm12) {
+        uint64_t target = rs.sval() + imm12; // before writing rd, which may be rs
         rd = m_vm.m_cpu.get_pc();
-        m_vm.m_cpu.set_pc(rs.sval() + imm12);
+        m_vm.m_cpu.set_pc(target);
     }
 
     void Interpreter::beq(const GPIntReg &rs1, const GPIntReg &rs2, int12 imm12) {
@@ -191,46 +192,14 @@ namespace rv64 {
     }
 
     void Interpreter::ecall() {
-        auto &a0 = m_vm.m_cpu.reg("a0");
-        const auto &a1 = m_vm.m_cpu.reg("a1");
-        const auto &a2 = m_vm.m_cpu.reg("a2");
-        MemErr err{};
-
-        switch (a0.sval()) {
-            case 1:
-                ui::print_output(std::to_string(a1.sval()));
-                return;
-            case 4:
-                ui::print_output(m_vm.m_memory.load_string(a1.val(), err));
-                break;
-            case 9:
-                a0 = m_vm.m_memory.sbrk(a1.sval(), err);
-                break;
-            case 10:
-                m_vm.terminate(0);
-                return;
-            case 11:
-                ui::print_output(std::string(1, static_cast<char>(a1.val() & 0xFF)));
-                return;
-            case 100: {
-                static std::random_device rd;
-                std::mt19937 rng(rd());
-                a0 = std::uniform_int_distribution(a1.sval(), a2.sval())(rng);
-                return;
-            }
-            case 17:
-                m_vm.terminate(static_cast<int>(a1.sval()));
-                return;
-            case -2137: // Secret exit code to suppress clangd "(err != MemErr::None) is always false",
-                // err can be modified in the cases above.
-                m_vm.terminate(-2137);
-                err = MemErr::ProgramExit;
-                break;
-            default:
-                ui::print_warning(std::format("Unsupported ecall code: {}", a0.sval()));
-                return;
+        if (m_vm.get_ecall_personality() == EcallPersonality::Linux) {
+            m_vm.m_linux_syscalls.handle();
+            return;
         }
-        if (err != MemErr::None) handle_error(err);
+
+        int64_t code = m_vm.m_cpu.reg(10).sval(); // a0
+        if (!m_vm.m_ecalls.dispatch(code, m_vm))
+            ui::print_warning(std::format("Unsupported ecall code: {}", code));
     }
 
     void Interpreter::ebreak() {
@@ -481,8 +450,9 @@ namespace rv64 {
             ebreak();
             return;
         }
+        uint64_t target = rs1.val(); // before writing ra, which may be rs1
         m_vm.m_cpu.reg(1) = m_vm.m_cpu.get_pc();
-        m_vm.m_cpu.set_pc(rs1.val());
+        m_vm.m_cpu.set_pc(target);
     }
 
     void Interpreter::c_beqz(const GPIntReg &rs1p, int8 imm8) {
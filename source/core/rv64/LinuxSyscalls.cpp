@@ -0,0 +1,260 @@
+#include "LinuxSyscalls.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <format>
+#include <ui.hpp>
+
+#include "VM.hpp"
+
+#ifdef _WIN32
+#   include <fcntl.h>
+#   include <io.h>
+#   include <sys/stat.h>
+#else
+#   include <fcntl.h>
+#   include <sys/uio.h>
+#   include <unistd.h>
+#endif
+
+namespace {
+    // guest (Linux generic ABI) constants, independent of the host
+    constexpr int64_t AT_FDCWD_GUEST = -100;
+    constexpr uint64_t O_ACCMODE_GUEST = 03;
+    constexpr uint64_t O_WRONLY_GUEST = 01;
+    constexpr uint64_t O_RDWR_GUEST = 02;
+    constexpr uint64_t O_CREAT_GUEST = 0100;
+    constexpr uint64_t O_EXCL_GUEST = 0200;
+    constexpr uint64_t O_TRUNC_GUEST = 01000;
+    constexpr uint64_t O_APPEND_GUEST = 02000;
+    constexpr int64_t CLOCK_REALTIME_GUEST = 0;
+    constexpr uint64_t IOV_MAX_GUEST = 1024;
+    constexpr int STD_STREAMS = 3;
+
+    int host_open_flags(uint64_t flags) {
+        int host = 0;
+        switch (flags & O_ACCMODE_GUEST) {
+            case O_WRONLY_GUEST: host = O_WRONLY; break;
+            case O_RDWR_GUEST: host = O_RDWR; break;
+            default: host = O_RDONLY; break;
+        }
+        if (flags & O_CREAT_GUEST) host |= O_CREAT;
+        if (flags & O_EXCL_GUEST) host |= O_EXCL;
+        if (flags & O_TRUNC_GUEST) host |= O_TRUNC;
+        if (flags & O_APPEND_GUEST) host |= O_APPEND;
+#ifdef _WIN32
+        host |= O_BINARY;
+#endif
+        return host;
+    }
+
+    int host_close(int fd) {
+#ifdef _WIN32
+        return _close(fd);
+#else
+        return ::close(fd);
+#endif
+    }
+}
+
+namespace rv64 {
+    LinuxSyscalls::~LinuxSyscalls() {
+        reset();
+    }
+
+    void LinuxSyscalls::handle() {
+        auto &cpu = m_vm.m_cpu;
+        auto arg = [&cpu](int i) { return cpu.reg(10 + i).val(); };
+        auto sarg = [&cpu](int i) { return cpu.reg(10 + i).sval(); };
+
+        int64_t result;
+        switch (static_cast<Syscall>(cpu.reg(17).sval())) {
+            case Syscall::openat: result = sys_openat(sarg(0), arg(1), arg(2), arg(3)); break;
+            case Syscall::close: result = sys_close(sarg(0)); break;
+            case Syscall::lseek: result = sys_lseek(sarg(0), sarg(1), sarg(2)); break;
+            case Syscall::read: result = sys_read(sarg(0), arg(1), arg(2)); break;
+            case Syscall::write: result = sys_write(sarg(0), arg(1), arg(2)); break;
+            case Syscall::writev: result = sys_writev(sarg(0), arg(1), arg(2)); break;
+            case Syscall::clock_gettime: result = sys_clock_gettime(sarg(0), arg(1)); break;
+            case Syscall::brk: result = sys_brk(arg(0)); break;
+            case Syscall::exit:
+            case Syscall::exit_group:
+                m_vm.terminate(static_cast<int>(sarg(0)));
+                return;
+            default:
+                ui::print_warning(std::format("Unsupported syscall: {}", cpu.reg(17).sval()));
+                result = -ENOSYS;
+                break;
+        }
+        cpu.reg(10) = result;
+    }
+
+    void LinuxSyscalls::reset() {
+        for (int fd: m_files) {
+            if (fd >= 0)
+                host_close(fd);
+        }
+        m_files.clear();
+    }
+
+    int LinuxSyscalls::host_fd(int64_t guest_fd) const noexcept {
+        if (guest_fd >= 0 && guest_fd < STD_STREAMS)
+            return static_cast<int>(guest_fd);
+        if (guest_fd < STD_STREAMS || guest_fd - STD_STREAMS >= static_cast<int64_t>(m_files.size()))
+            return -1;
+        return m_files[guest_fd - STD_STREAMS];
+    }
+
+    int64_t LinuxSyscalls::sys_openat(int64_t dir_fd, uint64_t path, uint64_t flags, uint64_t mode) {
+        MemErr err = MemErr::None;
+        std::string host_path = m_vm.m_memory.load_string(path, err);
+        if (err != MemErr::None)
+            return -EFAULT;
+
+        int fd;
+        bool relative_to_cwd = dir_fd == AT_FDCWD_GUEST || host_path.starts_with('/');
+#ifdef _WIN32
+        if (!relative_to_cwd)
+            return -ENOSYS;
+        fd = _open(host_path.c_str(), host_open_flags(flags), _S_IREAD | _S_IWRITE);
+#else
+        if (relative_to_cwd) {
+            fd = ::open(host_path.c_str(), host_open_flags(flags), static_cast<mode_t>(mode & 07777));
+        } else {
+            int dir = host_fd(dir_fd);
+            if (dir < 0)
+                return -EBADF;
+            fd = ::openat(dir, host_path.c_str(), host_open_flags(flags), static_cast<mode_t>(mode & 07777));
+        }
+#endif
+        if (fd < 0)
+            return -errno;
+
+        auto slot = std::ranges::find(m_files, -1);
+        if (slot == m_files.end())
+            slot = m_files.insert(slot, fd);
+        else
+            *slot = fd;
+        return STD_STREAMS + (slot - m_files.begin());
+    }
+
+    int64_t LinuxSyscalls::sys_close(int64_t fd) {
+        if (host_fd(fd) < 0)
+            return -EBADF;
+        if (fd < STD_STREAMS)
+            return 0; // the host's standard streams stay open
+
+        int &slot = m_files[fd - STD_STREAMS];
+        int result = host_close(slot);
+        slot = -1;
+        return result < 0 ? -errno : 0;
+    }
+
+    int64_t LinuxSyscalls::sys_lseek(int64_t fd, int64_t offset, int64_t whence) {
+        int host = host_fd(fd);
+        if (host < 0)
+            return -EBADF;
+#ifdef _WIN32
+        int64_t result = _lseeki64(host, offset, static_cast<int>(whence));
+#else
+        int64_t result = ::lseek(host, static_cast<off_t>(offset), static_cast<int>(whence));
+#endif
+        return result < 0 ? -errno : result;
+    }
+
+    int64_t LinuxSyscalls::sys_read(int64_t fd, uint64_t buf, uint64_t count) {
+        m_spans.clear();
+        if (m_vm.m_memory.host_spans(buf, count, m_spans, true) != MemErr::None)
+            return -EFAULT;
+        return transfer(fd, false);
+    }
+
+    int64_t LinuxSyscalls::sys_write(int64_t fd, uint64_t buf, uint64_t count) {
+        m_spans.clear();
+        if (m_vm.m_memory.host_spans(buf, count, m_spans, false) != MemErr::None)
+            return -EFAULT;
+        return transfer(fd, true);
+    }
+
+    int64_t LinuxSyscalls::sys_writev(int64_t fd, uint64_t iov, uint64_t iov_count) {
+        if (iov_count > IOV_MAX_GUEST)
+            return -EINVAL;
+
+        m_spans.clear();
+        auto &mem = m_vm.m_memory;
+        for (uint64_t i = 0; i < iov_count; ++i) {
+            MemErr err = MemErr::None, len_err = MemErr::None;
+            auto base = mem.load<uint64_t>(iov + i * 16, err);
+            auto len = mem.load<uint64_t>(iov + i * 16 + 8, len_err);
+            if (err != MemErr::None || len_err != MemErr::None || mem.host_spans(base, len, m_spans, false) != MemErr::None)
+                return -EFAULT;
+        }
+        return transfer(fd, true);
+    }
+
+    int64_t LinuxSyscalls::sys_clock_gettime(int64_t clock_id, uint64_t timespec) {
+        using namespace std::chrono;
+        nanoseconds now = clock_id == CLOCK_REALTIME_GUEST
+                              ? duration_cast<nanoseconds>(system_clock::now().time_since_epoch())
+                              : duration_cast<nanoseconds>(steady_clock::now().time_since_epoch());
+
+        auto secs = duration_cast<seconds>(now);
+        if (m_vm.m_memory.store(timespec, static_cast<int64_t>(secs.count())) != MemErr::None
+            || m_vm.m_memory.store(timespec + 8, static_cast<int64_t>((now - secs).count())) != MemErr::None)
+            return -EFAULT;
+        return 0;
+    }
+
+    int64_t LinuxSyscalls::sys_brk(uint64_t address) {
+        auto &mem = m_vm.m_memory;
+        uint64_t current = mem.get_brk();
+        if (address == 0 || address == current)
+            return static_cast<int64_t>(current);
+
+        // on failure the break stays where it was, which is how Linux reports it
+        MemErr err = MemErr::None;
+        (void) mem.sbrk(static_cast<int64_t>(address - current), err);
+        return static_cast<int64_t>(mem.get_brk());
+    }
+
+    int64_t LinuxSyscalls::transfer(int64_t guest_fd, bool write) {
+        int fd = host_fd(guest_fd);
+        if (fd < 0)
+            return -EBADF;
+
+        int64_t total = 0;
+#ifdef _WIN32
+        for (auto span: m_spans) {
+            auto size = static_cast<unsigned>(span.size());
+            int n = write ? _write(fd, span.data(), size) : _read(fd, span.data(), size);
+            if (n < 0)
+                return total > 0 ? total : -errno;
+            total += n;
+            if (static_cast<unsigned>(n) < size)
+                break;
+        }
+#else
+        std::array<iovec, 64> iov{};
+        for (size_t i = 0; i < m_spans.size();) {
+            size_t batch = std::min(m_spans.size() - i, iov.size());
+            size_t requested = 0;
+            for (size_t j = 0; j < batch; ++j) {
+                iov[j] = {m_spans[i + j].data(), m_spans[i + j].size()};
+                requested += m_spans[i + j].size();
+            }
+
+            ssize_t n = write ? ::writev(fd, iov.data(), static_cast<int>(batch))
+                              : ::readv(fd, iov.data(), static_cast<int>(batch));
+            if (n < 0)
+                return total > 0 ? total : -errno;
+            total += n;
+            if (static_cast<size_t>(n) < requested)
+                break;
+            i += batch;
+        }
+#endif
+        return total;
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace rv64 {
+    class VM;
+
+    /// @brief Emulation of a subset of the Linux RISC-V syscall ABI against the host:
+    /// the number is in a7, arguments in a0-a5 and the result (or -errno) is returned in a0.
+    ///
+    /// Guest fds 0-2 are the host's standard streams, files opened by the guest get the
+    /// following fds and are closed on reset. Data is transferred between guest pages and
+    /// host fds directly, without intermediate buffers. Host errno values are passed through.
+    class LinuxSyscalls {
+    public:
+        enum class Syscall : int64_t {
+            openat = 56,
+            close = 57,
+            lseek = 62,
+            read = 63,
+            write = 64,
+            writev = 66,
+            exit = 93,
+            exit_group = 94,
+            clock_gettime = 113,
+            brk = 214,
+        };
+
+        explicit LinuxSyscalls(VM &vm) : m_vm(vm) {}
+        ~LinuxSyscalls();
+
+        LinuxSyscalls(const LinuxSyscalls &) = delete;
+        LinuxSyscalls &operator=(const LinuxSyscalls &) = delete;
+
+        /// @brief executes the syscall selected by a7
+        void handle();
+
+        /// @brief closes all files opened by the guest
+        void reset();
+
+    private:
+        int64_t sys_openat(int64_t dir_fd, uint64_t path, uint64_t flags, uint64_t mode);
+        int64_t sys_close(int64_t fd);
+        int64_t sys_lseek(int64_t fd, int64_t offset, int64_t whence);
+        int64_t sys_read(int64_t fd, uint64_t buf, uint64_t count);
+        int64_t sys_write(int64_t fd, uint64_t buf, uint64_t count);
+        int64_t sys_writev(int64_t fd, uint64_t iov, uint64_t iov_count);
+        int64_t sys_clock_gettime(int64_t clock_id, uint64_t timespec);
+        int64_t sys_brk(uint64_t address);
+
+        /// @return host fd for the guest fd, -1 if it is not open
+        [[nodiscard]] int host_fd(int64_t guest_fd) const noexcept;
+
+        /// @brief transfers between the host fd and the collected guest spans
+        /// @return bytes transferred or -errno
+        int64_t transfer(int64_t guest_fd, bool write);
+
+        VM &m_vm;
+        std::vector<int> m_files; ///< host fds of guest fds 3, 4, ...; -1 for closed slots
+        std::vector<std::span<uint8_t>> m_spans; ///< scratch list of guest buffers
+    };
+}
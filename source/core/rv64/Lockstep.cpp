@@ -0,0 +1,99 @@
+#include "Lockstep.hpp"
+#include <format>
+#include <vector>
+
+#include "VM.hpp"
+
+namespace {
+    using namespace rv64;
+
+    bool can_continue(VMState state) {
+        return state == VMState::Loaded || state == VMState::Running
+               || state == VMState::Stopped || state == VMState::Breakpoint;
+    }
+
+    /// @brief records the stores of both VMs for the lifetime of the guard
+    class StoreJournals {
+    public:
+        StoreJournals(VM &reference, VM &candidate) : m_reference(reference), m_candidate(candidate) {
+            m_reference.m_memory.set_store_journal(&reference_stores);
+            m_candidate.m_memory.set_store_journal(&candidate_stores);
+        }
+
+        ~StoreJournals() {
+            m_reference.m_memory.set_store_journal(nullptr);
+            m_candidate.m_memory.set_store_journal(nullptr);
+        }
+
+        StoreJournals(const StoreJournals &) = delete;
+        StoreJournals &operator=(const StoreJournals &) = delete;
+
+        void clear() {
+            reference_stores.clear();
+            candidate_stores.clear();
+        }
+
+        std::vector<Memory::StoreRecord> reference_stores;
+        std::vector<Memory::StoreRecord> candidate_stores;
+
+    private:
+        VM &m_reference;
+        VM &m_candidate;
+    };
+
+    /// @return description of the first difference, nullopt if there is none
+    std::optional<std::string> compare(VM &reference, VM &candidate, const StoreJournals &journals) {
+        if (candidate.get_state() != reference.get_state())
+            return std::format("VM state {}, expected {}", int(candidate.get_state()), int(reference.get_state()));
+        if (candidate.get_instruction_count() != reference.get_instruction_count())
+            return std::format("{} instructions executed, expected {}",
+                               candidate.get_instruction_count(), reference.get_instruction_count());
+        if (candidate.m_cpu.get_pc() != reference.m_cpu.get_pc())
+            return std::format("pc = 0x{:x}, expected 0x{:x}", candidate.m_cpu.get_pc(), reference.m_cpu.get_pc());
+        for (int i = 0; i < int(Cpu::INT_REG_CNT); i++) {
+            uint64_t actual = candidate.m_cpu.reg(i).val(), expected = reference.m_cpu.reg(i).val();
+            if (actual != expected)
+                return std::format("x{} = 0x{:x}, expected 0x{:x}", i, actual, expected);
+        }
+        if (!Memory::same_stores(candidate.m_memory, journals.candidate_stores,
+                                 reference.m_memory, journals.reference_stores))
+            return std::format("{} memory writes differ from the reference's {}",
+                               journals.candidate_stores.size(), journals.reference_stores.size());
+        return std::nullopt;
+    }
+}
+
+namespace rv64 {
+    std::string Divergence::to_string() const {
+        std::string where = line == SIZE_MAX ? std::format("0x{:x}", pc) : std::format("0x{:x} (line {})", pc, line);
+        return std::format("diverged after {} instructions, in a step of {} starting at {} '{}': {}",
+                           instruction_count, step_size, where, instruction, detail);
+    }
+
+    std::optional<Divergence> run_lockstep(VM &reference, VM &candidate, uint64_t max_instructions) {
+        StoreJournals journals(reference, candidate);
+        while (can_continue(candidate.get_state()) && candidate.get_instruction_count() < max_instructions) {
+            uint64_t count = candidate.get_instruction_count();
+            uint64_t pc = candidate.m_cpu.get_pc();
+            journals.clear();
+
+            uint64_t step = candidate.run_dispatch(max_instructions - count);
+            while (can_continue(reference.get_state()) && reference.get_instruction_count() < count + step)
+                reference.run_dispatch(count + step - reference.get_instruction_count());
+
+            if (auto detail = compare(reference, candidate, journals)) {
+                MemErr err;
+                auto fetch = reference.m_memory.get_instruction_at(pc, err);
+                return Divergence{
+                    .instruction_count = count,
+                    .step_size = step,
+                    .pc = pc,
+                    .line = fetch.lineno.value_or(SIZE_MAX),
+                    .instruction = err == MemErr::None ? fetch.inst.to_string() : "<no instruction>",
+                    .detail = std::move(*detail)
+                };
+            }
+        }
+        return std::nullopt;
+    }
+}
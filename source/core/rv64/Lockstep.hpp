@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace rv64 {
+    class VM;
+
+    /// @brief First point where two engines disagree
+    struct Divergence {
+        uint64_t instruction_count; ///< instructions executed by both VMs before the diverging step
+        uint64_t step_size;         ///< instructions executed by the candidate in that step
+        uint64_t pc;                ///< first instruction of the step
+        size_t line;                ///< its source line, SIZE_MAX if there is none
+        std::string instruction;    ///< its assembly text
+        std::string detail;         ///< the differing state
+
+        [[nodiscard]] std::string to_string() const;
+    };
+
+    /// @brief Runs the candidate VM's engine against the reference VM's engine; both VMs must
+    /// have the same program loaded. The candidate executes one dispatch (a block, a fused idiom
+    /// or a single instruction), the reference catches up to the same instruction count, then
+    /// state, pc, registers and the memory written during the step are compared.
+    ///
+    /// Both VMs execute ecalls for real: give them the same input (InputReader::use_buffer)
+    /// and the same VMConfig::m_rng_seed.
+    /// @return the first divergence, nullopt if the VMs agree until the candidate stops
+    /// or max_instructions have been executed
+    [[nodiscard]] std::optional<Divergence> run_lockstep(VM &reference, VM &candidate,
+                                                         uint64_t max_instructions = UINT64_MAX);
+}
@@ -0,0 +1,211 @@
+#include "PipelineModel.hpp"
+#include <algorithm>
+#include <format>
+#include <map>
+#include <ranges>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
+
+#include "BranchPredictor.hpp"
+#include "CacheModel.hpp"
+#include "InstructionMix.hpp"
+#include "VM.hpp"
+
+namespace {
+    using namespace rv64;
+    using I = is::IBaseI::InstId;
+    using M = is::IExtensionM::InstId;
+    using C = is::IExtensionC::InstId;
+    using Stall = PipelineModel::Stall;
+
+    constexpr uint8_t SP = 2;
+    constexpr uint64_t MIN_INSTR_SIZE = 2;
+
+    /// Registers an instruction writes and reads (x0 is never a dependency)
+    struct Operands {
+        uint8_t destination = 0;
+        std::array<uint8_t, 2> sources{};
+    };
+
+    Operands operands(const Instruction &inst) {
+        const auto &args = inst.get_args();
+        std::array<uint8_t, 3> regs{};
+        size_t reg_cnt = 0;
+        for (const auto &arg: args) {
+            if (const auto *reg = std::get_if<Reg>(&arg); reg && reg_cnt < regs.size())
+                regs[reg_cnt++] = static_cast<uint8_t>(reg->idx());
+        }
+
+        switch (inst.get_prototype().id) {
+            // everything read, nothing written
+            case (int) I::sb: case (int) I::sh: case (int) I::sw: case (int) I::sd:
+            case (int) I::beq: case (int) I::bne: case (int) I::blt:
+            case (int) I::bge: case (int) I::bltu: case (int) I::bgeu:
+            case (int) C::c_sw: case (int) C::c_sd: case (int) C::c_fsd:
+            case (int) C::c_beqz: case (int) C::c_bnez: case (int) C::c_jr:
+                return {.sources = {regs[0], regs[1]}};
+            case (int) C::c_swsp: case (int) C::c_sdsp: case (int) C::c_fsdsp:
+                return {.sources = {regs[0], SP}};
+            case (int) C::c_jalr:
+                return {.destination = 1, .sources = {regs[0], 0}};
+            // stack pointer relative
+            case (int) C::c_lwsp: case (int) C::c_ldsp: case (int) C::c_fldsp: case (int) C::c_addi4spn:
+                return {.destination = regs[0], .sources = {SP, 0}};
+            case (int) C::c_addi16sp:
+                return {.destination = SP, .sources = {SP, 0}};
+            // rd is also the first source
+            case (int) C::c_addi: case (int) C::c_addiw: case (int) C::c_slli: case (int) C::c_srli:
+            case (int) C::c_srai: case (int) C::c_andi: case (int) C::c_add: case (int) C::c_and:
+            case (int) C::c_or: case (int) C::c_xor: case (int) C::c_sub: case (int) C::c_addw: case (int) C::c_subw:
+                return {.destination = regs[0], .sources = {regs[0], regs[1]}};
+            default:
+                // rd followed by the sources
+                return {.destination = regs[0], .sources = {regs[1], regs[2]}};
+        }
+    }
+
+    bool is_division(int id) {
+        switch (id) {
+            case (int) M::div: case (int) M::divu: case (int) M::rem: case (int) M::remu:
+            case (int) M::divw: case (int) M::divuw: case (int) M::remw: case (int) M::remuw:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
+namespace rv64 {
+    PipelineModel::Timing &PipelineModel::Timing::operator+=(const Timing &other) noexcept {
+        instructions += other.instructions;
+        cycles += other.cycles;
+        for (size_t i = 0; i < STALL_CNT; ++i)
+            stalls[i] += other.stalls[i];
+        return *this;
+    }
+
+    PipelineModel::PipelineModel(const Config &config, size_t program_size)
+        : m_config(config), m_instructions(program_size) {}
+
+    PipelineModel::Events PipelineModel::read_events(const CacheHierarchy *caches, const BranchModel *branches) noexcept {
+        Events events;
+        if (caches) {
+            using Level = CacheHierarchy::Level;
+            events.l1i_misses = caches->cache(Level::L1I).stats().misses;
+            events.l1d_misses = caches->cache(Level::L1D).stats().misses;
+            events.l2_misses = caches->cache(Level::L2).stats().misses;
+        }
+        if (branches) {
+            const auto &stats = branches->stats();
+            events.mispredicted = stats.mispredicted;
+            events.ras_mispredicted = stats.ras_mispredicted;
+            events.btb_misses = stats.btb_misses;
+        }
+        return events;
+    }
+
+    void PipelineModel::retire(uint64_t pc, uint32_t index, const Instruction &inst, uint64_t next_pc,
+                               const CacheHierarchy *caches, const BranchModel *branches) {
+        std::array<uint64_t, STALL_CNT> stalls{};
+        auto stall = [&](Stall kind) -> uint64_t & { return stalls[static_cast<size_t>(kind)]; };
+        auto cls = InstructionMix::classify(inst);
+        auto ops = operands(inst);
+
+        if (m_load_destination != 0 && std::ranges::find(ops.sources, m_load_destination) != ops.sources.end())
+            stall(Stall::LoadUse) = m_config.load_use_penalty;
+        m_load_destination = cls == InstructionMix::Class::Load ? ops.destination : 0;
+
+        if (cls == InstructionMix::Class::MulDiv) {
+            uint32_t latency = is_division(inst.get_prototype().id) ? m_config.div_latency : m_config.mul_latency;
+            stall(Stall::MulDiv) = std::max<uint32_t>(latency, 1) - 1;
+        }
+
+        auto events = read_events(caches, branches);
+        if (branches) {
+            stall(Stall::Control) = (events.mispredicted - m_events.mispredicted
+                                     + events.ras_mispredicted - m_events.ras_mispredicted) * m_config.branch_penalty
+                                    + (events.btb_misses - m_events.btb_misses) * m_config.jump_penalty;
+        } else if (next_pc != pc + inst.byte_size()) {
+            // predict not taken: every control transfer flushes the fetched instructions
+            int id = inst.get_prototype().id;
+            bool direct_jump = id == (int) I::jal || id == (int) C::c_j;
+            if (cls == InstructionMix::Class::BranchNotTaken || cls == InstructionMix::Class::Jump)
+                stall(Stall::Control) = direct_jump ? m_config.jump_penalty : m_config.branch_penalty;
+        }
+        stall(Stall::Fetch) = (events.l1i_misses - m_events.l1i_misses) * m_config.l2_latency;
+        stall(Stall::Data) = (events.l1d_misses - m_events.l1d_misses) * m_config.l2_latency;
+        stall(Stall::Memory) = (events.l2_misses - m_events.l2_misses) * m_config.memory_latency;
+        m_events = events;
+
+        Timing timing{.instructions = 1, .cycles = 1, .stalls = stalls};
+        for (auto s: stalls)
+            timing.cycles += s;
+        m_total += timing;
+        if (index < m_instructions.size())
+            m_instructions[index] += timing;
+    }
+
+    void PipelineModel::skip_events(const CacheHierarchy *caches, const BranchModel *branches) noexcept {
+        m_events = read_events(caches, branches);
+        m_load_destination = 0;
+    }
+
+    std::string_view PipelineModel::stall_name(Stall stall) noexcept {
+        switch (stall) {
+            case Stall::LoadUse: return "load-use";
+            case Stall::MulDiv: return "mul/div";
+            case Stall::Control: return "control";
+            case Stall::Fetch: return "L1I miss";
+            case Stall::Data: return "L1D miss";
+            case Stall::Memory: return "L2 miss";
+            default: return "";
+        }
+    }
+
+    std::string PipelineModel::report(const VM &vm, size_t top_n) const {
+        std::string out = std::format("cycles: {}, instructions: {}, CPI: {:.3f}\n", cycles(), m_total.instructions,
+                                      m_total.instructions ? double(cycles()) / double(m_total.instructions) : 0.0);
+        for (size_t i = 0; i < STALL_CNT; ++i) {
+            auto share = cycles() ? 100.0 * double(m_total.stalls[i]) / double(cycles()) : 0.0;
+            out += std::format("  {:<10} {:>14} stall cycles ({:.2f}%)\n", stall_name(Stall(i)), m_total.stalls[i],
+                               share);
+        }
+
+        struct Row {
+            std::string label;
+            Timing timing;
+        };
+        std::map<size_t, Timing> lines;
+        std::vector<Row> rows;
+        const auto &memory = vm.m_memory;
+        for (uint64_t pc = memory.get_instruction_begin_addr(); pc < memory.get_instruction_end_addr();
+             pc += MIN_INSTR_SIZE) {
+            auto index = memory.get_program_index(pc);
+            if (index >= m_instructions.size() || m_instructions[index].instructions == 0)
+                continue;
+            MemErr err;
+            auto fetch = memory.get_instruction_at(pc, err);
+            if (fetch.lineno)
+                lines[*fetch.lineno] += m_instructions[index];
+            else
+                rows.push_back({std::format("{:#x}", pc), m_instructions[index]});
+        }
+        for (const auto &[line, timing]: lines)
+            rows.push_back({std::format("line {}", line), timing});
+        std::ranges::stable_sort(rows, std::greater{}, [](const Row &row) { return row.timing.cycles; });
+        if (rows.empty())
+            return out;
+
+        out += std::format("\n{:<12} {:>12} {:>12} {:>7}", "", "cycles", "instructions", "CPI");
+        for (size_t i = 0; i < STALL_CNT; ++i)
+            out += std::format(" {:>10}", stall_name(Stall(i)));
+        out += '\n';
+        for (const auto &row: rows | std::views::take(top_n)) {
+            out += std::format("{:<12} {:>12} {:>12} {:>7.3f}", row.label, row.timing.cycles,
+                               row.timing.instructions, row.timing.cpi());
+            for (auto stall: row.timing.stalls)
+                out += std::format(" {:>10}", stall);
+            out += '\n';
+        }
+        return out;
+    }
+}
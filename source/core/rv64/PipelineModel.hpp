@@ -0,0 +1,97 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <Instruction.hpp>
+
+namespace rv64 {
+    class BranchModel;
+    class CacheHierarchy;
+    class VM;
+
+    /// @brief Timing model of a classic 5-stage in-order pipeline (IF, ID, EX, MEM, WB) with full
+    /// forwarding, estimating cycles from the stream of retired instructions.
+    ///
+    /// Every instruction takes one cycle plus its stalls: a load-use hazard, a multi-cycle M
+    /// extension operation blocking EX, a control transfer (mispredicted or, without a
+    /// BranchModel, taken; branches resolve in EX and jal in ID) and the miss latencies reported
+    /// by the CacheHierarchy, if the VM runs one.
+    class PipelineModel {
+    public:
+        struct Config {
+            uint32_t mul_latency = 3;       ///< EX cycles of mul*
+            uint32_t div_latency = 20;      ///< EX cycles of div* and rem*
+            uint32_t load_use_penalty = 1;  ///< stall of an instruction using the previous load's result
+            uint32_t branch_penalty = 2;    ///< mispredicted branch or jalr
+            uint32_t jump_penalty = 1;      ///< jal, or a branch target missing from the BTB
+            uint32_t l2_latency = 10;       ///< extra cycles of an L1 miss
+            uint32_t memory_latency = 100;  ///< extra cycles of an L2 miss
+            /// VM::get_cycle_count (and the cycle ecall service) reports the modelled cycles
+            /// instead of the instruction count
+            bool drive_cycle_counter = true;
+        };
+
+        enum class Stall { LoadUse, MulDiv, Control, Fetch, Data, Memory, Count };
+        static constexpr size_t STALL_CNT = static_cast<size_t>(Stall::Count);
+        static constexpr uint64_t PIPELINE_FILL = 4; ///< cycles until the first instruction retires
+
+        struct Timing {
+            uint64_t instructions = 0;
+            uint64_t cycles = 0; ///< instructions plus stalls
+            std::array<uint64_t, STALL_CNT> stalls{};
+
+            [[nodiscard]] double cpi() const noexcept {
+                return instructions ? double(cycles) / double(instructions) : 0.0;
+            }
+            Timing &operator+=(const Timing &other) noexcept;
+        };
+
+        /// @param program_size number of instruction slots of the loaded program
+        PipelineModel(const Config &config, size_t program_size);
+
+        /// @brief accounts for a retired instruction; call after the branch and cache models saw it
+        /// @param index instruction slot (see Memory::get_program_index)
+        /// @param next_pc pc after the instruction
+        /// @param caches cache model of the VM, nullptr if there is none
+        /// @param branches branch model of the VM, nullptr if there is none
+        void retire(uint64_t pc, uint32_t index, const Instruction &inst, uint64_t next_pc,
+                    const CacheHierarchy *caches, const BranchModel *branches);
+
+        /// @brief ignores the events the other models counted since the last retired instruction,
+        /// for resuming after instructions the pipeline did not see
+        void skip_events(const CacheHierarchy *caches, const BranchModel *branches) noexcept;
+
+        /// @return estimated cycles since the program was loaded
+        [[nodiscard]] uint64_t cycles() const noexcept {
+            return m_total.instructions ? m_total.cycles + PIPELINE_FILL : 0;
+        }
+        [[nodiscard]] const Timing &total() const noexcept { return m_total; }
+        [[nodiscard]] const Config &config() const noexcept { return m_config; }
+        /// @return timing per instruction slot
+        [[nodiscard]] const std::vector<Timing> &instruction_timing() const noexcept { return m_instructions; }
+
+        [[nodiscard]] static std::string_view stall_name(Stall stall) noexcept;
+
+        /// @brief cycles, CPI and stall breakdown, followed by the source lines (or, without
+        /// source, instructions) with the most cycles
+        [[nodiscard]] std::string report(const VM &vm, size_t top_n = 20) const;
+
+    private:
+        /// Event counters of the other models, to see what the last instruction caused
+        struct Events {
+            uint64_t l1i_misses = 0, l1d_misses = 0, l2_misses = 0;
+            uint64_t mispredicted = 0, ras_mispredicted = 0, btb_misses = 0;
+        };
+
+        [[nodiscard]] static Events read_events(const CacheHierarchy *caches, const BranchModel *branches) noexcept;
+
+        Config m_config;
+        Timing m_total;
+        std::vector<Timing> m_instructions;
+        Events m_events;
+        uint8_t m_load_destination = 0; ///< register loaded by the previous instruction, 0 if none
+    };
+}
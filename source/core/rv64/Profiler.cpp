@@ -0,0 +1,77 @@
+#include "Profiler.hpp"
+#include <format>
+#include <map>
+#include <ranges>
+
+#include "VM.hpp"
+
+namespace {
+    constexpr uint64_t MIN_INSTR_SIZE = 2;
+}
+
+namespace rv64 {
+    void Profiler::reset(size_t program_size) {
+        m_counts.assign(program_size, 0);
+    }
+
+    uint64_t Profiler::total() const noexcept {
+        uint64_t sum = 0;
+        for (auto c: m_counts)
+            sum += c;
+        return sum;
+    }
+
+    std::vector<Profiler::PcCount> Profiler::by_pc(const Memory &memory) const {
+        std::vector<PcCount> result;
+        uint64_t end = memory.get_instruction_end_addr();
+        for (uint64_t pc = memory.get_instruction_begin_addr(); pc < end; pc += MIN_INSTR_SIZE) {
+            auto index = memory.get_program_index(pc);
+            if (index == Memory::NOT_AN_INSTRUCTION || index >= m_counts.size() || m_counts[index] == 0)
+                continue;
+            MemErr err;
+            auto fetch = memory.get_instruction_at(pc, err);
+            result.push_back({pc, fetch.lineno.value_or(SIZE_MAX), m_counts[index]});
+        }
+        std::ranges::stable_sort(result, std::greater{}, &PcCount::count);
+        return result;
+    }
+
+    std::vector<Profiler::LineCount> Profiler::by_line(const Memory &memory) const {
+        std::map<size_t, uint64_t> lines;
+        for (const auto &entry: by_pc(memory)) {
+            if (entry.line != SIZE_MAX)
+                lines[entry.line] += entry.count;
+        }
+        std::vector<LineCount> result;
+        for (auto [line, count]: lines)
+            result.push_back({line, count});
+        std::ranges::stable_sort(result, std::greater{}, &LineCount::count);
+        return result;
+    }
+
+    std::string Profiler::report(const VM &vm, size_t top_n) const {
+        auto total_count = total();
+        auto share = [&](uint64_t count) { return total_count ? 100.0 * double(count) / double(total_count) : 0.0; };
+
+        std::string out = std::format("{} instructions executed\n\n{:>18} {:>14} {:>7} {:>6}  {}\n",
+                                      total_count, "pc", "count", "%", "line", "instruction");
+        auto pcs = by_pc(vm.m_memory);
+        for (const auto &entry: pcs | std::views::take(top_n)) {
+            MemErr err;
+            auto text = vm.m_memory.get_instruction_at(entry.pc, err).inst.to_string();
+            if (const auto *symbol = vm.find_symbol(entry.pc))
+                text = std::format("{:<28} <{}+{:#x}>", text, symbol->name, entry.pc - symbol->address);
+            std::string line = entry.line == SIZE_MAX ? "-" : std::to_string(entry.line);
+            out += std::format("{:#18x} {:>14} {:>6.2f}% {:>6}  {}\n", entry.pc, entry.count, share(entry.count),
+                               line, text);
+        }
+
+        auto lines = by_line(vm.m_memory);
+        if (!lines.empty()) {
+            out += std::format("\n{:>6} {:>14} {:>7}\n", "line", "count", "%");
+            for (const auto &entry: lines | std::views::take(top_n))
+                out += std::format("{:>6} {:>14} {:>6.2f}%\n", entry.line, entry.count, share(entry.count));
+        }
+        return out;
+    }
+}
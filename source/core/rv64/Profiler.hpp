@@ -0,0 +1,56 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Memory;
+
+namespace rv64 {
+    class VM;
+
+    /// @brief Execution counts of the loaded program, one counter per instruction slot
+    /// (see Memory::get_program_index). Filled by VM when VMConfig::m_profile is set.
+    class Profiler {
+    public:
+        struct PcCount {
+            uint64_t pc;
+            size_t line; ///< SIZE_MAX if the instruction has no source line
+            uint64_t count;
+        };
+
+        struct LineCount {
+            size_t line;
+            uint64_t count;
+        };
+
+        /// @brief zeroes the counters and sizes them for a program of program_size instructions
+        void reset(size_t program_size);
+
+        /// @brief counts one execution of n consecutive instructions starting at first_index;
+        /// indices outside the program (Memory::NOT_AN_INSTRUCTION) are ignored
+        void count(uint32_t first_index, uint64_t n) noexcept {
+            if (first_index >= m_counts.size())
+                return;
+            auto last = std::min<uint64_t>(m_counts.size(), first_index + n);
+            for (uint64_t i = first_index; i < last; ++i)
+                ++m_counts[i];
+        }
+
+        [[nodiscard]] const std::vector<uint64_t> &counts() const noexcept { return m_counts; }
+        /// @return sum of all counters
+        [[nodiscard]] uint64_t total() const noexcept;
+
+        /// @return executed instructions, hottest first (ties in address order)
+        [[nodiscard]] std::vector<PcCount> by_pc(const Memory &memory) const;
+        /// @return executed source lines, hottest first (ties in line order)
+        [[nodiscard]] std::vector<LineCount> by_line(const Memory &memory) const;
+
+        /// @brief hot-spot report of the top_n hottest instructions with their share of the total,
+        /// source line, enclosing ELF symbol and assembly text, followed by the hottest lines
+        [[nodiscard]] std::string report(const VM &vm, size_t top_n = 20) const;
+
+    private:
+        std::vector<uint64_t> m_counts;
+    };
+}
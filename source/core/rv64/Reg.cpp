@@ -1,11 +1,11 @@
 #include "Reg.hpp"
 #include <format>
 #include <cassert>
-#include <unordered_map>
+#include <PerfectHashMap.hpp>
 
 #include "Cpu.hpp"
 
-static const std::unordered_map<std::string, int> sym_name_map = {
+static constexpr PerfectHashMap<int, 65> sym_name_map{{{
     {"zero", 0}, {"ra", 1},   {"sp", 2},   {"gp", 3},   {"tp", 4},
     {"t0", 5},   {"t1", 6},   {"t2", 7},   {"s0", 8},   {"fp", 8},
     {"s1", 9},   {"a0", 10},  {"a1", 11},  {"a2", 12},  {"a3", 13},
@@ -19,7 +19,7 @@ static const std::unordered_map<std::string, int> sym_name_map = {
     {"x17", 17}, {"x18", 18}, {"x19", 19}, {"x20", 20}, {"x21", 21},
     {"x22", 22}, {"x23", 23}, {"x24", 24}, {"x25", 25}, {"x26", 26},
     {"x27", 27}, {"x28", 28}, {"x29", 29}, {"x30", 30}, {"x31", 31},
-};
+}}};
 
 namespace rv64 {
     std::string Reg::get_name() const {
@@ -54,13 +54,12 @@ namespace rv64 {
         assert(idx < Cpu::INT_REG_CNT);
     }
 
-    Reg::Reg(std::string_view name) : m_idx(name_to_idx(std::string(name))) {
+    Reg::Reg(std::string_view name) : m_idx(name_to_idx(name)) {
     }
 
-    int Reg::name_to_idx(const std::string &name) {
-        auto it = sym_name_map.find(name);
-        if (it == sym_name_map.end()) return -1;
-        return it->second;
+    int Reg::name_to_idx(std::string_view name) noexcept {
+        const int *idx = sym_name_map.find(name);
+        return idx ? *idx : -1;
     }
 
     int Reg::idx() const {
@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace rv64 {
     class Reg {
@@ -15,8 +16,9 @@ namespace rv64 {
         [[nodiscard]] std::string get_name() const;
         [[nodiscard]] std::string get_abi_name() const;
 
-        /// @brief converts register (symbolic or not) name to index. Returns -1 if the name is invalid.
-        [[nodiscard]] static int name_to_idx(const std::string &name);
+        /// @brief converts register (symbolic or not, case-insensitive) name to index.
+        /// Returns -1 if the name is invalid.
+        [[nodiscard]] static int name_to_idx(std::string_view name) noexcept;
 
         [[nodiscard]] int idx() const;
 
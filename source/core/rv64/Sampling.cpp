@@ -0,0 +1,290 @@
+#include "Sampling.hpp"
+#include <cmath>
+#include <format>
+#include <vector>
+
+#include "VM.hpp"
+
+namespace {
+    using namespace rv64;
+    using Metric = SampledRun::Metric;
+
+    constexpr unsigned SIGNATURE_BITS = 5;
+    constexpr size_t SIGNATURE_DIMS = size_t(1) << SIGNATURE_BITS;
+    constexpr uint64_t SIGNATURE_HASH = 0x9E3779B97F4A7C15;
+
+    using Counts = std::array<uint64_t, SIGNATURE_DIMS>;
+    using Events = std::array<uint64_t, SampledRun::METRIC_CNT>;
+
+    /// Instructions executed per code region during an interval, normalized: a random projection
+    /// of its basic block vector, as SimPoint uses
+    using Signature = std::array<double, SIGNATURE_DIMS>;
+
+    struct Window {
+        uint64_t instructions;
+        Events events;
+    };
+
+    struct Phase {
+        Signature signature;
+        uint64_t instructions = 0;
+        std::vector<Window> windows;
+    };
+
+    bool can_run(VMState state) {
+        return state == VMState::Loaded || state == VMState::Running;
+    }
+
+    Events read_events(const VM &vm) {
+        Events events{};
+        auto set = [&](Metric metric, uint64_t value) { events[static_cast<size_t>(metric)] = value; };
+        if (vm.m_pipeline_model)
+            set(Metric::Cycles, vm.m_pipeline_model->total().cycles);
+        if (vm.m_cache_model) {
+            using Level = CacheHierarchy::Level;
+            set(Metric::L1IMisses, vm.m_cache_model->cache(Level::L1I).stats().misses);
+            set(Metric::L1DMisses, vm.m_cache_model->cache(Level::L1D).stats().misses);
+            set(Metric::L2Misses, vm.m_cache_model->cache(Level::L2).stats().misses);
+        }
+        if (vm.m_branch_model) {
+            const auto &stats = vm.m_branch_model->stats();
+            set(Metric::Mispredictions, stats.mispredicted + stats.ras_mispredicted);
+        }
+        return events;
+    }
+
+    bool has_model(const VM &vm, Metric metric) {
+        switch (metric) {
+            case Metric::Cycles: return vm.m_pipeline_model.has_value();
+            case Metric::Mispredictions: return vm.m_branch_model.has_value();
+            default: return vm.m_cache_model.has_value();
+        }
+    }
+
+    /// @return true if the last of the executed instructions starting at pc is a branch or jump
+    bool ends_basic_block(const Memory &memory, uint64_t pc, uint64_t executed) {
+        for (uint64_t i = 1; i < executed; ++i)
+            pc += memory.get_instruction_size(pc);
+        MemErr err;
+        auto fetch = memory.get_instruction_at(pc, err);
+        return err == MemErr::None && BranchModel::is_control_flow(fetch.inst);
+    }
+
+    /// @brief executes up to n instructions, adding every dispatch to the counts of its basic block,
+    /// so that the counts do not depend on how many instructions the engine executes per dispatch
+    /// @param block start of the current basic block, kept across calls
+    /// @return number of executed instructions
+    uint64_t run_for(VM &vm, uint64_t n, Counts &counts, uint64_t &block) {
+        uint64_t start = vm.get_instruction_count();
+        while (can_run(vm.get_state())) {
+            uint64_t done = vm.get_instruction_count() - start;
+            if (done >= n)
+                break;
+            uint64_t pc = vm.m_cpu.get_pc();
+            uint64_t executed = vm.run_dispatch(n - done);
+            counts[(block * SIGNATURE_HASH) >> (64 - SIGNATURE_BITS)] += executed;
+            if (ends_basic_block(vm.m_memory, pc, executed))
+                block = vm.m_cpu.get_pc();
+        }
+        return vm.get_instruction_count() - start;
+    }
+
+    Signature normalize(const Counts &counts, uint64_t total) {
+        Signature signature{};
+        for (size_t i = 0; i < SIGNATURE_DIMS; ++i)
+            signature[i] = double(counts[i]) / double(total);
+        return signature;
+    }
+
+    double distance(const Signature &a, const Signature &b) {
+        double sum = 0;
+        for (size_t i = 0; i < SIGNATURE_DIMS; ++i)
+            sum += std::abs(a[i] - b[i]);
+        return sum;
+    }
+
+    /// @return index of the phase of the interval, added to phases if it starts a new one
+    size_t classify(std::vector<Phase> &phases, const Signature &signature, const SamplingConfig &config) {
+        if (config.schedule == SamplingConfig::Schedule::Periodic) {
+            if (phases.empty())
+                phases.push_back({.signature = signature, .instructions = 0, .windows = {}});
+            return 0;
+        }
+        size_t closest = phases.size();
+        double closest_distance = INFINITY;
+        for (size_t i = 0; i < phases.size(); ++i) {
+            double d = distance(phases[i].signature, signature);
+            if (d < closest_distance) {
+                closest = i;
+                closest_distance = d;
+            }
+        }
+        if (closest_distance < config.phase_threshold || phases.size() >= config.max_phases)
+            return closest;
+        phases.push_back({.signature = signature, .instructions = 0, .windows = {}});
+        return phases.size() - 1;
+    }
+
+    /// Ratio estimate of the events per instruction of a set of windows
+    struct Rate {
+        double rate = 0;
+        double variance = 0; ///< of a window's rate, scaled to the mean window size
+        size_t n = 0;
+        uint64_t instructions = 0;
+    };
+
+    Rate estimate_rate(const std::vector<Window> &windows, size_t metric) {
+        Rate r;
+        double events = 0;
+        for (const auto &w: windows) {
+            r.instructions += w.instructions;
+            events += double(w.events[metric]);
+            ++r.n;
+        }
+        if (r.n == 0)
+            return r;
+        r.rate = events / double(r.instructions);
+        if (r.n < 2)
+            return r;
+        double mean_size = double(r.instructions) / double(r.n);
+        double sum = 0;
+        for (const auto &w: windows) {
+            double residual = double(w.events[metric]) - r.rate * double(w.instructions);
+            sum += residual * residual;
+        }
+        r.variance = sum / double(r.n - 1) / (mean_size * mean_size);
+        return r;
+    }
+
+    std::vector<Window> all_windows(const std::vector<Phase> &phases) {
+        std::vector<Window> windows;
+        for (const auto &phase: phases)
+            windows.insert(windows.end(), phase.windows.begin(), phase.windows.end());
+        return windows;
+    }
+
+    /// @brief stratified estimate: each phase contributes its instructions times its rate; phases
+    /// without a window (or with a single one) borrow the rate (or the variance) of all windows
+    SampledRun::Estimate extrapolate(const std::vector<Phase> &phases, size_t metric, double z_score) {
+        auto pooled = estimate_rate(all_windows(phases), metric);
+        double total = 0, variance = 0;
+        for (const auto &phase: phases) {
+            auto r = estimate_rate(phase.windows, metric);
+            double rate_variance;
+            if (r.n == 0) {
+                r.rate = pooled.rate;
+                rate_variance = pooled.n ? pooled.variance / double(pooled.n) : 0;
+            } else {
+                // the measured part of the phase is known exactly
+                double unmeasured = 1.0 - std::min(1.0, double(r.instructions) / double(phase.instructions));
+                rate_variance = (r.n < 2 ? pooled.variance : r.variance) / double(r.n) * unmeasured;
+            }
+            total += double(phase.instructions) * r.rate;
+            variance += double(phase.instructions) * double(phase.instructions) * rate_variance;
+        }
+        return {.value = total, .margin = z_score * std::sqrt(variance), .measured = true};
+    }
+}
+
+namespace rv64 {
+    std::optional<std::string> SamplingConfig::validate(const SamplingConfig &config) {
+        if (config.window == 0)
+            return std::string("Sampling window must contain at least 1 instruction");
+        if (config.warmup + config.window > config.interval)
+            return std::format("Warm-up and window ({} instructions) do not fit in the sampling interval of {}",
+                               config.warmup + config.window, config.interval);
+        if (config.schedule == Schedule::Phases) {
+            if (config.samples_per_phase == 0)
+                return std::string("Samples per phase must be at least 1");
+            if (config.max_phases == 0)
+                return std::string("Phase count limit must be at least 1");
+            if (!(config.phase_threshold > 0))
+                return std::string("Phase threshold must be positive");
+        }
+        if (!(config.z_score >= 0))
+            return std::string("Confidence z-score must not be negative");
+        return std::nullopt;
+    }
+
+    std::string_view SampledRun::metric_name(Metric metric) noexcept {
+        switch (metric) {
+            case Metric::Cycles: return "cycles";
+            case Metric::L1IMisses: return "L1I misses";
+            case Metric::L1DMisses: return "L1D misses";
+            case Metric::L2Misses: return "L2 misses";
+            case Metric::Mispredictions: return "mispredictions";
+            default: return "";
+        }
+    }
+
+    std::string SampledRun::report() const {
+        double detailed = instructions ? 100.0 * double(detailed_instructions) / double(instructions) : 0.0;
+        std::string out = std::format(
+            "instructions: {}, in detail: {} ({:.2f}%), intervals: {}, windows: {}, phases: {}\n",
+            instructions, detailed_instructions, detailed, intervals, windows, phases);
+        for (size_t i = 0; i < METRIC_CNT; ++i) {
+            const auto &e = estimates[i];
+            if (!e.measured)
+                continue;
+            double relative = e.value > 0 ? 100.0 * e.margin / e.value : 0.0;
+            double per_k = instructions ? 1000.0 * e.value / double(instructions) : 0.0;
+            out += std::format("  {:<15} {:>16.0f} +- {:<14.0f} ({:>6.2f}%) {:>10.3f} per 1k instructions\n",
+                               metric_name(Metric(i)), e.value, e.margin, relative, per_k);
+        }
+        return out;
+    }
+
+    SampledRun run_sampled(VM &vm, const SamplingConfig &config) {
+        SampledRun run;
+        std::vector<Phase> phases;
+        std::optional<size_t> previous;
+        uint64_t start = vm.get_instruction_count();
+        uint64_t block = vm.m_cpu.get_pc();
+
+        auto fast = config.functional_warming ? ModelDetail::Warming : ModelDetail::Off;
+        vm.set_model_detail(fast);
+        while (can_run(vm.get_state())) {
+            // the phase of an interval is only known at its end, assume it continues the previous one
+            bool sample = config.schedule == SamplingConfig::Schedule::Periodic || !previous
+                          || phases[*previous].windows.size() < config.samples_per_phase;
+            Counts counts{};
+            uint64_t executed = 0;
+            std::optional<Window> window;
+            if (sample) {
+                vm.set_model_detail(ModelDetail::Full);
+                executed += run_for(vm, config.warmup, counts, block);
+                auto before = read_events(vm);
+                uint64_t measured = run_for(vm, config.window, counts, block);
+                auto after = read_events(vm);
+                vm.set_model_detail(fast);
+                executed += measured;
+                run.detailed_instructions += executed;
+                if (measured > 0) {
+                    window = Window{.instructions = measured, .events = {}};
+                    for (size_t i = 0; i < SampledRun::METRIC_CNT; ++i)
+                        window->events[i] = after[i] - before[i];
+                }
+            }
+            executed += run_for(vm, config.interval - executed, counts, block);
+            if (executed == 0)
+                break;
+
+            size_t index = classify(phases, normalize(counts, executed), config);
+            phases[index].instructions += executed;
+            if (window)
+                phases[index].windows.push_back(*window);
+            previous = index;
+            ++run.intervals;
+            run.windows += window.has_value();
+        }
+        vm.set_model_detail(ModelDetail::Full);
+
+        run.instructions = vm.get_instruction_count() - start;
+        run.phases = phases.size();
+        for (size_t i = 0; i < SampledRun::METRIC_CNT; ++i) {
+            if (has_model(vm, Metric(i)))
+                run.estimates[i] = extrapolate(phases, i, config.z_score);
+        }
+        return run;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace rv64 {
+    class VM;
+
+    /// @brief Schedule of the detailed windows of run_sampled
+    struct SamplingConfig {
+        enum class Schedule {
+            Periodic, ///< a window at the start of every interval
+            Phases    ///< intervals are grouped into phases by the code they run (SimPoint-like);
+                      ///< windows are taken until every phase has samples_per_phase of them
+        };
+
+        Schedule schedule = Schedule::Periodic;
+        uint64_t interval = 100'000;  ///< instructions per interval
+        uint64_t warmup = 2'000;      ///< detailed instructions before a window, not measured
+        uint64_t window = 1'000;      ///< measured instructions
+        uint32_t samples_per_phase = 4;
+        /// keep the caches and branch predictors warm between the windows (ModelDetail::Warming,
+        /// as SMARTS does); without it they are stale at every window that the warm-up cannot
+        /// refill, which biases the misses upwards
+        bool functional_warming = true;
+        /// an interval joins the closest phase if the L1 distance between their normalized
+        /// execution signatures (0 to 2) is below this, otherwise it starts a new phase
+        double phase_threshold = 0.3;
+        uint32_t max_phases = 32;
+        double z_score = 1.96; ///< of the confidence intervals (1.96: 95%)
+
+        /// @return optional string with error message
+        [[nodiscard]] static std::optional<std::string> validate(const SamplingConfig &config);
+    };
+
+    /// @brief Totals of a sampled run, extrapolated from the detailed windows
+    struct SampledRun {
+        enum class Metric { Cycles, L1IMisses, L1DMisses, L2Misses, Mispredictions, Count };
+        static constexpr size_t METRIC_CNT = static_cast<size_t>(Metric::Count);
+
+        struct Estimate {
+            double value = 0; ///< estimated total
+            double margin = 0; ///< half width of the confidence interval
+            bool measured = false; ///< false if the VM has no model for the metric
+        };
+
+        uint64_t instructions = 0;          ///< executed in total
+        uint64_t detailed_instructions = 0; ///< executed with the models on (warm-up and windows)
+        size_t intervals = 0;
+        size_t windows = 0;
+        size_t phases = 0;
+        std::array<Estimate, METRIC_CNT> estimates{};
+
+        [[nodiscard]] const Estimate &estimate(Metric metric) const noexcept {
+            return estimates[static_cast<size_t>(metric)];
+        }
+        [[nodiscard]] static std::string_view metric_name(Metric metric) noexcept;
+        [[nodiscard]] std::string report() const;
+    };
+
+    /// @brief Runs the loaded program until it stops, with the VM's cache, branch and pipeline
+    /// models in full detail only for short windows (see VM::set_model_detail) and the configured
+    /// engine executing everything else. Each window is preceded by a detailed warm-up; the
+    /// totals are extrapolated from the event rates of the windows, stratified by phase, with
+    /// confidence intervals from their variance.
+    ///
+    /// Breakpoints and the watchdog limits are ignored. The models are left in full detail.
+    /// @param config must be valid (see SamplingConfig::validate)
+    [[nodiscard]] SampledRun run_sampled(VM &vm, const SamplingConfig &config);
+}
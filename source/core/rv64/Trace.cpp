@@ -0,0 +1,378 @@
+#include "Trace.hpp"
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <ostream>
+#include <Memory.hpp>
+#include <rv64/instruction_sets/Rv64IMC.hpp>
+
+#include "Cpu.hpp"
+
+namespace {
+    using namespace rv64;
+    using namespace rv64::trace_format;
+
+    constexpr size_t REG_CNT = 32;
+    constexpr uint64_t MIN_INSTR_SIZE = 2;
+    constexpr size_t READ_SIZE = size_t(1) << 20;
+    constexpr auto WRITER_POLL = std::chrono::milliseconds(1);
+
+    void put_varint(std::vector<uint8_t> &out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint64_t zigzag(uint64_t delta) {
+        auto d = std::bit_cast<int64_t>(delta);
+        return (delta << 1) ^ static_cast<uint64_t>(d >> 63);
+    }
+
+    uint64_t unzigzag(uint64_t value) {
+        return (value >> 1) ^ (0 - (value & 1));
+    }
+
+    uint8_t inline_count(uint64_t count) {
+        return count <= INLINE_COUNT_MAX ? static_cast<uint8_t>(count) : COUNT_FOLLOWS;
+    }
+
+    std::string_view mnemonic(int inst_id) {
+        auto name = is::Rv64IMC::get_inst_proto(inst_id).mnemonic;
+        return name.empty() ? "?" : name;
+    }
+}
+
+namespace rv64 {
+    std::optional<std::string> TraceRecorder::validate(const Config &config) {
+        if (config.path.empty())
+            return std::string("Trace file path is empty");
+        if (!std::has_single_bit(config.buffer_size) || config.buffer_size < 4096)
+            return std::format("Trace buffer size {} is not a power of two of at least 4096", config.buffer_size);
+        if (config.write_size == 0 || config.write_size > config.buffer_size)
+            return std::format("Trace write size {} is outside 1..{}", config.write_size, config.buffer_size);
+        return std::nullopt;
+    }
+
+    TraceRecorder::~TraceRecorder() {
+        close();
+    }
+
+    std::optional<std::string> TraceRecorder::open(const Config &config, const Memory &memory, const Cpu &cpu) {
+        close();
+        m_file.open(config.path, std::ios::binary | std::ios::trunc);
+        if (!m_file)
+            return std::format("Cannot create trace file {}", config.path.string());
+
+        m_ring.assign(config.buffer_size, 0);
+        m_write_size = config.write_size;
+        m_head.store(0, std::memory_order_relaxed);
+        m_tail.store(0, std::memory_order_relaxed);
+        m_stop.store(false, std::memory_order_relaxed);
+        m_failed.store(false, std::memory_order_relaxed);
+        m_accesses.clear();
+        m_pc = 0;
+        m_address = 0;
+        m_records = 0;
+
+        m_record.assign(TRACE_MAGIC.begin(), TRACE_MAGIC.end());
+        std::vector<std::pair<uint64_t, size_t>> lines;
+        m_inst_ids.assign(memory.get_program_size(), -1);
+        for (uint64_t pc = memory.get_instruction_begin_addr(); pc < memory.get_instruction_end_addr();
+             pc += MIN_INSTR_SIZE) {
+            auto index = memory.get_program_index(pc);
+            if (index >= m_inst_ids.size())
+                continue;
+            MemErr err;
+            auto fetch = memory.get_instruction_at(pc, err);
+            m_inst_ids[index] = fetch.inst.get_prototype().id;
+            if (err == MemErr::None && fetch.lineno)
+                lines.emplace_back(pc, *fetch.lineno);
+        }
+        put_varint(m_record, lines.size());
+        uint64_t previous = 0;
+        for (auto [pc, line]: lines) {
+            put_varint(m_record, zigzag(pc - previous));
+            put_varint(m_record, line);
+            previous = pc;
+        }
+        for (size_t i = 0; i < REG_CNT; ++i) {
+            m_regs[i] = cpu.int_regs()[i].val();
+            put_varint(m_record, m_regs[i]);
+        }
+
+        m_writer = std::thread(&TraceRecorder::write_loop, this);
+        push(m_record.data(), m_record.size());
+        return std::nullopt;
+    }
+
+    std::optional<std::string> TraceRecorder::close() {
+        if (!is_open())
+            return std::nullopt;
+        m_stop.store(true, std::memory_order_release);
+        m_writer.join();
+        bool failed = m_failed.load(std::memory_order_relaxed);
+        m_file.close();
+        if (failed || m_file.fail())
+            return std::string("Writing the trace file failed");
+        return std::nullopt;
+    }
+
+    void TraceRecorder::retire(uint64_t pc, uint32_t index, const Cpu &cpu) {
+        const auto &regs = cpu.int_regs();
+        uint32_t changed = 0;
+        for (size_t i = 1; i < REG_CNT; ++i)
+            changed |= uint32_t(regs[i].val() != m_regs[i]) << i;
+        auto reg_count = static_cast<uint64_t>(std::popcount(changed));
+
+        m_record.clear();
+        m_record.push_back(static_cast<uint8_t>(inline_count(reg_count) | inline_count(m_accesses.size()) << 2));
+        if (reg_count >= COUNT_FOLLOWS)
+            put_varint(m_record, reg_count);
+        if (m_accesses.size() >= COUNT_FOLLOWS)
+            put_varint(m_record, m_accesses.size());
+        put_varint(m_record, zigzag(pc - m_pc));
+        put_varint(m_record, index < m_inst_ids.size() ? static_cast<uint64_t>(m_inst_ids[index]) : 0);
+        m_pc = pc;
+
+        for (; changed; changed &= changed - 1) {
+            auto i = static_cast<size_t>(std::countr_zero(changed));
+            uint64_t value = regs[i].val();
+            m_record.push_back(static_cast<uint8_t>(i));
+            put_varint(m_record, zigzag(value - m_regs[i]));
+            m_regs[i] = value;
+        }
+        for (const auto &access: m_accesses) {
+            m_record.push_back(access.kind);
+            put_varint(m_record, zigzag(access.address - m_address));
+            m_address = access.address;
+            if (access.kind & STORE_BIT)
+                put_varint(m_record, access.value);
+        }
+        m_accesses.clear();
+        push(m_record.data(), m_record.size());
+        ++m_records;
+    }
+
+    void TraceRecorder::push(const uint8_t *data, size_t size) {
+        const uint64_t capacity = m_ring.size();
+        uint64_t head = m_head.load(std::memory_order_relaxed);
+        while (size > 0) {
+            uint64_t free = capacity - (head - m_tail.load(std::memory_order_acquire));
+            if (free == 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            size_t offset = head & (capacity - 1);
+            size_t n = std::min<uint64_t>({size, free, capacity - offset});
+            std::memcpy(m_ring.data() + offset, data, n);
+            data += n;
+            size -= n;
+            head += n;
+            m_head.store(head, std::memory_order_release);
+        }
+    }
+
+    void TraceRecorder::write_loop() {
+        const uint64_t capacity = m_ring.size();
+        while (true) {
+            // stop before head: once stop is seen, head holds the last push
+            bool stop = m_stop.load(std::memory_order_acquire);
+            uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            uint64_t available = m_head.load(std::memory_order_acquire) - tail;
+            if (available == 0 && stop)
+                break;
+            if (available < m_write_size && !stop) {
+                std::this_thread::sleep_for(WRITER_POLL);
+                continue;
+            }
+            // up to the end of the ring, the wrapped part in the next round
+            size_t offset = tail & (capacity - 1);
+            size_t n = std::min<uint64_t>(available, capacity - offset);
+            if (!m_failed.load(std::memory_order_relaxed)) {
+                m_file.write(reinterpret_cast<const char *>(m_ring.data() + offset), static_cast<std::streamsize>(n));
+                if (!m_file)
+                    m_failed.store(true, std::memory_order_relaxed);
+            }
+            m_tail.store(tail + n, std::memory_order_release);
+        }
+        m_file.flush();
+        if (!m_file)
+            m_failed.store(true, std::memory_order_relaxed);
+    }
+
+    std::string TraceEntry::to_text() const {
+        std::string out = std::format("{:>10} {:#010x}", index, pc);
+        out += line ? std::format(" {:>6}", *line) : std::string(7, ' ');
+        out += std::format("  {:<10}", mnemonic(inst_id));
+        for (const auto &w: reg_writes)
+            out += std::format(" x{}={:#x}", w.reg, w.value);
+        for (const auto &a: accesses) {
+            out += std::format(" {}{} [{:#x}]", a.store ? "store" : "load", a.size, a.address);
+            if (a.store)
+                out += std::format("={:#x}", a.value);
+        }
+        return out;
+    }
+
+    std::string TraceEntry::to_csv() const {
+        std::string out = std::format("{},{:#x},{},{},", index, pc, line ? std::to_string(*line) : "",
+                                      mnemonic(inst_id));
+        for (size_t i = 0; i < reg_writes.size(); ++i)
+            out += std::format("{}x{}={:#x}", i ? ";" : "", reg_writes[i].reg, reg_writes[i].value);
+        out += ',';
+        for (size_t i = 0; i < accesses.size(); ++i) {
+            const auto &a = accesses[i];
+            out += std::format("{}{}{}@{:#x}", i ? ";" : "", a.store ? "store" : "load", a.size, a.address);
+            if (a.store)
+                out += std::format("={:#x}", a.value);
+        }
+        return out;
+    }
+
+    std::optional<std::string> TraceReader::open(const std::filesystem::path &path) {
+        m_file = std::ifstream(path, std::ios::binary);
+        if (!m_file)
+            return std::format("Cannot open trace file {}", path.string());
+        m_buffer.resize(READ_SIZE);
+        m_pos = m_end = 0;
+        m_lines.clear();
+        m_pc = m_address = m_index = 0;
+        m_error.reset();
+
+        std::array<char, TRACE_MAGIC.size()> magic{};
+        for (auto &c: magic) {
+            uint8_t byte;
+            if (!read_byte(byte))
+                break;
+            c = static_cast<char>(byte);
+        }
+        if (magic != TRACE_MAGIC)
+            return std::format("{} is not an execution trace", path.string());
+
+        uint64_t count, pc = 0;
+        if (!read_varint(count))
+            return std::string("Trace header is truncated");
+        for (uint64_t i = 0; i < count; ++i) {
+            uint64_t delta, line;
+            if (!read_varint(delta) || !read_varint(line))
+                return std::string("Trace header is truncated");
+            pc += unzigzag(delta);
+            m_lines[pc] = line;
+        }
+        for (auto &reg: m_initial) {
+            if (!read_varint(reg))
+                return std::string("Trace header is truncated");
+        }
+        m_regs = m_initial;
+        return std::nullopt;
+    }
+
+    bool TraceReader::next(TraceEntry &entry) {
+        uint8_t flags;
+        if (!read_byte(flags))
+            return false;
+        auto corrupt = [&] {
+            m_error = std::format("Trace is truncated or corrupt at record {}", m_index);
+            return false;
+        };
+
+        uint64_t reg_count, access_count, delta, id;
+        if (!read_count(flags & 3, reg_count) || !read_count((flags >> 2) & 3, access_count)
+            || !read_varint(delta) || !read_varint(id) || reg_count >= REG_CNT)
+            return corrupt();
+        m_pc += unzigzag(delta);
+        entry.index = m_index++;
+        entry.pc = m_pc;
+        entry.inst_id = static_cast<int>(id);
+        auto line = m_lines.find(m_pc);
+        entry.line = line != m_lines.end() ? std::optional(line->second) : std::nullopt;
+
+        entry.reg_writes.clear();
+        for (uint64_t i = 0; i < reg_count; ++i) {
+            uint8_t reg;
+            if (!read_byte(reg) || reg >= REG_CNT || !read_varint(delta))
+                return corrupt();
+            m_regs[reg] += unzigzag(delta);
+            entry.reg_writes.push_back({reg, m_regs[reg]});
+        }
+        entry.accesses.clear();
+        for (uint64_t i = 0; i < access_count; ++i) {
+            uint8_t kind;
+            uint64_t value = 0;
+            if (!read_byte(kind) || !read_varint(delta))
+                return corrupt();
+            bool store = kind & STORE_BIT;
+            if (store && !read_varint(value))
+                return corrupt();
+            m_address += unzigzag(delta);
+            entry.accesses.push_back({m_address, value, static_cast<uint8_t>(kind & ~STORE_BIT), store});
+        }
+        return true;
+    }
+
+    bool TraceReader::read_byte(uint8_t &byte) {
+        if (m_pos == m_end) {
+            m_file.read(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+            m_end = static_cast<size_t>(m_file.gcount());
+            m_pos = 0;
+            if (m_end == 0)
+                return false;
+        }
+        byte = static_cast<uint8_t>(m_buffer[m_pos++]);
+        return true;
+    }
+
+    bool TraceReader::read_varint(uint64_t &value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!read_byte(byte))
+                return false;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    bool TraceReader::read_count(uint8_t inline_count, uint64_t &count) {
+        if (inline_count < COUNT_FOLLOWS) {
+            count = inline_count;
+            return true;
+        }
+        return read_varint(count);
+    }
+
+    bool TraceFilter::matches(const TraceEntry &entry) const {
+        if (pc_begin && entry.pc < *pc_begin)
+            return false;
+        if (pc_end && entry.pc >= *pc_end)
+            return false;
+        if (line && entry.line != line)
+            return false;
+        if (reg) {
+            return std::ranges::any_of(entry.reg_writes,
+                                       [&](const TraceEntry::RegWrite &w) { return w.reg == *reg; });
+        }
+        return true;
+    }
+
+    std::optional<std::string> decode_trace(const std::filesystem::path &path, std::ostream &out,
+                                            TraceOutput format, const TraceFilter &filter) {
+        TraceReader reader;
+        if (auto err = reader.open(path))
+            return err;
+        if (format == TraceOutput::Csv)
+            out << TraceEntry::CSV_HEADER << '\n';
+        TraceEntry entry;
+        while (reader.next(entry)) {
+            if (filter.matches(entry))
+                out << (format == TraceOutput::Csv ? entry.to_csv() : entry.to_text()) << '\n';
+        }
+        return reader.error();
+    }
+}
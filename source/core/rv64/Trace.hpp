@@ -0,0 +1,180 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iosfwd>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+class Memory;
+
+namespace rv64 {
+    class Cpu;
+
+    /// Binary execution trace: a header followed by one record per retired instruction.
+    ///
+    /// Header: TRACE_MAGIC, varint entry count and entries (zigzag pc delta, line) of the program's
+    /// line table, then the 32 initial register values as varints.
+    ///
+    /// Record: a flag byte with the number of register writes (bits 0-1) and memory accesses
+    /// (bits 2-3), followed by a varint for each count of COUNT_FOLLOWS or more; the zigzag varint
+    /// pc delta to the previous record and the varint instruction id; the register writes (index
+    /// byte, zigzag delta to the register's previous value) and the memory accesses (byte with the
+    /// size and STORE_BIT, zigzag delta to the previous access address, for stores the varint value).
+    namespace trace_format {
+        inline constexpr std::array<char, 8> TRACE_MAGIC{'R', 'V', '6', '4', 'T', 'R', 'C', '1'};
+        inline constexpr uint8_t STORE_BIT = 0x80;
+        inline constexpr uint8_t INLINE_COUNT_MAX = 2;
+        inline constexpr uint8_t COUNT_FOLLOWS = 3;
+    }
+
+    /// @brief Records the retired instructions of a VM to a trace file (see trace_format). Records
+    /// are encoded on the VM thread into a lock-free single-producer ring buffer, which a
+    /// background thread drains to the file in large sequential writes; the VM only waits when
+    /// the ring is full.
+    class TraceRecorder {
+    public:
+        struct Config {
+            std::filesystem::path path;
+            size_t buffer_size = size_t(1) << 22; ///< ring buffer bytes, a power of two
+            size_t write_size = size_t(1) << 18;  ///< bytes the writer waits for before writing
+        };
+
+        /// @return optional string with error message
+        [[nodiscard]] static std::optional<std::string> validate(const Config &config);
+
+        TraceRecorder() = default;
+        ~TraceRecorder();
+        TraceRecorder(const TraceRecorder &) = delete;
+        TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+        /// @brief creates the file, writes the header for the loaded program and starts the writer
+        /// @param config must be valid (see validate)
+        /// @return optional string with error message
+        [[nodiscard]] std::optional<std::string> open(const Config &config, const Memory &memory, const Cpu &cpu);
+        /// @brief writes the remaining records and closes the file (also done by the destructor)
+        /// @return optional string with error message if a write failed
+        std::optional<std::string> close();
+        [[nodiscard]] bool is_open() const noexcept { return m_writer.joinable(); }
+
+        /// @brief memory accesses of the instruction being executed, reported by Memory
+        void load(uint64_t address, size_t size) { m_accesses.push_back({address, 0, static_cast<uint8_t>(size)}); }
+        void store(uint64_t address, size_t size, uint64_t value) {
+            m_accesses.push_back({address, value, static_cast<uint8_t>(size | trace_format::STORE_BIT)});
+        }
+        /// @brief appends the record of the instruction at pc with its memory accesses and the
+        /// registers it changed (writes of an unchanged value are not recorded)
+        /// @param index instruction slot (see Memory::get_program_index)
+        void retire(uint64_t pc, uint32_t index, const Cpu &cpu);
+
+        [[nodiscard]] uint64_t record_count() const noexcept { return m_records; }
+        /// @return bytes of records and header produced so far
+        [[nodiscard]] uint64_t byte_count() const noexcept { return m_head.load(std::memory_order_relaxed); }
+
+    private:
+        struct Access {
+            uint64_t address;
+            uint64_t value;
+            uint8_t kind; ///< size, | STORE_BIT for stores
+        };
+
+        /// @brief copies bytes into the ring, waiting for the writer while it is full
+        void push(const uint8_t *data, size_t size);
+        void write_loop();
+
+        std::vector<uint8_t> m_ring;
+        size_t m_write_size = 0;
+        std::atomic<uint64_t> m_head = 0; ///< bytes pushed, written by the VM thread only
+        std::atomic<uint64_t> m_tail = 0; ///< bytes written to the file, written by the writer only
+        std::atomic<bool> m_stop = false;
+        std::atomic<bool> m_failed = false;
+        std::thread m_writer;
+        std::ofstream m_file;
+
+        std::vector<uint8_t> m_record;
+        std::vector<Access> m_accesses;
+        std::vector<int> m_inst_ids; ///< instruction id of every slot of the program
+        std::array<uint64_t, 32> m_regs{};
+        uint64_t m_pc = 0;
+        uint64_t m_address = 0;
+        uint64_t m_records = 0;
+    };
+
+    /// @brief Retired instruction decoded from a trace
+    struct TraceEntry {
+        struct RegWrite {
+            uint8_t reg;
+            uint64_t value;
+        };
+
+        struct Access {
+            uint64_t address;
+            uint64_t value; ///< stored value, 0 for loads
+            uint8_t size;
+            bool store;
+        };
+
+        uint64_t index = 0; ///< position in the trace, from 0
+        uint64_t pc = 0;
+        int inst_id = -1;
+        std::optional<size_t> line;
+        std::vector<RegWrite> reg_writes;
+        std::vector<Access> accesses;
+
+        /// @return one line: index, pc, source line, mnemonic, register writes and memory accesses
+        [[nodiscard]] std::string to_text() const;
+        /// @return a row with the columns of CSV_HEADER
+        [[nodiscard]] std::string to_csv() const;
+        static constexpr std::string_view CSV_HEADER = "index,pc,line,instruction,registers,memory";
+    };
+
+    /// @brief Sequential reader of a trace file
+    class TraceReader {
+    public:
+        /// @return optional string with error message
+        [[nodiscard]] std::optional<std::string> open(const std::filesystem::path &path);
+        /// @brief decodes the next record into entry
+        /// @return false at the end of the trace (check error() for a truncated one)
+        bool next(TraceEntry &entry);
+        [[nodiscard]] const std::optional<std::string> &error() const noexcept { return m_error; }
+        /// @return register values before the first record
+        [[nodiscard]] const std::array<uint64_t, 32> &initial_registers() const noexcept { return m_initial; }
+
+    private:
+        [[nodiscard]] bool read_byte(uint8_t &byte);
+        [[nodiscard]] bool read_varint(uint64_t &value);
+        [[nodiscard]] bool read_count(uint8_t inline_count, uint64_t &count);
+
+        std::ifstream m_file;
+        std::vector<char> m_buffer;
+        size_t m_pos = 0, m_end = 0;
+        std::unordered_map<uint64_t, size_t> m_lines;
+        std::array<uint64_t, 32> m_initial{};
+        std::array<uint64_t, 32> m_regs{};
+        uint64_t m_pc = 0;
+        uint64_t m_address = 0;
+        uint64_t m_index = 0;
+        std::optional<std::string> m_error;
+    };
+
+    /// @brief Selects trace entries; every set criterion must match
+    struct TraceFilter {
+        std::optional<uint64_t> pc_begin, pc_end; ///< [pc_begin, pc_end)
+        std::optional<size_t> line;
+        std::optional<uint8_t> reg; ///< entries writing the register
+
+        [[nodiscard]] bool matches(const TraceEntry &entry) const;
+    };
+
+    enum class TraceOutput { Text, Csv };
+
+    /// @brief writes the entries of a trace matching the filter to out
+    /// @return optional string with error message
+    [[nodiscard]] std::optional<std::string> decode_trace(const std::filesystem::path &path, std::ostream &out,
+                                                          TraceOutput format, const TraceFilter &filter = {});
+}
@@ -1,17 +1,136 @@
 #include "VM.hpp"
+#include <algorithm>
+#include <array>
 #include <cassert>
 #include <format>
 #include <ui.hpp>
 
+namespace {
+    // auxiliary vector entry types (psABI / Linux)
+    constexpr uint64_t AT_NULL = 0;
+    constexpr uint64_t AT_PHDR = 3;
+    constexpr uint64_t AT_PHENT = 4;
+    constexpr uint64_t AT_PHNUM = 5;
+    constexpr uint64_t AT_PAGESZ = 6;
+    constexpr uint64_t AT_ENTRY = 9;
+    constexpr uint64_t AT_RANDOM = 25;
+
+    constexpr uint64_t GUEST_PAGE_SIZE = 4096;
+}
+
 namespace rv64 {
     VM::VM(const VMConfig &config) : m_config(config), m_memory(config.m_mem_layout){
         m_state = VMState::Initializing;
         m_config = config;
+        register_default_ecalls(m_ecalls);
+        if (m_config.m_rng_seed)
+            seed_rng(*m_config.m_rng_seed);
+    }
+
+    void VM::load_program(asm_parsing::ParsedInstVec instructions) {
+        m_memory.load_program(std::move(instructions));
+        enter_loaded_state();
+        setup_models();
+    }
+
+    void VM::load_program(asm_parsing::ParsedInstVec instructions, std::span<const uint8_t> bytecode) {
+        m_memory.load_program(std::move(instructions), bytecode);
+        enter_loaded_state();
+        setup_models();
+    }
+
+    std::optional<std::string> VM::load_elf(const std::filesystem::path &path) {
+        auto read = ElfFile::read(path);
+        if (auto *err = std::get_if<std::string>(&read))
+            return *err;
+        const auto &elf = std::get<ElfFile>(read);
+
+        Memory::Layout layout = m_config.m_mem_layout;
+        layout.data_base = elf.segments().front().address;
+        layout.endianness = elf.endianness();
+        if (auto err = Memory::validate_layout(layout))
+            return *err;
+
+        std::vector<Memory::ImageSegment> segments;
+        for (const auto &seg: elf.segments())
+            segments.push_back({.address = seg.address, .bytes = seg.data, .mem_size = seg.mem_size});
+        std::vector<Memory::AddressRange> code;
+        for (const auto &range: elf.code_ranges())
+            code.push_back({.begin = range.address, .end = range.address + range.size});
+
+        reset();
+        m_memory = Memory(layout);
+        if (auto err = m_memory.load_image(segments, code)) {
+            reset();
+            return err;
+        }
+
+        enter_loaded_state();
+        m_ecall_personality = EcallPersonality::Linux;
+        m_cpu.set_pc(elf.entry());
+        if (auto err = setup_process_stack(elf, path.filename().string())) {
+            reset();
+            return err;
+        }
+        m_symbols = elf.symbols();
+        // after the initial stack is written, which is not a guest access
+        setup_models();
+        return std::nullopt;
+    }
+
+    std::optional<std::string> VM::map_file(const FileMap &map) {
+        return m_memory.map_file(map.address, map.path, map.mode);
+    }
+
+    std::optional<std::string> VM::setup_process_stack(const ElfFile &elf, std::string_view program_name) {
+        const auto &layout = m_memory.get_layout();
+        uint64_t sp = layout.stack_base + layout.stack_size;
+        MemErr err = MemErr::None;
+        auto push_bytes = [&](std::span<const uint8_t> bytes) {
+            sp -= bytes.size();
+            for (size_t i = 0; i < bytes.size() && err == MemErr::None; ++i)
+                err = m_memory.store(sp + i, bytes[i]);
+            return sp;
+        };
+
+        std::vector<uint8_t> name(program_name.begin(), program_name.end());
+        name.push_back(0);
+        uint64_t argv0 = push_bytes(name);
+        // AT_RANDOM seed; fixed so runs stay reproducible
+        constexpr std::array<uint8_t, 16> random_bytes{
+            0x52, 0x56, 0x36, 0x34, 0x53, 0x49, 0x4D, 0x00, 0x9E, 0x37, 0x79, 0xB9, 0x7F, 0x4A, 0x7C, 0x15
+        };
+        uint64_t random = push_bytes(random_bytes);
+
+        std::vector<uint64_t> words{
+            1, argv0, 0, // argc, argv[], NULL
+            0,           // envp[] is empty
+            AT_PAGESZ, GUEST_PAGE_SIZE,
+            AT_ENTRY, elf.entry(),
+            AT_RANDOM, random,
+        };
+        if (elf.program_headers_address() != 0) {
+            words.insert(words.end(), {
+                AT_PHDR, elf.program_headers_address(),
+                AT_PHENT, ElfFile::PROGRAM_HEADER_SIZE,
+                AT_PHNUM, elf.program_header_count()
+            });
+        }
+        words.insert(words.end(), {AT_NULL, 0});
+
+        // sp must be 16-byte aligned and point at argc
+        sp = (sp - words.size() * sizeof(uint64_t)) & ~uint64_t(15);
+        for (size_t i = 0; i < words.size() && err == MemErr::None; ++i)
+            err = m_memory.store(sp + i * sizeof(uint64_t), words[i]);
+
+        if (err != MemErr::None)
+            return std::format("Cannot set up the initial stack: {}", Memory::err_to_string(err));
+        m_cpu.reg(2) = sp;
+        return std::nullopt;
     }
 
-    void VM::load_program(const asm_parsing::ParsedInstVec &instructions) {
+    void VM::enter_loaded_state() {
         auto sp_pos = m_config.m_sp_pos;
-        m_memory.load_program(instructions);
         m_cpu.set_pc(m_memory.get_layout().data_base);
         m_cpu.reg(2) = sp_pos == SpPos::Zero
                            ? 0
@@ -19,9 +138,75 @@ namespace rv64 {
                                   ? m_memory.get_layout().stack_base
                                   : m_memory.get_layout().stack_base
                                     + m_memory.get_layout().stack_size);
+        m_symbols.clear();
+        m_blocks.clear();
+        // the block engine falls back to single instructions, it has no use for the idioms
+        m_memory.set_fusion(m_config.m_engine == ExecEngine::Interpreter && m_config.m_fuse_instructions);
+        m_profiler.reset(m_memory.get_program_size());
+        m_instruction_mix.reset();
+        m_linux_syscalls.reset();
+        m_stop_reason = StopReason::None;
+        m_instruction_count = 0;
+        m_watchdog_started = false;
+        m_ecall_personality = m_config.m_ecall_personality;
+        m_memory.unmap_files();
+        for (const auto &map: m_config.m_file_maps) {
+            if (auto err = map_file(map))
+                ui::print_error(*err);
+        }
+        if (m_config.m_rng_seed)
+            seed_rng(*m_config.m_rng_seed);
         m_state = VMState::Loaded;
     }
 
+    void VM::setup_models() {
+        m_cache_model.reset();
+        if (m_config.m_cache_model) {
+            if (auto err = CacheHierarchy::validate(*m_config.m_cache_model)) {
+                ui::print_error(*err);
+            } else {
+                const auto &layout = m_memory.get_layout();
+                m_cache_model.emplace(*m_config.m_cache_model, m_memory.get_program_size());
+                m_cache_model->set_regions(m_memory.get_instruction_begin_addr(), m_memory.get_instruction_end_addr(),
+                                           layout.stack_base, layout.stack_base + layout.stack_size);
+            }
+        }
+        m_memory.set_cache_model(m_cache_model ? &*m_cache_model : nullptr);
+
+        m_branch_model.reset();
+        if (m_config.m_branch_model) {
+            if (auto err = BranchModel::validate(*m_config.m_branch_model))
+                ui::print_error(*err);
+            else
+                m_branch_model.emplace(*m_config.m_branch_model, m_memory.get_program_size());
+        }
+
+        m_pipeline_model.reset();
+        if (m_config.m_pipeline_model)
+            m_pipeline_model.emplace(*m_config.m_pipeline_model, m_memory.get_program_size());
+        m_model_detail = ModelDetail::Full;
+
+        if (auto err = m_trace_recorder.close())
+            ui::print_error(*err);
+        if (m_config.m_trace) {
+            auto err = TraceRecorder::validate(*m_config.m_trace);
+            if (!err)
+                err = m_trace_recorder.open(*m_config.m_trace, m_memory, m_cpu);
+            if (err)
+                ui::print_error(*err);
+        }
+        m_memory.set_trace_recorder(m_trace_recorder.is_open() ? &m_trace_recorder : nullptr);
+
+        m_history.stop();
+        if (m_config.m_history) {
+            auto err = History::validate(*m_config.m_history);
+            if (!err)
+                err = m_history.start(*m_config.m_history);
+            if (err)
+                ui::print_error(*err);
+        }
+    }
+
     void VM::run_step() {
         assert(m_state == VMState::Loaded ||
             m_state == VMState::Running ||
@@ -29,17 +214,186 @@ namespace rv64 {
             m_state == VMState::Breakpoint);
 
         m_state = VMState::Running;
+        start_watchdog();
+        bool budget_spent = m_config.m_instruction_budget && m_instruction_count >= *m_config.m_instruction_budget;
+        if ((budget_spent || m_instruction_count % WATCHDOG_INTERVAL == 0) && check_limits())
+            return;
 
-        if (!m_cpu.next_cycle()) {
+        ++m_instruction_count;
+        uint64_t pc = m_cpu.get_pc();
+        record_fetch(pc);
+        bool more = m_cpu.next_cycle();
+        record_dispatch(pc, 1);
+        if (!more) {
             m_state = VMState::Finished;
         }
+        m_history.record(m_instruction_count);
     }
 
     void VM::run_until_stop() {
         assert(m_state == VMState::Loaded || m_state == VMState::Running);
-        do {
-            run_step();
-        } while (m_state == VMState::Running);
+        m_state = VMState::Running;
+        start_watchdog();
+        bool models = m_model_detail != ModelDetail::Off && (m_cache_model || m_branch_model || m_pipeline_model);
+        if (m_config.m_profile || m_config.m_instruction_mix || models || m_trace_recorder.is_open()
+            || m_history.is_recording())
+            run_slices<true>();
+        else
+            run_slices<false>();
+    }
+
+    template<bool Instrumented>
+    void VM::run_slices() {
+        // limits are checked once per slice of instructions, the inner loop only watches the state
+        while (m_state == VMState::Running && !check_limits()) {
+            uint64_t slice = WATCHDOG_INTERVAL;
+            if (m_config.m_instruction_budget)
+                slice = std::min(slice, *m_config.m_instruction_budget - m_instruction_count);
+
+            if (single_dispatch()) {
+                for (; slice > 0 && m_state == VMState::Running; --slice) {
+                    ++m_instruction_count;
+                    [[maybe_unused]] uint64_t pc = m_cpu.get_pc();
+                    if constexpr (Instrumented)
+                        record_fetch(pc);
+                    bool more = m_cpu.next_cycle();
+                    if constexpr (Instrumented) {
+                        record_dispatch(pc, 1);
+                        m_history.record(m_instruction_count);
+                    }
+                    if (!more)
+                        m_state = VMState::Finished;
+                }
+                continue;
+            }
+            bool blocks = m_config.m_engine == ExecEngine::Blocks;
+            while (slice > 0 && m_state == VMState::Running) {
+                uint64_t executed = 0;
+                [[maybe_unused]] uint64_t pc = m_cpu.get_pc();
+                bool more = blocks ? m_cpu.next_block(slice, executed) : m_cpu.next_fused_cycle(slice, executed);
+                if constexpr (Instrumented)
+                    record_dispatch(pc, executed);
+                m_instruction_count += executed;
+                if constexpr (Instrumented)
+                    m_history.record(m_instruction_count);
+                slice -= executed;
+                if (!more)
+                    m_state = VMState::Finished;
+            }
+        }
+    }
+
+    uint64_t VM::run_dispatch(uint64_t max_instructions) {
+        assert(m_state == VMState::Loaded ||
+            m_state == VMState::Running ||
+            m_state == VMState::Stopped ||
+            m_state == VMState::Breakpoint);
+        assert(max_instructions > 0);
+
+        m_state = VMState::Running;
+        uint64_t executed = 1;
+        uint64_t pc = m_cpu.get_pc();
+        bool more = true;
+        record_fetch(pc);
+        if (single_dispatch())
+            more = m_cpu.next_cycle();
+        else if (m_config.m_engine == ExecEngine::Blocks)
+            more = m_cpu.next_block(max_instructions, executed);
+        else
+            more = m_cpu.next_fused_cycle(max_instructions, executed);
+        record_dispatch(pc, executed);
+        m_instruction_count += executed;
+        if (!more)
+            m_state = VMState::Finished;
+        m_history.record(m_instruction_count);
+        return executed;
+    }
+
+    bool VM::single_dispatch() const noexcept {
+        return (m_config.m_engine == ExecEngine::Interpreter && !m_config.m_fuse_instructions)
+               || (m_model_detail == ModelDetail::Full && (m_cache_model || m_pipeline_model))
+               || m_trace_recorder.is_open();
+    }
+
+    void VM::record_fetch(uint64_t pc) {
+        if (!m_cache_model || m_model_detail != ModelDetail::Full)
+            return;
+        m_cache_model->set_current_instruction(m_memory.get_program_index(pc));
+        if (auto size = m_memory.get_instruction_size(pc))
+            m_cache_model->fetch(pc, size);
+    }
+
+    void VM::record_dispatch(uint64_t pc, uint64_t executed) {
+        if (m_config.m_profile)
+            m_profiler.count(m_memory.get_program_index(pc), executed);
+        if (m_config.m_instruction_mix)
+            record_instruction_mix(pc, executed);
+        if (m_state == VMState::Error)
+            return;
+        if (m_trace_recorder.is_open())
+            m_trace_recorder.retire(pc, m_memory.get_program_index(pc), m_cpu);
+        if (m_model_detail == ModelDetail::Off)
+            return;
+        if (m_branch_model)
+            record_branch(pc, executed);
+        if (m_pipeline_model && m_model_detail == ModelDetail::Full) {
+            MemErr err;
+            auto fetch = m_memory.get_instruction_at(pc, err);
+            if (err == MemErr::None) {
+                m_pipeline_model->retire(pc, m_memory.get_program_index(pc), fetch.inst, m_cpu.get_pc(),
+                                         m_cache_model ? &*m_cache_model : nullptr,
+                                         m_branch_model ? &*m_branch_model : nullptr);
+            }
+        }
+    }
+
+    void VM::record_branch(uint64_t pc, uint64_t executed) {
+        for (uint64_t i = 1; i < executed; ++i)
+            pc += m_memory.get_instruction_size(pc);
+        MemErr err;
+        auto fetch = m_memory.get_instruction_at(pc, err);
+        if (err == MemErr::None && BranchModel::is_control_flow(fetch.inst))
+            m_branch_model->record(pc, m_memory.get_program_index(pc), fetch.inst, m_cpu.get_pc());
+    }
+
+    void VM::record_instruction_mix(uint64_t pc, uint64_t executed) {
+        // a whole block was executed: its summary is already in the block cache
+        if (m_config.m_engine == ExecEngine::Blocks) {
+            const auto *block = m_blocks.get(m_memory, pc);
+            if (block && executed == block->insts.size()) {
+                m_instruction_mix.add(block->mix, m_cpu.get_pc() != block->end_pc);
+                return;
+            }
+        }
+        for (uint64_t i = 0; i < executed; ++i) {
+            MemErr err;
+            auto fetch = m_memory.get_instruction_at(pc, err);
+            pc += fetch.inst.byte_size();
+            m_instruction_mix.add(fetch.inst, i + 1 == executed && m_cpu.get_pc() != pc);
+        }
+    }
+
+    void VM::start_watchdog() {
+        if (m_watchdog_started)
+            return;
+        m_watchdog_started = true;
+        if (m_config.m_time_limit)
+            m_deadline = std::chrono::steady_clock::now() + *m_config.m_time_limit;
+    }
+
+    bool VM::check_limits() {
+        if (m_config.m_instruction_budget && m_instruction_count >= *m_config.m_instruction_budget)
+            m_stop_reason = StopReason::InstructionBudget;
+        else if (m_config.m_time_limit && std::chrono::steady_clock::now() >= m_deadline)
+            m_stop_reason = StopReason::TimeLimit;
+        else
+            return false;
+
+        m_state = VMState::LimitExceeded;
+        ui::print_error(m_stop_reason == StopReason::InstructionBudget
+                            ? std::format("Instruction budget of {} exceeded", *m_config.m_instruction_budget)
+                            : std::format("Time limit of {} ms exceeded", m_config.m_time_limit->count()));
+        return true;
     }
 
     void VM::terminate(int exit_code) {
@@ -59,9 +413,23 @@ namespace rv64 {
     }
 
     void VM::reset() {
+        m_history.stop();
         m_state = VMState::Initializing;
+        m_linux_syscalls.reset();
+        m_stop_reason = StopReason::None;
+        m_instruction_count = 0;
+        m_watchdog_started = false;
         m_memory = Memory(m_config.m_mem_layout);
         m_cpu.reset();
+        m_symbols.clear();
+        m_blocks.clear();
+        m_profiler.reset(0);
+        m_instruction_mix.reset();
+        m_cache_model.reset();
+        m_branch_model.reset();
+        m_pipeline_model.reset();
+        if (auto err = m_trace_recorder.close())
+            ui::print_error(*err);
     }
 
     void VM::set_config(const VMConfig &config) {
@@ -99,5 +467,95 @@ namespace rv64 {
         return m_memory.get_layout();
     }
 
+    VM::Snapshot VM::save_snapshot() const {
+        Snapshot snapshot{
+            .regs = {},
+            .pc = m_cpu.get_pc(),
+            .line = get_current_line(),
+            .state = m_state,
+            .instruction_count = m_instruction_count,
+            .brk = m_memory.get_brk(),
+            .input_position = m_input.position(),
+            .rng = m_rng
+        };
+        for (size_t i = 0; i < Cpu::INT_REG_CNT; ++i)
+            snapshot.regs[i] = m_cpu.int_regs()[i].val();
+        return snapshot;
+    }
+
+    void VM::restore_snapshot(const Snapshot &snapshot) {
+        for (size_t i = 1; i < Cpu::INT_REG_CNT; ++i)
+            m_cpu.reg(int(i)) = snapshot.regs[i];
+        m_cpu.set_pc(snapshot.pc);
+        m_cpu.m_interpreter.set_current_line(snapshot.line);
+        m_state = snapshot.state;
+        m_stop_reason = StopReason::None;
+        m_instruction_count = snapshot.instruction_count;
+        m_input.rewind(snapshot.input_position);
+        m_rng = snapshot.rng;
+
+        MemErr err = MemErr::None; // sbrk leaves it unset if the break does not move
+        m_memory.sbrk(static_cast<int64_t>(snapshot.brk - m_memory.get_brk()), err);
+        if (err != MemErr::None || m_memory.get_brk() != snapshot.brk) {
+            ui::print_error(std::format("Cannot restore the heap break {:#x}: {}", snapshot.brk,
+                                        err == MemErr::None ? "the break did not move" : Memory::err_to_string(err)));
+            error_stop();
+        }
+    }
+
     size_t VM::get_current_line() const noexcept { return m_cpu.m_interpreter.get_current_line(); }
+
+    StopReason VM::get_stop_reason() const noexcept {
+        return m_stop_reason;
+    }
+
+    uint64_t VM::get_instruction_count() const noexcept {
+        return m_instruction_count;
+    }
+
+    void VM::set_model_detail(ModelDetail detail) {
+        if (m_cache_model)
+            m_cache_model->set_current_instruction(CacheHierarchy::NO_INSTRUCTION);
+        // the accesses and branches seen while warming are not the next instruction's
+        if (m_pipeline_model && detail == ModelDetail::Full && m_model_detail != ModelDetail::Full)
+            m_pipeline_model->skip_events(m_cache_model ? &*m_cache_model : nullptr,
+                                          m_branch_model ? &*m_branch_model : nullptr);
+        m_model_detail = detail;
+        m_memory.set_cache_model(detail != ModelDetail::Off && m_cache_model ? &*m_cache_model : nullptr);
+    }
+
+    ModelDetail VM::get_model_detail() const noexcept {
+        return m_model_detail;
+    }
+
+    uint64_t VM::get_cycle_count() const noexcept {
+        if (m_pipeline_model && m_pipeline_model->config().drive_cycle_counter)
+            return m_pipeline_model->cycles();
+        return m_instruction_count;
+    }
+
+    EcallPersonality VM::get_ecall_personality() const noexcept {
+        return m_ecall_personality;
+    }
+
+    std::mt19937_64 &VM::rng() noexcept {
+        return m_rng;
+    }
+
+    void VM::seed_rng(uint64_t seed) {
+        m_rng.seed(seed);
+    }
+
+    const std::vector<ElfFile::Symbol> &VM::get_symbols() const noexcept {
+        return m_symbols;
+    }
+
+    const ElfFile::Symbol *VM::find_symbol(uint64_t address) const noexcept {
+        auto it = std::ranges::upper_bound(m_symbols, address, {}, &ElfFile::Symbol::address);
+        if (it == m_symbols.begin())
+            return nullptr;
+        --it;
+        bool inside = it->size == 0 ? address == it->address : address - it->address < it->size;
+        return inside ? &*it : nullptr;
+    }
 } // rv64
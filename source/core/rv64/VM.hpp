@@ -1,5 +1,23 @@
 #pragma once
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+#include <rv64/BranchPredictor.hpp>
+#include <rv64/CacheModel.hpp>
 #include <rv64/Cpu.hpp>
+#include <rv64/EcallRegistry.hpp>
+#include <rv64/History.hpp>
+#include <rv64/InputReader.hpp>
+#include <rv64/InstructionMix.hpp>
+#include <rv64/LinuxSyscalls.hpp>
+#include <rv64/PipelineModel.hpp>
+#include <rv64/Profiler.hpp>
+#include <rv64/Trace.hpp>
+#include <ElfFile.hpp>
 #include <Memory.hpp>
 #include <parser/ParserProcessor.hpp>
 
@@ -12,7 +30,14 @@ namespace rv64 {
         Stopped = 3,
         Error = 4,
         Breakpoint = 5,
-        Finished = 6
+        Finished = 6,
+        LimitExceeded = 7 ///< stopped by the instruction budget or time limit, see StopReason
+    };
+
+    enum class StopReason {
+        None,
+        InstructionBudget,
+        TimeLimit
     };
 
     enum class SpPos {
@@ -21,18 +46,99 @@ namespace rv64 {
         StackTop
     };
 
+    /// How ecall selects the requested service
+    enum class EcallPersonality {
+        Venus, ///< service code in a0 (Venus/RARS-style environment calls)
+        Linux  ///< Linux syscall number in a7, see LinuxSyscalls
+    };
+
+    /// How run_until_stop executes instructions; single steps always execute one instruction
+    enum class ExecEngine {
+        Interpreter, ///< one dispatch per instruction, or per fused idiom with m_fuse_instructions
+        Blocks       ///< optimized block IR, see IrBlock (falls back to the Interpreter)
+    };
+
+    /// How the cache, branch and pipeline models follow the execution, see VM::set_model_detail
+    enum class ModelDetail {
+        Full,    ///< every model sees every instruction, one instruction per dispatch
+        Warming, ///< the configured engine runs at full speed, the cache model only sees the loads and
+                 ///< stores and the branch model the branches and jumps; the pipeline model is idle
+        Off      ///< the models are idle and keep their state
+    };
+
+    /// Host file mapped into the guest address space
+    struct FileMap {
+        uint64_t address;
+        std::filesystem::path path;
+        FileMapping::Mode mode = FileMapping::Mode::ReadOnly;
+    };
+
     struct VMConfig {
         Memory::Layout m_mem_layout = Memory::Layout();
         SpPos m_sp_pos = SpPos::StackTop;
+        EcallPersonality m_ecall_personality = EcallPersonality::Venus; ///< for assembly programs
+        std::optional<uint64_t> m_rng_seed; ///< seed of the random ecall, applied on every load; random if not set
+        std::vector<FileMap> m_file_maps; ///< mapped on every load
+        /// Watchdog for untrusted programs: maximum number of executed instructions and wall-clock time
+        /// from the first executed instruction (checked every WATCHDOG_INTERVAL instructions)
+        std::optional<uint64_t> m_instruction_budget;
+        std::optional<std::chrono::milliseconds> m_time_limit;
+        /// run_until_stop executes common idioms (see FusedOp) as superinstructions with the
+        /// Interpreter engine; single steps and breakpoints are unaffected
+        bool m_fuse_instructions = true;
+        /// the block engine is opt-in until it has been validated against the Interpreter
+        ExecEngine m_engine = ExecEngine::Interpreter;
+        /// every block is run by the reference Interpreter as well; the VM stops with an error
+        /// at the first difference (slow, for testing the IR passes)
+        bool m_validate_blocks = false;
+        /// count executions per instruction in VM::m_profiler; run_until_stop switches to an
+        /// instrumented copy of its loop, the plain loop stays free of profiling code
+        bool m_profile = false;
+        /// count executed instructions by opcode, class and access width in VM::m_instruction_mix
+        /// (instrumented loop as for m_profile; blocks add their precomputed summary at once)
+        bool m_instruction_mix = false;
+        /// simulate the caches for the guest's fetches, loads and stores in VM::m_cache_model;
+        /// run_until_stop then executes one instruction per dispatch so that every access is
+        /// attributed to its instruction
+        std::optional<CacheHierarchy::Config> m_cache_model;
+        /// simulate branch prediction for the executed branches and jumps in VM::m_branch_model
+        std::optional<BranchModel::Config> m_branch_model;
+        /// estimate cycles with a 5-stage pipeline model in VM::m_pipeline_model, on top of the
+        /// cache and branch models if they are enabled; executes one instruction per dispatch
+        std::optional<PipelineModel::Config> m_pipeline_model;
+        /// record every retired instruction with its register writes and memory accesses to a
+        /// binary trace with VM::m_trace_recorder; executes one instruction per dispatch
+        std::optional<TraceRecorder::Config> m_trace;
+        /// keep checkpoints for reverse execution in VM::m_history, started on every load
+        std::optional<History::Config> m_history;
     };
 
     class VM {
     public:
         explicit VM(const VMConfig &config = {});
 
-        void load_program(const asm_parsing::ParsedInstVec &instructions);
+        /// @brief loads the program; pass an rvalue to hand the instructions over without a copy
+        void load_program(asm_parsing::ParsedInstVec instructions);
+        /// @brief loads pre-assembled bytecode, skipping the AssemblerUnit pass
+        void load_program(asm_parsing::ParsedInstVec instructions, std::span<const uint8_t> bytecode);
+
+        /// @brief loads a static ELF64 RISC-V executable: the data segment is moved to the lowest
+        /// PT_LOAD address, execution starts at e_entry and the stack holds argc/argv/envp/auxv
+        /// as laid out by the psABI (argv[0] is the file name); ecalls are Linux syscalls
+        /// @return optional string with error message (the VM is left reset)
+        [[nodiscard]] std::optional<std::string> load_elf(const std::filesystem::path &path);
+        /// @brief maps a host file into the loaded program's address space (until the next load)
+        /// @return optional string with error message
+        [[nodiscard]] std::optional<std::string> map_file(const FileMap &map);
+
+        static constexpr uint64_t WATCHDOG_INTERVAL = 4096;
+
         void run_step();
         void run_until_stop();
+        /// @brief executes one dispatch of the configured engine: a block, a fused idiom or a single
+        /// instruction, at most max_instructions (> 0); the watchdog limits are not checked
+        /// @return number of executed instructions
+        uint64_t run_dispatch(uint64_t max_instructions);
         void terminate(int exit_code);
         void error_stop();
         void breakpoint_hit();
@@ -49,15 +155,99 @@ namespace rv64 {
         [[nodiscard]] bool check_breakpoint() const;
 
         [[nodiscard]] VMState get_state() const noexcept;
+        [[nodiscard]] StopReason get_stop_reason() const noexcept;
+        /// @return instructions executed since the program was loaded
+        [[nodiscard]] uint64_t get_instruction_count() const noexcept;
+        /// @brief sets how closely the cache, branch and pipeline models follow the execution
+        /// (ModelDetail::Full after every load), see run_sampled
+        void set_model_detail(ModelDetail detail);
+        [[nodiscard]] ModelDetail get_model_detail() const noexcept;
+        /// @return cycles estimated by the pipeline model if it drives the cycle counter
+        /// (PipelineModel::Config::drive_cycle_counter), otherwise the instruction count
+        [[nodiscard]] uint64_t get_cycle_count() const noexcept;
         [[nodiscard]] const Memory::Layout &get_memory_layout() const noexcept;
         [[nodiscard]] size_t get_current_line() const noexcept;
+        [[nodiscard]] EcallPersonality get_ecall_personality() const noexcept;
+
+        /// Execution state of the loaded program outside the memory contents, see History
+        struct Snapshot {
+            std::array<uint64_t, Cpu::INT_REG_CNT> regs;
+            uint64_t pc;
+            size_t line;
+            VMState state;
+            uint64_t instruction_count;
+            uint64_t brk;
+            uint64_t input_position; ///< see InputReader::position
+            std::mt19937_64 rng;
+        };
+
+        [[nodiscard]] Snapshot save_snapshot() const;
+        /// @brief returns the loaded program to the snapshot (the input is rewound to its position);
+        /// the memory contents are left as they are. If the heap break cannot be restored, the VM
+        /// stops with an error.
+        void restore_snapshot(const Snapshot &snapshot);
+
+        /// @brief random engine of the ecall services, its state persists between calls
+        [[nodiscard]] std::mt19937_64 &rng() noexcept;
+        void seed_rng(uint64_t seed);
+
+        /// @return symbols of the loaded ELF executable sorted by address (empty for assembly programs)
+        [[nodiscard]] const std::vector<ElfFile::Symbol> &get_symbols() const noexcept;
+
+        /// @return symbol whose [address, address + size) contains the address, nullptr if none
+        [[nodiscard]] const ElfFile::Symbol *find_symbol(uint64_t address) const noexcept;
 
 
         Memory m_memory; // memory subsystem
         Cpu m_cpu{*this}; // CPU and interpreter
+        EcallRegistry m_ecalls; // ecall services of EcallPersonality::Venus
+        BlockCache m_blocks; // translated blocks of the loaded program
+        InputReader m_input; // input of the read services (stdin by default)
+        LinuxSyscalls m_linux_syscalls{*this}; // ecall handler of EcallPersonality::Linux
+        Profiler m_profiler; // execution counts, filled if VMConfig::m_profile is set
+        InstructionMix m_instruction_mix; // filled if VMConfig::m_instruction_mix is set
+        std::optional<CacheHierarchy> m_cache_model; // set on load if VMConfig::m_cache_model is
+        std::optional<BranchModel> m_branch_model; // set on load if VMConfig::m_branch_model is
+        std::optional<PipelineModel> m_pipeline_model; // set on load if VMConfig::m_pipeline_model is
+        TraceRecorder m_trace_recorder; // opened on load if VMConfig::m_trace is set, closed on reset
+        History m_history{*this}; // recording from every load if VMConfig::m_history is set
 
     private:
+        void enter_loaded_state();
+        /// @brief creates the cache, branch and pipeline models of the loaded program, opens the
+        /// trace and starts the history (the cache model, the trace recorder and the history's
+        /// journal are attached to the memory)
+        void setup_models();
+        /// @return true if run_until_stop executes one instruction per dispatch
+        [[nodiscard]] bool single_dispatch() const noexcept;
+        /// @brief the run_until_stop loop; Instrumented selects the variant calling record_dispatch
+        template<bool Instrumented>
+        void run_slices();
+        /// @brief feeds the enabled statistics with a dispatch of executed consecutive instructions
+        /// that started at pc
+        void record_dispatch(uint64_t pc, uint64_t executed);
+        /// @brief feeds the cache model with the fetch of the instruction at pc, before it runs
+        void record_fetch(uint64_t pc);
+        /// @brief feeds the branch model with the last instruction of a dispatch; blocks and
+        /// fused idioms contain no other branches or jumps
+        void record_branch(uint64_t pc, uint64_t executed);
+        void record_instruction_mix(uint64_t pc, uint64_t executed);
+        /// @brief starts the time limit clock on the first executed instruction
+        void start_watchdog();
+        /// @return true (and enters VMState::LimitExceeded) if a limit was reached
+        bool check_limits();
+        [[nodiscard]] std::optional<std::string> setup_process_stack(const ElfFile &elf, std::string_view program_name);
+
         VMConfig m_config;
         VMState m_state = VMState::Initializing;
+        EcallPersonality m_ecall_personality = EcallPersonality::Venus;
+        std::mt19937_64 m_rng{std::random_device{}()};
+
+        StopReason m_stop_reason = StopReason::None;
+        uint64_t m_instruction_count = 0;
+        ModelDetail m_model_detail = ModelDetail::Full;
+        bool m_watchdog_started = false;
+        std::chrono::steady_clock::time_point m_deadline;
+        std::vector<ElfFile::Symbol> m_symbols;
     };
 }
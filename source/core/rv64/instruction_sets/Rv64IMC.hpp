@@ -3,40 +3,41 @@
 #include <rv64/instruction_sets/IExtensionM.hpp>
 #include <rv64/instruction_sets/IExtensionC.hpp>
 #include <Instruction.hpp>
-#include <unordered_map>
+#include <PerfectHashMap.hpp>
 #include <cassert>
 
 
 namespace rv64::is {
+    namespace detail {
+        constexpr size_t INST_COUNT =
+            IBaseI::list_inst().size() + IExtensionM::list_inst().size() + IExtensionC::list_inst().size();
+
+        constexpr std::array<std::pair<std::string_view, int>, INST_COUNT> list_mnemonics() {
+            std::array<std::pair<std::string_view, int>, INST_COUNT> result{};
+            size_t i = 0;
+            for (const auto &inst: IBaseI::list_inst())
+                result[i++] = {inst.mnemonic, inst.id};
+            for (const auto &inst: IExtensionM::list_inst())
+                result[i++] = {inst.mnemonic, inst.id};
+            for (const auto &inst: IExtensionC::list_inst())
+                result[i++] = {inst.mnemonic, inst.id};
+            return result;
+        }
+
+        /// mnemonic -> instruction id
+        inline constexpr PerfectHashMap<int, INST_COUNT> mnemonic_map{list_mnemonics()};
+    }
+
     class Rv64IMC : public IBaseI, public IExtensionM, public IExtensionC {
     public:
         ~Rv64IMC() override = default;
 
-        Rv64IMC() {
-            if (instructions.empty()) {
-                auto b = IBaseI::list_inst();
-                auto m = IExtensionM::list_inst();
-                auto c = IExtensionC::list_inst();
-                instructions.reserve(b.size() + m.size() + c.size());
-
-                for (const auto &inst: b) {
-                    instructions.emplace(std::string(inst.mnemonic), inst);
-                }
-                for (const auto &inst: m) {
-                    instructions.emplace(std::string(inst.mnemonic), inst);
-                }
-                for (const auto &inst: c) {
-                    instructions.emplace(std::string(inst.mnemonic), inst);
-                }
-            }
-        }
-
-        static const InstProto &get_inst_proto(const std::string &name) noexcept {
-
-            auto it = instructions.find(to_lowercase(name));
-            if (it == instructions.end())
+        /// @brief case-insensitive mnemonic lookup (does not allocate)
+        static constexpr InstProto get_inst_proto(std::string_view name) noexcept {
+            const int *id = detail::mnemonic_map.find(name);
+            if (!id)
                 return invalid_inst_proto;
-            return it->second;
+            return get_inst_proto(*id);
         }
 
         static constexpr InstProto get_inst_proto(int id) noexcept {
@@ -54,8 +55,5 @@ namespace rv64::is {
             }
             return invalid_inst_proto;
         }
-
-    protected:
-        inline static std::unordered_map<std::string, InstProto> instructions;
     };
 }
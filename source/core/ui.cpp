@@ -18,6 +18,7 @@ static std::function<void(std::string_view)> error_callback
 static std::optional<std::function<void(std::string_view)>> warning_callback = std::nullopt;
 static std::optional<std::function<void(std::string_view)>> info_callback = std::nullopt;
 static std::optional<std::function<void(std::string_view)>> hint_callback = std::nullopt;
+static bool muted = false;
 
 void ui::set_output_callback(const std::function<void(std::string_view)> &clbk) {
     output_callback = clbk;
@@ -39,6 +40,10 @@ void ui::set_info_msg_callback(const std::function<void(std::string_view)> &clbk
     info_callback = clbk;
 }
 
+void ui::set_muted(bool mute) {
+    muted = mute;
+}
+
 
 void ui::print_error(std::string_view msg, const std::source_location &loc) {
     std::string full_msg;
@@ -52,18 +57,21 @@ void ui::print_error(std::string_view msg, const std::source_location &loc) {
 }
 
 void ui::print_output(std::string_view msg) {
+    if (muted) return;
     output_callback(msg);
 }
 
 void ui::print_warning(std::string_view msg) {
+    if (muted) return;
     warning_callback.value_or(output_callback)(std::format("[WARNING] {}\n", msg));
 }
 
 void ui::print_hint(std::string_view msg) {
-    if (!hint_callback.has_value()) return;
+    if (muted || !hint_callback.has_value()) return;
     (*hint_callback)(std::format("[HINT] {}\n", msg));
 }
 
 void ui::print_info(std::string_view msg) {
+    if (muted) return;
     info_callback.value_or(output_callback)(std::format("[INFO] {}\n", msg));
 }
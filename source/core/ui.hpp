@@ -17,6 +17,9 @@ namespace ui {
 
     void set_info_msg_callback(const std::function<void(std::string_view)> &clbk);
 
+    /// @brief while muted, output, warnings, hints and info messages are dropped (errors are not)
+    void set_muted(bool muted);
+
 
 
     void print_error(std::string_view msg,
@@ -2,11 +2,27 @@
 #include <QtConcurrent/QtConcurrentRun>
 #include <QFileInfo>
 #include <QTextStream>
+#include <QStandardPaths>
+
+namespace {
+    struct BuildResult {
+        int code = 0;
+        asm_parsing::ParsedInstVec instructions;
+        std::vector<BuildError> diagnostics;
+        std::shared_ptr<const CachedProgram> cached; // set on a program cache hit
+    };
+}
 
 Backend::Backend(QObject *parent)
     : QObject(parent)
     , m_registerModel(this)
-    , m_memoryController(m_vm.m_memory, this) {
+    , m_memoryController(m_vm.m_memory, this)
+    , m_programCache(std::filesystem::path(
+          QStandardPaths::writableLocation(QStandardPaths::CacheLocation).toStdU16String()) / "programs") {
+
+    m_editTimer.setSingleShot(true);
+    m_editTimer.setInterval(BUILD_ON_TYPE_DELAY_MS);
+    connect(&m_editTimer, &QTimer::timeout, this, &Backend::startBackgroundAssembly);
 
     connect(&m_registerModel, &RegisterModel::registerModified,
             this, [this](int index, uint64_t value) {
@@ -18,6 +34,13 @@ bool Backend::isRunLocked() const {
     return m_appState != AppState::Ready && m_appState != AppState::Stopped;
 }
 
+bool Backend::isStepBackLocked() const {
+    if (m_appState != AppState::Stopped && m_appState != AppState::Finished && m_appState != AppState::Error)
+        return true;
+    const auto &history = m_vm.m_history;
+    return !history.is_recording() || m_vm.get_instruction_count() <= history.earliest();
+}
+
 void Backend::build(const QString &sourceCode) {
 if (m_appState != AppState::Idle)
     return;
@@ -29,25 +52,46 @@ auto config = m_settingsManager.createVMConfig();
 m_vm.set_config(config);
 m_memoryController.setStackSpAtTop(config.m_sp_pos == rv64::SpPos::StackTop);
 
-QtConcurrent::run([this, str = sourceCode.toStdString()] {
-        asm_parsing::ParsedInstVec parsed{};
-        auto result = asm_parsing::parse_and_resolve(str, parsed, 0);
-        return std::make_pair(result, std::move(parsed));
-    }).then(this, [this](std::pair<int, asm_parsing::ParsedInstVec> result) {
-        auto &[code, insts] = result;
-        if (code != 0) {
+// a pending or running background assembly is superseded by this build
+m_editTimer.stop();
+m_backgroundStop.request_stop();
+
+QtConcurrent::run([this, str = sourceCode.toStdString(), endian = config.m_mem_layout.endianness] {
+        BuildResult result;
+        if (auto cached = m_programCache.load(str, 0, endian)) {
+            result.instructions = cached->instructions();
+            result.cached = std::make_shared<const CachedProgram>(std::move(*cached));
+            return result;
+        }
+
+        std::lock_guard lock(m_assemblerMutex);
+        result.code = m_assembler.assemble(str, result.instructions);
+        result.diagnostics = m_assembler.diagnostics();
+        if (result.code == 0)
+            m_programCache.store(str, 0, endian, result.instructions, m_assembler.symbol_table());
+        return result;
+    }).then(this, [this](BuildResult result) {
+        for (const auto &err: result.diagnostics)
+            print(QString::fromStdString(err.format()) + "\n", MsgType::Error);
+        // a cache hit has no diagnostics, which clears those of earlier edits
+        setDiagnostics(result.diagnostics);
+
+        if (result.code != 0) {
             print("Parse error\n", MsgType::Error);
             setAppState(AppState::Idle);
             return;
         }
         try {
-            m_vm.load_program(insts);
+            if (result.cached)
+                m_vm.load_program(std::move(result.instructions), result.cached->bytecode());
+            else
+                m_vm.load_program(std::move(result.instructions));
         } catch (const std::exception &err) {
             print(QString("Initialization Error: ") + err.what(), MsgType::Error);
             setAppState(AppState::Idle);
             return;
         }
-        print("Build successful\n", MsgType::Success);
+        print(result.cached ? "Build successful (cached)\n" : "Build successful\n", MsgType::Success);
         m_currentLine = 0;
         setAppState(AppState::Ready);
         m_registerModel.updateFromCpu(m_vm.m_cpu);
@@ -69,6 +113,15 @@ void Backend::step() {
     m_memoryController.notifyContentChanged();
 }
 
+void Backend::stepBack() {
+    if (isStepBackLocked())
+        return;
+
+    m_registerModel.clearCoreModifiedFlags();
+    m_vm.m_history.step_back();
+    handleTravel();
+}
+
 void Backend::run() {
     if (isRunLocked())
         return;
@@ -83,7 +136,8 @@ void Backend::run() {
             auto state = m_vm.get_state();
             if (state == rv64::VMState::Error ||
                 state == rv64::VMState::Finished ||
-                state == rv64::VMState::Breakpoint) {
+                state == rv64::VMState::Breakpoint ||
+                state == rv64::VMState::LimitExceeded) {
                 break;
             }
         }
@@ -95,9 +149,30 @@ void Backend::run() {
     });
 }
 
+void Backend::reverseContinue() {
+    if (isStepBackLocked())
+        return;
+
+    m_registerModel.clearCoreModifiedFlags();
+    m_reverseStop = std::stop_source();
+    setAppState(AppState::Running);
+
+    QtConcurrent::run([this, stop = m_reverseStop.get_token()] {
+        return m_vm.m_history.reverse_continue(stop);
+    }).then(this, [this](bool hit) {
+        if (m_reverseStop.stop_requested())
+            print("Reverse continue stopped\n", MsgType::Info);
+        else if (!hit)
+            print("No earlier breakpoint hit, stopped at the oldest checkpoint\n", MsgType::Info);
+        handleTravel();
+    });
+}
+
 void Backend::stop() {
-    if (m_appState == AppState::Running)
+    if (m_appState == AppState::Running) {
         m_stopRequested.store(true);
+        m_reverseStop.request_stop();
+    }
 }
 
 void Backend::reset() {
@@ -111,6 +186,7 @@ void Backend::reset() {
 }
 
 void Backend::handleVmState() {
+    updateLineHeat();
     switch (m_vm.get_state()) {
         case rv64::VMState::Error:
             setAppState(AppState::Error);
@@ -120,6 +196,12 @@ void Backend::handleVmState() {
             setAppState(AppState::Finished);
             print("Program finished execution\n", MsgType::Info);
             break;
+        case rv64::VMState::LimitExceeded:
+            setAppState(AppState::Error);
+            print(m_vm.get_stop_reason() == rv64::StopReason::TimeLimit
+                      ? "Program stopped: time limit exceeded\n"
+                      : "Program stopped: instruction budget exceeded\n", MsgType::Error);
+            break;
         case rv64::VMState::Breakpoint:
             setAppState(AppState::Stopped);
             print("Breakpoint hit at line " + QString::number(m_currentLine + 1) + "\n", MsgType::Info);
@@ -131,6 +213,33 @@ void Backend::handleVmState() {
     }
 }
 
+void Backend::handleTravel() {
+    m_currentLine = int64_t(m_vm.get_current_line()) - 1;
+    updateLineHeat();
+    setAppState(AppState::Stopped);
+    if (m_vm.check_breakpoint())
+        emit breakpointHit(int(m_currentLine));
+    m_registerModel.updateFromCpu(m_vm.m_cpu);
+    m_memoryController.notifyContentChanged();
+}
+
+void Backend::updateLineHeat() {
+    QVariantMap heat;
+    // empty unless profiling is enabled in the settings
+    auto lines = m_vm.get_config().m_profile ? m_vm.m_profiler.by_line(m_vm.m_memory)
+                                             : std::vector<rv64::Profiler::LineCount>();
+    if (!lines.empty()) {
+        // by_line is sorted hottest first
+        auto hottest = double(lines.front().count);
+        for (const auto &entry: lines)
+            heat.insert(QString::number(entry.line - 1), double(entry.count) / hottest);
+    }
+    if (heat != m_lineHeat) {
+        m_lineHeat = std::move(heat);
+        emit lineHeatChanged();
+    }
+}
+
 void Backend::setAppState(AppState state) {
     bool shouldLock = (state != AppState::Idle);
     if (m_editorLocked != shouldLock) {
@@ -141,6 +250,10 @@ void Backend::setAppState(AppState state) {
     if (state == AppState::Idle) {
         m_currentLine = -1;
         m_registerModel.resetAllFlags();
+        if (!m_lineHeat.isEmpty()) {
+            m_lineHeat.clear();
+            emit lineHeatChanged();
+        }
     }
 
     bool canModify = (state == AppState::Ready || state == AppState::Stopped);
@@ -275,6 +388,44 @@ QString Backend::saveFileAs(const QUrl &fileUrl, const QString &content) {
     return {};
 }
 
+void Backend::sourceEdited(const QString &sourceCode) {
+    m_editedSource = sourceCode;
+    m_editTimer.start(); // restarts the debounce interval
+}
+
+void Backend::startBackgroundAssembly() {
+    if (m_appState == AppState::Building)
+        return;
+
+    // cancel the previous run; it stops at the next parse chunk
+    m_backgroundStop.request_stop();
+    m_backgroundStop = std::stop_source();
+
+    QtConcurrent::run([this, str = m_editedSource.toStdString(), stop = m_backgroundStop.get_token()] {
+        std::lock_guard lock(m_assemblerMutex);
+        if (stop.stop_requested())
+            return std::optional<std::vector<BuildError>>();
+
+        asm_parsing::ParsedInstVec instructions;
+        if (m_assembler.assemble(str, instructions, stop) == asm_parsing::IncrementalAssembler::CANCELLED)
+            return std::optional<std::vector<BuildError>>();
+        return std::optional(m_assembler.diagnostics());
+    }).then(this, [this](std::optional<std::vector<BuildError>> diagnostics) {
+        if (diagnostics)
+            setDiagnostics(*diagnostics);
+    });
+}
+
+void Backend::setDiagnostics(const std::vector<BuildError> &errors) {
+    QString text;
+    for (const auto &err: errors)
+        text += QString::fromStdString(err.format()) + "\n";
+    if (text != m_diagnostics) {
+        m_diagnostics = text;
+        emit diagnosticsChanged();
+    }
+}
+
 void Backend::setFileModified(bool modified) {
     if (m_fileModified != modified) {
         m_fileModified = modified;
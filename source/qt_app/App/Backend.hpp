@@ -1,9 +1,15 @@
 #pragma once
 
 #include <QString>
+#include <QTimer>
 #include <QUrl>
+#include <QVariantMap>
 #include <atomic>
+#include <mutex>
+#include <stop_token>
 #include "rv64/VM.hpp"
+#include "ProgramCache.hpp"
+#include "parser/IncrementalAssembler.hpp"
 #include "RegisterModel.hpp"
 #include "MemoryController.hpp"
 #include "SettingsManager.hpp"
@@ -18,12 +24,15 @@ class Backend : public QObject {
     Q_PROPERTY(bool editorLocked READ isEditorLocked NOTIFY editorLockChanged)
     Q_PROPERTY(bool buildingEnabled READ isBuildingEnabled NOTIFY appStateChanged)
     Q_PROPERTY(bool runLocked READ isRunLocked NOTIFY appStateChanged)
+    Q_PROPERTY(bool stepBackLocked READ isStepBackLocked NOTIFY appStateChanged)
     Q_PROPERTY(bool resetLocked READ isResetLocked NOTIFY appStateChanged)
     Q_PROPERTY(int64_t currentLine READ currentLine NOTIFY appStateChanged)
     Q_PROPERTY(QString output READ output NOTIFY outputUpdated)
     Q_PROPERTY(QString currentFile READ currentFile NOTIFY currentFileChanged)
     Q_PROPERTY(bool fileModified READ isFileModified NOTIFY fileModifiedChanged)
     Q_PROPERTY(QString windowTitle READ windowTitle NOTIFY windowTitleChanged)
+    Q_PROPERTY(QString diagnostics READ diagnostics NOTIFY diagnosticsChanged)
+    Q_PROPERTY(QVariantMap lineHeat READ lineHeat NOTIFY lineHeatChanged)
 
 public:
     explicit Backend(QObject *parent = nullptr);
@@ -38,11 +47,16 @@ public:
     bool isBuildingEnabled() const { return m_appState == AppState::Idle; }
     bool isResetLocked() const { return m_appState == AppState::Idle; }
     bool isRunLocked() const;
+    /// @return true unless the program is paused or has stopped with earlier history to go back to
+    bool isStepBackLocked() const;
     int64_t currentLine() const { return m_currentLine; }
     QString output() const { return m_output; }
     QString currentFile() const { return m_currentFile; }
     bool isFileModified() const { return m_fileModified; }
     QString windowTitle() const;
+    QString diagnostics() const { return m_diagnostics; }
+    /// @return execution share of every executed line (0-based) relative to the hottest line, 0..1
+    QVariantMap lineHeat() const { return m_lineHeat; }
 
     Q_INVOKABLE bool toggleBreakpoint(int line);
     Q_INVOKABLE bool hasBreakpoint(int line) const;
@@ -57,12 +71,18 @@ public:
 public slots:
     void build(const QString &sourceCode);
     void step();
+    /// @brief goes back one instruction, see rv64::History
+    void stepBack();
     void run();
+    /// @brief runs backwards to the previous breakpoint hit, or to the oldest checkpoint
+    void reverseContinue();
     void stop();
     void reset();
 
 public slots:
     void setFileModified(bool modified);
+    /// @brief schedules a background assembly of the edited source (debounced)
+    void sourceEdited(const QString &sourceCode);
 
 signals:
     void editorLockChanged(bool locked);
@@ -75,21 +95,40 @@ signals:
     void windowTitleChanged();
     void fileLoaded(const QString &content);
     void fileCleared();
+    void diagnosticsChanged();
+    void lineHeatChanged();
 
 private:
     enum class MsgType { Plain, Success, Warning, Error, Info };
 
     void setAppState(AppState state);
     void handleVmState();
+    /// @brief refreshes the views after the program went back in its history
+    void handleTravel();
     void print(const QString &text, MsgType type = MsgType::Plain);
     void clearOutput();
+    void startBackgroundAssembly();
+    void setDiagnostics(const std::vector<BuildError> &errors);
+    void updateLineHeat();
 
     rv64::VM m_vm;
     RegisterModel m_registerModel;
     MemoryController m_memoryController;
     SettingsManager m_settingsManager{this};
+    ProgramCache m_programCache;
+
+    // Incremental assembly; parser state is global, so every assemble() holds m_assemblerMutex
+    static constexpr int BUILD_ON_TYPE_DELAY_MS = 250;
+    asm_parsing::IncrementalAssembler m_assembler;
+    std::mutex m_assemblerMutex;
+    std::stop_source m_backgroundStop;
+    QTimer m_editTimer;
+    QString m_editedSource;
+    QString m_diagnostics;
+    QVariantMap m_lineHeat;
 
     std::atomic_bool m_stopRequested{false};
+    std::stop_source m_reverseStop; // of the running reverseContinue
     bool m_editorLocked = false;
     QString m_output;
     AppState m_appState = AppState::Idle;
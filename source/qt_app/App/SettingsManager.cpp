@@ -11,6 +11,9 @@ rv64::VMConfig SettingsManager::createVMConfig() const {
     rv64::VMConfig conf;
     conf.m_mem_layout = buildMemLayout();
     conf.m_sp_pos = m_systemConfig.spPos;
+    conf.m_profile = m_systemConfig.profile; // feeds the heat column of the editor
+    if (m_systemConfig.historyEnabled)
+        conf.m_history = m_systemConfig.history; // step back and reverse continue
     return conf;
 }
 
@@ -76,6 +79,52 @@ void SettingsManager::setEndiannessIndex(int index) {
     }
 }
 
+bool SettingsManager::historyEnabled() const {
+    return m_tmpSystemConfig.historyEnabled;
+}
+
+void SettingsManager::setHistoryEnabled(bool enabled) {
+    if (m_tmpSystemConfig.historyEnabled != enabled) {
+        m_tmpSystemConfig.historyEnabled = enabled;
+        emit historyEnabledChanged();
+    }
+}
+
+int SettingsManager::checkpointInterval() const {
+    return static_cast<int>(m_tmpSystemConfig.history.checkpoint_interval);
+}
+
+void SettingsManager::setCheckpointInterval(int interval) {
+    auto newInterval = static_cast<uint64_t>(interval);
+    if (m_tmpSystemConfig.history.checkpoint_interval != newInterval) {
+        m_tmpSystemConfig.history.checkpoint_interval = newInterval;
+        emit checkpointIntervalChanged();
+    }
+}
+
+int SettingsManager::historyBudgetMiB() const {
+    return static_cast<int>(m_tmpSystemConfig.history.memory_budget >> 20);
+}
+
+void SettingsManager::setHistoryBudgetMiB(int budgetMiB) {
+    size_t newBudget = static_cast<size_t>(budgetMiB) << 20;
+    if (m_tmpSystemConfig.history.memory_budget != newBudget) {
+        m_tmpSystemConfig.history.memory_budget = newBudget;
+        emit historyBudgetMiBChanged();
+    }
+}
+
+bool SettingsManager::profilingEnabled() const {
+    return m_tmpSystemConfig.profile;
+}
+
+void SettingsManager::setProfilingEnabled(bool enabled) {
+    if (m_tmpSystemConfig.profile != enabled) {
+        m_tmpSystemConfig.profile = enabled;
+        emit profilingEnabledChanged();
+    }
+}
+
 void SettingsManager::loadFromVM() {
     const auto &vmConfig = vm().get_config();
     const auto &memLayout = vm().get_memory_layout();
@@ -86,6 +135,10 @@ void SettingsManager::loadFromVM() {
 
     m_systemConfig.spPos = vmConfig.m_sp_pos;
     m_systemConfig.endianness = memLayout.endianness;
+    m_systemConfig.historyEnabled = vmConfig.m_history.has_value();
+    if (vmConfig.m_history)
+        m_systemConfig.history = *vmConfig.m_history;
+    m_systemConfig.profile = vmConfig.m_profile;
 
     // Copy to temp config
     m_tmpMemoryConfig = m_memoryConfig;
@@ -96,6 +149,10 @@ void SettingsManager::loadFromVM() {
     emit stackAddressChanged();
     emit spPosIndexChanged();
     emit endiannessIndexChanged();
+    emit historyEnabledChanged();
+    emit checkpointIntervalChanged();
+    emit historyBudgetMiBChanged();
+    emit profilingEnabledChanged();
 }
 
 Memory::Layout SettingsManager::buildMemLayout() const {
@@ -113,6 +170,10 @@ QString SettingsManager::apply() {
         m_backend->appendError(QString::fromStdString(*validationError));
         return QString::fromStdString(*validationError);
     }
+    if (auto historyError = rv64::History::validate(m_tmpSystemConfig.history)) {
+        m_backend->appendError(QString::fromStdString(*historyError));
+        return QString::fromStdString(*historyError);
+    }
 
     m_memoryConfig = m_tmpMemoryConfig;
     m_systemConfig = m_tmpSystemConfig;
@@ -129,6 +190,10 @@ void SettingsManager::cancel() {
     emit stackAddressChanged();
     emit spPosIndexChanged();
     emit endiannessIndexChanged();
+    emit historyEnabledChanged();
+    emit checkpointIntervalChanged();
+    emit historyBudgetMiBChanged();
+    emit profilingEnabledChanged();
 }
 
 QString SettingsManager::toHexString(uint64_t value) {
@@ -16,6 +16,10 @@ class SettingsManager : public QObject {
     // System settings
     Q_PROPERTY(int spPosIndex READ spPosIndex WRITE setSpPosIndex NOTIFY spPosIndexChanged)
     Q_PROPERTY(int endiannessIndex READ endiannessIndex WRITE setEndiannessIndex NOTIFY endiannessIndexChanged)
+    Q_PROPERTY(bool historyEnabled READ historyEnabled WRITE setHistoryEnabled NOTIFY historyEnabledChanged)
+    Q_PROPERTY(int checkpointInterval READ checkpointInterval WRITE setCheckpointInterval NOTIFY checkpointIntervalChanged)
+    Q_PROPERTY(int historyBudgetMiB READ historyBudgetMiB WRITE setHistoryBudgetMiB NOTIFY historyBudgetMiBChanged)
+    Q_PROPERTY(bool profilingEnabled READ profilingEnabled WRITE setProfilingEnabled NOTIFY profilingEnabledChanged)
 
 public:
     explicit SettingsManager(Backend *parent);
@@ -39,6 +43,20 @@ public:
     [[nodiscard]] int endiannessIndex() const;
     void setEndiannessIndex(int index);
 
+    // Reverse execution settings (see rv64::History)
+    [[nodiscard]] bool historyEnabled() const;
+    void setHistoryEnabled(bool enabled);
+
+    [[nodiscard]] int checkpointInterval() const;
+    void setCheckpointInterval(int interval);
+
+    [[nodiscard]] int historyBudgetMiB() const;
+    void setHistoryBudgetMiB(int budgetMiB);
+
+    // Execution counts per line for the heat column of the editor (see rv64::Profiler)
+    [[nodiscard]] bool profilingEnabled() const;
+    void setProfilingEnabled(bool enabled);
+
 public slots:
     void loadFromVM();
     QString apply();
@@ -50,12 +68,19 @@ signals:
     void stackAddressChanged();
     void spPosIndexChanged();
     void endiannessIndexChanged();
+    void historyEnabledChanged();
+    void checkpointIntervalChanged();
+    void historyBudgetMiBChanged();
+    void profilingEnabledChanged();
     void settingsApplied();
 
 private:
     struct SystemConfig {
         rv64::SpPos spPos = rv64::SpPos::StackTop;
         std::endian endianness = std::endian::little;
+        bool historyEnabled = false; // checkpoints and store journals cost time and memory
+        rv64::History::Config history;
+        bool profile = false; // the instrumented run loop is slower
     };
 
     struct MemoryConfig {
@@ -48,6 +48,22 @@ Window {
         }
     }
 
+    Shortcut {
+        sequence: "Shift+F7"
+        onActivated: {
+            if (!backend.stepBackLocked)
+                backend.stepBack()
+        }
+    }
+
+    Shortcut {
+        sequence: "Shift+F5"
+        onActivated: {
+            if (!backend.stepBackLocked)
+                backend.reverseContinue()
+        }
+    }
+
     Screen01 {
         id: screen
         anchors.fill: parent
@@ -88,6 +104,9 @@ Window {
             function onEdited() {
                 backend.setFileModified(true)
             }
+            function onTextChanged() {
+                backend.sourceEdited(screen.mainEditor.text)
+            }
         }
     }
 }
\ No newline at end of file
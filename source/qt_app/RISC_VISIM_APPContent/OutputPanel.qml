@@ -32,7 +32,7 @@ Rectangle {
                     font.pixelSize: 14
                     color: "#000000"
                     placeholderTextColor: "#808080"
-                    placeholderText: "Output will appear here..."
+                    placeholderText: backend.diagnostics !== "" ? backend.diagnostics : "Output will appear here..."
                     text: backend.output
                 }
             }
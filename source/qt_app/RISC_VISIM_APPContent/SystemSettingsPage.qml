@@ -35,6 +35,41 @@ SettingsPage {
                 currentIndex: settingsManager.endiannessIndex
                 onCurrentIndexChanged: settingsManager.endiannessIndex = currentIndex
             }
+
+            Label { text: "Reverse Execution"; color: root.cMuted }
+            CheckBox {
+                id: historyCheckBox
+                checked: settingsManager.historyEnabled
+                onToggled: settingsManager.historyEnabled = checked
+            }
+
+            Label { text: "Checkpoint Interval"; color: root.cMuted }
+            SettingsSpinBox {
+                id: checkpointIntervalSpinBox
+                enabled: historyCheckBox.checked
+                from: 100
+                to: 10000000
+                stepSize: 1000
+                value: settingsManager.checkpointInterval
+                onValueModified: settingsManager.checkpointInterval = value
+            }
+
+            Label { text: "History Budget (MiB)"; color: root.cMuted }
+            SettingsSpinBox {
+                id: historyBudgetSpinBox
+                enabled: historyCheckBox.checked
+                from: 1
+                to: 4096
+                value: settingsManager.historyBudgetMiB
+                onValueModified: settingsManager.historyBudgetMiB = value
+            }
+
+            Label { text: "Line Profiling"; color: root.cMuted }
+            CheckBox {
+                id: profilingCheckBox
+                checked: settingsManager.profilingEnabled
+                onToggled: settingsManager.profilingEnabled = checked
+            }
         }
 
         Rectangle {
@@ -22,6 +22,9 @@ Rectangle {
         : 20
 
     property var breakpointLines: ({})
+    // execution share of each line relative to the hottest one (0..1), see Backend::lineHeat
+    property var lineHeat: backend.lineHeat
+    property color heatColor: "#ff7a00"
     property int _lastLength: 0
 
     signal edited()
@@ -36,7 +39,7 @@ Rectangle {
 
         Rectangle {
             Layout.fillHeight: true
-            Layout.preferredWidth: 60
+            Layout.preferredWidth: 66
             color: "#f5f5f5"
             border.color: "#e0e0e0"
             border.width: 1
@@ -86,6 +89,14 @@ Rectangle {
                                     }
                                 }
 
+                                Rectangle {
+                                    readonly property real heat: root.lineHeat[gutterLine.index] ?? 0
+                                    width: 6
+                                    height: parent.height
+                                    color: root.heatColor
+                                    opacity: heat > 0 ? 0.2 + 0.8 * heat : 0
+                                }
+
                                 Text {
                                     width: 30
                                     height: parent.height
@@ -9,6 +9,7 @@ Rectangle {
     property alias settingsButton: settingsBtn
     property alias buildButton: buildBtn
     property alias resetButton: resetBtn
+    property alias stepBackButton: stepBackBtn
     property alias stepButton: stepBtn
     property alias runButton: runBtn
     property bool editorHasContent: false
@@ -138,6 +139,22 @@ Rectangle {
                 onClicked: backend.reset()
             }
 
+            NavButton {
+                id: reverseBtn
+                text: "◀◀ Reverse"
+                enabled: !backend.stepBackLocked
+                Layout.preferredHeight: 40
+                onClicked: backend.reverseContinue()
+            }
+
+            NavButton {
+                id: stepBackBtn
+                text: "|◀ Back"
+                enabled: !backend.stepBackLocked
+                Layout.preferredHeight: 40
+                onClicked: backend.stepBack()
+            }
+
             NavButton {
                 id: stepBtn
                 text: "▶| Step"
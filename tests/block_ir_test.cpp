@@ -0,0 +1,162 @@
+#include <catch2/catch_test_macros.hpp>
+#include <rv64/VM.hpp>
+#include <memory>
+
+#include "test_helpers.hpp"
+#include "ui.hpp"
+
+using namespace rv64;
+
+namespace {
+    std::unique_ptr<VM> load(const std::string &source, ExecEngine engine, bool validate = false) {
+        VMConfig config{};
+        config.m_engine = engine;
+        config.m_validate_blocks = validate;
+        return load_program(source, config);
+    }
+
+    void require_same_registers(VM &a, VM &b) {
+        REQUIRE(a.m_cpu.get_pc() == b.m_cpu.get_pc());
+        for (int i = 0; i < 32; i++)
+            REQUIRE(a.m_cpu.reg(i).val() == b.m_cpu.reg(i).val());
+    }
+}
+
+TEST_CASE("Block IR passes", "[block_ir]") {
+    auto vm = load(R"(
+        lui x5, 0x12345
+        addi x5, x5, 1656
+        addi x0, x5, 1
+        sd x5, -8(x2)
+        ld x6, -8(x2)
+        lw x7, -8(x2)
+        beq x6, x5, done
+        addi x8, x0, 1
+    done:
+    )", ExecEngine::Blocks);
+    uint64_t pc = vm->m_cpu.get_pc();
+    using Code = IrOp::Code;
+
+    SECTION("translation stops after the branch") {
+        auto block = translate_block(vm->m_memory, pc, false);
+        REQUIRE(block);
+        REQUIRE(block->insts.size() == 7);
+        REQUIRE(block->ends_with_jump);
+        REQUIRE(block->end_pc == pc + 28);
+        REQUIRE(block->inner_lines.size() == 6);
+        REQUIRE(block->ops.size() == 7);
+    }
+
+    SECTION("optimized block") {
+        auto block = translate_block(vm->m_memory, pc);
+        REQUIRE(block);
+        const auto &ops = block->ops;
+        REQUIRE(ops.size() == 5);
+        // lui folded into the addi, the x0 write dropped
+        REQUIRE(ops[0].code == Code::Const);
+        REQUIRE(ops[0].rd == 5);
+        REQUIRE(ops[0].imm == 0x12345678);
+        REQUIRE(ops[1].code == Code::Store);
+        // the reload of the stack slot became a move of the known value
+        REQUIRE(ops[2].code == Code::Const);
+        REQUIRE(ops[2].rd == 6);
+        REQUIRE(ops[2].imm == 0x12345678);
+        REQUIRE(ops[2].inst == 4);
+        // narrower load of the same slot is kept
+        REQUIRE(ops[3].code == Code::Load);
+        REQUIRE(ops[4].code == Code::Exec);
+    }
+
+    SECTION("blocks do not include ecall") {
+        auto ecall_vm = load("addi x10, x0, 1\necall\naddi x11, x0, 2", ExecEngine::Blocks);
+        uint64_t start = ecall_vm->m_cpu.get_pc();
+        auto block = translate_block(ecall_vm->m_memory, start);
+        REQUIRE(block);
+        REQUIRE(block->insts.size() == 1);
+        REQUIRE_FALSE(block->ends_with_jump);
+        REQUIRE_FALSE(translate_block(ecall_vm->m_memory, start + 4));
+    }
+}
+
+TEST_CASE("Block IR execution", "[block_ir]") {
+    const std::string source = R"(
+        addi x8, x2, -256
+        addi x5, x0, 0
+        addi x6, x0, 20
+    fill:
+        slli x7, x5, 3
+        add x7, x8, x7
+        sd x5, 0(x7)
+        addi x5, x5, 1
+        blt x5, x6, fill
+        addi x10, x0, 0
+        addi x5, x0, 0
+    sum:
+        addi x2, x2, -16
+        sd x5, 8(x2)
+        sd x10, 0(x2)
+        ld x11, 8(x2)
+        slli x11, x11, 3
+        add x11, x8, x11
+        ld x12, 0(x11)
+        ld x10, 0(x2)
+        add x10, x10, x12
+        ld x5, 8(x2)
+        addi x2, x2, 16
+        addi x5, x5, 1
+        blt x5, x6, sum
+        lui x13, 0x12345
+        addi x13, x13, 1656
+        addiw x14, x13, 2047
+        sw x13, -4(x2)
+        lw x15, -4(x2)
+        jal x1, func
+        addi x16, x0, 7
+        beq x0, x0, end
+    func:
+        addi x17, x0, 9
+        jalr x0, x1, 0
+    end:
+    )";
+
+    SECTION("validated run matches the interpreter") {
+        auto blocks = load(source, ExecEngine::Blocks, true);
+        auto plain = load(source, ExecEngine::Interpreter);
+        blocks->run_until_stop();
+        plain->run_until_stop();
+        REQUIRE(blocks->get_state() == VMState::Finished);
+        REQUIRE(plain->get_state() == VMState::Finished);
+        REQUIRE(blocks->get_instruction_count() == plain->get_instruction_count());
+        require_same_registers(*blocks, *plain);
+        REQUIRE(blocks->m_cpu.reg(10) == 190);
+        REQUIRE(blocks->m_cpu.reg(15) == 0x12345678);
+        REQUIRE(blocks->m_cpu.reg(16) == 7);
+        REQUIRE(blocks->m_cpu.reg(17) == 9);
+    }
+
+    SECTION("a fault inside a block leaves the reference state") {
+        ui::set_error_msg_callback([](auto) {});
+        const std::string faulting = "addi x5, x0, 1\nlui x6, 0\nld x7, 0(x6)\naddi x5, x0, 2\naddi x8, x0, 3";
+        auto blocks = load(faulting, ExecEngine::Blocks);
+        auto plain = load(faulting, ExecEngine::Interpreter);
+        REQUIRE_THROWS(blocks->run_until_stop());
+        REQUIRE_THROWS(plain->run_until_stop());
+        REQUIRE(blocks->get_state() == VMState::Error);
+        require_same_registers(*blocks, *plain);
+        REQUIRE(blocks->m_cpu.reg(5) == 1);
+    }
+
+    SECTION("breakpoints inside a block split it") {
+        auto vm = load(source, ExecEngine::Blocks);
+        vm->m_cpu.set_breakpoint(22, true); // add x10, x10, x12
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Breakpoint);
+        REQUIRE(vm->get_current_line() == 22);
+        REQUIRE(vm->m_cpu.reg(12) == 0);
+        vm->run_step();
+        vm->run_until_stop();
+        REQUIRE(vm->get_current_line() == 22);
+        REQUIRE(vm->m_cpu.reg(12) == 1);
+        REQUIRE(vm->m_cpu.reg(10) == 0);
+    }
+}
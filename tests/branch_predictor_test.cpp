@@ -0,0 +1,110 @@
+#include <catch2/catch_test_macros.hpp>
+#include <rv64/BranchPredictor.hpp>
+#include <rv64/VM.hpp>
+#include <memory>
+
+#include "test_helpers.hpp"
+
+using namespace rv64;
+
+namespace {
+    /// @return mispredictions of the predictor on the pattern, repeated to n branches
+    uint64_t mispredictions(PredictorKind kind, const std::vector<bool> &pattern, size_t n) {
+        auto predictor = make_branch_predictor(kind, 12);
+        uint64_t wrong = 0;
+        for (size_t i = 0; i < n; ++i) {
+            bool taken = pattern[i % pattern.size()];
+            wrong += predictor->predict(0x1000, 0x0F00) != taken;
+            predictor->update(0x1000, 0x0F00, taken);
+        }
+        return wrong;
+    }
+
+    std::unique_ptr<VM> run(const std::string &source, PredictorKind kind, ExecEngine engine = ExecEngine::Blocks,
+                            bool fuse = true) {
+        VMConfig config{};
+        config.m_engine = engine;
+        config.m_fuse_instructions = fuse;
+        config.m_branch_model = BranchModel::Config{.predictor = kind};
+        auto vm = run_program(source, config);
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE(vm->m_branch_model);
+        return vm;
+    }
+}
+
+TEST_CASE("Branch predictors", "[branch]") {
+    SECTION("names") {
+        REQUIRE(predictor_kind_from_name("tage") == PredictorKind::Tage);
+        REQUIRE_FALSE(predictor_kind_from_name("perceptron"));
+        REQUIRE(make_branch_predictor(PredictorKind::Gshare, 10)->name() == "gshare");
+    }
+
+    SECTION("static predicts backward branches taken") {
+        auto predictor = make_branch_predictor(PredictorKind::Static, 12);
+        REQUIRE(predictor->predict(0x1000, 0x0F00));
+        REQUIRE_FALSE(predictor->predict(0x1000, 0x1100));
+    }
+
+    SECTION("history based predictors learn patterns bimodal cannot") {
+        const std::vector<bool> alternating{true, false};
+        REQUIRE(mispredictions(PredictorKind::Bimodal, alternating, 1000) >= 500);
+        REQUIRE(mispredictions(PredictorKind::Gshare, alternating, 1000) < 20);
+        REQUIRE(mispredictions(PredictorKind::Tage, alternating, 1000) < 20);
+
+        const std::vector<bool> period9{true, true, true, false, true, true, false, false, true};
+        REQUIRE(mispredictions(PredictorKind::Bimodal, period9, 9000) > 2000);
+        REQUIRE(mispredictions(PredictorKind::Tage, period9, 9000) < 200);
+    }
+}
+
+TEST_CASE("Branch model", "[branch]") {
+    const std::string source = R"(
+        addi x5, x0, 0
+        addi x6, x0, 10
+    loop:
+        jal x1, func
+        addi x5, x5, 1
+        blt x5, x6, loop
+        beq x0, x0, end
+    func:
+        addi x7, x7, 1
+        jalr x0, x1, 0
+    end:
+    )";
+
+    SECTION("branches, jumps and returns") {
+        for (auto [engine, fuse]: {std::pair{ExecEngine::Interpreter, false}, std::pair{ExecEngine::Interpreter, true},
+                                   std::pair{ExecEngine::Blocks, true}}) {
+            auto vm = run(source, PredictorKind::Static, engine, fuse);
+            const auto &stats = vm->m_branch_model->stats();
+            REQUIRE(stats.branches == 11);
+            REQUIRE(stats.taken == 10);
+            REQUIRE(stats.mispredicted == 2); // the loop exit and the forward beq
+            REQUIRE(stats.jumps == 10);
+            REQUIRE(stats.returns == 10);
+            REQUIRE(stats.ras_mispredicted == 0);
+            REQUIRE(stats.btb_misses == 2); // first jal and first taken blt
+        }
+    }
+
+    SECTION("per-branch statistics") {
+        auto vm = run(source, PredictorKind::Bimodal);
+        const auto &memory = vm->m_memory;
+        auto blt = memory.get_program_index(memory.get_instruction_begin_addr() + 16);
+        const auto &branch = vm->m_branch_model->branch_stats()[blt];
+        REQUIRE(branch.executed == 10);
+        REQUIRE(branch.taken == 9);
+        REQUIRE(branch.mispredicted == 2);
+        REQUIRE(vm->m_branch_model->stats().mispredicted == 3);
+
+        auto report = vm->m_branch_model->report(*vm);
+        REQUIRE(report.starts_with("predictor: bimodal"));
+        REQUIRE(report.find("blt x5, x6, -4") != std::string::npos);
+    }
+
+    SECTION("disabled by default") {
+        auto vm = std::make_unique<VM>();
+        REQUIRE_FALSE(vm->m_branch_model);
+    }
+}
@@ -0,0 +1,161 @@
+#include <catch2/catch_test_macros.hpp>
+#include <rv64/CacheModel.hpp>
+#include <rv64/VM.hpp>
+#include <memory>
+
+#include "test_helpers.hpp"
+
+using namespace rv64;
+
+namespace {
+    Cache::Config small_cache(Cache::Replacement replacement = Cache::Replacement::Lru) {
+        // 2 sets, 4 ways, 16-byte lines; addresses 32 bytes apart map to the same set
+        return {.sets = 2, .ways = 4, .line_size = 16, .replacement = replacement};
+    }
+}
+
+TEST_CASE("Cache model", "[cache]") {
+    SECTION("configuration is validated") {
+        REQUIRE_FALSE(Cache::validate(small_cache()));
+        REQUIRE(Cache::validate({.sets = 3}));
+        REQUIRE(Cache::validate({.line_size = 2}));
+        REQUIRE(Cache::validate({.ways = 17}));
+        REQUIRE(Cache::validate({.ways = 6, .replacement = Cache::Replacement::PseudoLru}));
+        REQUIRE_FALSE(Cache::validate({.ways = 6}));
+    }
+
+    SECTION("hits within a line") {
+        Cache cache(small_cache());
+        REQUIRE_FALSE(cache.access(0x100, false).hit);
+        REQUIRE(cache.access(0x10F, false).hit);
+        REQUIRE_FALSE(cache.access(0x110, false).hit);
+        REQUIRE(cache.stats().hits == 1);
+        REQUIRE(cache.stats().misses == 2);
+    }
+
+    SECTION("LRU evicts the least recently used way") {
+        Cache cache(small_cache());
+        for (uint64_t a: {0x000, 0x020, 0x040, 0x060})
+            (void) cache.access(a, false);
+        REQUIRE(cache.access(0x000, false).hit); // 0x020 is now the oldest
+        auto result = cache.access(0x080, false);
+        REQUIRE(result.evicted);
+        REQUIRE(result.victim_address == 0x020);
+        REQUIRE(cache.access(0x000, false).hit);
+        REQUIRE_FALSE(cache.access(0x020, false).hit);
+        REQUIRE(cache.stats().evictions == 2);
+    }
+
+    SECTION("pseudo-LRU protects the most recent way") {
+        Cache cache(small_cache(Cache::Replacement::PseudoLru));
+        for (uint64_t a: {0x000, 0x020, 0x040, 0x060})
+            (void) cache.access(a, false);
+        (void) cache.access(0x000, false);
+        auto result = cache.access(0x080, false);
+        REQUIRE(result.evicted);
+        REQUIRE(result.victim_address != 0x000);
+        REQUIRE(cache.access(0x000, false).hit);
+    }
+
+    SECTION("dirty lines are written back on eviction") {
+        Cache cache({.sets = 1, .ways = 1, .line_size = 16});
+        (void) cache.access(0x100, true);
+        auto result = cache.access(0x200, false);
+        REQUIRE(result.writeback);
+        REQUIRE(result.victim_address == 0x100);
+        REQUIRE_FALSE(cache.access(0x300, false).writeback);
+        REQUIRE(cache.stats().writebacks == 1);
+    }
+
+    SECTION("write-through, no-write-allocate") {
+        Cache cache({.sets = 1, .ways = 1, .line_size = 16, .write_back = false, .write_allocate = false});
+        REQUIRE_FALSE(cache.access(0x100, true).hit);
+        REQUIRE_FALSE(cache.access(0x100, false).hit); // the store did not allocate
+        (void) cache.access(0x100, true);
+        REQUIRE_FALSE(cache.access(0x200, false).writeback);
+    }
+}
+
+TEST_CASE("Cache hierarchy", "[cache]") {
+    CacheHierarchy::Config config{
+        .l1i = {.sets = 4, .ways = 2, .line_size = 16},
+        .l1d = {.sets = 4, .ways = 2, .line_size = 16},
+        .l2 = {.sets = 16, .ways = 4, .line_size = 32},
+    };
+    using Level = CacheHierarchy::Level;
+    using Region = CacheHierarchy::Region;
+
+    SECTION("misses go to L2, dirty victims are written back") {
+        CacheHierarchy caches(config, 0);
+        caches.set_regions(0x1000, 0x2000, 0x8000, 0x9000);
+        caches.store(0x8000, 8);
+        caches.load(0x8008, 8);
+        // 0x8040 and 0x8080 map to the same L1D set and evict the dirty 0x8000 line
+        caches.load(0x8040, 8);
+        caches.load(0x8080, 8);
+        const auto &l1d = caches.cache(Level::L1D).stats();
+        REQUIRE(l1d.hits == 1);
+        REQUIRE(l1d.misses == 3);
+        REQUIRE(l1d.writebacks == 1);
+        const auto &l2 = caches.cache(Level::L2).stats();
+        REQUIRE(l2.misses == 3);
+        REQUIRE(l2.hits == 1); // the written back line is still in L2
+        REQUIRE(caches.region_stats(Level::L1D, Region::Stack).accesses() == 4);
+    }
+
+    SECTION("accesses crossing a line touch both lines") {
+        CacheHierarchy caches(config, 0);
+        caches.load(0x100C, 8);
+        REQUIRE(caches.cache(Level::L1D).stats().misses == 2);
+        caches.fetch(0x1000, 4);
+        REQUIRE(caches.cache(Level::L1I).stats().misses == 1);
+        REQUIRE(caches.cache(Level::L2).stats().hits == 2); // both L1 lines share an L2 line
+    }
+}
+
+TEST_CASE("Cache model in the VM", "[cache]") {
+    // sums a 64-element array of doublewords twice: the second pass hits in a 1 KiB L1D
+    const std::string source = R"(
+        addi x8, x2, -512
+        addi x6, x0, 2
+    pass:
+        addi x5, x0, 0
+        addi x9, x8, 0
+    loop:
+        ld x7, 0(x9)
+        add x10, x10, x7
+        addi x9, x9, 8
+        addi x5, x5, 1
+        addi x11, x0, 64
+        blt x5, x11, loop
+        addi x6, x6, -1
+        bne x6, x0, pass
+    )";
+    VMConfig vm_config{};
+    vm_config.m_cache_model = CacheHierarchy::Config{
+        .l1i = {.sets = 16, .ways = 2, .line_size = 32},
+        .l1d = {.sets = 16, .ways = 2, .line_size = 32},
+        .l2 = {.sets = 64, .ways = 4, .line_size = 64},
+    };
+    auto vm = run_program(source, vm_config);
+    REQUIRE(vm->get_state() == VMState::Finished);
+    REQUIRE(vm->m_cache_model);
+
+    const auto &caches = *vm->m_cache_model;
+    using Level = CacheHierarchy::Level;
+    REQUIRE(caches.cache(Level::L1I).stats().accesses() == vm->get_instruction_count());
+    REQUIRE(caches.cache(Level::L1I).stats().misses == 2); // 48 bytes of code
+    const auto &l1d = caches.cache(Level::L1D).stats();
+    REQUIRE(l1d.accesses() == 128);
+    REQUIRE(l1d.misses == 16); // 512 bytes in 32-byte lines, first pass only
+    REQUIRE(caches.region_stats(Level::L1D, CacheHierarchy::Region::Stack).misses == 16);
+
+    // all data accesses belong to the ld
+    auto ld_index = vm->m_memory.get_program_index(vm->m_memory.get_instruction_begin_addr() + 16);
+    REQUIRE(caches.instruction_stats()[ld_index].data.misses == 16);
+    REQUIRE(caches.instruction_stats()[ld_index].fetch.accesses() == 128);
+
+    auto report = caches.report(*vm);
+    REQUIRE(report.find("L1D: 1 KiB, 2-way, 16 sets, 32 B lines") != std::string::npos);
+    REQUIRE(report.find("line 8") != std::string::npos);
+}
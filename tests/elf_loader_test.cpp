@@ -0,0 +1,277 @@
+#include <catch2/catch_all.hpp>
+#include <ElfFile.hpp>
+#include <rv64/Decoder.hpp>
+#include <rv64/VM.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+    using rv64::Decoder;
+
+    /// Writes little-endian fields into a growing file image
+    struct ImageWriter {
+        std::vector<uint8_t> bytes;
+
+        template<typename T>
+        void put(size_t offset, T value) {
+            if (bytes.size() < offset + sizeof(T))
+                bytes.resize(offset + sizeof(T));
+            for (size_t i = 0; i < sizeof(T); ++i)
+                bytes[offset + i] = static_cast<uint8_t>(uint64_t(value) >> (8 * i));
+        }
+
+        void put_bytes(size_t offset, std::string_view data) {
+            if (bytes.size() < offset + data.size())
+                bytes.resize(offset + data.size());
+            std::memcpy(bytes.data() + offset, data.data(), data.size());
+        }
+    };
+
+    constexpr uint64_t TEXT_VADDR = 0x10000;
+    constexpr uint64_t CODE_OFFSET = 0xB0;
+    constexpr uint64_t ENTRY = TEXT_VADDR + CODE_OFFSET;
+    constexpr uint64_t DATA_VADDR = 0x11000;
+    constexpr uint64_t DATA_VALUE = 0x1122334455667788;
+
+    // standard encodings, as emitted by GNU as
+    constexpr uint32_t CODE32[] = {
+        0x00001517, // auipc a0, 1
+        0x00013583, // ld a1, 0(sp)
+    };
+    constexpr uint16_t CODE16[] = {
+        0x461D, // c.li a2, 7
+        0x060D, // c.addi a2, 3
+    };
+    constexpr uint32_t CODE32_TAIL[] = {
+        0x000116B7, // lui a3, 0x11
+        0x0006B703, // ld a4, 0(a3)
+        0x0080006F, // j +8
+        0xFFFFFFFF, // not an instruction, jumped over
+        0x00000097, // auipc ra, 0
+        0x00C080E7, // jalr ra, 12(ra), the call sequence of compilers
+        0xFFFFFFFF, // not an instruction, jumped over
+        0x00100073, // ebreak
+    };
+    constexpr uint16_t CODE_END = 0x0001; // c.nop, keeps the ebreak from being the last instruction
+    constexpr uint64_t CODE_SIZE = sizeof(CODE32) + sizeof(CODE16) + sizeof(CODE32_TAIL) + sizeof(CODE_END);
+
+    /// Static executable with a text segment (also mapping the headers), a data segment
+    /// with bss, and a symbol table
+    std::vector<uint8_t> make_test_elf() {
+        ImageWriter w;
+        constexpr size_t PHOFF = 64, DATA_OFF = 0x100, STRTAB_OFF = 0x110, SYMTAB_OFF = 0x120, SHOFF = 0x168;
+        constexpr std::string_view STRTAB{"\0_start\0value\0", 14};
+
+        // ELF header
+        w.put_bytes(0, "\x7F" "ELF");
+        w.put<uint8_t>(4, 2); // ELFCLASS64
+        w.put<uint8_t>(5, 1); // little endian
+        w.put<uint8_t>(6, 1); // EV_CURRENT
+        w.put<uint16_t>(16, 2); // ET_EXEC
+        w.put<uint16_t>(18, 243); // EM_RISCV
+        w.put<uint32_t>(20, 1);
+        w.put<uint64_t>(24, ENTRY);
+        w.put<uint64_t>(32, PHOFF);
+        w.put<uint64_t>(40, SHOFF);
+        w.put<uint16_t>(52, 64);
+        w.put<uint16_t>(54, 56);
+        w.put<uint16_t>(56, 2);
+        w.put<uint16_t>(58, 64);
+        w.put<uint16_t>(60, 4);
+
+        auto phdr = [&](size_t i, uint32_t flags, uint64_t offset, uint64_t vaddr, uint64_t filesz, uint64_t memsz) {
+            size_t ph = PHOFF + i * 56;
+            w.put<uint32_t>(ph, 1); // PT_LOAD
+            w.put<uint32_t>(ph + 4, flags);
+            w.put<uint64_t>(ph + 8, offset);
+            w.put<uint64_t>(ph + 16, vaddr);
+            w.put<uint64_t>(ph + 24, vaddr);
+            w.put<uint64_t>(ph + 32, filesz);
+            w.put<uint64_t>(ph + 40, memsz);
+            w.put<uint64_t>(ph + 48, 0x1000);
+        };
+        phdr(0, 0b101, 0, TEXT_VADDR, CODE_OFFSET + CODE_SIZE, CODE_OFFSET + CODE_SIZE);
+        phdr(1, 0b110, DATA_OFF, DATA_VADDR, 8, 16);
+
+        size_t pos = CODE_OFFSET;
+        for (auto inst: CODE32) { w.put(pos, inst); pos += 4; }
+        for (auto inst: CODE16) { w.put(pos, inst); pos += 2; }
+        for (auto inst: CODE32_TAIL) { w.put(pos, inst); pos += 4; }
+        w.put(pos, CODE_END);
+
+        w.put<uint64_t>(DATA_OFF, DATA_VALUE);
+        w.put_bytes(STRTAB_OFF, STRTAB);
+
+        auto sym = [&](size_t i, uint32_t name, uint8_t info, uint64_t value, uint64_t size) {
+            size_t s = SYMTAB_OFF + i * 24;
+            w.put<uint32_t>(s, name);
+            w.put<uint8_t>(s + 4, info);
+            w.put<uint16_t>(s + 6, 1);
+            w.put<uint64_t>(s + 8, value);
+            w.put<uint64_t>(s + 16, size);
+        };
+        sym(0, 0, 0, 0, 0);
+        sym(1, 1, 0x12, ENTRY, CODE_SIZE); // GLOBAL FUNC _start
+        sym(2, 8, 0x11, DATA_VADDR, 8); // GLOBAL OBJECT value
+
+        auto shdr = [&](size_t i, uint32_t type, uint64_t flags, uint64_t addr, uint64_t offset, uint64_t size,
+                        uint32_t link, uint64_t entsize) {
+            size_t sh = SHOFF + i * 64;
+            w.put<uint32_t>(sh + 4, type);
+            w.put<uint64_t>(sh + 8, flags);
+            w.put<uint64_t>(sh + 16, addr);
+            w.put<uint64_t>(sh + 24, offset);
+            w.put<uint64_t>(sh + 32, size);
+            w.put<uint32_t>(sh + 40, link);
+            w.put<uint64_t>(sh + 56, entsize);
+        };
+        shdr(0, 0, 0, 0, 0, 0, 0, 0);
+        shdr(1, 1, 0x6, ENTRY, CODE_OFFSET, CODE_SIZE, 0, 0); // .text
+        shdr(2, 2, 0, 0, SYMTAB_OFF, 3 * 24, 3, 24); // .symtab
+        shdr(3, 3, 0, 0, STRTAB_OFF, STRTAB.size(), 0, 0); // .strtab
+        return w.bytes;
+    }
+
+    struct TempElf {
+        std::filesystem::path path = std::filesystem::temp_directory_path() / "rv64sim-elf-test.elf";
+
+        explicit TempElf(const std::vector<uint8_t> &bytes) {
+            std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char *>(bytes.data()),
+                                                        static_cast<std::streamsize>(bytes.size()));
+        }
+        ~TempElf() {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+    };
+}
+
+TEST_CASE("Decoder - Standard encodings", "[decoder]") {
+    SECTION("base instructions") {
+        auto addi = Decoder::decode(0xFFF50513); // addi a0, a0, -1
+        REQUIRE(addi.get_prototype().mnemonic == "addi");
+        REQUIRE(std::get<rv64::Reg>(addi.get_args()[0]).idx() == 10);
+        REQUIRE(std::get<int12>(addi.get_args()[2]) == -1);
+
+        auto sd = Decoder::decode(0x00113423); // sd ra, 8(sp)
+        REQUIRE(sd.get_prototype().mnemonic == "sd");
+        REQUIRE(std::get<rv64::Reg>(sd.get_args()[0]).idx() == 1);
+        REQUIRE(std::get<rv64::Reg>(sd.get_args()[1]).idx() == 2);
+        REQUIRE(std::get<int12>(sd.get_args()[2]) == 8);
+
+        auto bne = Decoder::decode(0xFE059EE3); // bne a1, zero, -4
+        REQUIRE(bne.get_prototype().mnemonic == "bne");
+        REQUIRE(std::get<int12>(bne.get_args()[2]) == -2); // in halfwords
+
+        auto mul = Decoder::decode(0x02B50533); // mul a0, a0, a1
+        REQUIRE(mul.get_prototype().mnemonic == "mul");
+    }
+
+    SECTION("compressed instructions") {
+        REQUIRE(Decoder::instruction_length(0x461D) == 2);
+        auto li = Decoder::decode(0x461D); // c.li a2, 7
+        REQUIRE(li.get_prototype().mnemonic == "c.li");
+        REQUIRE(std::get<int6>(li.get_args()[1]) == 7);
+
+        auto ldsp = Decoder::decode(0x60A2); // c.ldsp ra, 8(sp)
+        REQUIRE(ldsp.get_prototype().mnemonic == "c.ldsp");
+        REQUIRE(std::get<int6>(ldsp.get_args()[1]) == 1);
+
+        auto j = Decoder::decode(0xBFF5); // c.j -4
+        REQUIRE(j.get_prototype().mnemonic == "c.j");
+        REQUIRE(std::get<int11>(j.get_args()[0]) == -2);
+    }
+
+    SECTION("unsupported encodings are invalid") {
+        REQUIRE_FALSE(Decoder::decode(0x00000000).is_valid()); // illegal instruction
+        REQUIRE_FALSE(Decoder::decode(0xC0002573).is_valid()); // rdcycle a0
+        REQUIRE_FALSE(Decoder::decode(0x00053507).is_valid()); // fld
+    }
+}
+
+TEST_CASE("VM - Static ELF executable", "[elf][vm]") {
+    TempElf file(make_test_elf());
+    rv64::VM vm{};
+
+    auto err = vm.load_elf(file.path);
+    INFO(err.value_or(""));
+    REQUIRE_FALSE(err);
+    REQUIRE(vm.get_state() == rv64::VMState::Loaded);
+    REQUIRE(vm.m_cpu.get_pc() == ENTRY);
+    REQUIRE(vm.get_memory_layout().data_base == TEXT_VADDR);
+
+    SECTION("initial stack follows the psABI") {
+        uint64_t sp = vm.m_cpu.reg(2).val();
+        REQUIRE(sp % 16 == 0);
+
+        MemErr mem_err = MemErr::None;
+        REQUIRE(vm.m_memory.load<uint64_t>(sp, mem_err) == 1); // argc
+        uint64_t argv0 = vm.m_memory.load<uint64_t>(sp + 8, mem_err);
+        REQUIRE(vm.m_memory.load_string(argv0, mem_err) == file.path.filename().string());
+        REQUIRE(vm.m_memory.load<uint64_t>(sp + 16, mem_err) == 0); // argv terminator
+        REQUIRE(vm.m_memory.load<uint64_t>(sp + 24, mem_err) == 0); // empty envp
+        REQUIRE(mem_err == MemErr::None);
+    }
+
+    SECTION("segments are loaded and bss is zeroed") {
+        MemErr mem_err = MemErr::None;
+        REQUIRE(vm.m_memory.load<uint64_t>(DATA_VADDR, mem_err) == DATA_VALUE);
+        REQUIRE(vm.m_memory.load<uint64_t>(DATA_VADDR + 8, mem_err) == 0);
+        REQUIRE(mem_err == MemErr::None);
+        REQUIRE(vm.m_memory.get_brk() >= DATA_VADDR + 16);
+    }
+
+    SECTION("symbols") {
+        REQUIRE(vm.get_symbols().size() == 2);
+        const auto *start = vm.find_symbol(ENTRY + 6);
+        REQUIRE(start);
+        REQUIRE(start->name == "_start");
+        REQUIRE(start->is_function);
+        REQUIRE(vm.find_symbol(DATA_VADDR + 8) == nullptr);
+    }
+
+    SECTION("runs to the ebreak") {
+        vm.run_until_stop();
+        REQUIRE(vm.get_state() == rv64::VMState::Breakpoint);
+        REQUIRE(vm.m_cpu.reg(10).val() == ENTRY + 0x1000); // auipc is relative to its own address
+        REQUIRE(vm.m_cpu.reg(11).val() == 1);
+        REQUIRE(vm.m_cpu.reg(12).val() == 10);
+        REQUIRE(vm.m_cpu.reg(13).val() == DATA_VADDR);
+        REQUIRE(vm.m_cpu.reg(14).val() == DATA_VALUE);
+        REQUIRE(vm.m_cpu.reg(1).val() == ENTRY + 28 + 8); // return address after the jalr
+        REQUIRE(vm.m_cpu.get_pc() == ENTRY + CODE_SIZE - sizeof(CODE_END));
+    }
+
+    SECTION("single steps reach the ebreak too") {
+        while (vm.get_state() == rv64::VMState::Loaded || vm.get_state() == rv64::VMState::Running)
+            vm.run_step();
+        REQUIRE(vm.get_state() == rv64::VMState::Breakpoint);
+        REQUIRE(vm.m_cpu.reg(1).val() == ENTRY + 28 + 8);
+        REQUIRE(vm.m_cpu.get_pc() == ENTRY + CODE_SIZE - sizeof(CODE_END));
+    }
+}
+
+TEST_CASE("VM - Invalid ELF files", "[elf][vm]") {
+    rv64::VM vm{};
+
+    SECTION("missing file") {
+        REQUIRE(vm.load_elf(std::filesystem::temp_directory_path() / "rv64sim-no-such-file.elf"));
+    }
+
+    SECTION("not an ELF file") {
+        TempElf file({'#', '!', '/', 'b', 'i', 'n'});
+        auto err = vm.load_elf(file.path);
+        REQUIRE(err);
+        REQUIRE(*err == "Not an ELF file");
+        REQUIRE(vm.get_state() == rv64::VMState::Initializing);
+    }
+
+    SECTION("wrong machine") {
+        auto bytes = make_test_elf();
+        bytes[18] = 62; // EM_X86_64
+        TempElf file(bytes);
+        REQUIRE(vm.load_elf(file.path) == "Not a RISC-V executable");
+    }
+}
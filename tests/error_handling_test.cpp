@@ -27,6 +27,19 @@ TEST_CASE("Error handling - Invalid register", "[errors]") {
     REQUIRE(err_msg.find("Invalid register 'x32'") != std::string::npos);
 }
 
+TEST_CASE("Error handling - Oversize tokens", "[errors]") {
+    err_msg.clear();
+    ui::set_error_msg_callback([](auto msg) {err_msg = msg;});
+    asm_parsing::ParsedInstVec out;
+    std::string mnemonic = "add" + std::string(40, 'd');
+    REQUIRE(asm_parsing::parse_and_resolve(mnemonic + " x1, x2, x3", out, 0x400000) != 0);
+    REQUIRE(err_msg.find("Unknown instruction '" + mnemonic + "'") != std::string::npos);
+
+    std::string reg = "x" + std::string(40, '1');
+    REQUIRE(asm_parsing::parse_and_resolve("add x1, " + reg + ", x3", out, 0x400000) != 0);
+    REQUIRE(err_msg.find("Invalid register '" + reg + "'") != std::string::npos);
+}
+
 TEST_CASE("Error handling - Immediate out of range", "[errors]") {
     err_msg.clear();
     ui::set_error_msg_callback([](auto msg) {err_msg = msg;});
@@ -42,10 +55,9 @@ TEST_CASE("Error handling - Duplicate label", "[errors]") {
     ui::set_error_msg_callback([](auto msg) {err_msg = msg;});
     asm_parsing::ParsedInstVec out;
     int result = asm_parsing::parse_and_resolve("loop:\n  add x1, x2, x3\nloop:\n  add x4, x5, x6", out, 0x400000);
-    // Note: duplicate label is reported but parsing may still succeed partially
-    // The second 'loop' label error is printed but doesn't stop parsing
-    REQUIRE(result == 0); // Parsing succeeds, but error is printed
-    REQUIRE(err_msg.find("Duplicate label 'loop'") != std::string::npos);
+    REQUIRE(result == 1);
+    REQUIRE(out.empty());
+    REQUIRE(err_msg.find("Line 3: Duplicate label 'loop'") != std::string::npos);
 }
 
 TEST_CASE("Error handling - Valid instruction parses correctly", "[errors]") {
@@ -99,5 +111,5 @@ TEST_CASE("Error handling - Multiple instructions parse", "[errors]") {
     asm_parsing::ParsedInstVec out;
     int result = asm_parsing::parse_and_resolve("add x1, x2, x3\nsub x4, x5, x6", out, 0);
     REQUIRE(result == 0);
-    REQUIRE(out.size() >= 2);  // At least 2 instructions (may have padding)
+    REQUIRE(out.size() == 2);
 }
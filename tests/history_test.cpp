@@ -0,0 +1,243 @@
+#include <catch2/catch_test_macros.hpp>
+#include <rv64/History.hpp>
+#include <rv64/VM.hpp>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stop_token>
+#include <ui.hpp>
+
+#include "test_helpers.hpp"
+
+using namespace rv64;
+
+namespace {
+    // reads five integers, keeps a running sum with random numbers added in registers, the stack and
+    // a growing heap, then reads a line into the stack
+    const std::string SOURCE = R"(
+        addi x9, x0, 0
+        addi x18, x0, 5
+    loop:
+        addi x10, x0, 5
+        ecall
+        add x9, x9, x10
+        addi x10, x0, 9
+        addi x11, x0, 8
+        ecall
+        sd x9, 0(x10)
+        sd x9, -8(x2)
+        addi x10, x0, 100
+        addi x11, x0, 0
+        addi x12, x0, 1000
+        ecall
+        add x9, x9, x10
+        addi x18, x18, -1
+        bne x18, x0, loop
+        addi x10, x0, 8
+        addi x11, x2, -64
+        addi x12, x0, 16
+        ecall
+        ld x19, -64(x2)
+    )";
+    constexpr size_t LOOP_LINE = 6; // add x9, x9, x10
+
+    const std::string INPUT = "3 14 15 92 65\nend of input\n";
+
+    std::unique_ptr<VM> load(History::Config history, ExecEngine engine = ExecEngine::Blocks, bool fuse = true) {
+        VMConfig config{};
+        config.m_history = history;
+        config.m_rng_seed = 42;
+        config.m_engine = engine;
+        config.m_fuse_instructions = fuse;
+        auto vm = load_program(SOURCE, config);
+        vm->m_input.use_buffer(INPUT);
+        REQUIRE(vm->m_history.is_recording());
+        return vm;
+    }
+
+    /// registers, pc, heap break and the words the program writes
+    std::vector<uint64_t> state_of(VM &vm) {
+        std::vector<uint64_t> state;
+        for (const auto &reg: vm.m_cpu.int_regs())
+            state.push_back(reg.val());
+        state.push_back(vm.m_cpu.get_pc());
+        state.push_back(vm.m_memory.get_brk());
+        state.push_back(vm.get_current_line());
+        uint64_t sp = vm.m_cpu.reg(2).val();
+        uint64_t heap = vm.get_memory_layout().data_base + vm.m_memory.get_instruction_end_addr()
+                        - vm.m_memory.get_instruction_begin_addr();
+        for (uint64_t address = sp - 64; address < sp; address += 8) {
+            MemErr err;
+            state.push_back(vm.m_memory.load<uint64_t>(address, err));
+        }
+        for (uint64_t address = heap; address < vm.m_memory.get_brk(); address += 8) {
+            MemErr err;
+            state.push_back(vm.m_memory.load<uint64_t>(address, err));
+        }
+        return state;
+    }
+
+    /// @return state before every instruction and after the last one
+    std::vector<std::vector<uint64_t>> run_stepping(VM &vm) {
+        std::vector<std::vector<uint64_t>> states{state_of(vm)};
+        while (vm.get_state() != VMState::Finished) {
+            vm.run_step();
+            REQUIRE(vm.get_instruction_count() == states.size());
+            states.push_back(state_of(vm));
+        }
+        return states;
+    }
+}
+
+TEST_CASE("Reverse execution", "[history]") {
+    SECTION("going back restores every earlier state and replays the same input") {
+        auto vm = load({.checkpoint_interval = 7});
+        auto states = run_stepping(*vm);
+        uint64_t end = vm->get_instruction_count();
+        REQUIRE(vm->m_cpu.reg(19).val() != 0); // the line was read
+        REQUIRE(vm->m_history.checkpoint_count() > 5);
+        REQUIRE(vm->m_history.earliest() == 0);
+
+        for (uint64_t target: {end - 1, end - 10, uint64_t(31), uint64_t(30), uint64_t(7), uint64_t(0)}) {
+            REQUIRE(vm->m_history.travel_to(target) == target);
+            REQUIRE(vm->get_instruction_count() == target);
+            REQUIRE(state_of(*vm) == states[target]);
+        }
+        REQUIRE(vm->get_state() == VMState::Loaded);
+
+        // forward again: the kept input is read again and the random engine repeats itself
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE(vm->get_instruction_count() == end);
+        REQUIRE(state_of(*vm) == states.back());
+
+        REQUIRE(vm->m_history.step_back(3) == end - 3);
+        REQUIRE(state_of(*vm) == states[end - 3]);
+        vm->run_step();
+        REQUIRE(state_of(*vm) == states[end - 2]);
+    }
+
+    SECTION("engines replay alike") {
+        for (auto [engine, fuse]: {std::pair{ExecEngine::Interpreter, false}, std::pair{ExecEngine::Interpreter, true},
+                                   std::pair{ExecEngine::Blocks, true}}) {
+            auto vm = load({.checkpoint_interval = 16}, engine, fuse);
+            auto states = run_stepping(*vm);
+            for (uint64_t target = states.size() - 1; target-- > 0;) {
+                vm->m_history.travel_to(target);
+                REQUIRE(state_of(*vm) == states[target]);
+            }
+        }
+    }
+
+    SECTION("running to the end records checkpoints") {
+        auto reference = load({.checkpoint_interval = 10});
+        auto states = run_stepping(*reference);
+
+        auto vm = load({.checkpoint_interval = 10});
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE(vm->m_history.checkpoint_count() > 1);
+        REQUIRE(vm->m_history.step_back(25) == states.size() - 26);
+        REQUIRE(state_of(*vm) == states[states.size() - 26]);
+    }
+
+    SECTION("the memory budget drops the oldest checkpoints") {
+        auto vm = load({.checkpoint_interval = 5, .memory_budget = 1});
+        auto states = run_stepping(*vm);
+        REQUIRE(vm->m_history.checkpoint_count() == 1);
+        uint64_t earliest = vm->m_history.earliest();
+        REQUIRE(earliest > 0);
+        REQUIRE(earliest < states.size());
+
+        REQUIRE(vm->m_history.step_back(states.size()) == earliest);
+        REQUIRE(state_of(*vm) == states[earliest]);
+        vm->run_until_stop();
+        REQUIRE(state_of(*vm) == states.back());
+    }
+
+    SECTION("reverse continue stops at the earlier breakpoint hits") {
+        auto vm = load({.checkpoint_interval = 9});
+        auto states = run_stepping(*vm);
+        vm->toggle_breakpoint(LOOP_LINE);
+
+        std::vector<uint64_t> hits;
+        for (uint64_t i = 0; i < states.size(); ++i) {
+            if (states[i][Cpu::INT_REG_CNT + 2] == LOOP_LINE)
+                hits.push_back(i);
+        }
+        REQUIRE(hits.size() == 5);
+
+        for (auto hit = hits.rbegin(); hit != hits.rend(); ++hit) {
+            REQUIRE(vm->m_history.reverse_continue());
+            REQUIRE(vm->get_instruction_count() == *hit);
+            REQUIRE(vm->get_current_line() == LOOP_LINE);
+            REQUIRE(state_of(*vm) == states[*hit]);
+        }
+        REQUIRE_FALSE(vm->m_history.reverse_continue());
+        REQUIRE(vm->get_instruction_count() == 0);
+    }
+
+    SECTION("reverse continue ends on a stop request") {
+        auto vm = load({.checkpoint_interval = 9});
+        auto states = run_stepping(*vm);
+        vm->toggle_breakpoint(LOOP_LINE);
+
+        std::stop_source stop;
+        stop.request_stop();
+        REQUIRE_FALSE(vm->m_history.reverse_continue(stop.get_token()));
+        REQUIRE(vm->get_instruction_count() == states.size() - 1);
+        REQUIRE(state_of(*vm) == states.back());
+        REQUIRE(vm->m_history.reverse_continue());
+        REQUIRE(vm->get_current_line() == LOOP_LINE);
+    }
+
+    SECTION("programs using Linux syscalls are not recorded") {
+        VMConfig config{};
+        config.m_history = History::Config{};
+        config.m_ecall_personality = EcallPersonality::Linux;
+        auto vm = load_program(SOURCE, config);
+        REQUIRE_FALSE(vm->m_history.is_recording());
+        REQUIRE(vm->m_history.start({}).has_value());
+        REQUIRE_FALSE(vm->m_history.is_recording());
+    }
+
+    SECTION("a heap break that cannot be restored stops with an error") {
+        ui::set_error_msg_callback([](auto) {});
+        auto vm = load({});
+        auto snapshot = vm->save_snapshot();
+        snapshot.brk = vm->get_memory_layout().data_base; // below the program
+        REQUIRE_THROWS(vm->restore_snapshot(snapshot));
+        REQUIRE(vm->get_state() == VMState::Error);
+    }
+
+    SECTION("configuration is validated") {
+        REQUIRE(History::validate({}) == std::nullopt);
+        REQUIRE(History::validate({.checkpoint_interval = 0}).has_value());
+        REQUIRE(History::validate({.memory_budget = 0}).has_value());
+    }
+}
+
+TEST_CASE("Input rewind", "[history]") {
+    auto path = std::filesystem::temp_directory_path() / "rv64sim-history-input.txt";
+    std::ofstream(path) << "1 22 333";
+
+    InputReader input;
+    REQUIRE(input.use_file(path));
+    input.set_keep_consumed(true);
+    REQUIRE(input.read_int() == 1);
+    uint64_t after_first = input.position();
+    REQUIRE(input.read_int() == 22);
+    REQUIRE(input.read_int() == 333);
+    REQUIRE_FALSE(input.read_char()); // the buffer is refilled, the consumed bytes are kept
+    REQUIRE(input.kept_size() == 8);
+
+    input.rewind(after_first);
+    REQUIRE(input.read_int() == 22);
+    input.forget_before(input.position());
+    REQUIRE(input.kept_size() == 0);
+    REQUIRE(input.read_int() == 333);
+    REQUIRE_FALSE(input.read_int());
+
+    input.use_stdin();
+    std::filesystem::remove(path);
+}
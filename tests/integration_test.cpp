@@ -1,24 +1,15 @@
 #include <catch2/catch_test_macros.hpp>
-#include <parser/asm_parsing.hpp>
+#include <rv64/Lockstep.hpp>
 #include <rv64/VM.hpp>
+#include <algorithm>
 #include <memory>
+#include <set>
 
+#include "test_helpers.hpp"
 #include "ui.hpp"
 
 using namespace rv64;
 
-// Helper to parse, load, and run a program
-static std::unique_ptr<VM> run_program(const std::string &source) {
-    auto vm = std::make_unique<VM>();
-    asm_parsing::ParsedInstVec instructions;
-    int result = asm_parsing::parse_and_resolve(source, instructions, vm->m_cpu.get_pc());
-
-    REQUIRE(result == 0);
-    vm->load_program(instructions);
-    vm->run_until_stop();
-    return vm;
-}
-
 TEST_CASE("Integration - Simple arithmetic", "[integration]") {
     SECTION("add two registers") {
         auto vm = run_program(R"(
@@ -270,6 +261,38 @@ TEST_CASE("Integration - Function calls", "[integration]") {
         REQUIRE(vm->m_cpu.reg(11) == 10);
     }
 
+    SECTION("auipc and jalr jump relative to the auipc") {
+        auto vm = run_program(R"(
+            auipc x5, 0
+            jalr x1, x5, 12
+            addi x10, x10, 100
+            addi x10, x10, 1
+        )");
+        REQUIRE(vm->m_cpu.reg(10) == 1);
+        REQUIRE(vm->m_cpu.reg(1).val() - vm->m_cpu.reg(5).val() == 8);
+    }
+
+    SECTION("call through ra: auipc ra and jalr ra, off(ra)") {
+        std::string source = R"(
+            auipc ra, 0
+            jalr ra, ra, 12
+            addi x10, x10, 100
+            addi x10, x10, 1
+            addi x11, ra, 0
+        )";
+        auto vm = run_program(source);
+        REQUIRE(vm->m_cpu.reg(10) == 1);
+        REQUIRE(vm->m_cpu.reg(11).val() - vm->m_memory.get_instruction_begin_addr() == 8);
+
+        // single steps are never fused
+        auto stepped = load_program(source);
+        while (stepped->get_state() != VMState::Finished && stepped->get_state() != VMState::Error)
+            stepped->run_step();
+        REQUIRE(stepped->get_state() == VMState::Finished);
+        REQUIRE(stepped->m_cpu.reg(10) == 1);
+        REQUIRE(stepped->m_cpu.reg(11) == vm->m_cpu.reg(11).val());
+    }
+
 }
 
 TEST_CASE("Integration - Register aliases", "[integration]") {
@@ -465,3 +488,372 @@ TEST_CASE("Integration - System calls", "[integration]") {
         REQUIRE(vm->m_cpu.reg(4) == 0); // not executed
     }
 }
+
+TEST_CASE("Integration - Watchdog", "[integration][watchdog]") {
+    constexpr auto INFINITE_LOOP = R"(
+        addi x1, x0, 0
+    loop:
+        addi x1, x1, 1
+        beq x0, x0, loop
+    )";
+    ui::set_error_msg_callback([](auto) {});
+
+    SECTION("instruction budget") {
+        VMConfig config{};
+        config.m_instruction_budget = 10001;
+        auto vm = load_program(INFINITE_LOOP, config);
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::LimitExceeded);
+        REQUIRE(vm->get_stop_reason() == StopReason::InstructionBudget);
+        REQUIRE(vm->get_instruction_count() == 10001);
+        REQUIRE(vm->m_cpu.reg(1) == 5000);
+    }
+
+    SECTION("instruction budget when stepping") {
+        VMConfig config{};
+        config.m_instruction_budget = 3;
+        auto vm = load_program(INFINITE_LOOP, config);
+        for (int i = 0; i < 3; i++) {
+            vm->run_step();
+            REQUIRE(vm->get_state() == VMState::Running);
+        }
+        vm->run_step();
+        REQUIRE(vm->get_state() == VMState::LimitExceeded);
+        REQUIRE(vm->get_instruction_count() == 3);
+    }
+
+    SECTION("time limit") {
+        VMConfig config{};
+        config.m_time_limit = std::chrono::milliseconds(20);
+        auto vm = load_program(INFINITE_LOOP, config);
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::LimitExceeded);
+        REQUIRE(vm->get_stop_reason() == StopReason::TimeLimit);
+    }
+
+    SECTION("programs within the limits finish normally") {
+        VMConfig config{};
+        config.m_instruction_budget = 3;
+        config.m_time_limit = std::chrono::seconds(10);
+        auto vm = load_program("addi x1, x0, 1\naddi x2, x0, 2\naddi x3, x0, 3", config);
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE(vm->get_stop_reason() == StopReason::None);
+        REQUIRE(vm->m_cpu.reg(3) == 3);
+    }
+}
+
+TEST_CASE("Integration - Superinstruction fusion", "[integration][fusion]") {
+    const std::string source = R"(
+        addi x8, x2, -128
+        addi x5, x0, 0
+        addi x6, x0, 10
+        addi x10, x0, 0
+    fill:
+        slli x7, x5, 3
+        add x7, x8, x7
+        sd x5, 0(x7)
+        addi x5, x5, 1
+        blt x5, x6, fill
+        addi x5, x0, 0
+    sum:
+        slli x7, x5, 3
+        add x7, x8, x7
+        ld x9, 0(x7)
+        add x10, x10, x9
+        addi x5, x5, 1
+        blt x5, x6, sum
+        lui x11, 0x12345
+        addi x11, x11, 1656
+        auipc x12, 0
+        jalr x13, x12, 12
+        addi x14, x0, 1
+        addi x15, x0, 2
+        auipc ra, 0
+        jalr ra, ra, 12
+        addi x16, x0, 1
+        addi x17, ra, 0
+    )";
+    auto line_of = [&](std::string_view text) {
+        return static_cast<size_t>(std::ranges::count(source.substr(0, source.find(text)), '\n')) + 1;
+    };
+    auto load = [&](bool fuse) {
+        VMConfig config{};
+        config.m_fuse_instructions = fuse;
+        return load_program(source, config);
+    };
+
+    SECTION("idioms are found in the decoded program") {
+        auto vm = load(true);
+        std::set<FusedOp::Kind> kinds;
+        for (uint64_t pc = vm->m_cpu.get_pc(); pc < vm->m_memory.get_instruction_end_addr(); pc += 2) {
+            if (auto *op = vm->m_memory.get_fused_at(pc))
+                kinds.insert(op->kind);
+        }
+        REQUIRE(kinds == std::set{FusedOp::Kind::LoadImmediate, FusedOp::Kind::FarJump,
+                                  FusedOp::Kind::AddiBranch, FusedOp::Kind::IndexedLoad});
+    }
+
+    SECTION("idioms are only looked for when the Interpreter fuses them") {
+        auto count_fused = [](const VM &vm) {
+            size_t count = 0;
+            for (uint64_t pc = vm.m_cpu.get_pc(); pc < vm.m_memory.get_instruction_end_addr(); pc += 2)
+                count += vm.m_memory.get_fused_at(pc) != nullptr;
+            return count;
+        };
+        REQUIRE(count_fused(*load(false)) == 0);
+
+        VMConfig config{};
+        config.m_engine = ExecEngine::Blocks;
+        auto blocks = load_program(source, config);
+        REQUIRE(count_fused(*blocks) == 0);
+        blocks->run_until_stop();
+        REQUIRE(blocks->get_state() == VMState::Finished);
+        REQUIRE(blocks->m_cpu.reg(10) == 45);
+    }
+
+    SECTION("fused and unfused runs end in the same state") {
+        auto fused = load(true);
+        auto plain = load(false);
+        fused->run_until_stop();
+        plain->run_until_stop();
+        REQUIRE(fused->get_state() == VMState::Finished);
+        REQUIRE(plain->get_state() == VMState::Finished);
+        REQUIRE(fused->get_instruction_count() == plain->get_instruction_count());
+        for (int i = 0; i < 32; i++)
+            REQUIRE(fused->m_cpu.reg(i).val() == plain->m_cpu.reg(i).val());
+        REQUIRE(fused->m_cpu.reg(10) == 45);
+        REQUIRE(fused->m_cpu.reg(11) == 0x12345678);
+        REQUIRE(fused->m_cpu.reg(14) == 0);
+        REQUIRE(fused->m_cpu.reg(15) == 2);
+        // auipc ra; jalr ra, lo(ra) returns behind the jalr and jumps relative to the old ra
+        REQUIRE(fused->m_cpu.reg(16) == 0);
+        REQUIRE(fused->m_cpu.reg(17).val() == fused->m_memory.get_instruction_end_addr() - 8);
+    }
+
+    SECTION("a breakpoint inside a fused idiom splits it") {
+        auto vm = load(true);
+        size_t ld_line = line_of("ld x9");
+        vm->m_cpu.set_breakpoint(ld_line, true);
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Breakpoint);
+        REQUIRE(vm->get_current_line() == ld_line);
+        REQUIRE(vm->m_cpu.reg(7).val() == vm->m_cpu.reg(8).val()); // slli and add done
+
+        vm->run_step();
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Breakpoint);
+        REQUIRE(vm->get_current_line() == ld_line);
+        REQUIRE(vm->m_cpu.reg(7).val() == vm->m_cpu.reg(8).val() + 8);
+        REQUIRE(vm->m_cpu.reg(9) == 0); // ld of the second iteration not executed yet
+        vm->run_step();
+        REQUIRE(vm->m_cpu.reg(9) == 1);
+    }
+
+    SECTION("the instruction budget is exact") {
+        VMConfig config{};
+        config.m_instruction_budget = 8; // ends between the addi and blt of the first loop
+        auto vm = run_program(source, config);
+        REQUIRE(vm->get_state() == VMState::LimitExceeded);
+        REQUIRE(vm->get_instruction_count() == 8);
+        REQUIRE(vm->m_cpu.reg(5) == 1);
+        REQUIRE(vm->get_current_line() == line_of("blt x5, x6, fill"));
+    }
+}
+
+TEST_CASE("Integration - Lockstep", "[integration][lockstep]") {
+    const std::string source = R"(
+        addi x5, x0, 0
+        addi x6, x0, 50
+        addi x8, x2, -64
+    loop:
+        lui x7, 0x1
+        addi x7, x7, -1
+        sd x7, 0(x8)
+        ld x9, 0(x8)
+        add x10, x10, x9
+        addi x5, x5, 1
+        blt x5, x6, loop
+        addi x11, x0, 1
+    )";
+    auto load = [](const std::string &src, ExecEngine engine, bool fuse = false) {
+        VMConfig config{};
+        config.m_engine = engine;
+        config.m_fuse_instructions = fuse;
+        return load_program(src, config);
+    };
+
+    SECTION("engines agree") {
+        for (auto engine: {ExecEngine::Interpreter, ExecEngine::Blocks}) {
+            auto reference = load(source, ExecEngine::Interpreter);
+            auto candidate = load(source, engine, true);
+            REQUIRE_FALSE(run_lockstep(*reference, *candidate));
+            REQUIRE(candidate->get_state() == VMState::Finished);
+            REQUIRE(reference->get_state() == VMState::Finished);
+            REQUIRE(candidate->m_cpu.reg(10) == 50 * 4095);
+        }
+    }
+
+    SECTION("instruction limit") {
+        auto reference = load(source, ExecEngine::Interpreter);
+        auto candidate = load(source, ExecEngine::Blocks);
+        REQUIRE_FALSE(run_lockstep(*reference, *candidate, 20));
+        REQUIRE(candidate->get_instruction_count() == 20);
+        REQUIRE(reference->get_instruction_count() == 20);
+    }
+
+    SECTION("the first divergence is reported") {
+        std::string changed = source;
+        changed.replace(changed.find("addi x7, x7, -1"), 15, "addi x7, x7, -2");
+        auto reference = load(source, ExecEngine::Interpreter);
+        auto candidate = load(changed, ExecEngine::Interpreter);
+        auto divergence = run_lockstep(*reference, *candidate);
+        REQUIRE(divergence);
+        REQUIRE(divergence->instruction_count == 4);
+        REQUIRE(divergence->step_size == 1);
+        REQUIRE(divergence->line == 7);
+        REQUIRE(divergence->instruction == "addi x7, x7, -1");
+        REQUIRE(divergence->detail == "x7 = 0xffe, expected 0xfff");
+    }
+
+    SECTION("memory writes are compared") {
+        std::string changed = source;
+        changed.replace(changed.find("sd x7, 0(x8)"), 12, "sd x7, 8(x8)");
+        auto reference = load(source, ExecEngine::Interpreter);
+        auto candidate = load(changed, ExecEngine::Interpreter);
+        auto divergence = run_lockstep(*reference, *candidate);
+        REQUIRE(divergence);
+        REQUIRE(divergence->instruction_count == 5);
+        REQUIRE(divergence->detail.find("memory writes") != std::string::npos);
+    }
+}
+
+TEST_CASE("Integration - Profiler", "[integration][profiler]") {
+    const std::string source = R"(
+        addi x5, x0, 0
+        addi x6, x0, 10
+    loop:
+        lui x7, 0x1
+        addi x7, x7, -1
+        add x10, x10, x7
+        addi x5, x5, 1
+        blt x5, x6, loop
+        addi x11, x0, 1
+    )";
+    auto load = [&](ExecEngine engine, bool profile = true, bool fuse = true) {
+        VMConfig config{};
+        config.m_engine = engine;
+        config.m_fuse_instructions = fuse;
+        config.m_profile = profile;
+        return load_program(source, config);
+    };
+    const std::vector<uint64_t> expected{1, 1, 10, 10, 10, 10, 10, 1};
+
+    SECTION("every engine produces the same counts") {
+        for (auto [engine, fuse]: {std::pair{ExecEngine::Interpreter, false}, std::pair{ExecEngine::Interpreter, true},
+                                   std::pair{ExecEngine::Blocks, true}}) {
+            auto vm = load(engine, true, fuse);
+            vm->run_until_stop();
+            REQUIRE(vm->get_state() == VMState::Finished);
+            REQUIRE(vm->m_profiler.counts() == expected);
+            REQUIRE(vm->m_profiler.total() == vm->get_instruction_count());
+        }
+    }
+
+    SECTION("single steps are counted") {
+        auto vm = load(ExecEngine::Blocks);
+        while (vm->get_state() != VMState::Finished)
+            vm->run_step();
+        REQUIRE(vm->m_profiler.counts() == expected);
+    }
+
+    SECTION("reports are sorted hottest first") {
+        auto vm = load(ExecEngine::Blocks);
+        vm->run_until_stop();
+        auto pcs = vm->m_profiler.by_pc(vm->m_memory);
+        REQUIRE(pcs.size() == 8);
+        REQUIRE(pcs[0].pc == vm->m_memory.get_instruction_begin_addr() + 8);
+        REQUIRE(pcs[0].count == 10);
+        REQUIRE(pcs[0].line == 5);
+        REQUIRE(pcs.back().line == 10);
+        REQUIRE(pcs.back().count == 1);
+
+        auto lines = vm->m_profiler.by_line(vm->m_memory);
+        REQUIRE(lines.size() == 8);
+        REQUIRE(lines[0].line == 5);
+        REQUIRE(lines[4].line == 9);
+        REQUIRE(lines[5].count == 1);
+
+        auto report = vm->m_profiler.report(*vm);
+        REQUIRE(report.starts_with("53 instructions executed"));
+        REQUIRE(report.find("lui x7, 1") != std::string::npos);
+    }
+
+    SECTION("profiling is off by default") {
+        auto vm = load(ExecEngine::Blocks, false);
+        vm->run_until_stop();
+        REQUIRE(vm->m_profiler.total() == 0);
+    }
+}
+
+TEST_CASE("Integration - Instruction mix", "[integration][instruction_mix]") {
+    ui::set_info_msg_callback([](auto) {});
+    const std::string source = R"(
+        addi x5, x0, 0
+        addi x6, x0, 4
+        addi x8, x2, -64
+    loop:
+        sd x5, 0(x8)
+        lw x9, 0(x8)
+        lb x9, 1(x8)
+        mul x11, x5, x6
+        c.addi x5, 1
+        blt x5, x6, loop
+        jal x1, end
+    end:
+        addi x10, x0, 10
+        ecall
+    )";
+    using Class = InstructionMix::Class;
+    auto run = [&](ExecEngine engine, bool fuse = true) {
+        VMConfig config{};
+        config.m_engine = engine;
+        config.m_fuse_instructions = fuse;
+        config.m_instruction_mix = true;
+        auto vm = run_program(source, config);
+        REQUIRE(vm->get_state() == VMState::Finished);
+        return vm;
+    };
+
+    SECTION("counts by class, width and opcode") {
+        for (auto [engine, fuse]: {std::pair{ExecEngine::Interpreter, false}, std::pair{ExecEngine::Interpreter, true},
+                                   std::pair{ExecEngine::Blocks, true}}) {
+            auto vm = run(engine, fuse);
+            const auto &mix = vm->m_instruction_mix;
+            REQUIRE(mix.total() == vm->get_instruction_count());
+            REQUIRE(mix.total() == 30);
+            REQUIRE(mix.class_count(Class::Alu) == 8);
+            REQUIRE(mix.class_count(Class::Load) == 8);
+            REQUIRE(mix.class_count(Class::Store) == 4);
+            REQUIRE(mix.class_count(Class::MulDiv) == 4);
+            REQUIRE(mix.class_count(Class::BranchTaken) == 3);
+            REQUIRE(mix.class_count(Class::BranchNotTaken) == 1);
+            REQUIRE(mix.class_count(Class::Jump) == 1);
+            REQUIRE(mix.class_count(Class::Ecall) == 1);
+            REQUIRE(mix.width_count(1) == 4);
+            REQUIRE(mix.width_count(4) == 4);
+            REQUIRE(mix.width_count(8) == 4);
+            REQUIRE(mix.compressed_count() == 4);
+            REQUIRE(mix.opcode_count((int) is::IBaseI::InstId::addi) == 4);
+            REQUIRE(mix.opcode_count((int) is::IExtensionC::InstId::c_addi) == 4);
+        }
+    }
+
+    SECTION("JSON output") {
+        auto json = run(ExecEngine::Blocks)->m_instruction_mix.to_json();
+        REQUIRE(json.find("\"total\": 30") != std::string::npos);
+        REQUIRE(json.find("\"branch_taken\": 3") != std::string::npos);
+        REQUIRE(json.find("\"c.addi\": 4") != std::string::npos);
+        REQUIRE(json.find("\"8\": 4") != std::string::npos);
+    }
+}
@@ -2,6 +2,9 @@
 #include <Memory.hpp>
 #include <rv64/VM.hpp>
 
+#include <filesystem>
+#include <fstream>
+
 TEST_CASE("Memory descending stack (default)", "[memory][stack][descending]") {
     Memory::Layout layout;
     layout.stack_base = 0x7FF00000;  // Base (bottom) of stack
@@ -456,3 +459,113 @@ TEST_CASE("Memory endianness", "[memory][endianness]") {
         REQUIRE(mem_be.load<uint8_t>(vm_be.get_memory_layout().data_base + 1, err) == 0xCD);
     }
 }
+
+TEST_CASE("Memory instruction fetch", "[memory][program]") {
+    asm_parsing::ParsedInstVec insts;
+    REQUIRE(asm_parsing::parse_and_resolve("addi a0, a0, 1\nc.addi a0, 2\nadd a1, a0, a0", insts, 0) == 0);
+    REQUIRE(insts.size() == 3);
+
+    rv64::VM vm{};
+    vm.load_program(std::move(insts));
+    Memory &mem = vm.m_memory;
+    const auto base = vm.get_memory_layout().data_base;
+    MemErr err = MemErr::None;
+
+    SECTION("instructions are found at their byte offsets") {
+        auto fetch = mem.get_instruction_at(base, err);
+        REQUIRE(err == MemErr::None);
+        REQUIRE(fetch.inst.get_prototype().mnemonic == "addi");
+        REQUIRE(fetch.lineno == 1);
+
+        fetch = mem.get_instruction_at(base + 4, err);
+        REQUIRE(err == MemErr::None);
+        REQUIRE(fetch.inst.get_prototype().mnemonic == "c.addi");
+        REQUIRE(fetch.lineno == 2);
+
+        fetch = mem.get_instruction_at(base + 6, err);
+        REQUIRE(err == MemErr::None);
+        REQUIRE(fetch.inst.get_prototype().mnemonic == "add");
+        REQUIRE(fetch.lineno == 3);
+    }
+
+    SECTION("fetch from the middle of an instruction") {
+        (void)mem.get_instruction_at(base + 2, err);
+        REQUIRE(err == MemErr::InvalidInstructionAddress);
+        (void)mem.get_instruction_at(base + 8, err);
+        REQUIRE(err == MemErr::InvalidInstructionAddress);
+    }
+
+    SECTION("program end and out of range") {
+        REQUIRE(mem.get_instruction_end_addr() == base + 10);
+        (void)mem.get_instruction_at(base + 10, err);
+        REQUIRE(err == MemErr::ProgramExit);
+        (void)mem.get_instruction_at(base + 12, err);
+        REQUIRE(err == MemErr::SegFault);
+        (void)mem.get_instruction_at(base - 2, err);
+        REQUIRE(err == MemErr::SegFault);
+    }
+}
+
+TEST_CASE("Memory file mappings", "[memory][mmap]") {
+    auto path = std::filesystem::temp_directory_path() / "rv64sim-mmap-test.bin";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "RV64" << std::string(8192, 'x') << '\0';
+    }
+    constexpr uint64_t BASE = 0x10000000;
+    rv64::VM vm{};
+    vm.load_program({});
+    Memory &mem = vm.m_memory;
+    MemErr err = MemErr::None;
+
+    SECTION("read-only mapping") {
+        REQUIRE_FALSE(vm.map_file({.address = BASE, .path = path}));
+        REQUIRE(mem.load<uint32_t>(BASE, err) == 0x34365652); // "RV64", little endian
+        REQUIRE(err == MemErr::None);
+        REQUIRE(mem.load<uint8_t>(BASE + 8195, err) == 'x');
+        REQUIRE(mem.load_string(BASE + 8190, err) == "xxxxxx");
+        REQUIRE(err == MemErr::None);
+
+        REQUIRE(mem.store<uint8_t>(BASE, 0) == MemErr::SegFault);
+        std::vector<std::span<uint8_t>> spans;
+        REQUIRE(mem.host_spans(BASE, 16, spans, true) == MemErr::SegFault);
+        REQUIRE(mem.host_spans(BASE, 16, spans, false) == MemErr::None);
+        REQUIRE(spans.size() == 1);
+
+        (void) mem.load<uint16_t>(BASE + 8196, err); // past the end of the file
+        REQUIRE(err == MemErr::SegFault);
+    }
+
+    SECTION("copy-on-write mapping leaves the file unchanged") {
+        REQUIRE_FALSE(vm.map_file({.address = BASE, .path = path, .mode = FileMapping::Mode::CopyOnWrite}));
+        REQUIRE(mem.store<uint32_t>(BASE, 0x12345678) == MemErr::None);
+        REQUIRE(mem.load<uint32_t>(BASE, err) == 0x12345678);
+
+        std::ifstream in(path, std::ios::binary);
+        std::string head(4, '\0');
+        in.read(head.data(), 4);
+        REQUIRE(head == "RV64");
+    }
+
+    SECTION("invalid mappings") {
+        REQUIRE(vm.map_file({.address = vm.get_memory_layout().data_base, .path = path}));
+        REQUIRE(vm.map_file({.address = vm.get_memory_layout().stack_base - 0x1000, .path = path}));
+        REQUIRE(vm.map_file({.address = BASE, .path = path.string() + ".missing"}));
+        REQUIRE_FALSE(vm.map_file({.address = BASE, .path = path}));
+        REQUIRE(vm.map_file({.address = BASE + 0x1000, .path = path}));
+    }
+
+    SECTION("config mappings are applied on every load") {
+        rv64::VMConfig config{};
+        config.m_file_maps.push_back({.address = BASE, .path = path});
+        vm.set_config(config);
+        vm.load_program({});
+        REQUIRE(vm.m_memory.load<uint8_t>(BASE, err) == 'R');
+        vm.load_program({});
+        REQUIRE(vm.m_memory.load<uint8_t>(BASE + 1, err) == 'V');
+        REQUIRE(err == MemErr::None);
+    }
+
+    vm.reset();
+    std::filesystem::remove(path);
+}
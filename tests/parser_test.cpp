@@ -1,5 +1,7 @@
 #include <catch2/catch_test_macros.hpp>
 #include <parser/asm_parsing.hpp>
+#include <parser/IncrementalAssembler.hpp>
+#include <rv64/AssemblerUnit.hpp>
 #include <rv64/VM.hpp>
 
 // Initialize instruction table once for all tests
@@ -336,6 +338,24 @@ TEST_CASE("Parser - Register aliases", "[parser][aliases]") {
     }
 }
 
+TEST_CASE("Parser - Case-insensitive lookups", "[parser][aliases]") {
+    REQUIRE(rv64::is::Rv64IMC::get_inst_proto("ADDI").id == (int) rv64::is::IBaseI::InstId::addi);
+    REQUIRE(rv64::is::Rv64IMC::get_inst_proto("C.Addi4spn").id == (int) rv64::is::IExtensionC::InstId::c_addi4spn);
+    REQUIRE_FALSE(rv64::is::Rv64IMC::get_inst_proto("addix"));
+    REQUIRE_FALSE(rv64::is::Rv64IMC::get_inst_proto(""));
+
+    REQUIRE(rv64::Reg::name_to_idx("A0") == 10);
+    REQUIRE(rv64::Reg::name_to_idx("Zero") == 0);
+    REQUIRE(rv64::Reg::name_to_idx("x31") == 31);
+    REQUIRE(rv64::Reg::name_to_idx("x32") == -1);
+    REQUIRE(rv64::Reg::name_to_idx("") == -1);
+
+    asm_parsing::ParsedInstVec out;
+    int result = asm_parsing::parse_and_resolve("ADD A0, SP, Ra", out, 0);
+    REQUIRE(result == 0);
+    REQUIRE(out[0].inst.get_prototype().mnemonic == "add");
+}
+
 TEST_CASE("Parser - Immediate formats", "[parser][immediate]") {
     asm_parsing::ParsedInstVec out;
 
@@ -375,6 +395,65 @@ TEST_CASE("Parser - Immediate formats", "[parser][immediate]") {
         result = asm_parsing::parse_and_resolve("addi x1, x2, -2048", out, 0);
         REQUIRE(result == 0);
     }
+
+    SECTION("binary and octal immediates") {
+        int result = asm_parsing::parse_and_resolve("addi x1, x2, 0b101\naddi x3, x4, 017", out, 0);
+        REQUIRE(result == 0);
+        REQUIRE(std::get<int12>(out[0].inst.get_args()[2]) == 5);
+        REQUIRE(std::get<int12>(out[1].inst.get_args()[2]) == 15);
+    }
+
+    SECTION("hex branch offset") {
+        int result = asm_parsing::parse_and_resolve("beq x1, x2, 0x10", out, 0);
+        REQUIRE(result == 0);
+        REQUIRE(std::get<int12>(out[0].inst.get_args()[2]) == 8);
+    }
+}
+
+TEST_CASE("Parser - Immediate literal parsing", "[parser][immediate]") {
+    using IB = InstructionBuilder;
+
+    REQUIRE(IB::parse_immediate("42")->value == 42);
+    REQUIRE(IB::parse_immediate("-42")->value == -42);
+    REQUIRE(IB::parse_immediate("+7")->value == 7);
+    REQUIRE(IB::parse_immediate("0x7fffffffffffffff")->value == INT64_MAX);
+    REQUIRE(IB::parse_immediate("-9223372036854775808")->value == INT64_MIN);
+    REQUIRE(IB::parse_immediate("0b11")->is_unsigned_literal);
+    REQUIRE_FALSE(IB::parse_immediate("10")->is_unsigned_literal);
+    // a sign makes a hex or binary literal signed
+    REQUIRE(IB::parse_immediate("-0x10")->value == -16);
+    REQUIRE_FALSE(IB::parse_immediate("-0x10")->is_unsigned_literal);
+    REQUIRE_FALSE(IB::parse_immediate("+0b1")->is_unsigned_literal);
+
+    REQUIRE_FALSE(IB::parse_immediate(""));
+    REQUIRE_FALSE(IB::parse_immediate("-"));
+    REQUIRE_FALSE(IB::parse_immediate("0x"));
+    REQUIRE_FALSE(IB::parse_immediate("loop"));
+    REQUIRE_FALSE(IB::parse_immediate("x1"));
+    REQUIRE_FALSE(IB::parse_immediate("12abc"));
+    REQUIRE_FALSE(IB::parse_immediate("--1"));
+    REQUIRE_FALSE(IB::parse_immediate("9223372036854775808"));
+    REQUIRE_FALSE(IB::parse_immediate("08")); // invalid octal, std::stoll used to stop at the 8
+
+    // not a literal, so it's a symbol reference
+    asm_parsing::ParsedInstVec out;
+    REQUIRE(asm_parsing::parse_and_resolve("addi x1, x0, 08", out, 0) != 0);
+    REQUIRE(asm_parsing::parse_and_resolve("addi x1, x0, -0x10", out, 0) == 0);
+    REQUIRE(std::get<int12>(out[0].inst.get_args()[2]) == -16);
+}
+
+TEST_CASE("Parser - Symbol interning", "[parser][symbols]") {
+    asm_parsing::SymbolTable table;
+
+    auto fwd = table.intern("target");
+    REQUIRE(table.intern("target") == fwd);
+    REQUIRE_FALSE(table.address_of(fwd).has_value());
+
+    REQUIRE_FALSE(table.add_label("target", 0x40));
+    REQUIRE(table.address_of(fwd) == 0x40);
+    REQUIRE(table.name_of(fwd) == "target");
+    REQUIRE(table.add_label("target", 0x80).has_value());
+    REQUIRE(table.size() == 1);
 }
 
 TEST_CASE("Parser - Multiple instructions", "[parser][multi]") {
@@ -438,11 +517,9 @@ TEST_CASE("Parser - Line numbers", "[parser][lineno]") {
         bool has_line_2 = false;
         bool has_line_3 = false;
         for (const auto &inst : out) {
-            if (!inst.is_padding()) {
-                if (inst.lineno == 1) has_line_1 = true;
-                if (inst.lineno == 2) has_line_2 = true;
-                if (inst.lineno == 3) has_line_3 = true;
-            }
+            if (inst.lineno == 1) has_line_1 = true;
+            if (inst.lineno == 2) has_line_2 = true;
+            if (inst.lineno == 3) has_line_3 = true;
         }
         REQUIRE(has_line_1);
         REQUIRE(has_line_2);
@@ -710,3 +787,130 @@ TEST_CASE("Parser - C extension (compressed instructions)", "[parser][rv64c]") {
         REQUIRE_FALSE(out.empty());
     }
 }
+
+TEST_CASE("Parser - Incremental assembly", "[parser][incremental]") {
+    asm_parsing::IncrementalAssembler assembler;
+
+    auto check_matches_full_build = [&](const std::string &source) {
+        asm_parsing::ParsedInstVec expected, actual;
+        REQUIRE(asm_parsing::parse_and_resolve(source, expected, 0) == 0);
+        REQUIRE(assembler.assemble(source, actual) == 0);
+        REQUIRE(actual.size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            INFO("index " << i);
+            REQUIRE(actual[i].lineno == expected[i].lineno);
+        }
+        REQUIRE(rv64::AssemblerUnit::assemble(actual) == rv64::AssemblerUnit::assemble(expected));
+    };
+
+    std::string source =
+        "start:\n"
+        "    addi a0, zero, 10\n"
+        "loop:\n"
+        "    addi a0, a0, -1\n"
+        "    bne a0, zero, loop\n"
+        "    jal ra, end\n"
+        "    c.nop\n"
+        "end:\n"
+        "    add a1, a0, a0\n";
+
+    check_matches_full_build(source);
+    REQUIRE(assembler.stats().reparsed_lines == assembler.stats().lines);
+
+    SECTION("unchanged source re-parses nothing") {
+        check_matches_full_build(source);
+        REQUIRE(assembler.stats().reparsed_lines == 0);
+        REQUIRE(assembler.stats().resolved_instructions == 0);
+    }
+
+    SECTION("editing one line re-parses only that line") {
+        source.replace(source.find("-1"), 2, "-2");
+        check_matches_full_build(source);
+        REQUIRE(assembler.stats().reparsed_lines == 1);
+        REQUIRE(assembler.stats().resolved_instructions == 1);
+    }
+
+    SECTION("inserting an instruction re-resolves only label users") {
+        source.insert(source.find("    c.nop"), "    c.addi a0, 1\n");
+        check_matches_full_build(source);
+        REQUIRE(assembler.stats().reparsed_lines == 1);
+        // the new instruction and 'jal ra, end', whose target moved
+        REQUIRE(assembler.stats().resolved_instructions == 2);
+    }
+
+    SECTION("removing a label reports an unresolved symbol") {
+        source.erase(source.find("end:\n"), 5);
+        asm_parsing::ParsedInstVec out;
+        REQUIRE(assembler.assemble(source, out) == 2);
+        REQUIRE(out.empty());
+        REQUIRE(assembler.diagnostics().size() == 1);
+        REQUIRE(assembler.diagnostics()[0].line == 6);
+
+        source += "end:\n";
+        check_matches_full_build(source);
+    }
+
+    SECTION("syntax errors are reported per line") {
+        source.replace(source.find("c.nop"), 5, "c.nop ,,");
+        asm_parsing::ParsedInstVec out;
+        REQUIRE(assembler.assemble(source, out) == 1);
+        REQUIRE(assembler.diagnostics().size() == 1);
+        REQUIRE(assembler.diagnostics()[0].kind == BuildErrorKind::SyntaxError);
+        REQUIRE(assembler.diagnostics()[0].line == 7);
+    }
+
+    SECTION("duplicate labels fail the build like a full build") {
+        source += "loop:\n";
+        asm_parsing::ParsedInstVec expected, out;
+        REQUIRE(asm_parsing::parse_and_resolve(source, expected, 0) == 1);
+        REQUIRE(expected.empty());
+
+        REQUIRE(assembler.assemble(source, out) == 1);
+        REQUIRE(out.empty());
+        REQUIRE(assembler.diagnostics().size() == 1);
+        REQUIRE(assembler.diagnostics()[0].kind == BuildErrorKind::DuplicateLabel);
+        REQUIRE(assembler.diagnostics()[0].line == 10);
+
+        // both definitions parsed in one chunk
+        asm_parsing::IncrementalAssembler fresh;
+        REQUIRE(fresh.assemble(source, out) == 1);
+        REQUIRE(fresh.diagnostics().size() == 1);
+        REQUIRE(fresh.diagnostics()[0].line == 10);
+
+        source.erase(source.rfind("loop:\n"));
+        check_matches_full_build(source);
+        REQUIRE(assembler.diagnostics().empty());
+    }
+
+    SECTION("cancelled builds keep the previous state") {
+        std::stop_source stop;
+        stop.request_stop();
+        asm_parsing::ParsedInstVec out;
+        REQUIRE(assembler.assemble(source + "add a2, a2, a2\n", out, stop.get_token())
+                == asm_parsing::IncrementalAssembler::CANCELLED);
+        check_matches_full_build(source);
+        REQUIRE(assembler.stats().reparsed_lines == 0);
+    }
+}
+
+TEST_CASE("Parser - Consuming resolve", "[parser][resolve]") {
+    const std::string source = "start:\n addi a0, a0, 1\n c.addi a1, 2\n bne a0, a1, start\n jal ra, missing\n";
+
+    SECTION("matches the copying resolve") {
+        auto parsed = asm_parsing::parse("loop:\n addi a0, a0, 1\n c.addi a1, 2\n bne a0, a1, loop\n");
+        REQUIRE(parsed.error_code == 0);
+
+        asm_parsing::ParsedInstVec copied, consumed;
+        REQUIRE(parsed.resolve_instructions(copied, 0) == 0);
+        REQUIRE(std::move(parsed).resolve_instructions(consumed, 0) == 0);
+        REQUIRE(rv64::AssemblerUnit::assemble(consumed) == rv64::AssemblerUnit::assemble(copied));
+        REQUIRE(consumed.size() == copied.size());
+    }
+
+    SECTION("errors leave the output untouched") {
+        asm_parsing::ParsedInstVec out;
+        REQUIRE(asm_parsing::parse_and_resolve("add a0, a0, a0", out, 0) == 0);
+        REQUIRE(asm_parsing::parse_and_resolve(source, out, 0) == 2);
+        REQUIRE(out.size() == 1);
+    }
+}
@@ -1,14 +1,35 @@
+#include <parser/asm_parsing.hpp>
+#include <rv64/AssemblerUnit.hpp>
 #include <rv64/VM.hpp>
 #include <common.hpp>
 #include <ui.hpp>
+#include <algorithm>
+#include <array>
+#include <charconv>
 #include <chrono>
+#include <cmath>
+#include <fstream>
 #include <functional>
+#include <optional>
 #include <random>
 #include <iomanip>
 #include <format>
+#include <sstream>
+#include <variant>
+#include "parser.tab.hh"
+
+extern yy::parser::symbol_type yylex();
+extern void yyset_istream(std::istream *in);
 
 using namespace rv64;
 
+// Benchmark harness: every case is prepared once per N, run `warmup` times unmeasured and
+// `repetitions` times measured, timing each stage of the pipeline. The summaries can be written
+// as JSON and compared against a baseline written by an earlier version:
+//
+//   RV64_SIM_PERF_TEST --json=baseline.json
+//   RV64_SIM_PERF_TEST --compare=baseline.json   (exit code 1 on a regression)
+
 // VT100 colors
 namespace color {
     constexpr auto RESET = "\033[0m", BOLD = "\033[1m", DIM = "\033[2m";
@@ -17,13 +38,47 @@ namespace color {
     constexpr auto CLEAR_LINE = "\033[2K\r";
 }
 
+// Pipeline stages; parse drives the lexer itself, so its time includes the lex time
+enum class Stage { Lex, Parse, Resolve, Assemble, Execute, Count };
+constexpr size_t STAGE_CNT = static_cast<size_t>(Stage::Count);
+constexpr std::array<std::string_view, STAGE_CNT> STAGE_NAMES = {"lex", "parse", "resolve", "assemble", "execute"};
+constexpr std::string_view TOTAL_NAME = "total";
+
+// Statistical summary of the measured repetitions, in microseconds
+struct Summary {
+    double median = 0, p95 = 0, mean = 0, stddev = 0, min = 0;
+};
+
+struct Result {
+    std::string name;
+    int n = 0;
+    bool failed = false;
+    uint64_t instructions = 0; // executed per run
+    size_t tokens = 0;
+    std::array<Summary, STAGE_CNT> stages{};
+    Summary total;
+};
+
+// VMConfig::m_engine and m_fuse_instructions of the measured runs
+enum class Engine { Interpreter, Fused, Blocks };
+
+struct Options {
+    int warmup = 2;
+    int repetitions = 10;
+    std::vector<int> n_values = {1000, 100000};
+    std::string filter; // runs the cases whose name contains it
+    unsigned seed = 1;  // of the random operands, fixed so that runs stay comparable
+    Engine engine = Engine::Fused; // the VM default
+    std::string json_path;
+    std::string baseline_path;
+    double threshold = 10; // percent of slowdown flagged as a regression
+};
+
 // Forward declarations
 void print_section_header(std::string_view title, const char *border_color);
 void print_progress_bar(std::string_view name, int current, int total, std::string_view status);
-void print_results_table(std::string_view name, const std::vector<int> &n_vals,
-                         const std::vector<int64_t> &parse, const std::vector<int64_t> &exec,
-                         const std::vector<int64_t> &total);
-std::string format_time(int64_t us);
+void print_results_table(const Result &result);
+std::string format_time(double us);
 
 static std::mt19937 g_rng;
 
@@ -34,69 +89,136 @@ int random_int(int min, int max) {
 // Stopwatch
 struct Stopwatch {
     std::chrono::steady_clock::time_point t0;
-    int64_t elapsed_us = 0;
 
     void start() { t0 = std::chrono::steady_clock::now(); }
 
-    void stop() {
-        elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
-            std::chrono::steady_clock::now() - t0).count();
+    [[nodiscard]] double elapsed_us() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
     }
 };
 
+Summary summarize(std::vector<double> samples) {
+    Summary s;
+    if (samples.empty())
+        return s;
+    std::ranges::sort(samples);
+    size_t n = samples.size();
+    s.min = samples.front();
+    s.median = n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    s.p95 = samples[static_cast<size_t>(std::ceil(0.95 * double(n))) - 1]; // nearest rank
+    for (double x: samples)
+        s.mean += x;
+    s.mean /= double(n);
+    if (n > 1) {
+        double sum = 0;
+        for (double x: samples)
+            sum += (x - s.mean) * (x - s.mean);
+        s.stddev = std::sqrt(sum / double(n - 1));
+    }
+    return s;
+}
+
 // Test case
 struct TestCase {
     std::string_view name;
     std::string source;
     std::function<std::string(std::string_view, int)> prep;
-    std::vector<int64_t> parse_times, exec_times, total_times;
+};
 
-    void run(const std::vector<int> &n_values) {
-        parse_times.clear();
-        exec_times.clear();
-        total_times.clear();
+// One pass through the pipeline: lex, parse, resolve, assemble, load (not timed) and execute
+struct Run {
+    std::array<double, STAGE_CNT> times{};
+    uint64_t instructions = 0;
+    size_t tokens = 0;
+};
 
-        auto null_cb = [](std::string_view) {
-        };
-        ui::set_output_callback(null_cb);
-        ui::set_error_msg_callback(null_cb);
-
-        int total = static_cast<int>(n_values.size());
-        for (int i = 0; i < total; ++i) {
-            int n = n_values[i];
-            print_progress_bar(name, i, total, std::format("N={}", n));
-
-            VM vm;
-            Stopwatch sw_total, sw_parse, sw_exec;
-            asm_parsing::ParsedInstVec instructions;
-
-            sw_total.start();
-            sw_parse.start();
-            int res = asm_parsing::parse_and_resolve(prep(source, n), instructions, vm.m_cpu.get_pc());
-            sw_parse.stop();
-
-            if (res != 0) {
-                std::cout << color::CLEAR_LINE;
-                std::cerr << color::RED << "✗ Parse failed: " << color::RESET << name << " n=" << n << "\n";
-                parse_times.push_back(-1);
-                exec_times.push_back(-1);
-                total_times.push_back(-1);
-                continue;
-            }
+// Runs only the lexer over the source, to measure it apart from the parser that drives it
+size_t count_tokens(const std::string &source) {
+    std::stringstream ss(source);
+    yyset_istream(&ss);
+    size_t count = 0;
+    while (yylex().kind() != yy::parser::symbol_kind::S_YYEOF)
+        ++count;
+    return count;
+}
 
-            vm.load_program(instructions);
-            sw_exec.start();
-            vm.run_until_stop();
-            sw_exec.stop();
-            sw_total.stop();
+std::optional<Run> run_once(const std::string &source, Engine engine) {
+    Run run;
+    Stopwatch sw;
+    auto time = [&](Stage stage) { run.times[static_cast<size_t>(stage)] = sw.elapsed_us(); };
+
+    sw.start();
+    run.tokens = count_tokens(source);
+    time(Stage::Lex);
+
+    sw.start();
+    auto parsed = asm_parsing::parse(source, 1, false);
+    time(Stage::Parse);
+    if (parsed.error_code != 0)
+        return std::nullopt;
+
+    VMConfig config{};
+    config.m_engine = engine == Engine::Blocks ? ExecEngine::Blocks : ExecEngine::Interpreter;
+    config.m_fuse_instructions = engine != Engine::Interpreter;
+    VM vm(config);
+    asm_parsing::ParsedInstVec instructions;
+    sw.start();
+    int res = std::move(parsed).resolve_instructions(instructions, vm.m_cpu.get_pc());
+    time(Stage::Resolve);
+    if (res != 0)
+        return std::nullopt;
+
+    sw.start();
+    auto bytecode = AssemblerUnit::assemble(instructions, config.m_mem_layout.endianness);
+    time(Stage::Assemble);
+
+    vm.load_program(std::move(instructions), bytecode);
+    sw.start();
+    vm.run_until_stop();
+    time(Stage::Execute);
+    if (vm.get_state() != VMState::Finished)
+        return std::nullopt;
+    run.instructions = vm.get_instruction_count();
+    return run;
+}
 
-            parse_times.push_back(sw_parse.elapsed_us);
-            exec_times.push_back(sw_exec.elapsed_us);
-            total_times.push_back(sw_total.elapsed_us);
+Result run_benchmark(const TestCase &test, int n, const Options &opt, int index, int count) {
+    Result result{.name = std::string(test.name), .n = n};
+    std::string source = test.prep(test.source, n);
+
+    std::array<std::vector<double>, STAGE_CNT> samples;
+    std::vector<double> totals;
+    int runs = opt.warmup + opt.repetitions;
+    for (int i = 0; i < runs; ++i) {
+        bool warming = i < opt.warmup;
+        print_progress_bar(test.name, index, count, warming
+                               ? std::format("N={} warm-up {}/{}", n, i + 1, opt.warmup)
+                               : std::format("N={} run {}/{}", n, i - opt.warmup + 1, opt.repetitions));
+        auto run = run_once(source, opt.engine);
+        if (!run) {
+            std::cout << color::CLEAR_LINE;
+            std::cerr << color::RED << "✗ Failed: " << color::RESET << test.name << " n=" << n << "\n";
+            result.failed = true;
+            return result;
+        }
+        result.instructions = run->instructions;
+        result.tokens = run->tokens;
+        if (warming)
+            continue;
+        double total = 0;
+        for (size_t s = 0; s < STAGE_CNT; ++s) {
+            samples[s].push_back(run->times[s]);
+            // the lexer runs again inside the parser
+            if (s != static_cast<size_t>(Stage::Lex))
+                total += run->times[s];
         }
-        std::cout << color::CLEAR_LINE << std::flush;
+        totals.push_back(total);
     }
-};
+    for (size_t s = 0; s < STAGE_CNT; ++s)
+        result.stages[s] = summarize(std::move(samples[s]));
+    result.total = summarize(std::move(totals));
+    return result;
+}
 
 // Source prep helpers
 std::string load_imm_asm(int val) {
@@ -143,7 +265,7 @@ std::vector<TestCase> create_tests() {
         addi a0, zero, 10
         and x1, x1, sp
         )",
-            prep_repeat, {}, {}, {}
+            prep_repeat
         },
 
         {
@@ -157,7 +279,7 @@ std::vector<TestCase> create_tests() {
         addi a0, zero, 10
         ecall
         )",
-            prep_load_n, {}, {}, {}
+            prep_load_n
         },
 
         {
@@ -184,7 +306,7 @@ std::vector<TestCase> create_tests() {
         addi a0, zero, 10
         ecall
         )",
-            prep_muldiv, {}, {}, {}
+            prep_muldiv
         },
 
         {
@@ -207,7 +329,7 @@ std::vector<TestCase> create_tests() {
         addi a0, zero, 10
         ecall
         )",
-            prep_load_n, {}, {}, {}
+            prep_load_n
         },
 
         {
@@ -234,40 +356,393 @@ std::vector<TestCase> create_tests() {
         addi a0, zero, 10
         ecall
         )",
-            prep_load_n, {}, {}, {}
+            prep_load_n
         }
     };
 }
 
-int main() {
-    unsigned seed = std::random_device()();
-    g_rng.seed(seed);
+// ============================================================================
+// JSON output and baseline comparison
+// ============================================================================
+
+std::string_view engine_name(Engine engine) {
+    switch (engine) {
+        case Engine::Interpreter: return "interpreter";
+        case Engine::Fused: return "fused";
+        default: return "blocks";
+    }
+}
+
+std::string json_string(std::string_view str) {
+    std::string out = "\"";
+    for (char ch: str) {
+        if (ch == '"' || ch == '\\')
+            out += '\\';
+        out += ch;
+    }
+    return out + "\"";
+}
+
+std::string summary_json(const Summary &s) {
+    return std::format(R"({{"median_us": {:.3f}, "p95_us": {:.3f}, "mean_us": {:.3f}, "stddev_us": {:.3f}, "min_us": {:.3f}}})",
+                       s.median, s.p95, s.mean, s.stddev, s.min);
+}
+
+std::string to_json(const std::vector<Result> &results, const Options &opt) {
+    std::string out = std::format(
+        "{{\n  \"schema\": 1,\n  \"config\": {{\"warmup\": {}, \"repetitions\": {}, \"seed\": {}, \"engine\": \"{}\"}},\n"
+        "  \"benchmarks\": [", opt.warmup, opt.repetitions, opt.seed, engine_name(opt.engine));
+    bool first = true;
+    for (const auto &r: results) {
+        if (r.failed)
+            continue;
+        out += std::format("{}\n    {{\n      \"name\": {},\n      \"n\": {},\n      \"instructions\": {},\n"
+                           "      \"tokens\": {},\n      \"stages\": {{",
+                           first ? "" : ",", json_string(r.name), r.n, r.instructions, r.tokens);
+        for (size_t s = 0; s < STAGE_CNT; ++s)
+            out += std::format("\n        \"{}\": {},", STAGE_NAMES[s], summary_json(r.stages[s]));
+        out += std::format("\n        \"{}\": {}\n      }}\n    }}", TOTAL_NAME, summary_json(r.total));
+        first = false;
+    }
+    out += first ? "]\n}\n" : "\n  ]\n}\n";
+    return out;
+}
+
+// Minimal JSON value, enough to read the files written by to_json
+struct Json {
+    using Array = std::vector<Json>;
+    using Object = std::vector<std::pair<std::string, Json>>;
+    std::variant<std::monostate, bool, double, std::string, Array, Object> value;
+
+    [[nodiscard]] const Json *find(std::string_view key) const {
+        if (auto *obj = std::get_if<Object>(&value)) {
+            for (const auto &[k, v]: *obj)
+                if (k == key) return &v;
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] std::optional<double> number(std::string_view key) const {
+        auto *v = find(key);
+        if (auto *d = v ? std::get_if<double>(&v->value) : nullptr)
+            return *d;
+        return std::nullopt;
+    }
+
+    [[nodiscard]] std::string string(std::string_view key) const {
+        auto *v = find(key);
+        if (auto *str = v ? std::get_if<std::string>(&v->value) : nullptr)
+            return *str;
+        return {};
+    }
+};
+
+class JsonReader {
+public:
+    explicit JsonReader(std::string_view text) : m_text(text) {}
+
+    // @return nullopt on a syntax error
+    std::optional<Json> read() {
+        auto value = read_value();
+        skip_space();
+        if (m_pos != m_text.size())
+            return std::nullopt;
+        return value;
+    }
+
+private:
+    void skip_space() {
+        while (m_pos < m_text.size() && std::isspace(static_cast<unsigned char>(m_text[m_pos])))
+            ++m_pos;
+    }
+
+    bool consume(char ch) {
+        skip_space();
+        if (m_pos < m_text.size() && m_text[m_pos] == ch) {
+            ++m_pos;
+            return true;
+        }
+        return false;
+    }
+
+    bool consume_word(std::string_view word) {
+        if (m_text.substr(m_pos, word.size()) != word)
+            return false;
+        m_pos += word.size();
+        return true;
+    }
+
+    std::optional<std::string> read_string() {
+        if (!consume('"'))
+            return std::nullopt;
+        std::string out;
+        while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+            if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size())
+                ++m_pos;
+            out += m_text[m_pos++];
+        }
+        if (!consume('"'))
+            return std::nullopt;
+        return out;
+    }
+
+    std::optional<Json> read_value() {
+        skip_space();
+        if (m_pos >= m_text.size())
+            return std::nullopt;
+        char ch = m_text[m_pos];
+        if (ch == '{') {
+            ++m_pos;
+            Json::Object obj;
+            if (consume('}'))
+                return Json{std::move(obj)};
+            do {
+                auto key = read_string();
+                if (!key || !consume(':'))
+                    return std::nullopt;
+                auto value = read_value();
+                if (!value)
+                    return std::nullopt;
+                obj.emplace_back(std::move(*key), std::move(*value));
+            } while (consume(','));
+            return consume('}') ? std::optional(Json{std::move(obj)}) : std::nullopt;
+        }
+        if (ch == '[') {
+            ++m_pos;
+            Json::Array arr;
+            if (consume(']'))
+                return Json{std::move(arr)};
+            do {
+                auto value = read_value();
+                if (!value)
+                    return std::nullopt;
+                arr.push_back(std::move(*value));
+            } while (consume(','));
+            return consume(']') ? std::optional(Json{std::move(arr)}) : std::nullopt;
+        }
+        if (ch == '"') {
+            auto str = read_string();
+            return str ? std::optional(Json{std::move(*str)}) : std::nullopt;
+        }
+        if (consume_word("true")) return Json{true};
+        if (consume_word("false")) return Json{false};
+        if (consume_word("null")) return Json{};
+
+        double number = 0;
+        auto [ptr, ec] = std::from_chars(m_text.data() + m_pos, m_text.data() + m_text.size(), number);
+        if (ec != std::errc())
+            return std::nullopt;
+        m_pos = static_cast<size_t>(ptr - m_text.data());
+        return Json{number};
+    }
+
+    std::string_view m_text;
+    size_t m_pos = 0;
+};
+
+// Differences below this are timer noise, never flagged
+constexpr double NOISE_FLOOR_US = 20;
+
+// @return number of regressions: stages whose median is slower than the baseline's by more than
+// the threshold and above the baseline's p95 (outside its spread)
+int compare_with_baseline(const std::vector<Result> &results, const Json &baseline, const Options &opt) {
+    print_section_header("Comparison with " + opt.baseline_path, color::MAGENTA);
+    if (auto *config = baseline.find("config")) {
+        if (config->string("engine") != engine_name(opt.engine) || config->number("seed") != double(opt.seed))
+            std::cout << color::YELLOW << "⚠ The baseline was measured with a different engine or seed"
+                      << color::RESET << "\n";
+    }
+    const auto *benchmarks = baseline.find("benchmarks");
+    const auto *list = benchmarks ? std::get_if<Json::Array>(&benchmarks->value) : nullptr;
+
+    int regressions = 0;
+    std::cout << color::BOLD << std::format("{:<44} {:>9} {:>12} {:>12} {:>9}", "Benchmark", "Stage",
+                                            "Baseline", "Current", "Change") << color::RESET << "\n";
+    for (const auto &r: results) {
+        if (r.failed)
+            continue;
+        const Json *base = nullptr;
+        for (size_t i = 0; list && i < list->size(); ++i) {
+            if ((*list)[i].string("name") == r.name && (*list)[i].number("n") == double(r.n))
+                base = &(*list)[i];
+        }
+        std::string label = std::format("{} N={}", r.name, r.n);
+        if (!base) {
+            std::cout << color::DIM << std::format("{:<44} not in the baseline", label) << color::RESET << "\n";
+            continue;
+        }
+        const auto *stages = base->find("stages");
+        for (size_t s = 0; s <= STAGE_CNT; ++s) {
+            auto name = s < STAGE_CNT ? STAGE_NAMES[s] : TOTAL_NAME;
+            const auto &cur = s < STAGE_CNT ? r.stages[s] : r.total;
+            const auto *stage = stages ? stages->find(name) : nullptr;
+            auto base_median = stage ? stage->number("median_us") : std::nullopt;
+            auto base_p95 = stage ? stage->number("p95_us") : std::nullopt;
+            if (!base_median || !base_p95)
+                continue;
+
+            double change = *base_median > 0 ? (cur.median / *base_median - 1.0) * 100.0 : 0.0;
+            bool significant = std::abs(cur.median - *base_median) >= NOISE_FLOOR_US;
+            const char *col = color::RESET;
+            std::string_view status;
+            if (significant && change > opt.threshold && cur.median > *base_p95) {
+                col = color::RED;
+                status = "REGRESSION";
+                ++regressions;
+            } else if (significant && change < -opt.threshold && cur.p95 < *base_median) {
+                col = color::GREEN;
+                status = "improved";
+            }
+            std::cout << col << std::format("{:<44} {:>9} {:>12} {:>12} {:>+8.1f}% {}", label, name,
+                                            format_time(*base_median), format_time(cur.median), change, status)
+                      << color::RESET << "\n";
+            label.clear();
+        }
+    }
+    std::cout << (regressions ? color::RED : color::GREEN)
+              << std::format("{} regression(s) beyond {:.1f}%", regressions, opt.threshold) << color::RESET << "\n";
+    return regressions;
+}
+
+// ============================================================================
+// Command line
+// ============================================================================
+
+constexpr std::string_view USAGE = R"(usage: RV64_SIM_PERF_TEST [options]
+  --warmup=N          unmeasured runs per benchmark (default 2)
+  --repetitions=N     measured runs per benchmark (default 10)
+  --n=N,N,...         sizes of every case (default 1000,100000)
+  --filter=TEXT       only the cases whose name contains TEXT
+  --seed=N            seed of the random operands (default 1)
+  --engine=NAME       interpreter, fused (default) or blocks
+  --json=FILE         write the results as JSON
+  --compare=FILE      compare with a baseline written by --json, exit code 1 on a regression
+  --threshold=PCT     slowdown flagged as a regression (default 10)
+)";
+
+std::optional<Options> parse_options(int argc, char **argv) {
+    Options opt;
+    auto to_int = [](std::string_view str, auto &out) {
+        auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), out);
+        return ec == std::errc() && ptr == str.data() + str.size();
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto eq = arg.find('=');
+        std::string_view key = arg.substr(0, eq);
+        std::string_view value = eq == std::string_view::npos ? "" : arg.substr(eq + 1);
+        bool ok = true;
+        if (key == "--warmup") {
+            ok = to_int(value, opt.warmup) && opt.warmup >= 0;
+        } else if (key == "--repetitions") {
+            ok = to_int(value, opt.repetitions) && opt.repetitions > 0;
+        } else if (key == "--n") {
+            opt.n_values.clear();
+            for (size_t pos = 0; ok && pos <= value.size();) {
+                size_t end = std::min(value.find(',', pos), value.size());
+                int n = 0;
+                ok = to_int(value.substr(pos, end - pos), n) && n > 0;
+                opt.n_values.push_back(n);
+                pos = end + 1;
+            }
+        } else if (key == "--filter") {
+            opt.filter = value;
+        } else if (key == "--seed") {
+            ok = to_int(value, opt.seed);
+        } else if (key == "--engine") {
+            if (value == "interpreter") opt.engine = Engine::Interpreter;
+            else if (value == "blocks") opt.engine = Engine::Blocks;
+            else ok = value == "fused";
+        } else if (key == "--json") {
+            opt.json_path = value;
+        } else if (key == "--compare") {
+            opt.baseline_path = value;
+        } else if (key == "--threshold") {
+            auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), opt.threshold);
+            ok = ec == std::errc() && opt.threshold >= 0;
+        } else {
+            ok = false;
+        }
+        if (!ok || (value.empty() && key != "--filter")) {
+            std::cerr << "invalid option: " << arg << "\n" << USAGE;
+            return std::nullopt;
+        }
+    }
+    return opt;
+}
+
+int main(int argc, char **argv) {
+    auto options = parse_options(argc, argv);
+    if (!options)
+        return 2;
+    const Options &opt = *options;
+
+    std::optional<Json> baseline;
+    if (!opt.baseline_path.empty()) {
+        std::ifstream file(opt.baseline_path);
+        std::stringstream text;
+        text << file.rdbuf();
+        if (file)
+            baseline = JsonReader(text.str()).read();
+        if (!baseline) {
+            std::cerr << color::RED << "✗ Cannot read the baseline " << opt.baseline_path << color::RESET << "\n";
+            return 2;
+        }
+    }
 
     print_section_header("RV64 Simulator Performance Test", color::BLUE);
-    std::cout << color::DIM << "Random seed: " << seed << color::RESET << "\n";
+    std::cout << color::DIM << std::format("Engine: {}, random seed: {}, {} warm-up and {} measured runs",
+                                           engine_name(opt.engine), opt.seed, opt.warmup, opt.repetitions)
+              << color::RESET << "\n";
+
+    std::vector<TestCase> tests;
+    for (auto &t: create_tests()) {
+        if (t.name.find(opt.filter) != std::string_view::npos)
+            tests.push_back(std::move(t));
+    }
 
-    auto tests = create_tests();
-    std::vector n_values = {10, 100, 1000, 10000, 100000};
+    // the program output would be timed with the execution
+    ui::set_muted(true);
+    std::vector<Result> results;
+    int count = static_cast<int>(tests.size() * opt.n_values.size());
+    for (const auto &t: tests) {
+        for (int n: opt.n_values) {
+            // the same operands for every N and every run of the suite
+            g_rng.seed(opt.seed);
+            results.push_back(run_benchmark(t, n, opt, static_cast<int>(results.size()), count));
+            std::cout << color::CLEAR_LINE;
+            if (!results.back().failed)
+                print_results_table(results.back());
+        }
+    }
 
-    for (auto &t: tests) {
-        t.run(n_values);
-        print_results_table(t.name, n_values, t.parse_times, t.exec_times, t.total_times);
+    int failed = 0;
+    std::array<double, STAGE_CNT> stage_totals{};
+    for (const auto &r: results) {
+        failed += r.failed;
+        for (size_t s = 0; s < STAGE_CNT && !r.failed; ++s)
+            stage_totals[s] += r.stages[s].median;
     }
 
-    int64_t total_parse = 0, total_exec = 0;
-    for (const auto &t: tests)
-        for (size_t i = 0; i < t.parse_times.size(); ++i) {
-            if (t.parse_times[i] > 0) total_parse += t.parse_times[i];
-            if (t.exec_times[i] > 0) total_exec += t.exec_times[i];
+    print_section_header("Summary (sum of medians)", color::GREEN);
+    for (size_t s = 0; s < STAGE_CNT; ++s)
+        std::cout << std::format("{}{:<10}{}{}{}\n", color::YELLOW, STAGE_NAMES[s], color::BOLD,
+                                 format_time(stage_totals[s]), color::RESET);
+    if (failed)
+        std::cout << color::RED << std::format("{} benchmark(s) failed", failed) << color::RESET << "\n";
+
+    if (!opt.json_path.empty()) {
+        std::ofstream file(opt.json_path);
+        file << to_json(results, opt);
+        if (!file) {
+            std::cerr << color::RED << "✗ Cannot write " << opt.json_path << color::RESET << "\n";
+            return 2;
         }
+        std::cout << color::DIM << "Results written to " << opt.json_path << color::RESET << "\n";
+    }
 
-    print_section_header("Summary", color::GREEN);
-    std::cout << std::format("{}Total parsing time:   {}{}{}\n", color::YELLOW, color::BOLD, format_time(total_parse),
-                             color::RESET)
-            << std::format("{}Total execution time: {}{}{}\n", color::GREEN, color::BOLD, format_time(total_exec),
-                           color::RESET)
-            << std::format("{}Grand total:          {}{}{}\n", color::MAGENTA, color::BOLD,
-                           format_time(total_parse + total_exec), color::RESET);
+    int regressions = baseline ? compare_with_baseline(results, *baseline, opt) : 0;
+    return regressions || failed ? 1 : 0;
 }
 
 // ============================================================================
@@ -299,25 +774,25 @@ void print_progress_bar(std::string_view name, int current, int total, std::stri
             << color::RESET << " " << color::DIM << status << color::RESET << std::flush;
 }
 
-std::string format_time(int64_t us) {
+std::string format_time(double us) {
     if (us < 0) return "ERROR";
-    if (us < 1000) return std::to_string(us) + " us";
+    if (us < 1000) return std::format("{:.1f} us", us);
     if (us < 1000000) return std::format("{:.2f} ms", us / 1000.0);
     return std::format("{:.2f} s", us / 1000000.0);
 }
 
-void print_results_table(std::string_view name, const std::vector<int> &n_vals,
-                         const std::vector<int64_t> &parse, const std::vector<int64_t> &exec,
-                         const std::vector<int64_t> &total) {
+void print_results_table(const Result &result) {
+    std::string title = std::format("{} - N={} ({} instructions, {} tokens)", result.name, result.n,
+                                    result.instructions, result.tokens);
     std::cout << "\n" << color::CYAN
             << "╔══════════════════════════════════════════════════════════════════╗\n"
-            << "║ " << color::BOLD << color::WHITE << std::left << std::setw(64) << name
+            << "║ " << color::BOLD << color::WHITE << std::left << std::setw(64) << title
             << color::RESET << color::CYAN << " ║\n"
             << "╚══════════════════════════════════════════════════════════════════╝" << color::RESET << "\n";
 
-    constexpr std::array W = {10, 12, 12, 12};
-    constexpr std::array HDR = {"N", "Parse", "Execute", "Total"};
-    constexpr std::array COL = {color::CYAN, color::YELLOW, color::GREEN, color::MAGENTA};
+    constexpr std::array W = {10, 11, 11, 11, 11};
+    constexpr std::array HDR = {"Stage", "Median", "p95", "Stddev", "Min"};
+    constexpr std::array COL = {color::CYAN, color::GREEN, color::YELLOW, color::DIM, color::MAGENTA};
 
     auto sep = [&] {
         std::cout << color::DIM << "+";
@@ -327,24 +802,23 @@ void print_results_table(std::string_view name, const std::vector<int> &n_vals,
 
     sep();
     std::cout << color::DIM << "|" << color::RESET;
-    for (size_t i = 0; i < 4; ++i)
+    for (size_t i = 0; i < W.size(); ++i)
         std::cout << color::BOLD << " " << std::setw(W[i]) << HDR[i] << color::RESET << color::DIM << " |" <<
                 color::RESET;
     std::cout << "\n";
     sep();
 
-    for (size_t i = 0; i < n_vals.size(); ++i) {
+    for (size_t s = 0; s <= STAGE_CNT; ++s) {
+        if (s == STAGE_CNT) sep();
+        const auto &sum = s < STAGE_CNT ? result.stages[s] : result.total;
         std::array cells = {
-            std::to_string(n_vals[i]), format_time(parse[i]),
-            format_time(exec[i]), format_time(total[i])
+            std::string(s < STAGE_CNT ? STAGE_NAMES[s] : TOTAL_NAME), format_time(sum.median),
+            format_time(sum.p95), format_time(sum.stddev), format_time(sum.min)
         };
-        bool err = parse[i] < 0 || exec[i] < 0;
 
         std::cout << color::DIM << "|" << color::RESET;
-        for (size_t j = 0; j < 4; ++j) {
-            auto c = (err && cells[j] == "ERROR") ? color::RED : COL[j];
-            std::cout << c << " " << std::setw(W[j]) << cells[j] << color::RESET << color::DIM << " |" << color::RESET;
-        }
+        for (size_t j = 0; j < cells.size(); ++j)
+            std::cout << COL[j] << " " << std::setw(W[j]) << cells[j] << color::RESET << color::DIM << " |" << color::RESET;
         std::cout << "\n";
     }
     sep();
@@ -0,0 +1,138 @@
+#include <catch2/catch_test_macros.hpp>
+#include <rv64/PipelineModel.hpp>
+#include <rv64/VM.hpp>
+#include <memory>
+
+#include "test_helpers.hpp"
+
+using namespace rv64;
+
+namespace {
+    using Stall = PipelineModel::Stall;
+
+    struct Models {
+        bool caches = false;
+        bool branches = false;
+    };
+
+    std::unique_ptr<VM> run(const std::string &source, Models models = {}, ExecEngine engine = ExecEngine::Blocks) {
+        VMConfig config{};
+        config.m_engine = engine;
+        if (models.caches)
+            config.m_cache_model = CacheHierarchy::Config{};
+        if (models.branches)
+            config.m_branch_model = BranchModel::Config{};
+        config.m_pipeline_model = PipelineModel::Config{};
+        auto vm = run_program(source, config);
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE(vm->m_pipeline_model);
+        return vm;
+    }
+
+    uint64_t stalls(const VM &vm, Stall stall) {
+        return vm.m_pipeline_model->total().stalls[static_cast<size_t>(stall)];
+    }
+}
+
+TEST_CASE("Pipeline model", "[pipeline]") {
+    SECTION("straight-line code retires one instruction per cycle") {
+        auto vm = run("addi x5, x0, 1\naddi x6, x5, 2\nadd x7, x5, x6");
+        const auto &total = vm->m_pipeline_model->total();
+        REQUIRE(total.instructions == 3);
+        REQUIRE(total.cycles == 3);
+        REQUIRE(vm->m_pipeline_model->cycles() == 3 + PipelineModel::PIPELINE_FILL);
+        REQUIRE(vm->get_cycle_count() == vm->m_pipeline_model->cycles());
+    }
+
+    SECTION("load-use hazards") {
+        auto vm = run(R"(
+            addi x2, x2, -16
+            sd x2, 8(x2)
+            ld x5, 8(x2)
+            addi x6, x5, 1
+            ld x7, 8(x2)
+            addi x8, x0, 1
+            addi x9, x7, 1
+            c.ldsp x10, 1
+            c.add x11, x10
+        )");
+        REQUIRE(stalls(*vm, Stall::LoadUse) == 2);
+        REQUIRE(vm->m_pipeline_model->total().cycles == 9 + 2);
+    }
+
+    SECTION("multiply and divide latency") {
+        auto vm = run("addi x5, x0, 6\naddi x6, x0, 7\nmul x7, x5, x6\ndiv x8, x7, x5\nremw x9, x7, x6");
+        PipelineModel::Config config{};
+        REQUIRE(stalls(*vm, Stall::MulDiv) == (config.mul_latency - 1) + 2 * (config.div_latency - 1));
+        REQUIRE(vm->m_cpu.reg(8) == 7);
+    }
+
+    const std::string loop = R"(
+        addi x5, x0, 0
+        addi x6, x0, 100
+    loop:
+        addi x5, x5, 1
+        blt x5, x6, loop
+        jal x1, func
+        beq x0, x0, end
+    func:
+        jalr x0, x1, 0
+    end:
+    )";
+
+    SECTION("without a branch model every taken transfer flushes") {
+        auto vm = run(loop);
+        PipelineModel::Config config{};
+        // 99 taken loop branches, jalr and the final beq; jal costs the shorter jump penalty
+        REQUIRE(stalls(*vm, Stall::Control) == 101 * config.branch_penalty + config.jump_penalty);
+    }
+
+    SECTION("a branch model only charges mispredictions") {
+        auto plain = run(loop);
+        auto predicted = run(loop, {.branches = true});
+        REQUIRE(stalls(*predicted, Stall::Control) < stalls(*plain, Stall::Control) / 4);
+        REQUIRE(predicted->m_pipeline_model->total().instructions == plain->m_pipeline_model->total().instructions);
+    }
+
+    SECTION("cache misses") {
+        auto vm = run(R"(
+            ld x5, -8(x2)
+            ld x6, -1032(x2)
+            ld x7, -8(x2)
+        )", {.caches = true});
+        PipelineModel::Config config{};
+        REQUIRE(stalls(*vm, Stall::Fetch) == config.l2_latency);
+        REQUIRE(stalls(*vm, Stall::Data) == 2 * config.l2_latency);
+        // the code line and both data lines come from memory
+        REQUIRE(stalls(*vm, Stall::Memory) == 3 * config.memory_latency);
+    }
+
+    SECTION("engines agree") {
+        auto blocks = run(loop, {.caches = true, .branches = true});
+        auto interpreter = run(loop, {.caches = true, .branches = true}, ExecEngine::Interpreter);
+        REQUIRE(blocks->get_cycle_count() == interpreter->get_cycle_count());
+    }
+
+    SECTION("cycle counter ecall") {
+        auto vm = run(R"(
+            addi x5, x0, 3
+            mul x6, x5, x5
+            addi x10, x0, 101
+            ecall
+        )");
+        // mul, plus the instructions before the ecall and the pipeline fill
+        REQUIRE(vm->m_cpu.reg(10) == 3 + 2 + PipelineModel::PIPELINE_FILL);
+
+        auto plain = run_program("addi x5, x0, 3\naddi x10, x0, 101\necall");
+        REQUIRE(plain->m_cpu.reg(10) == 2);
+    }
+
+    SECTION("report") {
+        auto vm = run(loop);
+        auto report = vm->m_pipeline_model->report(*vm);
+        REQUIRE(report.find("CPI") != std::string::npos);
+        REQUIRE(report.find("control") != std::string::npos);
+        REQUIRE(report.find("line 5") != std::string::npos);
+        REQUIRE(vm->m_pipeline_model->instruction_timing().size() >= 7);
+    }
+}
@@ -0,0 +1,202 @@
+#include <catch2/catch_all.hpp>
+#include <ProgramCache.hpp>
+#include <rv64/VM.hpp>
+#include <rv64/AssemblerUnit.hpp>
+
+#include <format>
+#include <fstream>
+#include <thread>
+
+namespace {
+    struct TempCache {
+        ProgramCache cache{std::filesystem::temp_directory_path() / "rv64sim-cache-test"};
+
+        TempCache() { cache.clear(); }
+        ~TempCache() {
+            std::error_code ec;
+            std::filesystem::remove_all(cache.directory(), ec);
+        }
+    };
+
+    constexpr auto SOURCE = R"(
+start:
+    addi a0, zero, 5
+    c.li a1, 3
+loop:
+    add a0, a0, a1
+    addi a1, a1, -1
+    bne a1, zero, loop
+    lui t0, 0x12345
+    jal ra, end
+end:
+    c.addi sp, -16
+)";
+}
+
+TEST_CASE("ProgramCache - round trip", "[cache]") {
+    TempCache tmp;
+    constexpr uint64_t data_offset = 0;
+    constexpr auto endian = std::endian::little;
+
+    REQUIRE_FALSE(tmp.cache.load(SOURCE, data_offset, endian));
+
+    auto parsed = asm_parsing::parse(SOURCE);
+    REQUIRE(parsed.error_code == 0);
+    asm_parsing::ParsedInstVec insts;
+    REQUIRE(parsed.resolve_instructions(insts, data_offset) == 0);
+    REQUIRE(tmp.cache.store(SOURCE, data_offset, endian, insts, parsed.symbol_table));
+
+    auto cached = tmp.cache.load(SOURCE, data_offset, endian);
+    REQUIRE(cached);
+
+    SECTION("instructions and line table match") {
+        auto loaded = cached->instructions();
+        REQUIRE(loaded.size() == insts.size());
+        for (size_t i = 0; i < insts.size(); ++i) {
+            INFO("index " << i);
+            REQUIRE(loaded[i].lineno == insts[i].lineno);
+            REQUIRE(loaded[i].inst.get_prototype().id == insts[i].inst.get_prototype().id);
+        }
+    }
+
+    SECTION("bytecode matches a fresh assembly") {
+        auto expected = rv64::AssemblerUnit::assemble(insts, endian);
+        auto code = cached->bytecode();
+        REQUIRE(std::equal(code.begin(), code.end(), expected.begin(), expected.end()));
+        REQUIRE(rv64::AssemblerUnit::assemble(cached->instructions(), endian) == expected);
+    }
+
+    SECTION("symbol table is preserved") {
+        auto symbols = cached->symbols();
+        REQUIRE(symbols.size() == parsed.symbol_table.size());
+        auto loop = std::ranges::find(symbols, "loop"sv, &CachedProgram::SymbolView::name);
+        REQUIRE(loop != symbols.end());
+        REQUIRE(loop->defined);
+        REQUIRE(loop->address == 6);
+    }
+
+    SECTION("cached program runs like the original") {
+        rv64::VM vm;
+        vm.load_program(cached->instructions(), cached->bytecode());
+        vm.run_until_stop();
+        REQUIRE(vm.get_state() == rv64::VMState::Finished);
+        REQUIRE(vm.m_cpu.reg(10).val() == 11);
+        REQUIRE(vm.m_cpu.reg(5).val() == 0x12345000);
+    }
+}
+
+TEST_CASE("ProgramCache - key covers source and layout", "[cache]") {
+    TempCache tmp;
+    auto parsed = asm_parsing::parse(SOURCE);
+    asm_parsing::ParsedInstVec insts;
+    REQUIRE(parsed.resolve_instructions(insts, 0) == 0);
+    REQUIRE(tmp.cache.store(SOURCE, 0, std::endian::little, insts, parsed.symbol_table));
+
+    REQUIRE(tmp.cache.load(SOURCE, 0, std::endian::little));
+    REQUIRE_FALSE(tmp.cache.load(std::string(SOURCE) + "\n", 0, std::endian::little));
+    REQUIRE_FALSE(tmp.cache.load(SOURCE, 0x1000, std::endian::little));
+    REQUIRE_FALSE(tmp.cache.load(SOURCE, 0, std::endian::big));
+
+    REQUIRE(ProgramCache::make_key(SOURCE, 0, std::endian::little)
+            != ProgramCache::make_key(SOURCE, 0, std::endian::big));
+}
+
+TEST_CASE("ProgramCache - images are checked against the source", "[cache]") {
+    TempCache tmp;
+    auto parsed = asm_parsing::parse(SOURCE);
+    asm_parsing::ParsedInstVec insts;
+    REQUIRE(parsed.resolve_instructions(insts, 0) == 0);
+    REQUIRE(tmp.cache.store(SOURCE, 0, std::endian::little, insts, parsed.symbol_table));
+
+    // an image under the key of another source of the same size, as after a hash collision
+    std::string other(SOURCE);
+    other[other.find("5")] = '6';
+    auto key_path = [&](std::string_view source) {
+        return tmp.cache.directory() / std::format("{:016x}.rv64c", ProgramCache::make_key(source, 0, std::endian::little));
+    };
+    std::filesystem::copy_file(key_path(SOURCE), key_path(other));
+    REQUIRE(tmp.cache.load(SOURCE, 0, std::endian::little));
+    REQUIRE_FALSE(tmp.cache.load(other, 0, std::endian::little));
+}
+
+TEST_CASE("ProgramCache - concurrent stores", "[cache]") {
+    TempCache tmp;
+    auto parsed = asm_parsing::parse(SOURCE);
+    asm_parsing::ParsedInstVec insts;
+    REQUIRE(parsed.resolve_instructions(insts, 0) == 0);
+
+    std::vector<std::thread> writers;
+    std::atomic<int> stored = 0;
+    for (int i = 0; i < 8; ++i) {
+        writers.emplace_back([&] {
+            for (int j = 0; j < 10; ++j)
+                stored += tmp.cache.store(SOURCE, 0, std::endian::little, insts, parsed.symbol_table);
+        });
+    }
+    for (auto &writer: writers)
+        writer.join();
+    REQUIRE(stored == 80);
+    REQUIRE(tmp.cache.load(SOURCE, 0, std::endian::little));
+    // no temporary files are left behind
+    REQUIRE(std::distance(std::filesystem::directory_iterator(tmp.cache.directory()), {}) == 1);
+}
+
+#ifndef _WIN32
+TEST_CASE("ProgramCache - the directory must be private", "[cache]") {
+    TempCache tmp;
+    auto parsed = asm_parsing::parse(SOURCE);
+    asm_parsing::ParsedInstVec insts;
+    REQUIRE(parsed.resolve_instructions(insts, 0) == 0);
+    REQUIRE(tmp.cache.store(SOURCE, 0, std::endian::little, insts, parsed.symbol_table));
+
+    namespace fs = std::filesystem;
+    REQUIRE((fs::status(tmp.cache.directory()).permissions() & fs::perms::all) == fs::perms::owner_all);
+
+    fs::permissions(tmp.cache.directory(), fs::perms::others_write, fs::perm_options::add);
+    REQUIRE_FALSE(tmp.cache.load(SOURCE, 0, std::endian::little));
+    REQUIRE_FALSE(tmp.cache.store(SOURCE, 0, std::endian::little, insts, parsed.symbol_table));
+}
+
+TEST_CASE("ProgramCache - default directory is per user", "[cache]") {
+    const char *xdg = std::getenv("XDG_CACHE_HOME");
+    std::string saved = xdg ? xdg : "";
+
+    setenv("XDG_CACHE_HOME", "/home/someone/.cache", 1);
+    REQUIRE(ProgramCache::default_directory() == "/home/someone/.cache/rv64sim");
+    setenv("XDG_CACHE_HOME", "relative", 1); // ignored, as the spec says
+    REQUIRE(ProgramCache::default_directory() != "relative/rv64sim");
+
+    if (xdg)
+        setenv("XDG_CACHE_HOME", saved.c_str(), 1);
+    else
+        unsetenv("XDG_CACHE_HOME");
+}
+#endif
+
+TEST_CASE("ProgramCache - corrupted images are misses", "[cache]") {
+    TempCache tmp;
+    auto parsed = asm_parsing::parse(SOURCE);
+    asm_parsing::ParsedInstVec insts;
+    REQUIRE(parsed.resolve_instructions(insts, 0) == 0);
+    REQUIRE(tmp.cache.store(SOURCE, 0, std::endian::little, insts, parsed.symbol_table));
+
+    auto path = *std::filesystem::directory_iterator(tmp.cache.directory());
+    auto size = std::filesystem::file_size(path);
+
+    SECTION("truncated") {
+        std::filesystem::resize_file(path, size - 1);
+        REQUIRE_FALSE(tmp.cache.load(SOURCE, 0, std::endian::little));
+    }
+
+    SECTION("empty") {
+        std::filesystem::resize_file(path, 0);
+        REQUIRE_FALSE(tmp.cache.load(SOURCE, 0, std::endian::little));
+    }
+
+    SECTION("bad magic") {
+        std::fstream f(path.path(), std::ios::in | std::ios::out | std::ios::binary);
+        f.put('X');
+        f.close();
+        REQUIRE_FALSE(tmp.cache.load(SOURCE, 0, std::endian::little));
+    }
+}
@@ -133,6 +133,14 @@ TEST_CASE("RV64C control transfer instructions", "[rv64c][jump][branch]") {
         REQUIRE(cpu.reg(1) == initial_pc); // ra = return address
     }
 
+    SECTION("c.jalr - jump through ra") {
+        cpu.set_pc(initial_pc);
+        cpu.reg(1) = 0x3000;
+        interp.c_jalr(cpu.reg(1));
+        REQUIRE(cpu.get_pc() == 0x3000);
+        REQUIRE(cpu.reg(1) == initial_pc);
+    }
+
     SECTION("c.beqz - branch if equal zero") {
         cpu.set_pc(initial_pc);
         cpu.reg(8) = 0;
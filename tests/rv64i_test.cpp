@@ -3,6 +3,10 @@
 #include <rv64/Cpu.hpp>
 #include <rv64/Interpreter.hpp>
 
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+
 #include "ui.hpp"
 
 using namespace rv64;
@@ -149,11 +153,12 @@ TEST_CASE("RV64I upper immediate instructions", "[rv64i][upper][immediate]") {
     }
 
     SECTION("auipc - add upper immediate to PC") {
-        cpu.set_pc(0x1000);
+        // the CPU advances the PC before executing
+        cpu.set_pc(0x1000 + INSTR_SIZE);
         interp.auipc(cpu.reg(1), 0x10);
         REQUIRE(cpu.reg(1) == 0x1000 + 0x10000);
 
-        cpu.set_pc(0x80000000);
+        cpu.set_pc(0x80000000 + INSTR_SIZE);
         interp.auipc(cpu.reg(2), 0x1);
         REQUIRE(cpu.reg(2) == 0x80000000 + 0x1000);
     }
@@ -606,6 +611,14 @@ TEST_CASE("RV64I jump instructions", "[rv64i][jump]") {
         REQUIRE(cpu.reg(1) == initial_pc);
     }
 
+    SECTION("jalr - rd same as rs1 jumps relative to the old value") {
+        cpu.set_pc(initial_pc);
+        cpu.reg(1) = 0x2000;
+        interp.jalr(cpu.reg(1), cpu.reg(1), 8);
+        REQUIRE(cpu.get_pc() == 0x2000 + 8);
+        REQUIRE(cpu.reg(1) == initial_pc);
+    }
+
     SECTION("jalr clears lowest bit") {
         cpu.set_pc(initial_pc);
         cpu.reg(2) = 0x2001;
@@ -833,10 +846,10 @@ TEST_CASE("RV64I PC manipulation", "[rv64i][pc]") {
     }
 
     SECTION("auipc computes address relative to PC") {
-        cpu.set_pc(0x10000);
+        cpu.set_pc(0x10000 + INSTR_SIZE);
         interp.auipc(cpu.reg(1), 1);
         REQUIRE(cpu.reg(1) == 0x10000 + 0x1000);
-        REQUIRE(cpu.get_pc() == 0x10000);
+        REQUIRE(cpu.get_pc() == 0x10000 + INSTR_SIZE);
     }
 }
 
@@ -911,3 +924,233 @@ TEST_CASE("RV64I fence and system instructions", "[rv64i][system]") {
 
 }
 
+
+TEST_CASE("Ecall registry", "[rv64i][system]") {
+    VMConfig config{};
+    config.m_rng_seed = 2137;
+    VM vm{config};
+    vm.load_program({});
+    Interpreter interp{vm};
+    auto &a0 = vm.m_cpu.reg(10);
+    auto &a1 = vm.m_cpu.reg(11);
+    auto &a2 = vm.m_cpu.reg(12);
+
+    SECTION("custom services") {
+        REQUIRE(vm.m_ecalls.set_handler(42, [](VM &vm) {
+            vm.m_cpu.reg(10) = vm.m_cpu.reg(11).val() * 2;
+        }));
+        a0 = 42;
+        a1 = 21;
+        interp.ecall();
+        REQUIRE(a0 == 42);
+
+        REQUIRE_FALSE(vm.m_ecalls.set_handler(EcallRegistry::MAX_SERVICES, [](VM &) {}));
+        REQUIRE_FALSE(vm.m_ecalls.set_handler(-1, [](VM &) {}));
+
+        vm.m_ecalls.remove_handler(10);
+        REQUIRE_FALSE(vm.m_ecalls.has_handler(10));
+        REQUIRE_FALSE(vm.m_ecalls.dispatch(10, vm));
+        REQUIRE(vm.get_state() == VMState::Loaded);
+    }
+
+    SECTION("bulk memory services") {
+        auto &mem = vm.m_memory;
+        auto &a3 = vm.m_cpu.reg(13);
+        const uint64_t src = vm.get_memory_layout().stack_base + 0xF00; // ranges cross page boundaries
+        const uint64_t dst = src + 0x1000;
+        for (uint64_t i = 0; i < 0x300; i++)
+            REQUIRE(mem.store(src + i, static_cast<uint8_t>(i % 255 + 1)) == MemErr::None);
+        auto byte_at = [&](uint64_t addr) {
+            MemErr err = MemErr::None;
+            auto value = mem.load<uint8_t>(addr, err);
+            REQUIRE(err == MemErr::None);
+            return value;
+        };
+        auto call = [&](int64_t code, uint64_t x, uint64_t y, uint64_t z) {
+            a0 = code;
+            a1 = x;
+            a2 = y;
+            a3 = z;
+            interp.ecall();
+            return a0.sval();
+        };
+
+        REQUIRE(call(200, dst, src, 0x300) == int64_t(dst)); // memcpy
+        REQUIRE(call(202, dst, src, 0x300) == 0); // memcmp
+        REQUIRE(byte_at(dst + 0x2FF) == static_cast<uint8_t>(0x2FF % 255 + 1));
+
+        REQUIRE(call(201, dst + 0x100, 0xFF, 0x10) == int64_t(dst + 0x100)); // memset
+        REQUIRE(byte_at(dst + 0x10F) == 0xFF);
+        REQUIRE(call(202, dst, src, 0x300) == 1);
+        REQUIRE(call(202, src, dst, 0x300) == -1);
+
+        call(200, src + 1, src, 0x200); // overlapping copy behaves like memmove
+        REQUIRE(byte_at(src + 0x200) == static_cast<uint8_t>(0x1FF % 255 + 1));
+
+        REQUIRE(mem.store(src + 0x123, uint8_t{0}) == MemErr::None);
+        REQUIRE(call(203, src + 0x23, 0, 0) == 0x100); // strlen
+        REQUIRE(vm.get_state() == VMState::Loaded);
+
+        REQUIRE_THROWS(call(200, 0x10, src, 8)); // unmapped destination
+    }
+
+    SECTION("read services") {
+        vm.m_input.use_buffer("  42 +7\n-9000000000 hello world\nxyz");
+        const uint64_t buf = vm.get_memory_layout().stack_base + 0xFFA; // crosses a page boundary
+        auto read_string = [&](int64_t size) {
+            a0 = 8;
+            a1 = buf;
+            a2 = size;
+            interp.ecall();
+            MemErr err = MemErr::None;
+            auto str = vm.m_memory.load_string(buf, err);
+            REQUIRE(err == MemErr::None);
+            return str;
+        };
+
+        a0 = 5;
+        interp.ecall();
+        REQUIRE(a0 == 42);
+        a0 = 5;
+        interp.ecall();
+        REQUIRE(a0 == 7);
+        REQUIRE(read_string(64) == "\n"); // rest of the line
+        a0 = 5;
+        interp.ecall();
+        REQUIRE(a0 == -9000000000);
+        REQUIRE(read_string(6) == " hell"); // at most size - 1 bytes
+        REQUIRE(read_string(64) == "o world\n");
+
+        a0 = 12;
+        interp.ecall();
+        REQUIRE(a0 == 'x');
+        REQUIRE(read_string(64) == "yz");
+        a0 = 12;
+        interp.ecall();
+        REQUIRE(a0 == -1); // end of input
+
+        a0 = 5;
+        REQUIRE_THROWS(interp.ecall());
+    }
+
+    SECTION("random numbers are reproducible with a seed") {
+        auto draw = [&] {
+            std::vector<int64_t> values;
+            for (int i = 0; i < 8; i++) {
+                a0 = 100;
+                a1 = -5;
+                a2 = 5;
+                interp.ecall();
+                REQUIRE(a0.sval() >= -5);
+                REQUIRE(a0.sval() <= 5);
+                values.push_back(a0.sval());
+            }
+            return values;
+        };
+        auto first = draw();
+        REQUIRE(std::ranges::adjacent_find(first, std::not_equal_to{}) != first.end()); // state persists between calls
+
+        vm.load_program({});
+        REQUIRE(draw() == first);
+    }
+}
+
+TEST_CASE("InputReader refills from a file", "[rv64i][system]") {
+    auto path = std::filesystem::temp_directory_path() / "rv64sim-input-test.txt";
+    constexpr int COUNT = 30000; // several buffer refills, numbers straddle the buffer boundaries
+    {
+        std::ofstream out(path);
+        for (int i = 0; i < COUNT; i++)
+            out << (i * 7919 - 100000) << (i % 10 == 9 ? '\n' : ' ');
+    }
+
+    InputReader reader;
+    REQUIRE(reader.use_file(path));
+    int64_t mismatches = 0;
+    for (int i = 0; i < COUNT; i++)
+        mismatches += reader.read_int() != int64_t(i) * 7919 - 100000;
+    REQUIRE(mismatches == 0);
+    REQUIRE_FALSE(reader.read_int());
+    REQUIRE_FALSE(reader.read_char());
+
+    REQUIRE_FALSE(reader.use_file(path.string() + ".missing"));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("RV64I ecall with the Linux syscall personality", "[rv64i][system][linux]") {
+    VMConfig config{};
+    config.m_ecall_personality = EcallPersonality::Linux;
+    VM vm{config};
+    vm.load_program({});
+    Interpreter interp{vm};
+    auto &cpu = vm.m_cpu;
+    auto &mem = vm.m_memory;
+    auto &a0 = cpu.reg("a0");
+    auto &a7 = cpu.reg("a7");
+    const uint64_t stack = vm.get_memory_layout().stack_base + 0x1000;
+
+    auto syscall = [&](LinuxSyscalls::Syscall number, std::initializer_list<uint64_t> args) {
+        int i = 10;
+        for (auto arg: args)
+            cpu.reg(i++) = arg;
+        a7 = static_cast<int64_t>(number);
+        REQUIRE_NOTHROW(interp.ecall());
+        return a0.sval();
+    };
+    auto store_bytes = [&](uint64_t addr, std::string_view sv) {
+        for (size_t i = 0; i < sv.size(); i++)
+            REQUIRE(mem.store(addr + i, sv[i]) == MemErr::None);
+        REQUIRE(mem.store(addr + sv.size(), '\0') == MemErr::None);
+    };
+
+    SECTION("exit") {
+        syscall(LinuxSyscalls::Syscall::exit, {3});
+        REQUIRE(vm.get_state() == VMState::Finished);
+    }
+
+    SECTION("file round trip through openat/write/lseek/read/close") {
+        auto path = (std::filesystem::temp_directory_path() / "rv64sim-syscall-test.txt").string();
+        constexpr int64_t CWD = -100; // AT_FDCWD
+        constexpr uint64_t FLAGS = 02 | 0100 | 01000; // O_RDWR | O_CREAT | O_TRUNC
+        const uint64_t path_addr = stack, data_addr = vm.get_memory_layout().data_base;
+        const uint64_t read_addr = stack + 0x1FF8; // crosses a page boundary
+        store_bytes(path_addr, path);
+        store_bytes(data_addr, "Hello World");
+
+        int64_t fd = syscall(LinuxSyscalls::Syscall::openat, {uint64_t(CWD), path_addr, FLAGS, 0644});
+        REQUIRE(fd >= 3);
+        REQUIRE(syscall(LinuxSyscalls::Syscall::write, {uint64_t(fd), data_addr, 11}) == 11);
+        REQUIRE(syscall(LinuxSyscalls::Syscall::lseek, {uint64_t(fd), 0, 0}) == 0);
+        REQUIRE(syscall(LinuxSyscalls::Syscall::read, {uint64_t(fd), read_addr, 64}) == 11);
+        REQUIRE(syscall(LinuxSyscalls::Syscall::close, {uint64_t(fd)}) == 0);
+        std::filesystem::remove(path);
+
+        MemErr err = MemErr::None;
+        REQUIRE(mem.load_string(read_addr, err).starts_with("Hello World"));
+        REQUIRE(err == MemErr::None);
+    }
+
+    SECTION("errors are returned as -errno") {
+        ui::set_output_callback([](auto) {}); // silences the unsupported syscall warning
+        REQUIRE(syscall(LinuxSyscalls::Syscall::close, {42}) == -EBADF);
+        REQUIRE(syscall(LinuxSyscalls::Syscall::write, {1, 0x10, 4}) == -EFAULT);
+        REQUIRE(syscall(static_cast<LinuxSyscalls::Syscall>(4242), {}) == -ENOSYS);
+    }
+
+    SECTION("brk") {
+        uint64_t brk = syscall(LinuxSyscalls::Syscall::brk, {0});
+        REQUIRE(brk == mem.get_brk());
+        REQUIRE(syscall(LinuxSyscalls::Syscall::brk, {brk + 4096}) == int64_t(brk + 4096));
+        REQUIRE(mem.store(brk + 4000, uint64_t{1}) == MemErr::None);
+        REQUIRE(syscall(LinuxSyscalls::Syscall::brk, {brk + Memory::PROGRAM_MEM_LIMIT}) == int64_t(brk + 4096));
+    }
+
+    SECTION("clock_gettime") {
+        REQUIRE(syscall(LinuxSyscalls::Syscall::clock_gettime, {1 /* CLOCK_MONOTONIC */, stack}) == 0);
+        MemErr err = MemErr::None;
+        auto nsec = mem.load<int64_t>(stack + 8, err);
+        REQUIRE(err == MemErr::None);
+        REQUIRE(nsec >= 0);
+        REQUIRE(nsec < 1'000'000'000);
+    }
+}
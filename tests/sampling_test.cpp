@@ -0,0 +1,138 @@
+#include <catch2/catch_test_macros.hpp>
+#include <rv64/Sampling.hpp>
+#include <rv64/VM.hpp>
+#include <cmath>
+#include <memory>
+
+#include "test_helpers.hpp"
+
+using namespace rv64;
+
+namespace {
+    using Metric = SampledRun::Metric;
+
+    // a loop bringing the data into the L2, a strided load loop missing in the L1D, an ALU loop,
+    // then the load loop again; the cold misses have their own code, so they form their own phase
+    const std::string phased = R"(
+        lui x8, 0x40
+        sub x8, x2, x8
+        lui x10, 5
+        addi x5, x0, 0
+        addi x6, x0, 2047
+    touch:
+        slli x7, x5, 6
+        add x7, x8, x7
+        ld x9, 0(x7)
+        addi x5, x5, 1
+        bge x6, x5, touch
+        addi x5, x0, 0
+    stride:
+        andi x7, x5, 2047
+        slli x7, x7, 6
+        add x7, x8, x7
+        ld x9, 0(x7)
+        addi x5, x5, 1
+        blt x5, x10, stride
+        addi x5, x0, 0
+    alu:
+        xor x11, x11, x5
+        addi x5, x5, 1
+        blt x5, x10, alu
+        addi x5, x0, 0
+    stride2:
+        andi x7, x5, 2047
+        slli x7, x7, 6
+        add x7, x8, x7
+        ld x9, 0(x7)
+        addi x5, x5, 1
+        blt x5, x10, stride2
+    )";
+
+    std::unique_ptr<VM> load(const std::string &source) {
+        VMConfig config{};
+        config.m_cache_model = CacheHierarchy::Config{};
+        config.m_branch_model = BranchModel::Config{};
+        config.m_pipeline_model = PipelineModel::Config{};
+        return load_program(source, config);
+    }
+
+    /// @return events of a full detailed run
+    std::array<double, SampledRun::METRIC_CNT> reference(const std::string &source) {
+        auto vm = load(source);
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Finished);
+        using Level = CacheHierarchy::Level;
+        const auto &branches = vm->m_branch_model->stats();
+        return {double(vm->m_pipeline_model->total().cycles),
+                double(vm->m_cache_model->cache(Level::L1I).stats().misses),
+                double(vm->m_cache_model->cache(Level::L1D).stats().misses),
+                double(vm->m_cache_model->cache(Level::L2).stats().misses),
+                double(branches.mispredicted + branches.ras_mispredicted)};
+    }
+
+    double relative_error(const SampledRun &run, Metric metric, double expected) {
+        return std::abs(run.estimate(metric).value - expected) / expected;
+    }
+}
+
+TEST_CASE("Sampled simulation", "[sampling]") {
+    SECTION("configuration") {
+        REQUIRE_FALSE(SamplingConfig::validate({}));
+        REQUIRE(SamplingConfig::validate({.interval = 1000, .warmup = 800, .window = 300}));
+        REQUIRE(SamplingConfig::validate({.window = 0}));
+        REQUIRE(SamplingConfig::validate({.schedule = SamplingConfig::Schedule::Phases, .samples_per_phase = 0}));
+    }
+
+    SECTION("models switched off keep their state") {
+        auto vm = load(phased);
+        vm->set_model_detail(ModelDetail::Off);
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE(vm->m_pipeline_model->total().instructions == 0);
+        REQUIRE(vm->m_cache_model->cache(CacheHierarchy::Level::L1D).stats().accesses() == 0);
+        REQUIRE(vm->m_branch_model->stats().branches == 0);
+        REQUIRE(vm->get_cycle_count() == 0);
+    }
+
+    SECTION("windows covering the whole run are exact") {
+        auto expected = reference(phased);
+        auto vm = load(phased);
+        auto run = run_sampled(*vm, {.interval = 5000, .warmup = 0, .window = 5000});
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE(vm->get_model_detail() == ModelDetail::Full);
+        REQUIRE(run.detailed_instructions == run.instructions);
+        REQUIRE(run.instructions == vm->get_instruction_count());
+        for (size_t i = 0; i < SampledRun::METRIC_CNT; ++i) {
+            REQUIRE(run.estimates[i].measured);
+            REQUIRE(std::abs(run.estimates[i].value - expected[i]) < 1e-6 * expected[i] + 1e-9);
+            REQUIRE(run.estimates[i].margin < 1e-6 * expected[i] + 1e-9);
+        }
+    }
+
+    SECTION("periodic windows") {
+        auto expected = reference(phased);
+        auto vm = load(phased);
+        auto run = run_sampled(*vm, {.interval = 10'000, .warmup = 1'000, .window = 1'000});
+        REQUIRE(run.phases == 1);
+        REQUIRE(run.windows == run.intervals);
+        REQUIRE(run.detailed_instructions * 4 < run.instructions);
+        REQUIRE(relative_error(run, Metric::L1DMisses, expected[2]) < 0.05);
+        // the cold L2 misses of the first pass make the cycles uncertain, but not beyond the interval
+        const auto &cycles = run.estimate(Metric::Cycles);
+        REQUIRE(cycles.margin > 0);
+        REQUIRE(std::abs(cycles.value - expected[0]) < cycles.margin);
+        REQUIRE(run.report().find("cycles") != std::string::npos);
+    }
+
+    SECTION("phase schedule") {
+        auto expected = reference(phased);
+        auto vm = load(phased);
+        auto run = run_sampled(*vm, {.schedule = SamplingConfig::Schedule::Phases, .interval = 10'000,
+                                     .warmup = 1'000, .window = 1'000, .samples_per_phase = 2});
+        REQUIRE(run.phases >= 2);
+        REQUIRE(run.windows < run.intervals);
+        REQUIRE(relative_error(run, Metric::L1DMisses, expected[2]) < 0.05);
+        const auto &cycles = run.estimate(Metric::Cycles);
+        REQUIRE(std::abs(cycles.value - expected[0]) < cycles.margin);
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <catch2/catch_test_macros.hpp>
+#include <parser/asm_parsing.hpp>
+#include <rv64/VM.hpp>
+#include <memory>
+#include <string>
+
+/// @brief assembles the source and loads it into a new VM with the config
+inline std::unique_ptr<rv64::VM> load_program(const std::string &source, const rv64::VMConfig &config = {}) {
+    auto vm = std::make_unique<rv64::VM>(config);
+    asm_parsing::ParsedInstVec instructions;
+    REQUIRE(asm_parsing::parse_and_resolve(source, instructions, vm->m_cpu.get_pc()) == 0);
+    vm->load_program(instructions);
+    return vm;
+}
+
+/// @brief like load_program, then runs the program until it stops
+inline std::unique_ptr<rv64::VM> run_program(const std::string &source, const rv64::VMConfig &config = {}) {
+    auto vm = load_program(source, config);
+    vm->run_until_stop();
+    return vm;
+}
@@ -0,0 +1,139 @@
+#include <catch2/catch_test_macros.hpp>
+#include <rv64/Trace.hpp>
+#include <rv64/VM.hpp>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+#include "test_helpers.hpp"
+
+using namespace rv64;
+
+namespace {
+    std::unique_ptr<VM> run_traced(const std::string &source, const std::filesystem::path &path,
+                                   size_t buffer_size = size_t(1) << 22) {
+        VMConfig config{};
+        config.m_trace = TraceRecorder::Config{.path = path, .buffer_size = buffer_size, .write_size = 1024};
+        auto vm = load_program(source, config);
+        REQUIRE(vm->m_trace_recorder.is_open());
+        vm->run_until_stop();
+        REQUIRE(vm->get_state() == VMState::Finished);
+        REQUIRE_FALSE(vm->m_trace_recorder.close());
+        return vm;
+    }
+
+    std::vector<TraceEntry> read_all(const std::filesystem::path &path) {
+        TraceReader reader;
+        REQUIRE_FALSE(reader.open(path));
+        std::vector<TraceEntry> entries;
+        TraceEntry entry;
+        while (reader.next(entry))
+            entries.push_back(entry);
+        REQUIRE_FALSE(reader.error());
+        return entries;
+    }
+}
+
+TEST_CASE("Execution trace", "[trace]") {
+    auto path = std::filesystem::temp_directory_path() / "rv64sim-trace-test.trace";
+    const std::string source = R"(
+        addi x5, x0, 3
+        addi x6, x0, 0
+    loop:
+        sd x5, -8(x2)
+        ld x7, -8(x2)
+        add x6, x6, x7
+        addi x5, x5, -1
+        bne x5, x0, loop
+        lui x8, 0x80000
+        sw x8, -16(x2)
+    )";
+
+    SECTION("records retired instructions, register writes and memory accesses") {
+        auto vm = run_traced(source, path);
+        REQUIRE(vm->m_trace_recorder.record_count() == vm->get_instruction_count());
+        auto entries = read_all(path);
+        REQUIRE(entries.size() == 2 + 3 * 5 + 2);
+
+        REQUIRE(entries[0].line == 2);
+        REQUIRE(entries[0].reg_writes.size() == 1);
+        REQUIRE(entries[0].reg_writes[0].reg == 5);
+        REQUIRE(entries[0].reg_writes[0].value == 3);
+
+        const auto &store = entries[2];
+        REQUIRE(store.reg_writes.empty());
+        REQUIRE(store.accesses.size() == 1);
+        REQUIRE(store.accesses[0].store);
+        REQUIRE(store.accesses[0].size == 8);
+        REQUIRE(store.accesses[0].value == 3);
+        REQUIRE(store.accesses[0].address == vm->m_cpu.reg(2).val() - 8);
+
+        const auto &load = entries[3];
+        REQUIRE(load.accesses.size() == 1);
+        REQUIRE_FALSE(load.accesses[0].store);
+        REQUIRE(load.reg_writes[0].reg == 7);
+
+        // branch back to the loop: the pc goes backwards
+        REQUIRE(entries[7].pc == entries[2].pc);
+        REQUIRE(entries.back().accesses[0].value == 0x80000000);
+        REQUIRE(entries[entries.size() - 2].reg_writes[0].value == 0xFFFFFFFF80000000);
+        for (size_t i = 0; i < entries.size(); ++i)
+            REQUIRE(entries[i].index == i);
+        std::filesystem::remove(path);
+    }
+
+    SECTION("a small ring buffer wraps around") {
+        std::string long_loop = "addi x5, x0, 0\nlui x6, 2\nloop:\naddi x5, x5, 1\nbne x5, x6, loop";
+        auto vm = run_traced(long_loop, path, 4096);
+        auto entries = read_all(path);
+        REQUIRE(entries.size() == vm->get_instruction_count());
+        REQUIRE(entries.back().reg_writes.empty());
+        REQUIRE(entries[entries.size() - 2].reg_writes[0].value == 8192);
+        std::filesystem::remove(path);
+    }
+
+    SECTION("decoder filters and formats") {
+        (void) run_traced(source, path);
+        std::ostringstream text;
+        REQUIRE_FALSE(decode_trace(path, text, TraceOutput::Text, {.line = 5}));
+        std::string out = text.str();
+        REQUIRE(std::ranges::count(out, '\n') == 3);
+        REQUIRE(out.find("sd") != std::string::npos);
+        REQUIRE(out.find("store8") != std::string::npos);
+
+        std::ostringstream csv;
+        REQUIRE_FALSE(decode_trace(path, csv, TraceOutput::Csv, {.reg = 6}));
+        out = csv.str();
+        REQUIRE(out.starts_with(TraceEntry::CSV_HEADER));
+        // addi x6, x0, 0 leaves x6 unchanged and is not a write
+        REQUIRE(std::ranges::count(out, '\n') == 1 + 3);
+        REQUIRE(out.find("x6=0x6") != std::string::npos);
+
+        std::ostringstream none;
+        REQUIRE_FALSE(decode_trace(path, none, TraceOutput::Text, {.pc_begin = 0, .pc_end = 1}));
+        REQUIRE(none.str().empty());
+        std::filesystem::remove(path);
+    }
+
+    SECTION("invalid and truncated traces") {
+        REQUIRE(TraceRecorder::validate({.path = path, .buffer_size = 5000}));
+        REQUIRE(TraceRecorder::validate({.path = path, .write_size = 0}));
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << "not a trace";
+        }
+        std::ostringstream sink;
+        REQUIRE(decode_trace(path, sink, TraceOutput::Text));
+
+        (void) run_traced(source, path);
+        auto size = std::filesystem::file_size(path);
+        std::filesystem::resize_file(path, size - 1);
+        TraceReader reader;
+        REQUIRE_FALSE(reader.open(path));
+        TraceEntry entry;
+        while (reader.next(entry)) {}
+        REQUIRE(reader.error());
+        std::filesystem::remove(path);
+    }
+}